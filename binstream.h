@@ -25,8 +25,12 @@ public:
 
     // read type
     generic T read();
+    // read type into output only if cond is set, without branching on cond
+    generic void read_if(bool cond, T& output);
     // read series of bytes as a pointer
     void* bytes(size_t size);
+    // read series of bytes in place (no copy, valid until the stream is written to)
+    const uint8_t* view(size_t size);
     // read type without advancing cursor
     generic T peek() const;
 
@@ -36,6 +40,8 @@ public:
 
     // wipe underlying buffer and reset
     void empty();
+    // preallocate space for writes
+    void reserve(size_t size);
 
     size_t tell() const;
     void seek(size_t pos);
@@ -63,9 +69,8 @@ generic inline void binstream::write(const T& value) {
 }
 
 inline void binstream::write(const void *ptr, const size_t size) {
-    buf.resize(this->size() + size);
-
-    memcpy(&buf[this->size() - size], ptr, size);
+    const auto* data = static_cast<const uint8_t*>(ptr);
+    buf.insert(buf.end(), data, data + size);
 }
 
 generic inline T binstream::read() {
@@ -75,6 +80,21 @@ generic inline T binstream::read() {
     return value;
 }
 
+generic inline void binstream::read_if(const bool cond, T& output) {
+    const size_t n = cond ? sizeof(T) : 0;
+    if (cursor + n > size())
+        throw std::exception("Tried to read beyond stream size");
+    if (size() < sizeof(T))
+        return;  // cond is not set (checked above), nothing to do
+
+    // the load happens either way, keep it inside the buffer
+    const size_t at = cursor + sizeof(T) <= size() ? cursor : size() - sizeof(T);
+    T value;
+    memcpy(&value, &buf[at], sizeof(T));
+    output = cond ? value : output;
+    cursor += n;
+}
+
 inline void* binstream::bytes(const size_t size) {
     auto* data = malloc(size);
     memcpy(data, &buf[cursor], size);
@@ -83,6 +103,16 @@ inline void* binstream::bytes(const size_t size) {
     return data;
 }
 
+inline const uint8_t* binstream::view(const size_t size) {
+    if (cursor + size > this->size())
+        throw std::exception("Tried to read beyond stream size");
+
+    const auto* data = &buf[cursor];
+    cursor += size;
+
+    return data;
+}
+
 generic inline T binstream::peek() const {
     if (cursor + sizeof(T) > size())
         throw std::exception("Tried to read beyond stream size");
@@ -108,6 +138,10 @@ inline void binstream::empty() {
     seek(0);
 }
 
+inline void binstream::reserve(const size_t size) {
+    buf.reserve(size);
+}
+
 inline size_t binstream::tell() const {
     return cursor;
 }
@@ -0,0 +1,33 @@
+#ifndef HELPERS_H
+#define HELPERS_H
+
+// small helpers more than one translation unit needs, kept inline here so no unit declares another's internals
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Peggle {
+
+    namespace PipelineHelpers {
+        // a level file in a pak, "levels\name.dat" with no deeper folder
+        inline bool is_level_path(const std::string& path) {
+            constexpr std::string_view folder = "levels\\", extension = ".dat";
+            return path.size() > folder.size() + extension.size()
+                && path.starts_with(folder) && path.ends_with(extension)
+                && path.find('\\', folder.size()) == std::string::npos;
+        }
+    }
+
+    namespace SimulationHelpers {
+        // splitmix64, one independent stream per seed
+        inline uint64_t mix(uint64_t x) {
+            x += 0x9E3779B97F4A7C15ull;
+            x = (x ^ x >> 30) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ x >> 27) * 0x94D049BB133111EBull;
+            return x ^ x >> 31;
+        }
+    }
+}
+
+#endif //HELPERS_H
@@ -0,0 +1,860 @@
+#ifndef LEVELSCHEMA_H
+#define LEVELSCHEMA_H
+
+// compile time description of the level record layouts.
+// every record is described once as a list of ops, and the reader, writer, size and skip functions are all
+// generated from that list, so the two sides of the serializer can not drift apart anymore.
+//
+// an op is any type with these static members:
+//   read(binstream&, T& obj, const Ctx&)          decode into obj
+//   write(Out&, const T& obj, const Ctx&)         encode obj to a binstream, or anything with its write members
+//   size(const T& obj, const Ctx&) -> size_t      encoded size of obj
+//   skip(binstream&, T& scratch, const Ctx&)      advance past obj, only decoding what later ops depend on
+//
+// Ctx carries the level format (version), either LevelFormat checked at runtime or a VersionFamily fixed at compile
+// time, in which case every version check in the schemas folds away (see with_format).
+
+#include <concepts>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "binstream.h"
+#include "libpeggle.h"
+
+namespace Peggle {
+
+    namespace LevelSchema {
+        // objects of a level are allocated from its arena and never destroyed one by one, the arena is released with
+        // the level, so anything they own has to come from the arena too
+        template<typename T, typename... Args>
+        T* arena_new(std::pmr::memory_resource* arena, Args&&... args) {
+            return std::pmr::polymorphic_allocator<T>(arena).template new_object<T>(std::forward<Args>(args)...);
+        }
+
+        // every string an emitter holds
+        template<typename F>
+        void for_each_string(LevelTypes::EmitterEntry& emitter, F&& f) {
+            f(emitter.mImage);
+            f(emitter.mMainVar2);
+            f(emitter.mEmitImage);
+            for (auto* v : {&emitter.mUnknown0, &emitter.mUnknown1, &emitter.mEmitRate, &emitter.mEmitAreaMultiplier,
+                            &emitter.mInitialRotation, &emitter.mRotationVelocity, &emitter.mMinScale,
+                            &emitter.mScaleVelocity, &emitter.mColourRed, &emitter.mColourGreen, &emitter.mColourBlue,
+                            &emitter.mOpacity, &emitter.mMinVelocityX, &emitter.mMinVelocityY})
+                f(v->mVariableValue);
+        }
+    }
+
+    struct LevelTypes::Entry {
+        union EntryData {
+            LevelTypes::RodEntry* Rod;
+            LevelTypes::PolygonEntry* Polygon;
+            LevelTypes::CircleEntry* Circle;
+            LevelTypes::BrickEntry* Brick;
+            LevelTypes::TeleportEntry* Teleport;
+            LevelTypes::EmitterEntry* Emitter;
+        };
+    private:
+        LevelTypes::LevelEntryType Type{};
+        EntryData Data{};
+
+    public:
+        explicit Entry(const LevelEntryType type, std::pmr::memory_resource* arena = std::pmr::new_delete_resource()) {
+            using LevelSchema::arena_new;
+            Type = type;
+            switch (type) {
+                case Rod: { Data.Rod = arena_new<RodEntry>(arena); break; }
+                case Polygon: {
+                    Data.Polygon = arena_new<PolygonEntry>(arena);
+                    std::destroy_at(&Data.Polygon->mPoints);
+                    std::construct_at(&Data.Polygon->mPoints, arena);
+                    break;
+                }
+                case Circle: { Data.Circle = arena_new<CircleEntry>(arena); break; }
+                case Brick: { Data.Brick = arena_new<BrickEntry>(arena); break; }
+                case Teleporter: { Data.Teleport = arena_new<TeleportEntry>(arena); break; }
+                case Emitter: { Data.Emitter = arena_new<EmitterEntry>(arena); break; }
+                default: break;
+            }
+        }
+
+        static LevelTypes::RodEntry* GetRod(const Entry* entry) {
+            if (entry->Type == LevelEntryType::Rod)
+                return entry->Data.Rod;
+            return nullptr;
+        }
+        static LevelTypes::PolygonEntry* GetPolygon(const Entry* entry) {
+            if (entry->Type == LevelEntryType::Polygon)
+                return entry->Data.Polygon;
+            return nullptr;
+        }
+        static LevelTypes::CircleEntry* GetCircle(const Entry* entry) {
+            if (entry->Type == LevelEntryType::Circle)
+                return entry->Data.Circle;
+            return nullptr;
+        }
+        static LevelTypes::BrickEntry* GetBrick(const Entry* entry) {
+            if (entry->Type == LevelEntryType::Brick)
+                return entry->Data.Brick;
+            return nullptr;
+        }
+        static LevelTypes::TeleportEntry* GetTeleporter(const Entry* entry) {
+            if (entry->Type == LevelEntryType::Teleporter)
+                return entry->Data.Teleport;
+            return nullptr;
+        }
+        static LevelTypes::EmitterEntry* GetEmitter(const Entry* entry) {
+            if (entry->Type == LevelEntryType::Emitter)
+                return entry->Data.Emitter;
+            return nullptr;
+        }
+
+        static LevelTypes::RodEntry* GetRod(const Entry& entry) {
+            if (entry.Type == LevelEntryType::Rod)
+                return entry.Data.Rod;
+            return nullptr;
+        }
+        static LevelTypes::PolygonEntry* GetPolygon(const Entry& entry) {
+            if (entry.Type == LevelEntryType::Polygon)
+                return entry.Data.Polygon;
+            return nullptr;
+        }
+        static LevelTypes::CircleEntry* GetCircle(const Entry& entry) {
+            if (entry.Type == LevelEntryType::Circle)
+                return entry.Data.Circle;
+            return nullptr;
+        }
+        static LevelTypes::BrickEntry* GetBrick(const Entry& entry) {
+            if (entry.Type == LevelEntryType::Brick)
+                return entry.Data.Brick;
+            return nullptr;
+        }
+        static LevelTypes::TeleportEntry* GetTeleporter(const Entry& entry) {
+            if (entry.Type == LevelEntryType::Teleporter)
+                return entry.Data.Teleport;
+            return nullptr;
+        }
+        static LevelTypes::EmitterEntry* GetEmitter(const Entry& entry) {
+            if (entry.Type == LevelEntryType::Emitter)
+                return entry.Data.Emitter;
+            return nullptr;
+        }
+
+        static LevelEntryType GetType(const Entry& entry) {
+            return entry.Type;
+        }
+        static LevelEntryType GetType(const Entry* entry) {
+            return entry->Type;
+        }
+
+        // the payload whatever its type, for code that moves entries around wholesale (level snapshots)
+        [[nodiscard]] void* GetPayload() const {
+            switch (Type) {
+                case Rod: return Data.Rod;
+                case Polygon: return Data.Polygon;
+                case Circle: return Data.Circle;
+                case Brick: return Data.Brick;
+                case Teleporter: return Data.Teleport;
+                case Emitter: return Data.Emitter;
+                default: return nullptr;
+            }
+        }
+        void SetPayload(void* payload) {
+            switch (Type) {
+                case Rod: { Data.Rod = static_cast<RodEntry*>(payload); break; }
+                case Polygon: { Data.Polygon = static_cast<PolygonEntry*>(payload); break; }
+                case Circle: { Data.Circle = static_cast<CircleEntry*>(payload); break; }
+                case Brick: { Data.Brick = static_cast<BrickEntry*>(payload); break; }
+                case Teleporter: { Data.Teleport = static_cast<TeleportEntry*>(payload); break; }
+                case Emitter: { Data.Emitter = static_cast<EmitterEntry*>(payload); break; }
+                default: break;
+            }
+        }
+    };
+
+    namespace LevelSchema {
+        using namespace LevelTypes;
+
+        // runtime level format. decoded records are allocated from arena
+        struct LevelFormat {
+            uint32_t version;
+            std::pmr::memory_resource* arena = std::pmr::new_delete_resource();
+        };
+
+        // level format fixed at compile time. V is the lowest version of a family, a family being a range of versions
+        // that every version predicate in the schemas treats the same
+        template<uint32_t V>
+        struct VersionFamily {
+            static constexpr uint32_t version = V;
+            std::pmr::memory_resource* arena = std::pmr::new_delete_resource();
+        };
+
+        // pick the family of version once and hand it to f, so per element code carries no version branches.
+        // the split points have to match the version predicates used by the record schemas below
+        template<typename F>
+        decltype(auto) with_format(const uint32_t version, std::pmr::memory_resource* arena, F&& f) {
+            if (version == 4)
+                return f(VersionFamily<4>{arena});  // 24 bit element flags
+            if (version < 0x23)
+                return f(VersionFamily<0>{arena});
+            if (version == 0x23)
+                return f(VersionFamily<0x23>{arena});  // brick FlagsB
+            if (version < 0x52)
+                return f(VersionFamily<0x24>{arena});  // polygon FlagsB
+            return f(VersionFamily<0x52>{arena});  // circle FlagsB
+        }
+
+        /// member access ///
+
+        // follow a chain of member pointers, ie. Path<&Element::generic, &GenericData::mRolly>
+        template<auto... Members>
+        struct Path {
+            template<typename T>
+            static auto& get(T& obj) { return (obj .* ... .* Members); }
+        };
+
+        template<typename T, auto... Members>
+        using member_t = std::remove_cvref_t<decltype(Path<Members...>::get(std::declval<T&>()))>;
+
+        // raw integer value of the various flag unions
+        inline uint32_t flag_bits(const Bits8& f) { return f.asByte; }
+        inline uint32_t flag_bits(const Bits16& f) { return f.asShort; }
+        inline uint32_t flag_bits(const Bits32& f) { return f.asInt; }
+        inline uint32_t flag_bits(const GenericDataFlags& f) { return f.asInt; }
+        inline uint32_t flag_bits(const MovementInfoFlags& f) { return f.asShort; }
+        inline uint32_t flag_bits(const EmitterFlags& f) { return f.asShort; }
+
+        /// value codecs ///
+
+        template<typename V>
+        struct Codec;
+
+        // record types described by a schema get their codec from it
+        template<typename T>
+        struct SchemaOf;
+
+        template<typename V> requires std::is_arithmetic_v<V>
+        struct Codec<V> {
+            template<typename C> static void read(binstream& bs, V& v, const C&) { v = bs.read<V>(); }
+            template<typename C, typename Out> static void write(Out& bs, const V& v, const C&) { bs.write(v); }
+            template<typename C> static size_t size(const V&, const C&) { return sizeof(V); }
+            template<typename C> static void skip(binstream& bs, const C&) { bs.seek(bs.tell() + sizeof(V)); }
+        };
+
+        // flag unions travel as their underlying integer
+        template<typename F, typename Raw>
+        struct FlagCodec {
+            template<typename C> static void read(binstream& bs, F& v, const C&) { v = {}; v_raw(v) = bs.read<Raw>(); }
+            template<typename C, typename Out> static void write(Out& bs, const F& v, const C&) { bs.write(static_cast<Raw>(flag_bits(v))); }
+            template<typename C> static size_t size(const F&, const C&) { return sizeof(Raw); }
+            template<typename C> static void skip(binstream& bs, const C&) { bs.seek(bs.tell() + sizeof(Raw)); }
+        private:
+            static auto& v_raw(Bits8& f) { return f.asByte; }
+            static auto& v_raw(Bits16& f) { return f.asShort; }
+            static auto& v_raw(MovementInfoFlags& f) { return f.asShort; }
+            static auto& v_raw(EmitterFlags& f) { return f.asShort; }
+            static auto& v_raw(GenericDataFlags& f) { return f.asInt; }
+        };
+        template<> struct Codec<Bits8> : FlagCodec<Bits8, uint8_t> {};
+        template<> struct Codec<Bits16> : FlagCodec<Bits16, uint16_t> {};
+        template<> struct Codec<MovementInfoFlags> : FlagCodec<MovementInfoFlags, uint16_t> {};
+        template<> struct Codec<EmitterFlags> : FlagCodec<EmitterFlags, uint16_t> {};
+        template<> struct Codec<GenericDataFlags> : FlagCodec<GenericDataFlags, uint32_t> {};
+
+        template<>
+        struct Codec<ColorARGB> {
+            template<typename C> static void read(binstream& bs, ColorARGB& v, const C&) { v = {}; v.asInt = bs.read<int32_t>(); }
+            template<typename C, typename Out> static void write(Out& bs, const ColorARGB& v, const C&) { bs.write(v.asInt); }
+            template<typename C> static size_t size(const ColorARGB&, const C&) { return sizeof(int32_t); }
+            template<typename C> static void skip(binstream& bs, const C&) { bs.seek(bs.tell() + sizeof(int32_t)); }
+        };
+
+        template<>
+        struct Codec<Point> {
+            template<typename C> static void read(binstream& bs, Point& v, const C&) { v.x = bs.read<float>(); v.y = bs.read<float>(); }
+            template<typename C, typename Out> static void write(Out& bs, const Point& v, const C&) { bs.write(v.x); bs.write(v.y); }
+            template<typename C> static size_t size(const Point&, const C&) { return sizeof(float) * 2; }
+            template<typename C> static void skip(binstream& bs, const C&) { bs.seek(bs.tell() + sizeof(float) * 2); }
+        };
+
+        // int16 length prefixed, decoded in place (see LevelStorage)
+        template<>
+        struct Codec<std::string_view> {
+            template<typename C> static void read(binstream& bs, std::string_view& v, const C&) {
+                const auto len = bs.read<int16_t>();
+                if (len <= 0) { v = {}; return; }
+                v = {reinterpret_cast<const char*>(bs.view(len)), static_cast<size_t>(len)};
+            }
+            template<typename C, typename Out> static void write(Out& bs, const std::string_view& v, const C&) {
+                const auto len = static_cast<int16_t>(v.length());
+                bs.write(len);
+                if (len == 0) return;
+                bs.write(v.data(), len);
+            }
+            template<typename C> static size_t size(const std::string_view& v, const C&) { return sizeof(int16_t) + v.length(); }
+            template<typename C> static void skip(binstream& bs, const C&) {
+                const auto len = bs.read<int16_t>();
+                if (len > 0) bs.seek(bs.tell() + len);
+            }
+        };
+
+        // int32 count followed by the points
+        template<typename A>
+        struct Codec<std::vector<Point, A>> {
+            template<typename C> static void read(binstream& bs, std::vector<Point, A>& v, const C& ctx) {
+                const auto count = bs.read<int32_t>();
+                v.clear();
+                if (count <= 0) return;
+                v.resize(count);
+                for (auto& p : v)
+                    Codec<Point>::read(bs, p, ctx);
+            }
+            template<typename C, typename Out> static void write(Out& bs, const std::vector<Point, A>& v, const C& ctx) {
+                bs.write(static_cast<int32_t>(v.size()));
+                for (const auto& p : v)
+                    Codec<Point>::write(bs, p, ctx);
+            }
+            template<typename C> static size_t size(const std::vector<Point, A>& v, const C&) { return sizeof(int32_t) + v.size() * sizeof(float) * 2; }
+            template<typename C> static void skip(binstream& bs, const C&) {
+                const auto count = bs.read<int32_t>();
+                if (count > 0) bs.seek(bs.tell() + count * sizeof(float) * 2);
+            }
+        };
+
+        // int8 tag, > 0 is a static float, otherwise a string expression
+        template<>
+        struct Codec<VariableFloat> {
+            template<typename C> static void read(binstream& bs, VariableFloat& v, const C& ctx) {
+                v = {};
+                v.mIsVariable = bs.read<char>() <= 0;
+                if (v.mIsVariable)
+                    Codec<std::string_view>::read(bs, v.mVariableValue, ctx);
+                else
+                    v.mStaticVariable = bs.read<float>();
+            }
+            template<typename C, typename Out> static void write(Out& bs, const VariableFloat& v, const C& ctx) {
+                bs.write(static_cast<int8_t>(!v.mIsVariable));
+                if (v.mIsVariable)
+                    Codec<std::string_view>::write(bs, v.mVariableValue, ctx);
+                else
+                    bs.write(v.mStaticVariable);
+            }
+            template<typename C> static size_t size(const VariableFloat& v, const C& ctx) {
+                return sizeof(int8_t) + (v.mIsVariable ? Codec<std::string_view>::size(v.mVariableValue, ctx) : sizeof(float));
+            }
+            template<typename C> static void skip(binstream& bs, const C& ctx) {
+                if (bs.read<char>() <= 0)
+                    Codec<std::string_view>::skip(bs, ctx);
+                else
+                    bs.seek(bs.tell() + sizeof(float));
+            }
+        };
+
+        // owned sub records (sub movements, teleporter elements)
+        template<typename T>
+        struct Codec<T*> {
+            template<typename C> static void read(binstream& bs, T*& v, const C& ctx) {
+                v = arena_new<T>(ctx.arena);
+                Codec<T>::read(bs, *v, ctx);
+            }
+            template<typename C, typename Out> static void write(Out& bs, T* const& v, const C& ctx) {
+                Codec<T>::write(bs, v ? *v : none(), ctx);
+            }
+            template<typename C> static size_t size(T* const& v, const C& ctx) {
+                return Codec<T>::size(v ? *v : none(), ctx);
+            }
+            // what a null pointer encodes as, one for every call instead of a copy per call
+            static const T& none() {
+                static const T value{};
+                return value;
+            }
+            template<typename C> static void skip(binstream& bs, const C& ctx) { Codec<T>::skip(bs, ctx); }
+        };
+
+        template<typename T> requires requires { typename SchemaOf<T>::type; }
+        struct Codec<T> {
+            using S = typename SchemaOf<T>::type;
+            template<typename C> static void read(binstream& bs, T& v, const C& ctx) { S::read(bs, v, ctx); }
+            template<typename C, typename Out> static void write(Out& bs, const T& v, const C& ctx) { S::write(bs, v, ctx); }
+            template<typename C> static size_t size(const T& v, const C& ctx) { return S::size(v, ctx); }
+            template<typename C> static void skip(binstream& bs, const C& ctx) {
+                T scratch{};
+                S::skip(bs, scratch, ctx);
+            }
+        };
+
+        /// ops ///
+
+        // a sequence of ops, this is what a schema is
+        template<typename... Ops>
+        struct Seq {
+            template<typename T, typename C> static void read(binstream& bs, T& obj, const C& ctx) { (Ops::read(bs, obj, ctx), ...); }
+            template<typename T, typename C, typename Out> static void write(Out& bs, const T& obj, const C& ctx) { (Ops::write(bs, obj, ctx), ...); }
+            template<typename T, typename C> static size_t size(const T& obj, const C& ctx) { return (size_t{0} + ... + Ops::size(obj, ctx)); }
+            template<typename T, typename C> static void skip(binstream& bs, T& obj, const C& ctx) { (Ops::skip(bs, obj, ctx), ...); }
+        };
+
+        // plain field, stored as its own type
+        template<auto... Members>
+        struct Field {
+            template<typename T, typename C> static void read(binstream& bs, T& obj, const C& ctx) {
+                Codec<member_t<T, Members...>>::read(bs, Path<Members...>::get(obj), ctx);
+            }
+            template<typename T, typename C, typename Out> static void write(Out& bs, const T& obj, const C& ctx) {
+                Codec<member_t<T, Members...>>::write(bs, Path<Members...>::get(obj), ctx);
+            }
+            template<typename T, typename C> static size_t size(const T& obj, const C& ctx) {
+                return Codec<member_t<T, Members...>>::size(Path<Members...>::get(obj), ctx);
+            }
+            template<typename T, typename C> static void skip(binstream& bs, T&, const C& ctx) {
+                Codec<member_t<T, Members...>>::skip(bs, ctx);
+            }
+        };
+
+        // field that later ops branch on, so it is decoded even while skipping. an output stream with branches() is
+        // told before the write (see LevelJournal)
+        template<auto... Members>
+        struct Flags : Field<Members...> {
+            template<typename T, typename C, typename Out> static void write(Out& bs, const T& obj, const C& ctx) {
+                if constexpr (requires { bs.branches(); })
+                    bs.branches();
+                Field<Members...>::write(bs, obj, ctx);
+            }
+            template<typename T, typename C> static void skip(binstream& bs, T& obj, const C& ctx) {
+                Field<Members...>::read(bs, obj, ctx);
+            }
+        };
+
+        // field stored as a different type on disk (ie. an int32 member that is an int16 in the file)
+        template<typename Wire, auto... Members>
+        struct As {
+            template<typename T, typename C> static void read(binstream& bs, T& obj, const C&) {
+                Path<Members...>::get(obj) = static_cast<member_t<T, Members...>>(bs.read<Wire>());
+            }
+            template<typename T, typename C, typename Out> static void write(Out& bs, const T& obj, const C&) {
+                bs.write(static_cast<Wire>(Path<Members...>::get(obj)));
+            }
+            template<typename T, typename C> static size_t size(const T&, const C&) { return sizeof(Wire); }
+            template<typename T, typename C> static void skip(binstream& bs, T&, const C&) { bs.seek(bs.tell() + sizeof(Wire)); }
+        };
+
+        // field stored with a constant bias on disk (stored = value - Bias)
+        template<typename Wire, int Bias, auto... Members>
+        struct Biased {
+            template<typename T, typename C> static void read(binstream& bs, T& obj, const C&) {
+                Path<Members...>::get(obj) = static_cast<member_t<T, Members...>>(bs.read<Wire>() + Bias);
+            }
+            template<typename T, typename C, typename Out> static void write(Out& bs, const T& obj, const C&) {
+                bs.write(static_cast<Wire>(Path<Members...>::get(obj) - Bias));
+            }
+            template<typename T, typename C> static size_t size(const T&, const C&) { return sizeof(Wire); }
+            template<typename T, typename C> static void skip(binstream& bs, T&, const C&) { bs.seek(bs.tell() + sizeof(Wire)); }
+        };
+
+        // fixup run after a record is read, for members derived from other members
+        template<auto Fn>
+        struct OnRead {
+            template<typename T, typename C> static void read(binstream&, T& obj, const C&) { Fn(obj); }
+            template<typename T, typename C, typename Out> static void write(Out&, const T&, const C&) {}
+            template<typename T, typename C> static size_t size(const T&, const C&) { return 0; }
+            template<typename T, typename C> static void skip(binstream&, T&, const C&) {}
+        };
+
+        /// predicates ///
+
+        template<int N, auto... Members>
+        struct Bit {
+            template<typename T, typename C> static bool test(const T& obj, const C&) {
+                return (flag_bits(Path<Members...>::get(obj)) >> N) & 1;
+            }
+        };
+
+        template<auto Value, auto... Members>
+        struct Equals {
+            template<typename T, typename C> static bool test(const T& obj, const C&) {
+                return Path<Members...>::get(obj) == Value;
+            }
+        };
+
+        // version predicates also expose fixed<C>, their result for a VersionFamily
+        template<uint32_t V>
+        struct VersionIs {
+            template<typename T, typename C> static bool test(const T&, const C& ctx) { return ctx.version == V; }
+            template<typename C> static constexpr bool fixed = C::version == V;
+        };
+        template<uint32_t V>
+        struct VersionAtLeast {
+            template<typename T, typename C> static bool test(const T&, const C& ctx) { return ctx.version >= V; }
+            template<typename C> static constexpr bool fixed = C::version >= V;
+        };
+        template<uint32_t V>
+        struct VersionAbove {
+            template<typename T, typename C> static bool test(const T&, const C& ctx) { return ctx.version > V; }
+            template<typename C> static constexpr bool fixed = C::version > V;
+        };
+
+        template<typename C> constexpr bool is_version_family = false;
+        template<uint32_t V> constexpr bool is_version_family<VersionFamily<V>> = true;
+
+        // Pred is known at compile time under C
+        template<typename Pred, typename C>
+        concept FixedPred = is_version_family<C> && requires { { Pred::template fixed<C> } -> std::convertible_to<bool>; };
+
+        template<typename Pred, typename Then, typename Else>
+        struct IfElse {
+            template<typename T, typename C> static void read(binstream& bs, T& obj, const C& ctx) {
+                if constexpr (FixedPred<Pred, C>)
+                    std::conditional_t<Pred::template fixed<C>, Then, Else>::read(bs, obj, ctx);
+                else if (Pred::test(obj, ctx)) Then::read(bs, obj, ctx); else Else::read(bs, obj, ctx);
+            }
+            template<typename T, typename C, typename Out> static void write(Out& bs, const T& obj, const C& ctx) {
+                if constexpr (FixedPred<Pred, C>)
+                    std::conditional_t<Pred::template fixed<C>, Then, Else>::write(bs, obj, ctx);
+                else if (Pred::test(obj, ctx)) Then::write(bs, obj, ctx); else Else::write(bs, obj, ctx);
+            }
+            template<typename T, typename C> static size_t size(const T& obj, const C& ctx) {
+                if constexpr (FixedPred<Pred, C>)
+                    return std::conditional_t<Pred::template fixed<C>, Then, Else>::size(obj, ctx);
+                else
+                    return Pred::test(obj, ctx) ? Then::size(obj, ctx) : Else::size(obj, ctx);
+            }
+            template<typename T, typename C> static void skip(binstream& bs, T& obj, const C& ctx) {
+                if constexpr (FixedPred<Pred, C>)
+                    std::conditional_t<Pred::template fixed<C>, Then, Else>::skip(bs, obj, ctx);
+                else if (Pred::test(obj, ctx)) Then::skip(bs, obj, ctx); else Else::skip(bs, obj, ctx);
+            }
+        };
+
+        template<typename Pred, typename... Ops>
+        struct If : IfElse<Pred, Seq<Ops...>, Seq<>> {};
+
+        // a single scalar behind a flag is read without branching on the flag
+        template<typename Pred, auto... Members>
+        struct If<Pred, Field<Members...>> : IfElse<Pred, Field<Members...>, Seq<>> {
+            template<typename T, typename C> static void read(binstream& bs, T& obj, const C& ctx) {
+                if constexpr (FixedPred<Pred, C> || !std::is_arithmetic_v<member_t<T, Members...>>)
+                    IfElse<Pred, Field<Members...>, Seq<>>::read(bs, obj, ctx);
+                else
+                    bs.read_if(Pred::test(obj, ctx), Path<Members...>::get(obj));
+            }
+        };
+
+        /// record schemas ///
+
+        inline void derive_brick(BrickEntry& e) {
+            e.mCurved = !(e.mFlagsC.v2 && e.mType == 5);
+            e.mTextureFlip = e.mFlagsC.v10;
+        }
+        inline void derive_movement(MovementInfo& m) {
+            m.mType = abs(m.mMovementShape);
+            // document mReverse as negative shape
+        }
+
+        template<> struct SchemaOf<RodEntry> {
+            using type = Seq<
+                Flags<&RodEntry::mFlags>,
+                Field<&RodEntry::mPointA>,
+                Field<&RodEntry::mPointB>,
+                If<Bit<0, &RodEntry::mFlags>, Field<&RodEntry::mE>>,
+                If<Bit<1, &RodEntry::mFlags>, Field<&RodEntry::mF>>
+            >;
+        };
+
+        template<> struct SchemaOf<PolygonEntry> {
+            using type = Seq<
+                Flags<&PolygonEntry::mFlagsA>,
+                If<VersionAbove<0x23>, Flags<&PolygonEntry::mFlagsB>>,
+                If<Bit<2, &PolygonEntry::mFlagsA>, Field<&PolygonEntry::mRotation>>,
+                If<Bit<3, &PolygonEntry::mFlagsA>, Field<&PolygonEntry::mUnk1>>,
+                If<Bit<5, &PolygonEntry::mFlagsA>, Field<&PolygonEntry::mScale>>,
+                If<Bit<1, &PolygonEntry::mFlagsA>, Field<&PolygonEntry::mNormalDir>>,
+                If<Bit<4, &PolygonEntry::mFlagsA>, Field<&PolygonEntry::mPos>>,
+                Field<&PolygonEntry::mPoints>,
+                If<Bit<0, &PolygonEntry::mFlagsB>, Field<&PolygonEntry::mUnk2>>,
+                If<Bit<1, &PolygonEntry::mFlagsB>, Field<&PolygonEntry::mGrowType>>
+            >;
+        };
+
+        template<> struct SchemaOf<CircleEntry> {
+            using type = Seq<
+                Flags<&CircleEntry::mFlagsA>,
+                If<VersionAtLeast<0x52>, Flags<&CircleEntry::mFlagsB>>,
+                If<Bit<1, &CircleEntry::mFlagsA>, Field<&CircleEntry::mPos>>,
+                Field<&CircleEntry::mRadius>
+            >;
+        };
+
+        template<> struct SchemaOf<BrickEntry> {
+            using type = Seq<
+                Flags<&BrickEntry::mFlagsA>,
+                If<VersionAtLeast<0x23>, Flags<&BrickEntry::mFlagsB>>,
+                If<Bit<2, &BrickEntry::mFlagsA>, Field<&BrickEntry::mUnk1>>,
+                If<Bit<3, &BrickEntry::mFlagsA>, Field<&BrickEntry::mUnk2>>,
+                If<Bit<5, &BrickEntry::mFlagsA>, Field<&BrickEntry::mUnk3>>,
+                If<Bit<1, &BrickEntry::mFlagsA>, Field<&BrickEntry::mUnk4>>,
+                If<Bit<4, &BrickEntry::mFlagsA>, Field<&BrickEntry::mPos>>,
+                If<Bit<0, &BrickEntry::mFlagsB>, Field<&BrickEntry::mUnk5>>,
+                If<Bit<1, &BrickEntry::mFlagsB>, Field<&BrickEntry::mUnk6>>,
+                If<Bit<2, &BrickEntry::mFlagsB>, Field<&BrickEntry::mUnk7>>,
+                Flags<&BrickEntry::mFlagsC>,
+                If<Bit<8, &BrickEntry::mFlagsC>, Field<&BrickEntry::mUnk8>>,
+                If<Bit<9, &BrickEntry::mFlagsC>, Field<&BrickEntry::mUnk9>>,
+                If<Bit<2, &BrickEntry::mFlagsC>, Field<&BrickEntry::mType>>,
+                If<Bit<3, &BrickEntry::mFlagsC>, Biased<uint8_t, 2, &BrickEntry::mCurvedPoints>>,
+                If<Bit<5, &BrickEntry::mFlagsC>, Field<&BrickEntry::mLeftAngle>>,
+                If<Bit<6, &BrickEntry::mFlagsC>, Field<&BrickEntry::mRightAngle>, Field<&BrickEntry::mUnk10>>,
+                If<Bit<4, &BrickEntry::mFlagsC>, Field<&BrickEntry::mSectorAngle>>,
+                If<Bit<7, &BrickEntry::mFlagsC>, Field<&BrickEntry::mWidth>>,
+                Field<&BrickEntry::mLength>,
+                Field<&BrickEntry::mAngle>,
+                Field<&BrickEntry::mUnk12>,
+                OnRead<&derive_brick>
+            >;
+        };
+
+        // the parts around the carried element, the skim pass (see LevelIndex) walks into it in between
+        using TeleportHead = Seq<
+            Flags<&TeleportEntry::mFlags>,
+            Field<&TeleportEntry::mWidth>,
+            Field<&TeleportEntry::mHeight>,
+            If<Bit<1, &TeleportEntry::mFlags>, As<int16_t, &TeleportEntry::mUnk0>>,
+            If<Bit<3, &TeleportEntry::mFlags>, Field<&TeleportEntry::mUnk1>>,
+            If<Bit<5, &TeleportEntry::mFlags>, Field<&TeleportEntry::mUnk2>>
+        >;
+        using TeleportTail = Seq<
+            If<Bit<2, &TeleportEntry::mFlags>, Field<&TeleportEntry::mPos>>,
+            If<Bit<6, &TeleportEntry::mFlags>, Field<&TeleportEntry::mUnk3>, Field<&TeleportEntry::mUnk4>>
+        >;
+
+        template<> struct SchemaOf<TeleportEntry> {
+            using type = Seq<
+                TeleportHead,
+                If<Bit<4, &TeleportEntry::mFlags>, Field<&TeleportEntry::mEntry>>,
+                TeleportTail
+            >;
+        };
+
+        template<> struct SchemaOf<EmitterEntry> {
+            using E = EmitterEntry;
+            using type = Seq<
+                Flags<&E::mMainVar>,
+                Flags<&E::mFlags>,
+                Field<&E::mImage>,
+                Field<&E::mWidth>,
+                Field<&E::mHeight>,
+                If<Equals<2, &E::mMainVar>,
+                    Field<&E::mMainVar0>,
+                    Field<&E::mMainVar1>,
+                    Field<&E::mMainVar2>,
+                    Field<&E::mMainVar3>,
+                    If<Bit<13, &E::mFlags>, Field<&E::mUnknown0>, Field<&E::mUnknown1>>  // hasUnk5
+                >,
+                If<Bit<5, &E::mFlags>, Field<&E::mPos>>,  // hasPosition
+                Field<&E::mEmitImage>,
+                Field<&E::mUnknownEmitRate>,
+                Field<&E::mUnknown2>,
+                Field<&E::mRotation>,
+                Field<&E::mMaxQuantity>,
+                Field<&E::mTimeBeforeFadeOut>,
+                Field<&E::mFadeInTime>,
+                Field<&E::mLifeDuration>,
+                Field<&E::mEmitRate>,
+                Field<&E::mEmitAreaMultiplier>,
+                If<Bit<12, &E::mFlags>,  // hasChangeRotation
+                    Field<&E::mInitialRotation>, Field<&E::mRotationVelocity>, Field<&E::mRotationUnknown>>,
+                If<Bit<7, &E::mFlags>,  // hasChangeScale
+                    Field<&E::mMinScale>, Field<&E::mScaleVelocity>, Field<&E::mMaxRandScale>>,
+                If<Bit<8, &E::mFlags>,  // hasChangeColor
+                    Field<&E::mColourRed>, Field<&E::mColourGreen>, Field<&E::mColourBlue>>,
+                If<Bit<9, &E::mFlags>, Field<&E::mOpacity>>,  // hasChangeOpacity
+                If<Bit<10, &E::mFlags>,  // hasChangeVelocity
+                    Field<&E::mMinVelocityX>, Field<&E::mMinVelocityY>,
+                    Field<&E::mMaxVelocityX>, Field<&E::mMaxVelocityY>,
+                    Field<&E::mAccelerationX>, Field<&E::mAccelerationY>>,
+                If<Bit<11, &E::mFlags>,  // hasChangeDirection
+                    Field<&E::mDirectionSpeed>, Field<&E::mDirectionRandomSpeed>, Field<&E::mDirectionAcceleration>,
+                    Field<&E::mDirectionAngle>, Field<&E::mDirectionRandomAngle>>,
+                If<Bit<6, &E::mFlags>, Field<&E::mUnknownA>, Field<&E::mUnknownB>>  // hasChangeUnknown
+            >;
+        };
+
+        template<> struct SchemaOf<MovementInfo> {
+            using M = MovementInfo;
+            using type = Seq<
+                Field<&M::mMovementShape>,
+                Field<&M::mAnchorPoint>,
+                Field<&M::mTimePeriod>,
+                Flags<&M::mFlags>,
+                If<Bit<0, &M::mFlags>, Field<&M::mOffset>>,
+                If<Bit<1, &M::mFlags>, Field<&M::mRadius1>>,
+                If<Bit<2, &M::mFlags>, Field<&M::mStartPhase>>,
+                If<Bit<3, &M::mFlags>, Field<&M::mMoveRotation>>,
+                If<Bit<4, &M::mFlags>, Field<&M::mRadius2>>,
+                If<Bit<5, &M::mFlags>, Field<&M::mPause1>>,
+                If<Bit<6, &M::mFlags>, Field<&M::mPause2>>,
+                If<Bit<7, &M::mFlags>, Field<&M::mPhase1>>,
+                If<Bit<8, &M::mFlags>, Field<&M::mPhase2>>,
+                If<Bit<9, &M::mFlags>, Field<&M::mPostDelayPhase>>,
+                If<Bit<10, &M::mFlags>, Field<&M::mMaxAngle>>,
+                If<Bit<11, &M::mFlags>, Field<&M::mUnknown8>>,
+                If<Bit<14, &M::mFlags>, Field<&M::mRotation>>,
+                If<Bit<12, &M::mFlags>,
+                    Field<&M::mSubMovementOffsetX>, Field<&M::mSubMovementOffsetY>, Field<&M::mSubMovementLink>>,
+                If<Bit<13, &M::mFlags>, Field<&M::mObjectX>, Field<&M::mObjectY>>,
+                OnRead<&derive_movement>
+            >;
+        };
+
+        template<> struct SchemaOf<MovementLink> {
+            using type = Seq<
+                Flags<&MovementLink::InternalLinkId>,
+                If<Equals<1, &MovementLink::InternalLinkId>, Field<&MovementLink::InternalMovement>>
+            >;
+        };
+
+        // mVariable and mCrumble mirror flag bits 1 and 3, the members win when writing
+        struct PegInfoFlags {
+            template<typename C> static void read(binstream& bs, PegInfo& p, const C&) {
+                p.mFlags = {};
+                p.mFlags.asByte = bs.read<uint8_t>();
+                p.mVariable = p.mFlags.v1;
+                p.mCrumble = p.mFlags.v3;
+            }
+            template<typename C, typename Out> static void write(Out& bs, const PegInfo& p, const C&) {
+                auto flags = p.mFlags;
+                flags.v1 = p.mVariable;
+                flags.v3 = p.mCrumble;
+                bs.write(flags.asByte);
+            }
+            template<typename C> static size_t size(const PegInfo&, const C&) { return sizeof(uint8_t); }
+            template<typename C> static void skip(binstream& bs, PegInfo& p, const C&) { p.mFlags.asByte = bs.read<uint8_t>(); }
+        };
+
+        template<> struct SchemaOf<PegInfo> {
+            using type = Seq<
+                Field<&PegInfo::mType>,
+                PegInfoFlags,
+                If<Bit<2, &PegInfo::mFlags>, Field<&PegInfo::mUnk0>>,
+                If<Bit<4, &PegInfo::mFlags>, Field<&PegInfo::mUnk1>>,
+                If<Bit<5, &PegInfo::mFlags>, Field<&PegInfo::mUnk2>>,
+                If<Bit<7, &PegInfo::mFlags>, Field<&PegInfo::mUnk3>>
+            >;
+        };
+
+        // version 4 stores the element flags as 3 bytes
+        struct ElementFlags24 {
+            template<typename C> static void read(binstream& bs, Element& e, const C&) {
+                const auto low = bs.read<uint8_t>();
+                const auto mid = bs.read<uint8_t>();
+                const auto high = bs.read<uint8_t>();
+                e.flags = {};
+                e.flags.asInt = (high << 16) | (mid << 8) | low;
+            }
+            template<typename C, typename Out> static void write(Out& bs, const Element& e, const C&) {
+                const uint32_t flags = e.flags.asInt;
+                bs.write(static_cast<uint8_t>(flags & 0xFF));
+                bs.write(static_cast<uint8_t>(flags >> 8 & 0xFF));
+                bs.write(static_cast<uint8_t>(flags >> 16 & 0xFF));
+            }
+            template<typename C> static size_t size(const Element&, const C&) { return 3; }
+            template<typename C> static void skip(binstream& bs, Element& e, const C& ctx) { read(bs, e, ctx); }
+        };
+
+        // the entry record is picked by eType
+        struct ElementEntry {
+            template<typename C> static void read(binstream& bs, Element& e, const C& ctx) {
+                e.entry = arena_new<Entry>(ctx.arena, static_cast<LevelEntryType>(e.eType), ctx.arena);
+                switch (e.eType) {
+                    case Rod: Codec<RodEntry>::read(bs, *Entry::GetRod(e.entry), ctx); break;
+                    case Polygon: Codec<PolygonEntry>::read(bs, *Entry::GetPolygon(e.entry), ctx); break;
+                    case Circle: Codec<CircleEntry>::read(bs, *Entry::GetCircle(e.entry), ctx); break;
+                    case Brick: Codec<BrickEntry>::read(bs, *Entry::GetBrick(e.entry), ctx); break;
+                    case Teleporter: Codec<TeleportEntry>::read(bs, *Entry::GetTeleporter(e.entry), ctx); break;
+                    case Emitter: Codec<EmitterEntry>::read(bs, *Entry::GetEmitter(e.entry), ctx); break;
+                    default: break;  // todo: raise exception for invalid entry type
+                }
+            }
+            template<typename C, typename Out> static void write(Out& bs, const Element& e, const C& ctx) {
+                if (!e.entry) return;
+                switch (Entry::GetType(e.entry)) {
+                    case Rod: Codec<RodEntry>::write(bs, *Entry::GetRod(e.entry), ctx); break;
+                    case Polygon: Codec<PolygonEntry>::write(bs, *Entry::GetPolygon(e.entry), ctx); break;
+                    case Circle: Codec<CircleEntry>::write(bs, *Entry::GetCircle(e.entry), ctx); break;
+                    case Brick: Codec<BrickEntry>::write(bs, *Entry::GetBrick(e.entry), ctx); break;
+                    case Teleporter: Codec<TeleportEntry>::write(bs, *Entry::GetTeleporter(e.entry), ctx); break;
+                    case Emitter: Codec<EmitterEntry>::write(bs, *Entry::GetEmitter(e.entry), ctx); break;
+                    default: break;
+                }
+            }
+            template<typename C> static size_t size(const Element& e, const C& ctx) {
+                if (!e.entry) return 0;
+                switch (Entry::GetType(e.entry)) {
+                    case Rod: return Codec<RodEntry>::size(*Entry::GetRod(e.entry), ctx);
+                    case Polygon: return Codec<PolygonEntry>::size(*Entry::GetPolygon(e.entry), ctx);
+                    case Circle: return Codec<CircleEntry>::size(*Entry::GetCircle(e.entry), ctx);
+                    case Brick: return Codec<BrickEntry>::size(*Entry::GetBrick(e.entry), ctx);
+                    case Teleporter: return Codec<TeleportEntry>::size(*Entry::GetTeleporter(e.entry), ctx);
+                    case Emitter: return Codec<EmitterEntry>::size(*Entry::GetEmitter(e.entry), ctx);
+                    default: return 0;
+                }
+            }
+            template<typename C> static void skip(binstream& bs, Element& e, const C& ctx) {
+                switch (e.eType) {
+                    case Rod: Codec<RodEntry>::skip(bs, ctx); break;
+                    case Polygon: Codec<PolygonEntry>::skip(bs, ctx); break;
+                    case Circle: Codec<CircleEntry>::skip(bs, ctx); break;
+                    case Brick: Codec<BrickEntry>::skip(bs, ctx); break;
+                    case Teleporter: Codec<TeleportEntry>::skip(bs, ctx); break;
+                    case Emitter: Codec<EmitterEntry>::skip(bs, ctx); break;
+                    default: break;
+                }
+            }
+        };
+
+        // generic data fields are gated by the element flags
+        template<int N, auto Member>
+        using Generic = If<Bit<N, &Element::flags>, Field<&Element::generic, Member>>;
+
+        // everything of an element before its movement link, the skim pass stops here to note where the movement
+        // and the entry start
+        using ElementHead = Seq<
+            Flags<&Element::eType>,
+            IfElse<VersionIs<4>, ElementFlags24, Flags<&Element::flags>>,  // TODO: no idea what the lower limit actually is, try and find it in ida
+            Generic<0, &GenericData::mRolly>,
+            Generic<1, &GenericData::mBouncy>,
+            Generic<4, &GenericData::mUnk0>,
+            Generic<8, &GenericData::mSolidColor>,
+            Generic<9, &GenericData::mOutlineColor>,
+            Generic<10, &GenericData::mImage>,
+            Generic<11, &GenericData::mImageDX>,
+            Generic<12, &GenericData::mImageDY>,
+            Generic<13, &GenericData::mRotation>,
+            Generic<16, &GenericData::mUnk1>,
+            Generic<17, &GenericData::mID>,
+            Generic<18, &GenericData::mUnk2>,
+            Generic<19, &GenericData::mSound>,
+            Generic<21, &GenericData::mLogic>,
+            Generic<23, &GenericData::mMaxBounceVelocity>,
+            Generic<26, &GenericData::mSubID>,
+            Generic<27, &GenericData::mFlipperFlags>,
+            Generic<2, &GenericData::mPegInfo>
+        >;
+
+        template<> struct SchemaOf<Element> {
+            using type = Seq<
+                Flags<&Element::magic>,
+                If<Equals<1, &Element::magic>,
+                    ElementHead,
+                    Generic<3, &GenericData::mMovementLink>,
+                    ElementEntry
+                >
+            >;
+        };
+    }
+}
+
+#endif //LEVELSCHEMA_H
@@ -0,0 +1,149 @@
+#ifndef LEVELSHAPES_H
+#define LEVELSHAPES_H
+
+// the outlines elements collide with, in level coordinates. the collision baker, the spatial index and the level
+// statistics all walk these, so a box always holds the shape that gets baked
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+
+#include "libpeggle.h"
+
+namespace Peggle::Shapes {
+
+    constexpr uint32_t circle_sides = 24;
+    // slanted brick ends stop short of a right angle, the corners would run off to infinity
+    constexpr double max_end_angle = 80.;
+
+    inline LevelTypes::Point at(const double x, const double y) {
+        return {static_cast<float>(x), static_cast<float>(y)};
+    }
+
+    template<typename F>
+    void circle_outline(const LevelTypes::CircleEntry& circle, F&& f) {
+        const double r = std::abs(circle.mRadius);
+        for (uint32_t i = 0; i < circle_sides; ++i) {
+            const double a = 2. * std::numbers::pi * i / circle_sides;
+            f(at(circle.mPos.x + r * std::cos(a), circle.mPos.y + r * std::sin(a)));
+        }
+    }
+
+    // straight bricks are the 4 corners, curved ones the outer arc and then the inner arc backwards, so point i of
+    // the outer arc pairs with point n - 1 - i either way
+    template<typename F>
+    void brick_outline(const LevelTypes::BrickEntry& brick, F&& f) {
+        const double radians = brick.mAngle * std::numbers::pi / 180.;
+        const double ux = std::cos(radians), uy = std::sin(radians);  // along the length
+        const double nx = -uy, ny = ux;  // across
+        const double px = brick.mPos.x, py = brick.mPos.y;
+        const double length = std::abs(brick.mLength), width = std::abs(brick.mWidth);
+        const double sector = std::abs(brick.mSectorAngle) * std::numbers::pi / 180.;
+
+        if (!brick.mCurved || sector < 1e-6 || sector >= 2. * std::numbers::pi) {
+            const auto slant = [](const float degrees, const bool set) {
+                if (!set)
+                    return 0.;
+                return std::tan(std::clamp<double>(degrees, -max_end_angle, max_end_angle) * std::numbers::pi / 180.);
+            };
+            const double hl = length / 2., hw = width / 2.;
+            const double left = hw * slant(brick.mLeftAngle, brick.mFlagsC.v5);
+            const double right = hw * slant(brick.mRightAngle, brick.mFlagsC.v6);
+            const auto corner = [&](const double along, const double across) {
+                f(at(px + ux * along + nx * across, py + uy * along + ny * across));
+            };
+            corner(-hl - left, -hw);
+            corner(hl + right, -hw);
+            corner(hl - right, hw);
+            corner(-hl + left, hw);
+            return;
+        }
+
+        // the middle of the outer arc sits on mPos, the arc bends towards +across (-across for a negative sector)
+        const double bend = brick.mSectorAngle < 0.f ? -1. : 1.;
+        const double bx = nx * bend, by = ny * bend;
+        const double outer = length / (2. * std::sin(sector / 2.));
+        const double inner = std::max(outer - width, 0.);
+        const double cx = px + bx * outer, cy = py + by * outer;
+        const uint32_t points = std::max<uint32_t>(brick.mCurvedPoints, 2);
+        const auto arc = [&](const double radius, const uint32_t i) {
+            const double phi = -sector / 2. + sector * i / (points - 1);
+            const double dx = -bx * std::cos(phi) + ux * std::sin(phi);
+            const double dy = -by * std::cos(phi) + uy * std::sin(phi);
+            f(at(cx + radius * dx, cy + radius * dy));
+        };
+        for (uint32_t i = 0; i < points; ++i)
+            arc(outer, i);
+        for (uint32_t i = points; i-- > 0;)
+            arc(inner, i);
+    }
+
+    template<typename F>
+    void polygon_outline(const LevelTypes::PolygonEntry& polygon, F&& f) {
+        const double scale = polygon.mFlagsA.v5 ? polygon.mScale : 1.;
+        const double radians = polygon.mFlagsA.v2 ? polygon.mRotation * std::numbers::pi / 180. : 0.;
+        const double c = std::cos(radians) * scale, s = std::sin(radians) * scale;
+        const double ox = polygon.mPos.x, oy = polygon.mPos.y;
+        for (const auto& p : polygon.mPoints) {
+            const double dx = p.x - ox, dy = p.y - oy;
+            f(at(ox + c * dx - s * dy, oy + s * dx + c * dy));
+        }
+    }
+
+    // call f(point) for every point of the element's outline (a rod is its two ends), false for elements without one
+    template<typename F>
+    bool outline(const LevelTypes::Element& element, F&& f) {
+        if (!element.entry)
+            return false;
+        switch (LevelTypes::Entry::GetType(element.entry)) {
+            case LevelTypes::Circle:
+                circle_outline(*LevelTypes::Entry::GetCircle(element.entry), f);
+                return true;
+            case LevelTypes::Brick:
+                brick_outline(*LevelTypes::Entry::GetBrick(element.entry), f);
+                return true;
+            case LevelTypes::Rod: {
+                const auto* rod = LevelTypes::Entry::GetRod(element.entry);
+                f(rod->mPointA);
+                f(rod->mPointB);
+                return true;
+            }
+            case LevelTypes::Polygon: {
+                const auto* polygon = LevelTypes::Entry::GetPolygon(element.entry);
+                if (polygon->mPoints.empty())
+                    return false;
+                polygon_outline(*polygon, f);
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    // box around the outline, the same one CollisionCache gives the baked shape. circles are boxed from their
+    // radius instead of their sides
+    inline bool bounds(const LevelTypes::Element& element, SpatialTypes::Box& box) {
+        if (element.entry && LevelTypes::Entry::GetType(element.entry) == LevelTypes::Circle) {
+            const auto* circle = LevelTypes::Entry::GetCircle(element.entry);
+            const double r = std::abs(circle->mRadius);
+            const auto lo = at(circle->mPos.x - r, circle->mPos.y - r), hi = at(circle->mPos.x + r, circle->mPos.y + r);
+            box = {lo.x, lo.y, hi.x, hi.y};
+            return true;
+        }
+        bool first = true;
+        return outline(element, [&](const LevelTypes::Point& p) {
+            if (first) {
+                box = {p.x, p.y, p.x, p.y};
+                first = false;
+                return;
+            }
+            box.MinX = std::min(box.MinX, p.x);
+            box.MinY = std::min(box.MinY, p.y);
+            box.MaxX = std::max(box.MaxX, p.x);
+            box.MaxY = std::max(box.MaxY, p.y);
+        });
+    }
+}
+
+#endif //LEVELSHAPES_H
@@ -3,8 +3,16 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
 #include "logma.h"
 
@@ -486,15 +494,16 @@ namespace Peggle {
             int32_t mUnk0 = 0;  // figure out what this is
             ColorARGB mSolidColor {};
             ColorARGB mOutlineColor {};
-            std::string mImage;
+            // strings are views into level storage, set them with Level::SetString
+            std::string_view mImage;
             float mImageDX = 0.;
             float mImageDY = 0.;
             float mRotation = 0.;
             int32_t mUnk1 = 0;  // figure out what this is
-            std::string mID;
+            std::string_view mID;
             int32_t mUnk2 = 0;  // figure out what this is
             uint8_t mSound = 0;
-            std::string mLogic;
+            std::string_view mLogic;
             float mMaxBounceVelocity = 0.;
             float mSubID = 0;
             // int32_t mUnk3 = 0  // figure out what this is
@@ -504,7 +513,7 @@ namespace Peggle {
         struct VariableFloat {
             bool mIsVariable = false;
             float mStaticVariable = 0;
-            std::string mVariableValue;
+            std::string_view mVariableValue;  // in level storage, see Level::SetString
         };
 
         struct Element;
@@ -525,7 +534,7 @@ namespace Peggle {
             float mScale = 0.;
             uint8_t mNormalDir = 0;
             Point mPos {0, 0};
-            std::vector<Point> mPoints {};
+            std::pmr::vector<Point> mPoints {};
             uint8_t mUnk2 = 0;
             int32_t mGrowType = 0;
         };
@@ -586,13 +595,14 @@ namespace Peggle {
             int32_t mMainVar = 0;
             EmitterFlags mFlags{};
 
-            std::string mImage;
+            // mImage, mMainVar2 and mEmitImage live in level storage like the GenericData strings
+            std::string_view mImage;
             int32_t mWidth = 0;
             int32_t mHeight = 0;
 
             int32_t mMainVar0 = 0;
             float mMainVar1 = 0.;
-            std::string mMainVar2;
+            std::string_view mMainVar2;
             uint8_t mMainVar3 = 0;
 
             VariableFloat mUnknown0 {};
@@ -600,7 +610,7 @@ namespace Peggle {
 
             Point mPos {0, 0};
 
-            std::string mEmitImage;
+            std::string_view mEmitImage;
             float mUnknownEmitRate = 0.;
             float mUnknown2 = 0.;
             float mRotation = 0.;
@@ -644,21 +654,244 @@ namespace Peggle {
             float mUnknownB = 0.;
         };
         struct Entry;
+        // backing memory of a level (source bytes, arena holding elements, entries, points and strings)
+        struct LevelStorage;
 
-        struct Element {
+        // bytes an element was decoded from, inside the source buffer of its level
+        struct ElementSource {
+            const uint8_t* Data = nullptr;
+            uint32_t Size = 0;
+        };
+
+        // what an element holds, pointers into some arena. trivially copyable
+        struct ElementFields {
             int32_t magic{};
             int32_t eType{};
             GenericDataFlags flags{};
             GenericData generic{};
             Entry* entry{};
+            // loaded bytes of a top level element, cleared by Level::MarkDirty
+            ElementSource source{};
         };
 
+        // copies are deep, into an arena of their own or the one given. moves never allocate
+        struct Element : ElementFields {
+            Element() = default;
+            Element(const Element& other);
+            Element(const Element& other, std::pmr::memory_resource* arena);
+            Element(Element&& other) noexcept;
+            Element& operator=(const Element& other);
+            Element& operator=(Element&& other) noexcept;
+            ~Element();
+
+        private:
+            // the arena and its first block in one allocation
+            struct OwnDeleter {
+                void operator()(std::pmr::monotonic_buffer_resource* arena) const;
+            };
+            // backs a copy made without an arena
+            std::unique_ptr<std::pmr::monotonic_buffer_resource, OwnDeleter> Own;
+        };
+
+        // copies are Level::CloneLevel, moves hand the storage over
         struct Level {
             bool valid = false;
             uint32_t version{};
             uint8_t sync_f{};
             uint32_t entries{};
+            // everything reachable from Elements lives in this, keep the level alive while using them
+            std::shared_ptr<LevelStorage> Storage{};
+            // not in the arena, so moves hand it over
             std::vector<Element> Elements{};
+
+            Level() = default;
+            Level(const Level& other);
+            Level(Level&& other) noexcept = default;
+            Level& operator=(const Level& other);
+            Level& operator=(Level&& other) noexcept = default;
+            ~Level() = default;
+        };
+
+        // level geometry by entry type, row i belongs to Level::Elements[Element[i]]
+        struct CircleColumns {
+            std::vector<uint32_t> Element;
+            std::vector<float> X, Y;
+            std::vector<float> Radius;
+        };
+        struct BrickColumns {
+            std::vector<uint32_t> Element;
+            std::vector<float> X, Y;
+            std::vector<float> Angle;
+            std::vector<float> Length;
+            std::vector<float> Width;
+            std::vector<float> SectorAngle;
+            std::vector<float> LeftAngle, RightAngle;
+        };
+        struct RodColumns {
+            std::vector<uint32_t> Element;
+            std::vector<float> AX, AY;
+            std::vector<float> BX, BY;
+        };
+        struct PolygonColumns {
+            std::vector<uint32_t> Element;
+            std::vector<float> X, Y;
+            std::vector<float> Rotation;
+            std::vector<float> Scale;
+            // points of polygon i are [PointStart[i], PointStart[i + 1])
+            std::vector<uint32_t> PointStart;
+            std::vector<float> PointX, PointY;
+        };
+        struct PositionColumns {
+            std::vector<uint32_t> Element;
+            std::vector<float> X, Y;
+        };
+        struct EmitterColumns {
+            std::vector<uint32_t> Element;
+            std::vector<float> X, Y;
+            std::vector<float> Rotation;
+        };
+        // GenericData::mRotation of the elements that have an image or a rotation, 0 when the flag is not set
+        struct ImageColumns {
+            std::vector<uint32_t> Element;
+            std::vector<float> Rotation;
+        };
+        // inline movement links, Depth counts sub movements. unset values are 0, writing one back sets its flag
+        struct MovementColumns {
+            std::vector<uint32_t> Element;
+            std::vector<uint8_t> Depth;
+            std::vector<float> X, Y;  // anchor
+            std::vector<int8_t> Shape;  // MovementInfo::mMovementShape, negative runs backwards
+            std::vector<float> MoveRotation, Rotation;
+            std::vector<float> Radius1, Radius2;  // rounded back to int16 when applied
+            std::vector<float> SubOffsetX, SubOffsetY;
+        };
+        struct Geometry {
+            CircleColumns Circles;
+            BrickColumns Bricks;
+            RodColumns Rods;
+            PolygonColumns Polygons;
+            PositionColumns Teleporters;
+            EmitterColumns Emitters;
+            ImageColumns Images;
+            MovementColumns Movements;
+        };
+
+        // x' = A * x + B * y + X
+        // y' = C * x + D * y + Y
+        // similarity transforms only (translation, rotation, uniform scale, mirror)
+        struct Transform {
+            double A = 1., B = 0.;
+            double C = 0., D = 1.;
+            double X = 0., Y = 0.;
+        };
+
+        // MovementInfo::mType. 10 and 13 to 15 are unknown and hold still
+        enum class MovementShape : uint8_t {
+            None = 0,
+            VerticalCycle = 1,
+            HorizontalCycle = 2,
+            Circle = 3,
+            HorizontalInfinity = 4,
+            VerticalInfinity = 5,
+            HorizontalArc = 6,
+            VerticalArc = 7,
+            Rotate = 8,
+            RotateBackAndForth = 9,
+            VerticalWrap = 11,
+            HorizontalWrap = 12
+        };
+
+        // how an element's movement was flattened
+        enum class MotionStatus : uint8_t {
+            None = 0,  // not moving, or not asked for
+            Ok = 1,
+            UnknownShape = 2,  // rows with shapes that are not understood hold still at their anchor
+            BrokenLink = 3,  // a reference to a movement that does not exist, the chain stops before it
+            LinkLoop = 4  // references that loop, the chain stops where it would repeat
+        };
+
+        // one row per inline movement, an element's rows consecutive with its own first. times are in ticks
+        struct MotionColumns {
+            std::vector<uint32_t> Element;
+            std::vector<MovementShape> Shape;
+            std::vector<float> AnchorX, AnchorY;
+            std::vector<float> Period;  // ticks of motion per cycle, pauses not included. 0 holds the start phase
+            std::vector<float> Offset;  // ticks added to the time
+            std::vector<float> StartPhase;  // turns
+            std::vector<float> Direction;  // 1 or -1
+            std::vector<float> Radius1, Radius2;
+            std::vector<float> MaxAngle;  // degrees
+            std::vector<float> Rotation;  // turns the whole shape, degrees
+            std::vector<float> SubOffsetX, SubOffsetY;  // added to the position when the row has a sub movement
+            // motion tick each pause starts at and how long it holds, PauseAt1 <= PauseAt2
+            std::vector<float> PauseAt1, Pause1;
+            std::vector<float> PauseAt2, Pause2;
+            std::vector<MotionStatus> Status;  // one per Level::Elements, not per row
+        };
+
+        // where the moving elements are over a batch of times. X[e * Times.size() + k] is Element[e] at Times[k]
+        struct MotionTracks {
+            std::vector<uint32_t> Element;
+            std::vector<float> Times;
+            std::vector<float> X, Y;
+            std::vector<float> Angle;  // degrees turned by the rotating shapes, 0 for the rest
+        };
+
+        // where an element sits in a level buffer, found without decoding it
+        struct ElementSpan {
+            uint32_t Offset = 0;  // of the magic, from the start of the buffer
+            uint32_t Size = 0;  // whole element, carried elements included
+            int32_t Magic = 0;
+            LevelEntryType Type = Unknown;  // Unknown unless Magic is 1
+            GenericDataFlags Flags{};
+            uint32_t MovementOffset = 0;
+            uint32_t MovementSize = 0;  // 0 when the element has no movement link
+            uint32_t EntryOffset = 0;
+            int32_t Carried = -1;  // teleporters: index into LevelIndex::Carried of the element they carry
+        };
+
+        struct LevelIndex {
+            bool valid = false;
+            uint32_t version{};
+            uint8_t sync_f{};
+            uint32_t entries{};
+            std::vector<ElementSpan> Elements;  // top level, in file order
+            std::vector<ElementSpan> Carried;  // elements carried by teleporters, a carrier comes after its element
+        };
+
+        // Removed bytes at Offset of the source element become Bytes, on field boundaries
+        struct ByteDelta {
+            uint32_t Offset = 0;
+            uint32_t Removed = 0;
+            std::vector<uint8_t> Bytes;
+        };
+
+        enum class PatchOp : uint8_t {
+            Copy = 0,  // Count source elements from Source on, unchanged
+            Modify = 1,  // source element Source with Deltas applied
+            Insert = 2  // a new element, Bytes is its encoding
+        };
+
+        struct PatchStep {
+            PatchOp Op = PatchOp::Copy;
+            uint32_t Source = 0;
+            uint32_t Count = 0;
+            // bytes of the source elements in the source buffer, they must span exactly those elements
+            uint32_t Offset = 0;
+            uint32_t Size = 0;
+            std::vector<ByteDelta> Deltas{};
+            std::vector<uint8_t> Bytes{};
+        };
+
+        // steps give the target's elements in order. SourceSize and SourceHash pin the source buffer
+        struct LevelPatch {
+            bool valid = false;
+            uint32_t version{};
+            uint8_t sync_f{};
+            uint32_t SourceSize = 0;
+            uint64_t SourceHash = 0;
+            uint32_t SourceCount = 0;
+            std::vector<PatchStep> Steps{};
         };
     }
 
@@ -669,28 +902,762 @@ namespace Peggle {
         static LevelTypes::Level LoadLevel(const std::filesystem::path& path);
         static LevelTypes::Level LoadLevel(const Pak& pak, const std::filesystem::path& path);
 
-        static LevelTypes::Element CloneElement(const LevelTypes::Element& element);
+        // deep copy of an element into lvl's arena, the copy is dirty
+        static LevelTypes::Element CloneElement(LevelTypes::Level& lvl, const LevelTypes::Element& element);
+        // deep copy with its own storage, clean elements stay clean
+        static LevelTypes::Level CloneLevel(const LevelTypes::Level& lvl);
         static LevelTypes::RodEntry* AccessRod(LevelTypes::Entry& entry);
         static LevelTypes::PolygonEntry* AccessPolygon(LevelTypes::Entry& entry);
         static LevelTypes::CircleEntry* AccessCircle(LevelTypes::Entry& entry);
         static LevelTypes::BrickEntry* AccessBrick(LevelTypes::Entry& entry);
         static LevelTypes::TeleportEntry* AccessTeleporter(LevelTypes::Entry& entry);
         static LevelTypes::EmitterEntry* AccessEmitter(LevelTypes::Entry& entry);
+        // entry of the element if it is of that type, marks the element dirty
+        static LevelTypes::RodEntry* AccessRod(LevelTypes::Element& element);
+        static LevelTypes::PolygonEntry* AccessPolygon(LevelTypes::Element& element);
+        static LevelTypes::CircleEntry* AccessCircle(LevelTypes::Element& element);
+        static LevelTypes::BrickEntry* AccessBrick(LevelTypes::Element& element);
+        static LevelTypes::TeleportEntry* AccessTeleporter(LevelTypes::Element& element);
+        static LevelTypes::EmitterEntry* AccessEmitter(LevelTypes::Element& element);
+
+        // copy a string into level storage so it can be assigned to one of the level's string fields
+        static std::string_view StoreString(LevelTypes::Level& lvl, std::string_view str);
+        // field = StoreString(lvl, str). mark the element dirty
+        static void SetString(LevelTypes::Level& lvl, std::string_view& field, std::string_view str);
+        // allocate an entry (and its polygon points) from lvl's arena, it lives as long as the level
+        static LevelTypes::Entry* CreateEntry(LevelTypes::Level& lvl, LevelTypes::LevelEntryType type);
+        // arena of lvl, for teleporter elements and sub movements added by hand
+        static std::pmr::memory_resource* GetArena(LevelTypes::Level& lvl);
 
         static FileRef BuildLevel(const LevelTypes::Level& lvl);
+        // mark an element as edited for BuildLevelIncremental (Access*(Element&) and the level edits do this)
+        static void MarkDirty(LevelTypes::Element& element);
+        // BuildLevel that copies clean elements' loaded bytes, without verify unmarked edits are lost
+        static FileRef BuildLevelIncremental(const LevelTypes::Level& lvl, bool verify = true);
+
+        // offset, size, type and flags of every element without decoding. throws if the buffer ends early
+        static LevelTypes::LevelIndex IndexLevel(const void* buf, uint32_t size);
+        static LevelTypes::LevelIndex IndexLevel(const FileRef& lvl);
+
+        // elements match by ID, else by bytes or position. the level overload diffs BuildLevel of each
+        static LevelTypes::LevelPatch DiffLevel(const LevelTypes::Level& from, const LevelTypes::Level& to);
+        static LevelTypes::LevelPatch DiffLevel(const void* from, uint32_t from_size, const void* to, uint32_t to_size);
+        // throws if from is not the patch's source or a step does not fit it
+        static FileRef ApplyPatch(const void* from, uint32_t from_size, const LevelTypes::LevelPatch& patch);
+        static FileRef ApplyPatch(const FileRef& from, const LevelTypes::LevelPatch& patch);
+        // compact wire form of a patch, varint encoded
+        static FileRef BuildPatch(const LevelTypes::LevelPatch& patch);
+        // throws on anything that is not a whole patch
+        static LevelTypes::LevelPatch LoadPatch(const void* buf, uint32_t size);
+
+        // gather the geometry of the top level elements into columns
+        static LevelTypes::Geometry ExtractGeometry(const LevelTypes::Level& lvl);
+        // write (edited) columns back to the elements they came from. polygons keep their point count
+        static void ApplyGeometry(LevelTypes::Level& lvl, const LevelTypes::Geometry& geometry);
+
+        // flatten the movements of the top level elements, references resolved. never throws, see Status
+        static LevelTypes::MotionColumns ExtractMotion(const LevelTypes::Level& lvl);
+        // only the elements flagged in elements, the rest keep MotionStatus::None
+        static LevelTypes::MotionColumns ExtractMotion(const LevelTypes::Level& lvl, const std::vector<bool>& elements);
+        // position of every moving element at each of times (ticks)
+        static LevelTypes::MotionTracks EvaluateMotion(const LevelTypes::MotionColumns& motion, const std::vector<float>& times);
+        // where an element on this movement is at time t
+        static LevelTypes::Point EvaluateMovement(const LevelTypes::MovementLink& link, float t);
+
+        static LevelTypes::Transform TranslateTransform(double x, double y);
+        static LevelTypes::Transform ScaleTransform(double scale);
+        // degrees, multiples of 90 are exact
+        static LevelTypes::Transform RotateTransform(double degrees);
+        // mirror_x flips x (across the vertical axis), mirror_y flips y
+        static LevelTypes::Transform MirrorTransform(bool mirror_x, bool mirror_y);
+        // first, then second
+        static LevelTypes::Transform ComposeTransform(const LevelTypes::Transform& first, const LevelTypes::Transform& second);
+        static LevelTypes::Transform InvertTransform(const LevelTypes::Transform& transform);
+        // move, scale and turn every position, size, angle and movement. compose first to transform once
+        static void TransformGeometry(LevelTypes::Geometry& geometry, const LevelTypes::Transform& transform);
+        static void TransformLevel(LevelTypes::Level& lvl, const LevelTypes::Transform& transform);
+
+        // f on every levels\*.dat across threads (0 = one per core), writes back the ones it returns true for
+        static std::vector<std::string> TransformPak(Pak& pak, const std::function<bool(const std::string& path, LevelTypes::Level& lvl)>& f, unsigned threads = 0);
+
+        // every field of the level as compact json, LoadLevelJson gives it back byte for byte
+        static std::string BuildLevelJson(const LevelTypes::Level& lvl);
+        // appends to out, so one buffer can be reused across levels
+        static void BuildLevelJson(const LevelTypes::Level& lvl, std::string& out);
+        // parse json straight into a level, unknown keys skipped. throws on anything malformed
+        static LevelTypes::Level LoadLevelJson(std::string_view json);
+        // BuildLevelJson of every levels\*.dat by path, across threads (0 = one per core)
+        static std::map<std::string, std::string> BuildPakJson(Pak& pak, unsigned threads = 0);
+    };
+
+    // level that decodes an element the first time it is asked for. not thread safe
+    class LazyLevel {
+    public:
+        // copies the buffer
+        LazyLevel(const void* buf, uint32_t size);
+        explicit LazyLevel(const FileRef& lvl);
+
+        [[nodiscard]]
+        const LevelTypes::LevelIndex& GetIndex() const;
+        [[nodiscard]]
+        size_t GetElementCount() const;
+        [[nodiscard]]
+        const LevelTypes::ElementSpan& GetSpan(size_t i) const;
+        // decoded element i, valid for the life of the lazy level
+        LevelTypes::Element& GetElement(size_t i);
+        [[nodiscard]]
+        bool IsDecoded(size_t i) const;
+        // decode whatever is left and return the full level, sharing this one's storage and elements
+        LevelTypes::Level Materialize();
     private:
-        static void CloneRod(LevelTypes::Entry& entry, LevelTypes::RodEntry* dest);
-        static void ClonePolygon(LevelTypes::Entry& entry, LevelTypes::PolygonEntry* dest);
-        static void CloneCircle(LevelTypes::Entry& entry, LevelTypes::CircleEntry* dest);
-        static void CloneBrick(LevelTypes::Entry& entry, LevelTypes::BrickEntry* dest);
-        static void CloneTeleporter(LevelTypes::Entry& entry, LevelTypes::TeleportEntry* dest);
-        static void CloneEmitter(LevelTypes::Entry& entry, LevelTypes::EmitterEntry* dest);
-        static LevelTypes::GenericData CloneGenericData(const LevelTypes::GenericData& generic);
-        static LevelTypes::MovementLink CloneMovementLink(const LevelTypes::MovementLink& movement);
+        std::shared_ptr<LevelTypes::LevelStorage> Storage;
+        LevelTypes::LevelIndex Index;
+        std::vector<LevelTypes::Element> Elements;
+        std::vector<bool> Decoded;
     };
 
 #pragma endregion
 
+/// Spatial Index ///
+
+    namespace SpatialTypes {
+        struct Box {
+            float MinX, MinY;
+            float MaxX, MaxY;
+        };
+        struct Nearest {
+            uint32_t Element;
+            float Distance;  // 0 when the point is inside the shape
+        };
+    }
+
+    // uniform grid over the bounding boxes of a level's shapes, by index into Level::Elements
+    class SpatialIndex {
+    public:
+        // cell_size <= 0 picks one from the element sizes
+        explicit SpatialIndex(const LevelTypes::Level& lvl, float cell_size = 0.f);
+
+        // re-read one element after it moved, changed shape, or was added to the end of Elements
+        void Update(const LevelTypes::Level& lvl, uint32_t element);
+        // drop one element from the index, indices of the other elements are kept
+        void Remove(uint32_t element);
+
+        [[nodiscard]]
+        // elements overlapping the box, in index order
+        std::vector<uint32_t> QueryBox(const SpatialTypes::Box& box) const;
+        [[nodiscard]]
+        // elements overlapping the circle, in index order
+        std::vector<uint32_t> QueryCircle(float x, float y, float radius) const;
+        [[nodiscard]]
+        // closest element to the point, only elements of the given type unless it is Unknown
+        std::optional<SpatialTypes::Nearest> QueryNearest(float x, float y, LevelTypes::LevelEntryType type = LevelTypes::Unknown) const;
+        [[nodiscard]]
+        // every pair of overlapping elements (first < second), sorted
+        std::vector<std::pair<uint32_t, uint32_t>> QueryOverlaps() const;
+
+    private:
+        struct Item {
+            bool Indexed = false;
+            // covers too many cells for the grid, in Large instead
+            bool Large = false;
+            LevelTypes::LevelEntryType Type = LevelTypes::Unknown;
+            SpatialTypes::Box Bounds{};
+            // circle shape, when Type is Circle
+            float X = 0.f, Y = 0.f, Radius = 0.f;
+        };
+        float CellSize;
+        std::vector<Item> Items;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> Cells;
+        std::vector<uint32_t> Large;
+        // cell range ever touched by the grid, bounds the nearest neighbour search
+        int32_t MinCellX = 0, MinCellY = 0, MaxCellX = -1, MaxCellY = -1;
+
+        void Insert(uint32_t element);
+        void Erase(uint32_t element);
+    };
+
+/// Collision ///
+
+    namespace CollisionTypes {
+        struct Segment {
+            LevelTypes::Point A, B;
+        };
+        struct Triangle {
+            LevelTypes::Point A, B, C;
+        };
+        // outline and fill of one element in level coordinates, rods have no fill
+        struct Shape {
+            uint32_t Element = 0;
+            LevelTypes::LevelEntryType Type = LevelTypes::Unknown;
+            SpatialTypes::Box Bounds{};
+            uint32_t FirstSegment = 0, SegmentCount = 0;  // into BakedLevel::Segments
+            uint32_t FirstTriangle = 0, TriangleCount = 0;  // into BakedLevel::Triangles
+            // circles keep their exact shape too
+            float X = 0.f, Y = 0.f, Radius = 0.f;
+        };
+        struct BakedLevel {
+            std::vector<Shape> Shapes;  // elements with a shape, in index order
+            std::vector<Segment> Segments;
+            std::vector<Triangle> Triangles;
+        };
+    }
+
+    // collision outlines of a level's shapes per element, Refresh rebakes the ones whose shape changed
+    class CollisionCache {
+    public:
+        // bring the cache in line with lvl, returns how many elements were baked
+        size_t Refresh(const LevelTypes::Level& lvl);
+        // bake element again on the next Refresh even if it looks unchanged
+        void Invalidate(uint32_t element);
+        void Clear();
+
+        [[nodiscard]]
+        // as of the last Refresh
+        const CollisionTypes::BakedLevel& GetBaked() const;
+
+    private:
+        struct Baked {
+            uint64_t Key = 0;
+            bool HasShape = false;
+            CollisionTypes::Shape Shape{};
+            std::vector<CollisionTypes::Segment> Segments;
+            std::vector<CollisionTypes::Triangle> Triangles;
+        };
+        std::vector<Baked> Elements;
+        std::vector<uint32_t> Invalid;
+        CollisionTypes::BakedLevel Flat;
+    };
+
+/// Simulation ///
+
+    namespace SimulationTypes {
+        // the board and the ball. units are level units and ticks, +y points down
+        struct Physics {
+            float BallRadius = 10.f;
+            float Gravity = .05f;  // per tick per tick
+            // kept share of the speed along and across the hit normal, unless mBouncy/mRolly are set
+            float Restitution = .8f;
+            float Friction = 1.f;
+            // ball speed never goes above this, elements with hasMaxBounceVelocity cap it lower when hit
+            float MaxSpeed = 20.f;
+            // walls on three sides, the ball is gone once it drops below Bottom
+            float Left = 0.f, Right = 800.f;
+            float Top = 0.f, Bottom = 600.f;
+            // stuck: moved less than its radius in StuckTicks, or still going after MaxTicks
+            uint32_t StuckTicks = 100;
+            uint32_t MaxTicks = 3000;
+        };
+        // Count shots uniformly over [MinAngle, MaxAngle] degrees, in Bins ranges
+        struct Shots {
+            float LaunchX = 400.f, LaunchY = 40.f;
+            float MinAngle = 10.f, MaxAngle = 170.f;
+            float Speed = 8.f;  // per tick
+            uint32_t Count = 10000;
+            uint32_t Bins = 32;
+            uint64_t Seed = 0;
+        };
+        struct ShotHistogram {
+            std::vector<uint32_t> Pegs;  // elements with peg info and a shape, in index order
+            uint32_t Bins = 0;
+            std::vector<uint32_t> Shots;  // per bin
+            // Hits[peg * Bins + bin] counts the shots of the bin that touched Pegs[peg] at least once
+            std::vector<uint32_t> Hits;
+            uint32_t Stuck = 0;
+            uint64_t Ticks = 0;  // simulated over all shots
+        };
+    }
+
+    // headless ball physics over a CollisionCache, threads (0 = one per core) do not change the results
+    class ShotSimulator {
+    public:
+        explicit ShotSimulator(const LevelTypes::Level& lvl, const SimulationTypes::Physics& physics = {});
+
+        [[nodiscard]]
+        SimulationTypes::ShotHistogram Run(const SimulationTypes::Shots& shots, unsigned threads = 0) const;
+
+    private:
+        // a circle (A is the center) or a segment from A along D, hit response from Surfaces[Surface]
+        struct Primitive {
+            float AX, AY;
+            float DX, DY;
+            float Radius;  // circles
+            float InvLength2;  // segments, 1 / |D|^2
+            uint32_t Surface;
+            bool Circle;
+        };
+        struct Surface {
+            float Restitution, Friction, MaxSpeed;
+            int32_t Peg;  // into ShotHistogram::Pegs, -1 for none
+        };
+        SimulationTypes::Physics World;
+        std::vector<uint32_t> Pegs;
+        std::vector<Surface> Surfaces;
+        std::vector<Primitive> Primitives;
+        // primitives within a ball radius of cell c are CellItems[CellStart[c] .. CellStart[c + 1])
+        float CellSize = 0.f;
+        uint32_t Columns = 0, Rows = 0;
+        std::vector<uint32_t> CellStart;
+        std::vector<uint32_t> CellItems;
+    };
+
+/// Query ///
+
+    namespace QueryTypes {
+        // row i is Level::Elements[i]. Peg is mType | mFlags << 8 | has peg info << 16
+        struct ElementColumns {
+            std::vector<uint32_t> Flags;  // GenericDataFlags::asInt
+            std::vector<uint32_t> Type;  // eType
+            std::vector<uint32_t> Peg;
+        };
+        enum class Column : uint8_t {
+            Flags,
+            Type,
+            Peg
+        };
+        // (column & Mask) == Value, or != with Negate
+        struct Term {
+            Column Field = Column::Flags;
+            uint32_t Mask = 0;
+            uint32_t Value = 0;
+            bool Negate = false;
+        };
+        // rows matching every term of at least one clause. a clause without terms matches every row
+        struct Predicate {
+            std::vector<std::vector<Term>> AnyOf;
+        };
+        struct PakMatch {
+            std::string Path;
+            std::vector<uint32_t> Elements;
+        };
+    }
+
+    // predicate compiled to per column masks for scanning element columns
+    class ElementQuery {
+    public:
+        explicit ElementQuery(const QueryTypes::Predicate& predicate);
+
+        // every flag set in flags is set
+        static QueryTypes::Term HasFlags(LevelTypes::GenericDataFlags flags);
+        // no flag set in flags is set
+        static QueryTypes::Term LacksFlags(LevelTypes::GenericDataFlags flags);
+        static QueryTypes::Term TypeIs(LevelTypes::LevelEntryType type);
+        // only elements with peg info match these two
+        static QueryTypes::Term PegTypeIs(uint8_t type);
+        static QueryTypes::Term HasPegFlags(uint8_t flags);
+
+        static QueryTypes::ElementColumns ExtractColumns(const LevelTypes::Level& lvl);
+        // straight from a level buffer, only the heads of elements with peg info are decoded
+        static QueryTypes::ElementColumns ExtractColumns(const void* buf, uint32_t size);
+
+        [[nodiscard]]
+        // matching rows, ascending
+        std::vector<uint32_t> Run(const QueryTypes::ElementColumns& columns) const;
+        [[nodiscard]]
+        std::vector<uint32_t> Run(const LevelTypes::Level& lvl) const;
+        [[nodiscard]]
+        // every levels\*.dat with a match, in path order, across threads (0 = one per core)
+        std::vector<QueryTypes::PakMatch> Run(Pak& pak, unsigned threads = 0) const;
+
+    private:
+        struct Clause {
+            uint32_t Mask[3] = {};  // by Column
+            uint32_t Value[3] = {};
+            std::vector<QueryTypes::Term> Negated;
+        };
+        std::vector<Clause> Clauses;
+    };
+
+/// Strings ///
+
+    namespace StringTypes {
+        // index into a StringTable, 0 is the empty string
+        using Handle = uint32_t;
+        enum class StringField : uint8_t {
+            Image,
+            ID,
+            Logic,
+            EmitterImage,
+            EmitImage,
+            EmitterMainVar2
+        };
+        // string handles of a level's elements, row i is Level::Elements[i]. 0 when there is none
+        struct LevelStrings {
+            std::string Name;
+            std::vector<Handle> Image, ID, Logic;
+            std::vector<Handle> EmitterImage, EmitImage, EmitterMainVar2;
+        };
+        struct Use {
+            uint32_t Level;
+            uint32_t Element;
+            StringField Field;
+            // teleporter nesting, 0 for the element itself
+            uint8_t Depth;
+        };
+    }
+
+    // one copy of every distinct string over a set of levels, handed out as handles
+    class StringTable {
+    public:
+        StringTable();
+
+        StringTypes::Handle Intern(std::string_view str);
+        [[nodiscard]]
+        std::optional<StringTypes::Handle> Find(std::string_view str) const;
+        [[nodiscard]]
+        // stays valid for the life of the table
+        std::string_view GetString(StringTypes::Handle handle) const;
+        [[nodiscard]]
+        // distinct strings, the empty one included
+        size_t GetCount() const;
+        [[nodiscard]]
+        // characters kept for them
+        size_t GetBytes() const;
+
+        // intern the strings of lvl's elements, carried ones included, returns the level's number
+        uint32_t AddLevel(const std::string& name, const LevelTypes::Level& lvl);
+        // every levels\*.dat, loaded across a pool of threads (0 = one per core) and added in path order
+        void AddPak(Pak& pak, unsigned threads = 0);
+
+        [[nodiscard]]
+        size_t GetLevelCount() const;
+        [[nodiscard]]
+        const StringTypes::LevelStrings& GetLevel(uint32_t level) const;
+        [[nodiscard]]
+        // in the order they were added, nothing for the empty string
+        const std::vector<StringTypes::Use>& GetUses(StringTypes::Handle handle) const;
+        [[nodiscard]]
+        // ascending
+        std::vector<uint32_t> GetLevelsUsing(StringTypes::Handle handle) const;
+
+    private:
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> Arena;
+        std::unordered_map<std::string_view, StringTypes::Handle> Lookup;
+        std::vector<std::string_view> Strings;
+        std::vector<std::vector<StringTypes::Use>> Uses;
+        std::vector<StringTypes::LevelStrings> Levels;
+        size_t Bytes = 0;
+    };
+
+/// Snapshot ///
+
+    // decoded levels kept as native images by name and source hash. call Save when IsDirty. not thread safe
+    class LevelSnapshot {
+    public:
+        LevelSnapshot() = default;
+        // a missing or foreign file opens empty
+        explicit LevelSnapshot(const std::filesystem::path& path);
+        void Save(const std::filesystem::path& path) const;
+
+        [[nodiscard]]
+        // name is in the snapshot for exactly these bytes
+        bool IsFresh(const std::string& name, const void* buf, uint32_t size) const;
+        // the level buf decodes to, from the snapshot when fresh. without verify a same size record is fresh
+        LevelTypes::Level Load(const std::string& name, const void* buf, uint32_t size, bool verify = true);
+        LevelTypes::Level Load(const std::string& name, const FileRef& lvl, bool verify = true);
+        // keep lvl as what buf decodes to
+        void Store(const std::string& name, const void* buf, uint32_t size, const LevelTypes::Level& lvl);
+        void Remove(const std::string& name);
+
+        [[nodiscard]]
+        // changed since it was opened or saved, or opened from a file that needs writing again
+        bool IsDirty() const;
+        [[nodiscard]]
+        size_t GetLevelCount() const;
+
+    private:
+        struct Record {
+            uint64_t SourceHash = 0;
+            uint32_t SourceSize = 0;
+            uint32_t Version = 0;
+            uint8_t Sync = 0;
+            uint32_t Entries = 0;
+            uint32_t ElementCount = 0;
+            uint64_t BlobSize = 0;
+            // ElementCount raw element fields, then BlobSize bytes of what they point at, inside Owner
+            const uint8_t* Image = nullptr;
+            std::shared_ptr<const std::vector<uint8_t>> Owner;
+            // blob offsets of the pointers, strings and entries a load redoes, found by the first load
+            std::vector<uint32_t> PointerSlots, StringSlots, EntrySlots;
+            bool Indexed = false;
+        };
+        std::map<std::string, Record> Records;
+        mutable bool Dirty = false;
+
+        // a fresh level out of an indexed record
+        LevelTypes::Level load(const Record& record) const;
+        void Store(const std::string& name, uint64_t hash, uint32_t size, const LevelTypes::Level& lvl);
+    };
+
+/// Particles ///
+
+    namespace ParticleTypes {
+        // times are in seconds, positions in level units (+y points down) and angles in degrees
+        struct Settings {
+            float TickSeconds = .01f;
+            // alive at once over every emitter, spawns past it are dropped
+            uint32_t MaxParticles = 1u << 20;
+            uint64_t Seed = 0;
+        };
+        // the alive particles, one column per property. Emitter indexes ParticleSimulator's emitters
+        struct Particles {
+            std::vector<uint32_t> Emitter;
+            std::vector<float> X, Y;
+            std::vector<float> VX, VY;  // per second
+            std::vector<float> AX, AY;  // per second per second
+            std::vector<float> Age, Life;
+            std::vector<float> Rotation, RotationVelocity;
+            std::vector<float> Scale, ScaleVelocity;
+            std::vector<float> Red, Green, Blue;
+            // BaseOpacity faded in over FadeIn and out from FadeOutAt to Life
+            std::vector<float> Opacity;
+            std::vector<float> BaseOpacity, FadeIn, FadeOutAt;
+        };
+        struct ParticleStats {
+            uint64_t Ticks = 0;
+            uint32_t Alive = 0;
+            uint32_t Peak = 0;
+            uint64_t PeakTick = 0;  // first tick (from 1) that ended with Peak alive
+            uint64_t Spawned = 0;
+            uint64_t Dropped = 0;  // held back by Settings::MaxParticles
+            std::vector<uint32_t> EmitterPeak;
+        };
+    }
+
+    // headless particles of a level's top level emitters, the same for the same level and Settings::Seed
+    class ParticleSimulator {
+    public:
+        explicit ParticleSimulator(const LevelTypes::Level& lvl, const ParticleTypes::Settings& settings = {});
+
+        void Step(uint32_t ticks = 1);
+        // back to no particles at tick 0
+        void Reset();
+
+        [[nodiscard]]
+        const ParticleTypes::Particles& GetParticles() const;
+        [[nodiscard]]
+        const ParticleTypes::ParticleStats& GetStats() const;
+        [[nodiscard]]
+        uint32_t GetEmitterCount() const;
+        [[nodiscard]]
+        // index of an emitter's element in the level
+        uint32_t GetElement(uint32_t emitter) const;
+
+    private:
+        // a variable float: Low when fixed, uniform between Low and High when random
+        struct Range {
+            float Low = 0.f, High = 0.f;
+        };
+        // what an emitter spawns, read out of its entry once
+        struct Source {
+            uint32_t Element = 0;
+            int32_t Track = -1;  // into the tracks of Motion, -1 when it does not move
+            float X = 0.f, Y = 0.f;
+            float Width = 0.f, Height = 0.f;  // random start box, 0 without hasRandomStartPosition
+            Range Rate;  // per second
+            Range Area;
+            uint32_t MaxQuantity = 0;  // alive at once, 0 for no limit
+            float Life = 0.f, FadeIn = 0.f, FadeOutAt = 0.f;
+            bool Velocity = false;
+            Range MinVX, MinVY;
+            float MaxVX = 0.f, MaxVY = 0.f;
+            float AX = 0.f, AY = 0.f;
+            bool Direction = false;
+            float Speed = 0.f, RandomSpeed = 0.f, DirectionAcceleration = 0.f;
+            float Angle = 0.f, RandomAngle = 0.f;
+            bool Rotating = false;
+            float Rotation = 0.f;
+            Range StartRotation, RotationVelocity;
+            bool Scaling = false;
+            Range MinScale, ScaleVelocity;
+            float MaxRandScale = 0.f;
+            bool Coloured = false;
+            Range Red, Green, Blue;
+            bool Fading = false;
+            Range Opacity;
+            uint64_t Rng = 0;
+            double Pending = 0.;  // particles owed, less than one after every tick
+        };
+        ParticleTypes::Settings Options;
+        LevelTypes::MotionColumns Motion;  // rows of the moving emitters only
+        std::vector<Source> Sources;
+        std::vector<uint32_t> Alive;  // per emitter
+        ParticleTypes::Particles State;
+        ParticleTypes::ParticleStats Stats;
+        std::vector<uint32_t> Kept;  // scratch for dropping dead particles
+
+        void Tick(const LevelTypes::MotionTracks& tracks, uint32_t k);
+        void Spawn(Source& source, uint32_t emitter, float x, float y, uint32_t count);
+    };
+
+/// Thumbnails ///
+
+    namespace ThumbnailTypes {
+        // colors are 0xAARRGGBB like LevelTypes::ColorARGB
+        struct Style {
+            uint32_t Width = 200, Height = 150;
+            // level area drawn, scaled to fit the image and centered
+            SpatialTypes::Box View = {0.f, 0.f, 800.f, 600.f};
+            // samples per pixel along each axis
+            uint32_t Samples = 2;
+            uint32_t Background = 0xFF141C2C;
+            // pegs by PegInfo::mType, 1 to 4 are blue, orange, green and purple. other types use [0]
+            uint32_t PegColors[5] = {0xFFB4B4B4, 0xFF3C78F0, 0xFFF08228, 0xFF3CC850, 0xFFA050DC};
+            // the rest, unless they have hasSolidColor
+            uint32_t Fill = 0xFF8C8C96;
+            // pixels. outlines are drawn in mOutlineColor when set, a darker fill otherwise
+            float OutlineWidth = 1.f;
+            float RodWidth = 2.f;
+        };
+        struct Image {
+            uint32_t Width = 0, Height = 0;
+            std::vector<uint8_t> Pixels{};  // RGBA, rows from the top
+        };
+    }
+
+    // draws levels the way CollisionCache sees them, in tiles across threads (0 = one per core)
+    class Thumbnailer {
+    public:
+        explicit Thumbnailer(const ThumbnailTypes::Style& style = {});
+
+        [[nodiscard]]
+        ThumbnailTypes::Image Render(const LevelTypes::Level& lvl, unsigned threads = 1) const;
+        // every level of pak, by path, one level per thread at a time
+        std::map<std::string, ThumbnailTypes::Image> RenderPak(Pak& pak, unsigned threads = 0) const;
+
+        // png, the pixels deflated with fixed codes
+        static std::vector<uint8_t> EncodePng(const ThumbnailTypes::Image& image);
+
+    private:
+        ThumbnailTypes::Style Look;
+    };
+
+/// Statistics ///
+
+    namespace StatsTypes {
+        // counts over the top level elements of a level
+        struct LevelStats {
+            uint32_t Elements = 0;
+            uint32_t Rods = 0, Polygons = 0, Circles = 0, Bricks = 0, Teleporters = 0, Emitters = 0, Other = 0;
+            // elements with peg info by PegInfo::mType, 1 to 4 are blue, orange, green and purple
+            uint32_t Pegs = 0;
+            uint32_t Blue = 0, Orange = 0, Green = 0, Purple = 0, OtherPegs = 0;
+            uint32_t Crumbling = 0, Variable = 0;
+            // by hasMovementInfo
+            uint32_t Moving = 0, Static = 0;
+            // shape bounds as SpatialIndex boxes them, all 0 without shapes
+            uint32_t Shapes = 0;
+            SpatialTypes::Box Bounds{};
+        };
+        struct StatsTable {
+            std::vector<std::string> Paths;
+            std::vector<LevelStats> Levels;  // Levels[i] is Paths[i]
+            // every count summed, Bounds around every level's
+            LevelStats Total;
+        };
+    }
+
+    // element statistics of level buffers, read in one pass without building a level
+    class LevelStatistics {
+    public:
+        static StatsTypes::LevelStats Collect(const LevelTypes::Level& lvl);
+        static StatsTypes::LevelStats Collect(const void* buf, uint32_t size);
+        // every level of pak, in path order, across a pool of threads (0 = one per core)
+        static StatsTypes::StatsTable Collect(Pak& pak, unsigned threads = 0);
+
+        // one header line, then a line per level and one for the total
+        static std::string ToCsv(const StatsTypes::StatsTable& table);
+    };
+
+/// Journal ///
+
+    // undo history of a level as the bytes each edit changed. edit the element list only through the journal
+    // and keep the level alive while it records
+    class LevelJournal {
+    public:
+        explicit LevelJournal(LevelTypes::Level& lvl);
+
+        void Begin();
+        // ends the outermost transaction, it is dropped if it changed nothing
+        void Commit();
+        // undoes what the open transaction did so far and drops it, nested ones included
+        void Rollback();
+
+        // element is copied into the level's storage
+        void Insert(size_t index, const LevelTypes::Element& element);
+        void Remove(size_t index);
+        // element index for changing in place until the transaction ends
+        LevelTypes::Element& Modify(size_t index);
+
+        // false when there is nothing to undo or redo. throw inside a transaction
+        bool Undo();
+        bool Redo();
+        void Clear();
+
+        [[nodiscard]]
+        size_t GetUndoCount() const;
+        [[nodiscard]]
+        size_t GetRedoCount() const;
+        [[nodiscard]]
+        // bytes held by the history, not counting elements that are out of the level
+        size_t GetMemoryUsage() const;
+
+    private:
+        enum EditKind : uint8_t {
+            Inserted,
+            Removed,
+            Modified,
+            Patched  // modified, values only
+        };
+        // Offset is the same on both sides. a run that changes the size is the only one of its edit
+        struct Run {
+            uint32_t Offset = 0;
+            uint32_t BeforeSize = 0, AfterSize = 0;
+            uint32_t Data = 0;  // into Transaction::Bytes, the before bytes then the after bytes
+        };
+        // changed bytes of one field, Offset into one of the element's blocks
+        struct Piece {
+            uint32_t Block = 0;
+            uint32_t Offset = 0, Size = 0;
+            uint32_t Data = 0;  // into Transaction::Bytes, the before bytes then the after bytes
+        };
+        struct Edit {
+            EditKind Kind = Modified;
+            uint32_t Index = 0;
+            // Runs, Pieces or Held from First
+            uint32_t First = 0, Count = 0;
+        };
+        struct Transaction {
+            std::vector<Edit> Edits;
+            std::vector<Run> Runs;
+            std::vector<Piece> Pieces;
+            std::vector<uint8_t> Bytes;
+            std::vector<LevelTypes::Element> Held;
+        };
+        // encoding of an element from before its first Modify in the open transaction
+        struct Pending {
+            uint32_t Index = 0;
+            uint32_t Offset = 0, Size = 0;  // into PendingBytes
+        };
+
+        void Open();
+        void Close();
+        void Settle();
+        void Flush();
+        bool Patch(LevelTypes::Element& element, const uint8_t* before, uint32_t index);
+        void Apply(Transaction& transaction, bool undo);
+        void Encode(const LevelTypes::Element& element, std::vector<uint8_t>& out) const;
+
+        LevelTypes::Level& Lvl;
+        std::vector<Transaction> Done;
+        std::vector<Transaction> Undone;
+        Transaction Current;
+        uint32_t Depth = 0;
+        bool Active = false;
+        std::vector<Pending> Touched;
+        std::vector<uint8_t> PendingBytes;
+        std::vector<uint8_t> Scratch;
+    };
+
 /// Logging ///
 
     enum log_mode_e {
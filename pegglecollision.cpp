@@ -0,0 +1,314 @@
+#include "levelschema.h"
+#include "levelshapes.h"
+#include "libpeggle.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Peggle {
+#pragma region libpeggle_Collision
+
+    namespace CollisionHelpers {
+        using LevelTypes::Point;
+        using CollisionTypes::Segment;
+        using CollisionTypes::Triangle;
+
+        // fnv-1a over the fields a shape is made from
+        struct Key {
+            uint64_t Hash = 0xCBF29CE484222325ull;
+
+            template<typename T>
+            void add(const T& value) {
+                uint8_t bytes[sizeof(T)];
+                memcpy(bytes, &value, sizeof(T));
+                for (const auto b : bytes)
+                    Hash = (Hash ^ b) * 0x100000001B3ull;
+            }
+            void add(const Point& p) {
+                add(p.x);
+                add(p.y);
+            }
+        };
+
+        bool has_shape(const LevelTypes::Element& element) {
+            if (!element.entry)
+                return false;
+            switch (LevelTypes::Entry::GetType(element.entry)) {
+                case LevelTypes::Circle:
+                case LevelTypes::Brick:
+                case LevelTypes::Rod:
+                    return true;
+                case LevelTypes::Polygon:
+                    return !LevelTypes::Entry::GetPolygon(element.entry)->mPoints.empty();
+                default:
+                    return false;
+            }
+        }
+
+        uint64_t shape_key(const LevelTypes::Element& element) {
+            Key key;
+            const auto type = LevelTypes::Entry::GetType(element.entry);
+            key.add(type);
+            switch (type) {
+                case LevelTypes::Circle: {
+                    const auto* circle = LevelTypes::Entry::GetCircle(element.entry);
+                    key.add(circle->mPos);
+                    key.add(circle->mRadius);
+                    break;
+                }
+                case LevelTypes::Brick: {
+                    const auto* brick = LevelTypes::Entry::GetBrick(element.entry);
+                    key.add(brick->mPos);
+                    key.add(brick->mFlagsC.asShort);
+                    key.add(brick->mCurved);
+                    key.add(brick->mCurvedPoints);
+                    key.add(brick->mLeftAngle);
+                    key.add(brick->mRightAngle);
+                    key.add(brick->mSectorAngle);
+                    key.add(brick->mWidth);
+                    key.add(brick->mLength);
+                    key.add(brick->mAngle);
+                    break;
+                }
+                case LevelTypes::Rod: {
+                    const auto* rod = LevelTypes::Entry::GetRod(element.entry);
+                    key.add(rod->mPointA);
+                    key.add(rod->mPointB);
+                    break;
+                }
+                case LevelTypes::Polygon: {
+                    const auto* polygon = LevelTypes::Entry::GetPolygon(element.entry);
+                    key.add(polygon->mFlagsA.asByte);
+                    key.add(polygon->mRotation);
+                    key.add(polygon->mScale);
+                    key.add(polygon->mPos);
+                    key.add(polygon->mPoints.size());
+                    for (const auto& p : polygon->mPoints)
+                        key.add(p);
+                    break;
+                }
+                default:
+                    break;
+            }
+            return key.Hash;
+        }
+
+        // outline through points, closed back to the first
+        void close_loop(const std::vector<Point>& loop, std::vector<Segment>& out) {
+            for (size_t i = 0; i < loop.size(); ++i)
+                out.push_back({loop[i], loop[(i + 1) % loop.size()]});
+        }
+
+        double cross(const Point& o, const Point& a, const Point& b) {
+            return (static_cast<double>(a.x) - o.x) * (static_cast<double>(b.y) - o.y)
+                 - (static_cast<double>(a.y) - o.y) * (static_cast<double>(b.x) - o.x);
+        }
+
+        bool inside_triangle(const Point& p, const Point& a, const Point& b, const Point& c) {
+            return cross(a, b, p) >= 0. && cross(b, c, p) >= 0. && cross(c, a, p) >= 0.;
+        }
+
+        // ear clipping, for the concave polygons levels are full of. falls back to a fan when the loop is not
+        // simple and no ear can be found
+        void triangulate(const std::vector<Point>& loop, std::vector<Triangle>& out) {
+            if (loop.size() < 3)
+                return;
+            double area = 0.;
+            for (size_t i = 0; i < loop.size(); ++i)
+                area += cross({0.f, 0.f}, loop[i], loop[(i + 1) % loop.size()]);
+            std::vector<uint32_t> left(loop.size());
+            for (uint32_t i = 0; i < left.size(); ++i)
+                left[i] = i;
+            if (area < 0.)
+                std::reverse(left.begin(), left.end());  // counter clockwise from here on
+
+            while (left.size() > 3) {
+                bool clipped = false;
+                for (size_t i = 0; i < left.size(); ++i) {
+                    const auto& a = loop[left[(i + left.size() - 1) % left.size()]];
+                    const auto& b = loop[left[i]];
+                    const auto& c = loop[left[(i + 1) % left.size()]];
+                    if (cross(a, b, c) <= 0.)
+                        continue;  // reflex or flat
+                    bool empty = true;
+                    for (const auto j : left) {
+                        const auto& p = loop[j];
+                        if (&p == &a || &p == &b || &p == &c)
+                            continue;
+                        if (inside_triangle(p, a, b, c)) {
+                            empty = false;
+                            break;
+                        }
+                    }
+                    if (!empty)
+                        continue;
+                    out.push_back({a, b, c});
+                    left.erase(left.begin() + static_cast<ptrdiff_t>(i));
+                    clipped = true;
+                    break;
+                }
+                if (!clipped)
+                    break;
+            }
+            for (size_t i = 1; i + 1 < left.size(); ++i)
+                out.push_back({loop[left[0]], loop[left[i]], loop[left[i + 1]]});
+        }
+
+        void bake_circle(const LevelTypes::CircleEntry& circle, CollisionTypes::Shape& shape,
+                         std::vector<Segment>& segments, std::vector<Triangle>& triangles) {
+            shape.X = circle.mPos.x;
+            shape.Y = circle.mPos.y;
+            shape.Radius = std::abs(circle.mRadius);
+            std::vector<Point> loop;
+            loop.reserve(Shapes::circle_sides);
+            Shapes::circle_outline(circle, [&](const Point& p) { loop.push_back(p); });
+            close_loop(loop, segments);
+            for (uint32_t i = 0; i < loop.size(); ++i)
+                triangles.push_back({circle.mPos, loop[i], loop[(i + 1) % loop.size()]});
+        }
+
+        void bake_brick(const LevelTypes::BrickEntry& brick, std::vector<Segment>& segments, std::vector<Triangle>& triangles) {
+            std::vector<Point> loop;
+            Shapes::brick_outline(brick, [&](const Point& p) { loop.push_back(p); });
+            close_loop(loop, segments);
+            // quads between the two sides, a straight brick is the one quad
+            const size_t n = loop.size();
+            for (size_t i = 0; i + 1 < n / 2; ++i) {
+                triangles.push_back({loop[i], loop[i + 1], loop[n - 2 - i]});
+                triangles.push_back({loop[i], loop[n - 2 - i], loop[n - 1 - i]});
+            }
+        }
+
+        void bake_polygon(const LevelTypes::PolygonEntry& polygon, std::vector<Segment>& segments, std::vector<Triangle>& triangles) {
+            std::vector<Point> loop;
+            loop.reserve(polygon.mPoints.size());
+            Shapes::polygon_outline(polygon, [&](const Point& p) { loop.push_back(p); });
+            close_loop(loop, segments);
+            triangulate(loop, triangles);
+        }
+
+        SpatialTypes::Box bounds_of(const std::vector<Segment>& segments) {
+            SpatialTypes::Box box = {segments[0].A.x, segments[0].A.y, segments[0].A.x, segments[0].A.y};
+            for (const auto& s : segments) {
+                for (const auto& p : {s.A, s.B}) {
+                    box.MinX = std::min(box.MinX, p.x);
+                    box.MinY = std::min(box.MinY, p.y);
+                    box.MaxX = std::max(box.MaxX, p.x);
+                    box.MaxY = std::max(box.MaxY, p.y);
+                }
+            }
+            return box;
+        }
+    }
+
+    size_t CollisionCache::Refresh(const LevelTypes::Level& lvl) {
+        std::vector<bool> forced(lvl.Elements.size());
+        for (const auto i : Invalid)
+            if (i < forced.size())
+                forced[i] = true;
+        Invalid.clear();
+
+        // bakes whose element moved to another index are found again by their key
+        std::unordered_map<uint64_t, std::vector<uint32_t>> by_key;
+        bool keyed = false;
+        std::vector<Baked> next(lvl.Elements.size());
+        size_t baked = 0;
+        bool changed = next.size() != Elements.size();
+        for (uint32_t i = 0; i < lvl.Elements.size(); ++i) {
+            const auto& element = lvl.Elements[i];
+            auto& b = next[i];
+            b.HasShape = CollisionHelpers::has_shape(element);
+            if (!b.HasShape) {
+                changed |= i < Elements.size() && Elements[i].HasShape;
+                continue;
+            }
+            b.Key = CollisionHelpers::shape_key(element);
+            if (!forced[i]) {
+                if (i < Elements.size() && Elements[i].HasShape && Elements[i].Key == b.Key) {
+                    b = std::move(Elements[i]);
+                    Elements[i].HasShape = false;
+                    continue;
+                }
+                if (!keyed) {
+                    for (uint32_t j = 0; j < Elements.size(); ++j)
+                        if (Elements[j].HasShape)
+                            by_key[Elements[j].Key].push_back(j);
+                    keyed = true;
+                }
+                // an earlier element may have taken it, those are marked by HasShape going false
+                if (const auto it = by_key.find(b.Key); it != by_key.end()) {
+                    auto& candidates = it->second;
+                    while (!candidates.empty() && !Elements[candidates.back()].HasShape)
+                        candidates.pop_back();
+                    if (!candidates.empty()) {
+                        const auto j = candidates.back();
+                        candidates.pop_back();
+                        b = std::move(Elements[j]);
+                        Elements[j].HasShape = false;
+                        b.Shape.Element = i;
+                        changed = true;
+                        continue;
+                    }
+                }
+            }
+
+            b.Shape = {.Element = i, .Type = LevelTypes::Entry::GetType(element.entry)};
+            switch (b.Shape.Type) {
+                case LevelTypes::Circle:
+                    CollisionHelpers::bake_circle(*LevelTypes::Entry::GetCircle(element.entry), b.Shape, b.Segments, b.Triangles);
+                    break;
+                case LevelTypes::Brick:
+                    CollisionHelpers::bake_brick(*LevelTypes::Entry::GetBrick(element.entry), b.Segments, b.Triangles);
+                    break;
+                case LevelTypes::Rod: {
+                    const auto* rod = LevelTypes::Entry::GetRod(element.entry);
+                    b.Segments.push_back({rod->mPointA, rod->mPointB});
+                    break;
+                }
+                case LevelTypes::Polygon:
+                    CollisionHelpers::bake_polygon(*LevelTypes::Entry::GetPolygon(element.entry), b.Segments, b.Triangles);
+                    break;
+                default:
+                    break;
+            }
+            b.Shape.Bounds = CollisionHelpers::bounds_of(b.Segments);
+            ++baked;
+            changed = true;
+        }
+        Elements = std::move(next);
+
+        if (!changed)
+            return baked;
+        Flat.Shapes.clear();
+        Flat.Segments.clear();
+        Flat.Triangles.clear();
+        for (auto& b : Elements) {
+            if (!b.HasShape)
+                continue;
+            b.Shape.FirstSegment = static_cast<uint32_t>(Flat.Segments.size());
+            b.Shape.SegmentCount = static_cast<uint32_t>(b.Segments.size());
+            b.Shape.FirstTriangle = static_cast<uint32_t>(Flat.Triangles.size());
+            b.Shape.TriangleCount = static_cast<uint32_t>(b.Triangles.size());
+            Flat.Shapes.push_back(b.Shape);
+            Flat.Segments.insert(Flat.Segments.end(), b.Segments.begin(), b.Segments.end());
+            Flat.Triangles.insert(Flat.Triangles.end(), b.Triangles.begin(), b.Triangles.end());
+        }
+        return baked;
+    }
+
+    void CollisionCache::Invalidate(const uint32_t element) {
+        Invalid.push_back(element);
+    }
+
+    void CollisionCache::Clear() {
+        Elements.clear();
+        Invalid.clear();
+        Flat = {};
+    }
+
+    const CollisionTypes::BakedLevel& CollisionCache::GetBaked() const {
+        return Flat;
+    }
+
+#pragma endregion
+}
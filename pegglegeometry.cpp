@@ -0,0 +1,498 @@
+#include "levelschema.h"
+#include "libpeggle.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace Peggle {
+#pragma region libpeggle_Geometry
+
+    namespace GeometryHelpers {
+        // own movement of an element, const or not
+        template<typename E>
+        auto* movement_of(E& element) {
+            return element.flags.hasMovementInfo ? &element.generic.mMovementLink : nullptr;
+        }
+
+        template<typename Columns>
+        void reserve_rows(Columns& columns, const size_t n) {
+            columns.Element.reserve(n);
+            columns.X.reserve(n);
+            columns.Y.reserve(n);
+        }
+
+        // a similarity transform split into what sizes and angles need
+        struct Similarity {
+            double scale;    // applied to radii and lengths
+            double sign;     // -1 when the transform mirrors
+            double degrees;  // rotation, added to angles after the sign
+        };
+
+        Similarity decompose(const LevelTypes::Transform& t) {
+            const double det = t.A * t.D - t.B * t.C;
+            const double sign = det < 0 ? -1. : 1.;
+            const double scale = std::sqrt(std::abs(det));
+            // rotation and scale keep D == A and C == -B, a mirror negates the second column
+            constexpr double eps = 1e-9;
+            if (!(scale > 0.) || std::abs(t.D - sign * t.A) > eps * scale || std::abs(t.C + sign * t.B) > eps * scale)
+                throw std::exception("Transform is not a similarity");
+
+            double degrees = std::atan2(t.C, t.A) * 180. / std::numbers::pi;
+            // keep quarter turns exact
+            if (const double turns = std::round(degrees / 90.); std::abs(degrees / 90. - turns) < eps)
+                degrees = turns * 90.;
+            return {scale, sign, degrees};
+        }
+
+        void transform_points(std::vector<float>& xs, std::vector<float>& ys, const LevelTypes::Transform& t) {
+            Simd::affine(xs.data(), ys.data(), std::min(xs.size(), ys.size()), t.A, t.B, t.C, t.D, t.X, t.Y);
+        }
+        void scale_values(std::vector<float>& vs, const double scale) {
+            Simd::linear(vs.data(), vs.size(), scale, 0.);
+        }
+        void turn_angles(std::vector<float>& vs, const Similarity& s) {
+            Simd::linear(vs.data(), vs.size(), s.sign, s.degrees);
+        }
+        // angles relative to something that already turned with the level only see the mirror
+        void flip_angles(std::vector<float>& vs, const Similarity& s) {
+            Simd::linear(vs.data(), vs.size(), s.sign, 0.);
+        }
+
+        // a mirror flips every movement about the x axis of its shape (its rotation was already turned). shapes
+        // symmetric about it stay, the rest run backwards or have the radius across the axis negated. a radius the
+        // shape does not use goes along so Radius2 keeps following Radius1
+        void mirror_movements(LevelTypes::MovementColumns& m) {
+            using LevelTypes::MovementShape;
+            for (size_t i = 0; i < m.Shape.size(); ++i) {
+                auto& shape = m.Shape[i];
+                switch (static_cast<MovementShape>(std::abs(shape))) {
+                    case MovementShape::VerticalCycle:
+                    case MovementShape::Circle:
+                    case MovementShape::Rotate:
+                    case MovementShape::VerticalArc:
+                    case MovementShape::RotateBackAndForth:
+                        shape = static_cast<int8_t>(-shape);
+                        break;
+                    case MovementShape::HorizontalArc:
+                        // hangs on the other side, backwards keeps the swing
+                        shape = static_cast<int8_t>(-shape);
+                        m.Radius1[i] = -m.Radius1[i];
+                        m.Radius2[i] = -m.Radius2[i];
+                        break;
+                    case MovementShape::VerticalWrap:
+                        m.Radius1[i] = -m.Radius1[i];
+                        m.Radius2[i] = -m.Radius2[i];
+                        break;
+                    case MovementShape::HorizontalInfinity:
+                        m.Radius2[i] = -m.Radius2[i];
+                        break;
+                    case MovementShape::VerticalInfinity:
+                        m.Radius1[i] = -m.Radius1[i];
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        int16_t to_radius(const float v) {
+            return static_cast<int16_t>(std::clamp(std::round(v), -32768.f, 32767.f));
+        }
+    }
+
+    LevelTypes::Geometry Level::ExtractGeometry(const LevelTypes::Level& lvl) {
+        LevelTypes::Geometry res = {};
+
+        size_t circles = 0, bricks = 0, rods = 0, polygons = 0, points = 0;
+        for (const auto& element : lvl.Elements) {
+            if (!element.entry)
+                continue;
+            switch (LevelTypes::Entry::GetType(element.entry)) {
+                case LevelTypes::Circle: ++circles; break;
+                case LevelTypes::Brick: ++bricks; break;
+                case LevelTypes::Rod: ++rods; break;
+                case LevelTypes::Polygon: {
+                    ++polygons;
+                    points += LevelTypes::Entry::GetPolygon(element.entry)->mPoints.size();
+                    break;
+                }
+                default: break;
+            }
+        }
+
+        auto& c = res.Circles;
+        GeometryHelpers::reserve_rows(c, circles);
+        c.Radius.reserve(circles);
+        auto& b = res.Bricks;
+        GeometryHelpers::reserve_rows(b, bricks);
+        b.Angle.reserve(bricks);
+        b.Length.reserve(bricks);
+        b.Width.reserve(bricks);
+        b.SectorAngle.reserve(bricks);
+        b.LeftAngle.reserve(bricks);
+        b.RightAngle.reserve(bricks);
+        auto& r = res.Rods;
+        r.Element.reserve(rods);
+        r.AX.reserve(rods); r.AY.reserve(rods);
+        r.BX.reserve(rods); r.BY.reserve(rods);
+        auto& p = res.Polygons;
+        GeometryHelpers::reserve_rows(p, polygons);
+        p.Rotation.reserve(polygons);
+        p.Scale.reserve(polygons);
+        p.PointStart.reserve(polygons + 1);
+        p.PointX.reserve(points);
+        p.PointY.reserve(points);
+
+        auto& t = res.Teleporters;
+        auto& e = res.Emitters;
+        auto& g = res.Images;
+        auto& m = res.Movements;
+
+        for (uint32_t i = 0; i < lvl.Elements.size(); ++i) {
+            const auto& element = lvl.Elements[i];
+            uint8_t depth = 0;
+            for (const auto* link = GeometryHelpers::movement_of(element); link; link = link->InternalMovement.mSubMovementLink) {
+                if (link->InternalLinkId != 1)
+                    break;
+                m.Element.push_back(i);
+                m.Depth.push_back(depth++);
+                const auto& info = link->InternalMovement;
+                m.X.push_back(info.mAnchorPoint.x);
+                m.Y.push_back(info.mAnchorPoint.y);
+                m.Shape.push_back(info.mMovementShape);
+                m.MoveRotation.push_back(info.mFlags.hasMovementRotation ? info.mMoveRotation : 0.f);
+                m.Rotation.push_back(info.mFlags.hasRotation ? info.mRotation : 0.f);
+                const float radius1 = info.mFlags.hasRadius1 ? info.mRadius1 : 0.f;
+                m.Radius1.push_back(radius1);
+                m.Radius2.push_back(info.mFlags.hasRadius2 ? info.mRadius2 : radius1);
+                m.SubOffsetX.push_back(info.mFlags.hasSubMovement ? info.mSubMovementOffsetX : 0.f);
+                m.SubOffsetY.push_back(info.mFlags.hasSubMovement ? info.mSubMovementOffsetY : 0.f);
+            }
+            if (element.flags.hasImage || element.flags.hasRotation) {
+                g.Element.push_back(i);
+                g.Rotation.push_back(element.flags.hasRotation ? element.generic.mRotation : 0.f);
+            }
+
+            const auto* entry = element.entry;
+            if (!entry)
+                continue;
+            switch (LevelTypes::Entry::GetType(entry)) {
+                case LevelTypes::Circle: {
+                    const auto* circle = LevelTypes::Entry::GetCircle(entry);
+                    c.Element.push_back(i);
+                    c.X.push_back(circle->mPos.x);
+                    c.Y.push_back(circle->mPos.y);
+                    c.Radius.push_back(circle->mRadius);
+                    break;
+                }
+                case LevelTypes::Brick: {
+                    const auto* brick = LevelTypes::Entry::GetBrick(entry);
+                    b.Element.push_back(i);
+                    b.X.push_back(brick->mPos.x);
+                    b.Y.push_back(brick->mPos.y);
+                    b.Angle.push_back(brick->mAngle);
+                    b.Length.push_back(brick->mLength);
+                    b.Width.push_back(brick->mWidth);
+                    b.SectorAngle.push_back(brick->mSectorAngle);
+                    b.LeftAngle.push_back(brick->mLeftAngle);
+                    b.RightAngle.push_back(brick->mRightAngle);
+                    break;
+                }
+                case LevelTypes::Rod: {
+                    const auto* rod = LevelTypes::Entry::GetRod(entry);
+                    r.Element.push_back(i);
+                    r.AX.push_back(rod->mPointA.x);
+                    r.AY.push_back(rod->mPointA.y);
+                    r.BX.push_back(rod->mPointB.x);
+                    r.BY.push_back(rod->mPointB.y);
+                    break;
+                }
+                case LevelTypes::Polygon: {
+                    const auto* polygon = LevelTypes::Entry::GetPolygon(entry);
+                    p.Element.push_back(i);
+                    p.X.push_back(polygon->mPos.x);
+                    p.Y.push_back(polygon->mPos.y);
+                    p.Rotation.push_back(polygon->mRotation);
+                    p.Scale.push_back(polygon->mScale);
+                    p.PointStart.push_back(static_cast<uint32_t>(p.PointX.size()));
+                    for (const auto& point : polygon->mPoints) {
+                        p.PointX.push_back(point.x);
+                        p.PointY.push_back(point.y);
+                    }
+                    break;
+                }
+                case LevelTypes::Teleporter: {
+                    const auto* teleporter = LevelTypes::Entry::GetTeleporter(entry);
+                    t.Element.push_back(i);
+                    t.X.push_back(teleporter->mPos.x);
+                    t.Y.push_back(teleporter->mPos.y);
+                    break;
+                }
+                case LevelTypes::Emitter: {
+                    const auto* emitter = LevelTypes::Entry::GetEmitter(entry);
+                    e.Element.push_back(i);
+                    e.X.push_back(emitter->mPos.x);
+                    e.Y.push_back(emitter->mPos.y);
+                    e.Rotation.push_back(emitter->mRotation);
+                    break;
+                }
+                default: break;
+            }
+        }
+        p.PointStart.push_back(static_cast<uint32_t>(p.PointX.size()));
+
+        return res;
+    }
+
+    void Level::ApplyGeometry(LevelTypes::Level& lvl, const LevelTypes::Geometry& geometry) {
+        // rows whose element no longer matches (the level changed since extracting) are skipped. every element a
+        // row points at is marked dirty, matching or not
+        const auto element_of = [&lvl](const uint32_t index) -> LevelTypes::Element* {
+            if (index >= lvl.Elements.size())
+                return nullptr;
+            MarkDirty(lvl.Elements[index]);
+            return &lvl.Elements[index];
+        };
+        const auto entry_of = [&element_of](const uint32_t index) -> LevelTypes::Entry* {
+            const auto* element = element_of(index);
+            return element ? element->entry : nullptr;
+        };
+
+        const auto& c = geometry.Circles;
+        for (size_t i = 0; i < c.Element.size(); ++i) {
+            const auto* entry = entry_of(c.Element[i]);
+            auto* circle = entry ? LevelTypes::Entry::GetCircle(entry) : nullptr;
+            if (!circle)
+                continue;
+            circle->mPos = {c.X[i], c.Y[i]};
+            circle->mRadius = c.Radius[i];
+        }
+
+        const auto& b = geometry.Bricks;
+        for (size_t i = 0; i < b.Element.size(); ++i) {
+            const auto* entry = entry_of(b.Element[i]);
+            auto* brick = entry ? LevelTypes::Entry::GetBrick(entry) : nullptr;
+            if (!brick)
+                continue;
+            brick->mPos = {b.X[i], b.Y[i]};
+            brick->mAngle = b.Angle[i];
+            brick->mLength = b.Length[i];
+            brick->mWidth = b.Width[i];
+            brick->mSectorAngle = b.SectorAngle[i];
+            brick->mLeftAngle = b.LeftAngle[i];
+            brick->mRightAngle = b.RightAngle[i];
+        }
+
+        const auto& r = geometry.Rods;
+        for (size_t i = 0; i < r.Element.size(); ++i) {
+            const auto* entry = entry_of(r.Element[i]);
+            auto* rod = entry ? LevelTypes::Entry::GetRod(entry) : nullptr;
+            if (!rod)
+                continue;
+            rod->mPointA = {r.AX[i], r.AY[i]};
+            rod->mPointB = {r.BX[i], r.BY[i]};
+        }
+
+        const auto& p = geometry.Polygons;
+        for (size_t i = 0; i < p.Element.size(); ++i) {
+            const auto* entry = entry_of(p.Element[i]);
+            auto* polygon = entry ? LevelTypes::Entry::GetPolygon(entry) : nullptr;
+            if (!polygon)
+                continue;
+            polygon->mPos = {p.X[i], p.Y[i]};
+            polygon->mRotation = p.Rotation[i];
+            polygon->mScale = p.Scale[i];
+            const auto start = p.PointStart[i];
+            const auto count = std::min<size_t>(p.PointStart[i + 1] - start, polygon->mPoints.size());
+            for (size_t j = 0; j < count; ++j)
+                polygon->mPoints[j] = {p.PointX[start + j], p.PointY[start + j]};
+        }
+
+        const auto& t = geometry.Teleporters;
+        for (size_t i = 0; i < t.Element.size(); ++i) {
+            const auto* entry = entry_of(t.Element[i]);
+            auto* teleporter = entry ? LevelTypes::Entry::GetTeleporter(entry) : nullptr;
+            if (!teleporter)
+                continue;
+            teleporter->mPos = {t.X[i], t.Y[i]};
+        }
+
+        const auto& e = geometry.Emitters;
+        for (size_t i = 0; i < e.Element.size(); ++i) {
+            const auto* entry = entry_of(e.Element[i]);
+            auto* emitter = entry ? LevelTypes::Entry::GetEmitter(entry) : nullptr;
+            if (!emitter)
+                continue;
+            emitter->mPos = {e.X[i], e.Y[i]};
+            emitter->mRotation = e.Rotation[i];
+        }
+
+        const auto& g = geometry.Images;
+        for (size_t i = 0; i < g.Element.size(); ++i) {
+            auto* element = element_of(g.Element[i]);
+            if (!element)
+                continue;
+            if (g.Rotation[i] != 0.f)
+                element->flags.hasRotation = true;
+            if (element->flags.hasRotation)
+                element->generic.mRotation = g.Rotation[i];
+        }
+
+        const auto& m = geometry.Movements;
+        for (size_t i = 0; i < m.Element.size(); ++i) {
+            auto* element = element_of(m.Element[i]);
+            auto* link = element ? GeometryHelpers::movement_of(*element) : nullptr;
+            for (uint8_t depth = 0; link && depth < m.Depth[i]; ++depth)
+                link = link->InternalMovement.mSubMovementLink;
+            if (!link || link->InternalLinkId != 1)
+                continue;
+            auto& info = link->InternalMovement;
+            info.mAnchorPoint = {m.X[i], m.Y[i]};
+            info.mMovementShape = m.Shape[i];
+            info.mType = std::abs(info.mMovementShape);
+            auto& flags = info.mFlags;
+            if (m.MoveRotation[i] != 0.f)
+                flags.hasMovementRotation = true;
+            if (flags.hasMovementRotation)
+                info.mMoveRotation = m.MoveRotation[i];
+            if (m.Rotation[i] != 0.f)
+                flags.hasRotation = true;
+            if (flags.hasRotation)
+                info.mRotation = m.Rotation[i];
+            // Radius2 only needs its own value once it stops following Radius1
+            const int16_t radius1 = GeometryHelpers::to_radius(m.Radius1[i]);
+            const int16_t radius2 = GeometryHelpers::to_radius(m.Radius2[i]);
+            if (radius1 != 0)
+                flags.hasRadius1 = true;
+            if (flags.hasRadius1)
+                info.mRadius1 = radius1;
+            if (radius2 != radius1)
+                flags.hasRadius2 = true;
+            if (flags.hasRadius2)
+                info.mRadius2 = radius2;
+            if (flags.hasSubMovement) {
+                info.mSubMovementOffsetX = m.SubOffsetX[i];
+                info.mSubMovementOffsetY = m.SubOffsetY[i];
+            }
+        }
+    }
+
+    LevelTypes::Transform Level::TranslateTransform(const double x, const double y) {
+        return {1., 0., 0., 1., x, y};
+    }
+
+    LevelTypes::Transform Level::ScaleTransform(const double scale) {
+        return {scale, 0., 0., scale, 0., 0.};
+    }
+
+    LevelTypes::Transform Level::RotateTransform(const double degrees) {
+        double cos = 0., sin = 0.;
+        if (const double turns = degrees / 90.; turns == std::floor(turns)) {
+            switch ((static_cast<int64_t>(std::fmod(turns, 4.)) + 4) % 4) {
+                case 0: cos = 1.; break;
+                case 1: sin = 1.; break;
+                case 2: cos = -1.; break;
+                case 3: sin = -1.; break;
+                default: break;
+            }
+        } else {
+            const double radians = degrees * std::numbers::pi / 180.;
+            cos = std::cos(radians);
+            sin = std::sin(radians);
+        }
+        return {cos, -sin, sin, cos, 0., 0.};
+    }
+
+    LevelTypes::Transform Level::MirrorTransform(const bool mirror_x, const bool mirror_y) {
+        return {mirror_x ? -1. : 1., 0., 0., mirror_y ? -1. : 1., 0., 0.};
+    }
+
+    LevelTypes::Transform Level::ComposeTransform(const LevelTypes::Transform& first, const LevelTypes::Transform& second) {
+        const auto& f = first;
+        const auto& s = second;
+        return {
+            s.A * f.A + s.B * f.C, s.A * f.B + s.B * f.D,
+            s.C * f.A + s.D * f.C, s.C * f.B + s.D * f.D,
+            s.A * f.X + s.B * f.Y + s.X, s.C * f.X + s.D * f.Y + s.Y
+        };
+    }
+
+    LevelTypes::Transform Level::InvertTransform(const LevelTypes::Transform& transform) {
+        const auto& t = transform;
+        const double det = t.A * t.D - t.B * t.C;
+        if (det == 0.)
+            throw std::exception("Transform is not invertible");
+        const double a = t.D / det, b = -t.B / det;
+        const double c = -t.C / det, d = t.A / det;
+        return {a, b, c, d, -(a * t.X + b * t.Y), -(c * t.X + d * t.Y)};
+    }
+
+    void Level::TransformGeometry(LevelTypes::Geometry& geometry, const LevelTypes::Transform& transform) {
+        const auto similarity = GeometryHelpers::decompose(transform);
+        using GeometryHelpers::transform_points;
+        using GeometryHelpers::scale_values;
+        using GeometryHelpers::turn_angles;
+        using GeometryHelpers::flip_angles;
+
+        transform_points(geometry.Circles.X, geometry.Circles.Y, transform);
+        scale_values(geometry.Circles.Radius, similarity.scale);
+
+        transform_points(geometry.Bricks.X, geometry.Bricks.Y, transform);
+        scale_values(geometry.Bricks.Length, similarity.scale);
+        scale_values(geometry.Bricks.Width, similarity.scale);
+        turn_angles(geometry.Bricks.Angle, similarity);
+        flip_angles(geometry.Bricks.SectorAngle, similarity);
+        flip_angles(geometry.Bricks.LeftAngle, similarity);
+        flip_angles(geometry.Bricks.RightAngle, similarity);
+
+        transform_points(geometry.Rods.AX, geometry.Rods.AY, transform);
+        transform_points(geometry.Rods.BX, geometry.Rods.BY, transform);
+
+        transform_points(geometry.Polygons.X, geometry.Polygons.Y, transform);
+        transform_points(geometry.Polygons.PointX, geometry.Polygons.PointY, transform);
+        flip_angles(geometry.Polygons.Rotation, similarity);
+
+        transform_points(geometry.Teleporters.X, geometry.Teleporters.Y, transform);
+        transform_points(geometry.Emitters.X, geometry.Emitters.Y, transform);
+        turn_angles(geometry.Emitters.Rotation, similarity);
+        turn_angles(geometry.Images.Rotation, similarity);
+
+        auto& m = geometry.Movements;
+        transform_points(m.X, m.Y, transform);
+        // offsets are distances, they only take the linear part
+        Simd::affine(m.SubOffsetX.data(), m.SubOffsetY.data(), std::min(m.SubOffsetX.size(), m.SubOffsetY.size()),
+                     transform.A, transform.B, transform.C, transform.D, 0., 0.);
+        scale_values(m.Radius1, similarity.scale);
+        scale_values(m.Radius2, similarity.scale);
+        turn_angles(m.MoveRotation, similarity);
+        turn_angles(m.Rotation, similarity);
+        if (similarity.sign < 0.)
+            GeometryHelpers::mirror_movements(m);
+    }
+
+    void Level::TransformLevel(LevelTypes::Level& lvl, const LevelTypes::Transform& transform) {
+        auto geometry = ExtractGeometry(lvl);
+        TransformGeometry(geometry, transform);
+        ApplyGeometry(lvl, geometry);
+
+        // elements carried by teleporters are not in the columns, run them through as a level of their own
+        LevelTypes::Level carried = {};
+        std::vector<LevelTypes::Element*> owners;
+        for (const auto& element : lvl.Elements) {
+            const auto* teleporter = element.entry ? LevelTypes::Entry::GetTeleporter(element.entry) : nullptr;
+            if (teleporter && teleporter->mEntry) {
+                // the fields only, so the entry stays the one the teleporter carries
+                static_cast<LevelTypes::ElementFields&>(carried.Elements.emplace_back()) = *teleporter->mEntry;
+                owners.push_back(teleporter->mEntry);
+            }
+        }
+        if (owners.empty())
+            return;
+        TransformLevel(carried, transform);
+        for (size_t i = 0; i < owners.size(); ++i)
+            static_cast<LevelTypes::ElementFields&>(*owners[i]) = carried.Elements[i];  // brings back the movement anchors
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,423 @@
+#include "binstream.h"
+#include "levelschema.h"
+#include "libpeggle.h"
+#include <algorithm>
+#include <memory_resource>
+
+namespace Peggle {
+#pragma region libpeggle_Journal
+
+    namespace JournalHelpers {
+        // equal bytes between two changes that are fewer than this go into the run with them, a run of its own costs
+        // more than that
+        constexpr size_t merge_gap = 16;
+
+        // calls run(offset, before_size, after_size) for every stretch where before and after differ, in order.
+        // when the sizes differ it is one run between the common prefix and suffix
+        template<typename F>
+        void diff(const uint8_t* before, const size_t before_size, const uint8_t* after, const size_t after_size, F&& run) {
+            if (before_size != after_size) {
+                const size_t shorter = std::min(before_size, after_size);
+                size_t prefix = 0;
+                while (prefix < shorter && before[prefix] == after[prefix])
+                    ++prefix;
+                size_t suffix = 0;
+                while (suffix < shorter - prefix && before[before_size - 1 - suffix] == after[after_size - 1 - suffix])
+                    ++suffix;
+                run(prefix, before_size - prefix - suffix, after_size - prefix - suffix);
+                return;
+            }
+            size_t i = 0;
+            while (i < before_size) {
+                if (before[i] == after[i]) {
+                    ++i;
+                    continue;
+                }
+                const size_t start = i;
+                size_t end = i + 1;
+                while (end < before_size) {
+                    if (before[end] != after[end]) {
+                        ++end;
+                        continue;
+                    }
+                    size_t same = 1;
+                    while (end + same < before_size && same < merge_gap && before[end + same] == after[end + same])
+                        ++same;
+                    if (end + same == before_size || same >= merge_gap)
+                        break;
+                    end += same;
+                }
+                run(start, end - start, end - start);
+                i = end;
+            }
+        }
+
+        // takes the place of the output stream and notes where each write goes in the encoding and where in memory it
+        // comes from. a write of a branch field (see LevelSchema::Flags) is marked
+        struct Locator {
+            struct Write {
+                uint32_t Offset, Size;
+                const uint8_t* From;
+                bool Branch;
+            };
+            std::vector<Write> Writes;
+            uint32_t At = 0;
+            bool Branch = false;
+
+            void branches() {
+                Branch = true;
+            }
+            template<typename T>
+            void write(const T& v) {
+                write(&v, sizeof(T));
+            }
+            void write(const void* data, const size_t size) {
+                Writes.push_back({At, static_cast<uint32_t>(size), static_cast<const uint8_t*>(data), Branch});
+                Branch = false;
+                At += static_cast<uint32_t>(size);
+            }
+        };
+
+        enum BlockKind : uint32_t {
+            FieldsBlock,
+            EntryBlock,
+            LinkBlock,
+            PointsBlock
+        };
+
+        // every stretch of memory an element is encoded from: its fields, its entry, its sub movements and polygon
+        // points, then the same for the element its teleporter carries. ids go by position, so a block is found again
+        // after the element was moved or copied. f(id, data, size, owner)
+        template<typename F>
+        void for_each_block(LevelTypes::ElementFields& e, F&& f, const uint32_t carried = 0) {
+            const auto id = [carried](const BlockKind kind, const uint32_t depth) { return carried << 24 | kind << 16 | depth; };
+            f(id(FieldsBlock, 0), &e, sizeof(e), e);
+            uint32_t depth = 0;
+            for (auto* link = e.generic.mMovementLink.InternalMovement.mSubMovementLink; link; link = link->InternalMovement.mSubMovementLink)
+                f(id(LinkBlock, ++depth), link, sizeof(*link), e);
+            if (!e.entry)
+                return;
+            using Entry = LevelTypes::Entry;
+            switch (Entry::GetType(e.entry)) {
+                case LevelTypes::Rod: { f(id(EntryBlock, 0), Entry::GetRod(e.entry), sizeof(LevelTypes::RodEntry), e); break; }
+                case LevelTypes::Polygon: {
+                    auto* polygon = Entry::GetPolygon(e.entry);
+                    f(id(EntryBlock, 0), polygon, sizeof(*polygon), e);
+                    f(id(PointsBlock, 0), polygon->mPoints.data(), polygon->mPoints.size() * sizeof(LevelTypes::Point), e);
+                    break;
+                }
+                case LevelTypes::Circle: { f(id(EntryBlock, 0), Entry::GetCircle(e.entry), sizeof(LevelTypes::CircleEntry), e); break; }
+                case LevelTypes::Brick: { f(id(EntryBlock, 0), Entry::GetBrick(e.entry), sizeof(LevelTypes::BrickEntry), e); break; }
+                case LevelTypes::Teleporter: {
+                    auto* teleport = Entry::GetTeleporter(e.entry);
+                    f(id(EntryBlock, 0), teleport, sizeof(*teleport), e);
+                    if (teleport->mEntry)
+                        for_each_block(*teleport->mEntry, f, carried + 1);
+                    break;
+                }
+                case LevelTypes::Emitter: { f(id(EntryBlock, 0), Entry::GetEmitter(e.entry), sizeof(LevelTypes::EmitterEntry), e); break; }
+                default: break;
+            }
+        }
+
+        // members the decoder derives from others (the OnRead ops), redone after a block was written to
+        void derive(const uint32_t block, void* data, LevelTypes::ElementFields& owner) {
+            switch (block >> 16 & 0xFF) {
+                case FieldsBlock: { LevelSchema::derive_movement(owner.generic.mMovementLink.InternalMovement); break; }
+                case LinkBlock: { LevelSchema::derive_movement(static_cast<LevelTypes::MovementLink*>(data)->InternalMovement); break; }
+                case EntryBlock: {
+                    if (auto* brick = LevelTypes::Entry::GetBrick(owner.entry))
+                        LevelSchema::derive_brick(*brick);
+                    break;
+                }
+                default: break;
+            }
+        }
+
+        template<typename T>
+        size_t held_bytes(const std::vector<T>& v) {
+            return v.capacity() * sizeof(T);
+        }
+    }
+
+    LevelJournal::LevelJournal(LevelTypes::Level& lvl) : Lvl(lvl) {}
+
+    void LevelJournal::Begin() {
+        Settle();
+        Open();
+        ++Depth;
+    }
+
+    void LevelJournal::Commit() {
+        if (!Depth)
+            throw std::exception("Commit without a transaction");
+        if (--Depth == 0)
+            Close();
+    }
+
+    void LevelJournal::Rollback() {
+        if (!Depth)
+            throw std::exception("Rollback without a transaction");
+        Flush();
+        Apply(Current, true);
+        Current = {};
+        Depth = 0;
+        Active = false;
+    }
+
+    void LevelJournal::Insert(const size_t index, const LevelTypes::Element& element) {
+        Settle();
+        if (index > Lvl.Elements.size())
+            throw std::exception("Element index out of range");
+        Open();
+        Flush();
+        Lvl.Elements.insert(Lvl.Elements.begin() + index, LevelTypes::Element(element, Level::GetArena(Lvl)));
+        Current.Edits.push_back({Inserted, static_cast<uint32_t>(index), static_cast<uint32_t>(Current.Held.size())});
+        // the element is only held once the insert is undone
+        Current.Held.emplace_back();
+        if (!Depth)
+            Close();
+    }
+
+    void LevelJournal::Remove(const size_t index) {
+        Settle();
+        if (index >= Lvl.Elements.size())
+            throw std::exception("Element index out of range");
+        Open();
+        Flush();
+        Current.Edits.push_back({Removed, static_cast<uint32_t>(index), static_cast<uint32_t>(Current.Held.size())});
+        Current.Held.push_back(std::move(Lvl.Elements[index]));
+        Lvl.Elements.erase(Lvl.Elements.begin() + index);
+        if (!Depth)
+            Close();
+    }
+
+    LevelTypes::Element& LevelJournal::Modify(const size_t index) {
+        Settle();
+        if (index >= Lvl.Elements.size())
+            throw std::exception("Element index out of range");
+        Open();
+        auto& element = Lvl.Elements[index];
+        const auto touched = std::find_if(Touched.begin(), Touched.end(), [&](const Pending& p) { return p.Index == index; });
+        if (touched == Touched.end()) {
+            Encode(element, Scratch);
+            Touched.push_back({static_cast<uint32_t>(index), static_cast<uint32_t>(PendingBytes.size()), static_cast<uint32_t>(Scratch.size())});
+            PendingBytes.insert(PendingBytes.end(), Scratch.begin(), Scratch.end());
+            Level::MarkDirty(element);
+        }
+        return element;
+    }
+
+    bool LevelJournal::Undo() {
+        Settle();
+        if (Depth)
+            throw std::exception("Undo inside a transaction");
+        if (Done.empty())
+            return false;
+        Apply(Done.back(), true);
+        Undone.push_back(std::move(Done.back()));
+        Done.pop_back();
+        return true;
+    }
+
+    bool LevelJournal::Redo() {
+        Settle();
+        if (Depth)
+            throw std::exception("Redo inside a transaction");
+        if (Undone.empty())
+            return false;
+        Apply(Undone.back(), false);
+        Done.push_back(std::move(Undone.back()));
+        Undone.pop_back();
+        return true;
+    }
+
+    void LevelJournal::Clear() {
+        Settle();
+        Done.clear();
+        Undone.clear();
+    }
+
+    size_t LevelJournal::GetUndoCount() const {
+        return Done.size();
+    }
+
+    size_t LevelJournal::GetRedoCount() const {
+        return Undone.size();
+    }
+
+    size_t LevelJournal::GetMemoryUsage() const {
+        size_t res = JournalHelpers::held_bytes(Done) + JournalHelpers::held_bytes(Undone);
+        for (const auto* history : {&Done, &Undone})
+            for (const auto& t : *history)
+                res += JournalHelpers::held_bytes(t.Edits) + JournalHelpers::held_bytes(t.Runs) +
+                       JournalHelpers::held_bytes(t.Pieces) + JournalHelpers::held_bytes(t.Bytes) +
+                       JournalHelpers::held_bytes(t.Held);
+        return res;
+    }
+
+    void LevelJournal::Open() {
+        Active = true;
+    }
+
+    void LevelJournal::Close() {
+        Flush();
+        if (!Current.Edits.empty()) {
+            Current.Edits.shrink_to_fit();
+            Current.Runs.shrink_to_fit();
+            Current.Pieces.shrink_to_fit();
+            Current.Bytes.shrink_to_fit();
+            Current.Held.shrink_to_fit();
+            Done.push_back(std::move(Current));
+            Undone.clear();
+        }
+        Current = {};
+        Active = false;
+    }
+
+    // a Modify outside of a transaction stays open until the next call
+    void LevelJournal::Settle() {
+        if (Active && !Depth)
+            Close();
+    }
+
+    // turn the elements touched so far into edits, before anything moves them
+    void LevelJournal::Flush() {
+        for (const auto& p : Touched) {
+            Encode(Lvl.Elements[p.Index], Scratch);
+            const auto* before = PendingBytes.data() + p.Offset;
+            if (p.Size == Scratch.size() && Patch(Lvl.Elements[p.Index], before, p.Index))
+                continue;
+            const auto* after = Scratch.data();
+            const auto first = static_cast<uint32_t>(Current.Runs.size());
+            JournalHelpers::diff(before, p.Size, after, Scratch.size(), [&](const size_t offset, const size_t before_size, const size_t after_size) {
+                Current.Runs.push_back({static_cast<uint32_t>(offset), static_cast<uint32_t>(before_size),
+                                        static_cast<uint32_t>(after_size), static_cast<uint32_t>(Current.Bytes.size())});
+                Current.Bytes.insert(Current.Bytes.end(), before + offset, before + offset + before_size);
+                Current.Bytes.insert(Current.Bytes.end(), after + offset, after + offset + after_size);
+            });
+            const auto count = static_cast<uint32_t>(Current.Runs.size()) - first;
+            if (count)
+                Current.Edits.push_back({Modified, p.Index, first, count});
+        }
+        Touched.clear();
+        PendingBytes.clear();
+    }
+
+    // the changed bytes of element as pieces of its fields, when every one of them is a value at a place in memory
+    // that no later op branches on. Scratch holds its encoding now, before the one of the same size from before
+    bool LevelJournal::Patch(LevelTypes::Element& element, const uint8_t* before, const uint32_t index) {
+        const auto* after = Scratch.data();
+        JournalHelpers::Locator locator;
+        LevelSchema::Codec<LevelTypes::Element>::write(locator, element, LevelSchema::LevelFormat{Lvl.version});
+        if (locator.At != Scratch.size())
+            return false;
+        const auto first = static_cast<uint32_t>(Current.Pieces.size());
+        const auto bytes = Current.Bytes.size();
+        for (const auto& w : locator.Writes) {
+            if (memcmp(before + w.Offset, after + w.Offset, w.Size) == 0)
+                continue;
+            Piece piece = {};
+            if (!w.Branch) {
+                JournalHelpers::for_each_block(element, [&](const uint32_t block, const void* data, const size_t size, auto&) {
+                    const auto* begin = static_cast<const uint8_t*>(data);
+                    if (w.From >= begin && w.From + w.Size <= begin + size)
+                        piece = {block, static_cast<uint32_t>(w.From - begin), w.Size, static_cast<uint32_t>(Current.Bytes.size())};
+                });
+            }
+            if (!piece.Size) {
+                Current.Pieces.resize(first);
+                Current.Bytes.resize(bytes);
+                return false;
+            }
+            Current.Pieces.push_back(piece);
+            Current.Bytes.insert(Current.Bytes.end(), before + w.Offset, before + w.Offset + w.Size);
+            Current.Bytes.insert(Current.Bytes.end(), after + w.Offset, after + w.Offset + w.Size);
+        }
+        const auto count = static_cast<uint32_t>(Current.Pieces.size()) - first;
+        if (count)
+            Current.Edits.push_back({Patched, index, first, count});
+        return true;
+    }
+
+    void LevelJournal::Apply(Transaction& transaction, const bool undo) {
+        auto& elements = Lvl.Elements;
+        const auto& edits = transaction.Edits;
+        for (size_t k = 0; k < edits.size(); ++k) {
+            const auto& edit = edits[undo ? edits.size() - 1 - k : k];
+            const bool modifies = edit.Kind == Modified || edit.Kind == Patched;
+            const bool takes_out = !modifies && (edit.Kind == Inserted) == undo;
+            if (edit.Index > elements.size() || (edit.Index == elements.size() && (modifies || takes_out)))
+                throw std::exception("Level journal does not match the level");
+            const auto at = elements.begin() + edit.Index;
+
+            if (!modifies) {
+                // an undone insert and a redone remove take the element out, the other two put it back
+                if (takes_out) {
+                    transaction.Held[edit.First] = std::move(*at);
+                    elements.erase(at);
+                } else {
+                    elements.insert(at, std::move(transaction.Held[edit.First]));
+                }
+                continue;
+            }
+
+            // values go straight back into the fields they came from
+            if (edit.Kind == Patched) {
+                for (uint32_t k = edit.First; k < edit.First + edit.Count; ++k) {
+                    const auto& piece = transaction.Pieces[k];
+                    bool found = false;
+                    JournalHelpers::for_each_block(*at, [&](const uint32_t block, void* data, const size_t size, auto& owner) {
+                        if (block != piece.Block || piece.Offset + piece.Size > size)
+                            return;
+                        const auto* bytes = transaction.Bytes.data() + piece.Data + (undo ? 0 : piece.Size);
+                        memcpy(static_cast<uint8_t*>(data) + piece.Offset, bytes, piece.Size);
+                        JournalHelpers::derive(block, data, owner);
+                        found = true;
+                    });
+                    if (!found)
+                        throw std::exception("Level journal does not match the level");
+                }
+                Level::MarkDirty(*at);
+                continue;
+            }
+
+            // the element's encoding now with every run swapped for the other side, then decoded again
+            Encode(*at, Scratch);
+            std::vector<uint8_t> patched;
+            patched.reserve(Scratch.size());
+            size_t done = 0;
+            for (uint32_t r = edit.First; r < edit.First + edit.Count; ++r) {
+                const auto& run = transaction.Runs[r];
+                const size_t skip = undo ? run.AfterSize : run.BeforeSize;
+                if (run.Offset < done || run.Offset + skip > Scratch.size())
+                    throw std::exception("Level journal does not match the level");
+                patched.insert(patched.end(), Scratch.begin() + done, Scratch.begin() + run.Offset);
+                const auto* bytes = transaction.Bytes.data() + run.Data + (undo ? 0 : run.BeforeSize);
+                patched.insert(patched.end(), bytes, bytes + (undo ? run.BeforeSize : run.AfterSize));
+                done = run.Offset + skip;
+            }
+            patched.insert(patched.end(), Scratch.begin() + done, Scratch.end());
+
+            // decoded strings point into bs. the copy owns its storage and frees the one it replaces, so undoing and
+            // redoing again and again does not grow the level's arena
+            binstream bs(patched.data(), patched.size());
+            std::pmr::monotonic_buffer_resource arena;
+            LevelTypes::Element decoded = {};
+            LevelSchema::Codec<LevelTypes::Element>::read(bs, decoded, LevelSchema::LevelFormat{Lvl.version, &arena});
+            if (bs.tell() != bs.size())
+                throw std::exception("Level journal does not match the level");
+            *at = decoded;
+        }
+    }
+
+    void LevelJournal::Encode(const LevelTypes::Element& element, std::vector<uint8_t>& out) const {
+        const LevelSchema::LevelFormat fmt{Lvl.version};
+        binstream bs;
+        bs.reserve(LevelSchema::Codec<LevelTypes::Element>::size(element, fmt));
+        LevelSchema::Codec<LevelTypes::Element>::write(bs, element, fmt);
+        out.assign(bs.buffer(), bs.buffer() + bs.size());
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,806 @@
+#include "helpers.h"
+#include "levelschema.h"
+#include "libpeggle.h"
+#include "workpool.h"
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+
+namespace Peggle {
+#pragma region libpeggle_Json
+
+    // both directions walk the same key tables, so a field added to one of the structs needs one line here
+    namespace JsonHelpers {
+        using namespace LevelTypes;
+
+        // bytes reserved per element before writing, about what one comes to with every field of its movement
+        constexpr size_t element_bytes = 1536;
+        // objects and arrays nested deeper than this are refused instead of recursed into
+        constexpr uint32_t max_depth = 64;
+
+        template<typename T, typename M>
+        struct Member {
+            std::string_view Key;
+            M T::* Pointer;
+        };
+        template<typename T, typename M>
+        constexpr Member<T, M> member(const std::string_view key, M T::* pointer) {
+            return {key, pointer};
+        }
+
+        template<typename T>
+        struct FieldsOf;
+
+        template<> struct FieldsOf<PegInfo> {
+            static constexpr auto value = std::tuple{
+                member("type", &PegInfo::mType),
+                member("flags", &PegInfo::mFlags),
+                member("unk0", &PegInfo::mUnk0),
+                member("unk1", &PegInfo::mUnk1),
+                member("unk2", &PegInfo::mUnk2),
+                member("unk3", &PegInfo::mUnk3),
+                member("variable", &PegInfo::mVariable),
+                member("crumble", &PegInfo::mCrumble)
+            };
+        };
+        template<> struct FieldsOf<MovementInfo> {
+            static constexpr auto value = std::tuple{
+                member("internalLinkID", &MovementInfo::mInternalLinkID),
+                member("movementShape", &MovementInfo::mMovementShape),
+                member("type", &MovementInfo::mType),
+                member("reverse", &MovementInfo::mReverse),
+                member("anchorPoint", &MovementInfo::mAnchorPoint),
+                member("timePeriod", &MovementInfo::mTimePeriod),
+                member("flags", &MovementInfo::mFlags),
+                member("offset", &MovementInfo::mOffset),
+                member("radius1", &MovementInfo::mRadius1),
+                member("startPhase", &MovementInfo::mStartPhase),
+                member("moveRotation", &MovementInfo::mMoveRotation),
+                member("radius2", &MovementInfo::mRadius2),
+                member("pause1", &MovementInfo::mPause1),
+                member("pause2", &MovementInfo::mPause2),
+                member("phase1", &MovementInfo::mPhase1),
+                member("phase2", &MovementInfo::mPhase2),
+                member("postDelayPhase", &MovementInfo::mPostDelayPhase),
+                member("maxAngle", &MovementInfo::mMaxAngle),
+                member("unknown8", &MovementInfo::mUnknown8),
+                member("rotation", &MovementInfo::mRotation),
+                member("subMovementOffsetX", &MovementInfo::mSubMovementOffsetX),
+                member("subMovementOffsetY", &MovementInfo::mSubMovementOffsetY),
+                member("subMovementLink", &MovementInfo::mSubMovementLink),
+                member("objectX", &MovementInfo::mObjectX),
+                member("objectY", &MovementInfo::mObjectY)
+            };
+        };
+        template<> struct FieldsOf<MovementLink> {
+            static constexpr auto value = std::tuple{
+                member("internalLinkId", &MovementLink::InternalLinkId),
+                member("internalMovement", &MovementLink::InternalMovement)
+            };
+        };
+        template<> struct FieldsOf<GenericData> {
+            static constexpr auto value = std::tuple{
+                member("rolly", &GenericData::mRolly),
+                member("bouncy", &GenericData::mBouncy),
+                member("pegInfo", &GenericData::mPegInfo),
+                member("movementLink", &GenericData::mMovementLink),
+                member("unk0", &GenericData::mUnk0),
+                member("solidColor", &GenericData::mSolidColor),
+                member("outlineColor", &GenericData::mOutlineColor),
+                member("image", &GenericData::mImage),
+                member("imageDX", &GenericData::mImageDX),
+                member("imageDY", &GenericData::mImageDY),
+                member("rotation", &GenericData::mRotation),
+                member("unk1", &GenericData::mUnk1),
+                member("id", &GenericData::mID),
+                member("unk2", &GenericData::mUnk2),
+                member("sound", &GenericData::mSound),
+                member("logic", &GenericData::mLogic),
+                member("maxBounceVelocity", &GenericData::mMaxBounceVelocity),
+                member("subID", &GenericData::mSubID),
+                member("flipperFlags", &GenericData::mFlipperFlags)
+            };
+        };
+        template<> struct FieldsOf<VariableFloat> {
+            static constexpr auto value = std::tuple{
+                member("isVariable", &VariableFloat::mIsVariable),
+                member("staticVariable", &VariableFloat::mStaticVariable),
+                member("variableValue", &VariableFloat::mVariableValue)
+            };
+        };
+        template<> struct FieldsOf<RodEntry> {
+            static constexpr auto value = std::tuple{
+                member("valid", &RodEntry::valid),
+                member("flags", &RodEntry::mFlags),
+                member("pointA", &RodEntry::mPointA),
+                member("pointB", &RodEntry::mPointB),
+                member("e", &RodEntry::mE),
+                member("f", &RodEntry::mF)
+            };
+        };
+        template<> struct FieldsOf<PolygonEntry> {
+            static constexpr auto value = std::tuple{
+                member("valid", &PolygonEntry::valid),
+                member("flagsA", &PolygonEntry::mFlagsA),
+                member("flagsB", &PolygonEntry::mFlagsB),
+                member("rotation", &PolygonEntry::mRotation),
+                member("unk1", &PolygonEntry::mUnk1),
+                member("scale", &PolygonEntry::mScale),
+                member("normalDir", &PolygonEntry::mNormalDir),
+                member("pos", &PolygonEntry::mPos),
+                member("points", &PolygonEntry::mPoints),
+                member("unk2", &PolygonEntry::mUnk2),
+                member("growType", &PolygonEntry::mGrowType)
+            };
+        };
+        template<> struct FieldsOf<CircleEntry> {
+            static constexpr auto value = std::tuple{
+                member("valid", &CircleEntry::valid),
+                member("flagsA", &CircleEntry::mFlagsA),
+                member("flagsB", &CircleEntry::mFlagsB),
+                member("pos", &CircleEntry::mPos),
+                member("radius", &CircleEntry::mRadius)
+            };
+        };
+        template<> struct FieldsOf<BrickEntry> {
+            static constexpr auto value = std::tuple{
+                member("valid", &BrickEntry::valid),
+                member("flagsA", &BrickEntry::mFlagsA),
+                member("flagsB", &BrickEntry::mFlagsB),
+                member("flagsC", &BrickEntry::mFlagsC),
+                member("unk1", &BrickEntry::mUnk1),
+                member("unk2", &BrickEntry::mUnk2),
+                member("unk3", &BrickEntry::mUnk3),
+                member("unk4", &BrickEntry::mUnk4),
+                member("pos", &BrickEntry::mPos),
+                member("unk5", &BrickEntry::mUnk5),
+                member("unk6", &BrickEntry::mUnk6),
+                member("unk7", &BrickEntry::mUnk7),
+                member("unk8", &BrickEntry::mUnk8),
+                member("unk9", &BrickEntry::mUnk9),
+                member("type", &BrickEntry::mType),
+                member("curved", &BrickEntry::mCurved),
+                member("curvedPoints", &BrickEntry::mCurvedPoints),
+                member("leftAngle", &BrickEntry::mLeftAngle),
+                member("rightAngle", &BrickEntry::mRightAngle),
+                member("unk10", &BrickEntry::mUnk10),
+                member("sectorAngle", &BrickEntry::mSectorAngle),
+                member("width", &BrickEntry::mWidth),
+                member("length", &BrickEntry::mLength),
+                member("angle", &BrickEntry::mAngle),
+                member("textureFlip", &BrickEntry::mTextureFlip),
+                member("unk12", &BrickEntry::mUnk12)
+            };
+        };
+        template<> struct FieldsOf<TeleportEntry> {
+            static constexpr auto value = std::tuple{
+                member("valid", &TeleportEntry::valid),
+                member("flags", &TeleportEntry::mFlags),
+                member("width", &TeleportEntry::mWidth),
+                member("height", &TeleportEntry::mHeight),
+                member("unk0", &TeleportEntry::mUnk0),
+                member("unk1", &TeleportEntry::mUnk1),
+                member("unk2", &TeleportEntry::mUnk2),
+                member("entry", &TeleportEntry::mEntry),
+                member("pos", &TeleportEntry::mPos),
+                member("unk3", &TeleportEntry::mUnk3),
+                member("unk4", &TeleportEntry::mUnk4)
+            };
+        };
+        template<> struct FieldsOf<EmitterEntry> {
+            static constexpr auto value = std::tuple{
+                member("valid", &EmitterEntry::valid),
+                member("mainVar", &EmitterEntry::mMainVar),
+                member("flags", &EmitterEntry::mFlags),
+                member("image", &EmitterEntry::mImage),
+                member("width", &EmitterEntry::mWidth),
+                member("height", &EmitterEntry::mHeight),
+                member("mainVar0", &EmitterEntry::mMainVar0),
+                member("mainVar1", &EmitterEntry::mMainVar1),
+                member("mainVar2", &EmitterEntry::mMainVar2),
+                member("mainVar3", &EmitterEntry::mMainVar3),
+                member("unknown0", &EmitterEntry::mUnknown0),
+                member("unknown1", &EmitterEntry::mUnknown1),
+                member("pos", &EmitterEntry::mPos),
+                member("emitImage", &EmitterEntry::mEmitImage),
+                member("unknownEmitRate", &EmitterEntry::mUnknownEmitRate),
+                member("unknown2", &EmitterEntry::mUnknown2),
+                member("rotation", &EmitterEntry::mRotation),
+                member("maxQuantity", &EmitterEntry::mMaxQuantity),
+                member("timeBeforeFadeOut", &EmitterEntry::mTimeBeforeFadeOut),
+                member("fadeInTime", &EmitterEntry::mFadeInTime),
+                member("lifeDuration", &EmitterEntry::mLifeDuration),
+                member("emitRate", &EmitterEntry::mEmitRate),
+                member("emitAreaMultiplier", &EmitterEntry::mEmitAreaMultiplier),
+                member("initialRotation", &EmitterEntry::mInitialRotation),
+                member("rotationVelocity", &EmitterEntry::mRotationVelocity),
+                member("rotationUnknown", &EmitterEntry::mRotationUnknown),
+                member("minScale", &EmitterEntry::mMinScale),
+                member("scaleVelocity", &EmitterEntry::mScaleVelocity),
+                member("maxRandScale", &EmitterEntry::mMaxRandScale),
+                member("colourRed", &EmitterEntry::mColourRed),
+                member("colourGreen", &EmitterEntry::mColourGreen),
+                member("colourBlue", &EmitterEntry::mColourBlue),
+                member("opacity", &EmitterEntry::mOpacity),
+                member("minVelocityX", &EmitterEntry::mMinVelocityX),
+                member("minVelocityY", &EmitterEntry::mMinVelocityY),
+                member("maxVelocityX", &EmitterEntry::mMaxVelocityX),
+                member("maxVelocityY", &EmitterEntry::mMaxVelocityY),
+                member("accelerationX", &EmitterEntry::mAccelerationX),
+                member("accelerationY", &EmitterEntry::mAccelerationY),
+                member("directionSpeed", &EmitterEntry::mDirectionSpeed),
+                member("directionRandomSpeed", &EmitterEntry::mDirectionRandomSpeed),
+                member("directionAcceleration", &EmitterEntry::mDirectionAcceleration),
+                member("directionAngle", &EmitterEntry::mDirectionAngle),
+                member("directionRandomAngle", &EmitterEntry::mDirectionRandomAngle),
+                member("unknownA", &EmitterEntry::mUnknownA),
+                member("unknownB", &EmitterEntry::mUnknownB)
+            };
+        };
+        // the entry follows these, its record is picked by type
+        template<> struct FieldsOf<Element> {
+            static constexpr auto value = std::tuple{
+                member("magic", &Element::magic),
+                member("type", &Element::eType),
+                member("flags", &Element::flags),
+                member("generic", &Element::generic)
+            };
+        };
+
+        template<typename T>
+        concept Record = requires { FieldsOf<T>::value; };
+
+        // flag unions and colors travel as their underlying integer
+        template<typename F>
+        struct RawOf;
+        template<> struct RawOf<Bits8> { static constexpr auto value = &Bits8::asByte; };
+        template<> struct RawOf<Bits16> { static constexpr auto value = &Bits16::asShort; };
+        template<> struct RawOf<Bits32> { static constexpr auto value = &Bits32::asInt; };
+        template<> struct RawOf<GenericDataFlags> { static constexpr auto value = &GenericDataFlags::asInt; };
+        template<> struct RawOf<MovementInfoFlags> { static constexpr auto value = &MovementInfoFlags::asShort; };
+        template<> struct RawOf<EmitterFlags> { static constexpr auto value = &EmitterFlags::asShort; };
+        template<> struct RawOf<ColorARGB> { static constexpr auto value = &ColorARGB::asInt; };
+
+        template<typename F>
+        concept Raw = requires { RawOf<F>::value; };
+
+        // appends compact json to Out in one pass, nothing is built in between
+        struct Writer {
+            std::string& Out;
+
+            void key(const std::string_view key) {
+                Out += '"';
+                Out.append(key);
+                Out.append("\":");
+            }
+
+            void value(const bool v) {
+                Out.append(v ? "true" : "false");
+            }
+
+            template<typename V> requires std::is_integral_v<V>
+            void value(const V v) {
+                char buf[24];
+                const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+                Out.append(buf, res.ptr);
+            }
+
+            // shortest form that reads back to the same float. json has no nan or inf, those go in quotes
+            void value(const float v) {
+                char buf[32];
+                const auto res = std::to_chars(buf + 1, buf + sizeof(buf) - 1, v);
+                if (std::isfinite(v)) {
+                    Out.append(buf + 1, res.ptr);
+                    return;
+                }
+                buf[0] = '"';
+                *res.ptr = '"';
+                Out.append(buf, res.ptr + 1);
+            }
+
+            template<Raw F>
+            void value(const F& v) {
+                value(v.*RawOf<F>::value);
+            }
+
+            void value(const Point& v) {
+                Out += '[';
+                value(v.x);
+                Out += ',';
+                value(v.y);
+                Out += ']';
+            }
+
+            template<typename A>
+            void value(const std::vector<Point, A>& v) {
+                Out += '[';
+                for (size_t i = 0; i < v.size(); ++i) {
+                    if (i)
+                        Out += ',';
+                    value(v[i]);
+                }
+                Out += ']';
+            }
+
+            // strings are bytes. anything json cannot hold as is, and everything above 0x7f, is escaped as the
+            // code point of the same number, so the output is ascii and reads back byte for byte
+            void value(const std::string_view v) {
+                constexpr char hex[] = "0123456789abcdef";
+                Out += '"';
+                size_t run = 0;
+                for (size_t i = 0; i < v.size(); ++i) {
+                    const auto c = static_cast<uint8_t>(v[i]);
+                    if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+                        continue;
+                    Out.append(v.data() + run, i - run);
+                    run = i + 1;
+                    switch (c) {
+                        case '"': Out.append("\\\""); break;
+                        case '\\': Out.append("\\\\"); break;
+                        case '\n': Out.append("\\n"); break;
+                        case '\r': Out.append("\\r"); break;
+                        case '\t': Out.append("\\t"); break;
+                        default: {
+                            const char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                            Out.append(escaped, sizeof(escaped));
+                        }
+                    }
+                }
+                Out.append(v.data() + run, v.size() - run);
+                Out += '"';
+            }
+
+            template<Record T>
+            void value(const T& v) {
+                Out += '{';
+                fields(v);
+                Out += '}';
+            }
+
+            template<typename T>
+            void value(const T* v) {
+                if (!v)
+                    Out.append("null");
+                else
+                    value(*v);
+            }
+
+            void value(const Element& v) {
+                Out += '{';
+                fields(v);
+                Out += ',';
+                key("entry");
+                entry(v.entry);
+                Out += '}';
+            }
+
+            void entry(const Entry* v) {
+                if (!v) {
+                    Out.append("null");
+                    return;
+                }
+                switch (Entry::GetType(v)) {
+                    case Rod: value(*Entry::GetRod(v)); break;
+                    case Polygon: value(*Entry::GetPolygon(v)); break;
+                    case Circle: value(*Entry::GetCircle(v)); break;
+                    case Brick: value(*Entry::GetBrick(v)); break;
+                    case Teleporter: value(*Entry::GetTeleporter(v)); break;
+                    case Emitter: value(*Entry::GetEmitter(v)); break;
+                    default: Out.append("null"); break;  // nothing is written for these either
+                }
+            }
+
+            template<Record T>
+            void fields(const T& v) {
+                std::apply([&](const auto& head, const auto&... rest) {
+                    key(head.Key);
+                    value(v.*head.Pointer);
+                    ((Out += ',', key(rest.Key), value(v.*rest.Pointer)), ...);
+                }, FieldsOf<T>::value);
+            }
+
+            void level(const LevelTypes::Level& lvl) {
+                Out += '{';
+                key("version");
+                value(lvl.version);
+                Out += ',';
+                key("sync");
+                value(lvl.sync_f);
+                Out += ',';
+                key("entries");
+                value(lvl.entries);
+                Out += ',';
+                key("elements");
+                Out += '[';
+                for (size_t i = 0; i < lvl.Elements.size(); ++i) {
+                    if (i)
+                        Out += ',';
+                    value(lvl.Elements[i]);
+                }
+                Out.append("]}");
+            }
+        };
+
+        // pulls tokens off the text and stores them straight into the level, no document is built
+        struct Reader {
+            const char* At;
+            const char* End;
+            LevelTypes::Level& Lvl;
+            std::pmr::memory_resource* Arena;
+            // unescaped strings and keys, valid until the next one is read
+            std::string Scratch{};
+            uint32_t Depth = 0;
+
+            [[noreturn]] static void malformed() {
+                throw std::exception("Malformed level json");
+            }
+
+            void ws() {
+                while (At < End && (*At == ' ' || *At == '\n' || *At == '\r' || *At == '\t'))
+                    ++At;
+            }
+
+            bool consume(const char c) {
+                ws();
+                if (At == End || *At != c)
+                    return false;
+                ++At;
+                return true;
+            }
+
+            void expect(const char c) {
+                if (!consume(c))
+                    malformed();
+            }
+
+            bool literal(const std::string_view word) {
+                ws();
+                if (static_cast<size_t>(End - At) < word.size() || memcmp(At, word.data(), word.size()) != 0)
+                    return false;
+                At += word.size();
+                return true;
+            }
+
+            void enter() {
+                if (++Depth > max_depth)
+                    malformed();
+            }
+
+            void leave() {
+                --Depth;
+            }
+
+            // bytes of a string, from \u escapes up to 00ff or the utf-8 of those code points
+            std::string_view string() {
+                expect('"');
+                const char* start = At;
+                while (At < End && *At != '"' && *At != '\\' && static_cast<uint8_t>(*At) >= 0x20 && static_cast<uint8_t>(*At) < 0x80)
+                    ++At;
+                if (At < End && *At == '"')
+                    return {start, static_cast<size_t>(At++ - start)};
+
+                Scratch.assign(start, At);
+                for (;;) {
+                    if (At == End)
+                        malformed();
+                    const auto c = static_cast<uint8_t>(*At++);
+                    if (c == '"')
+                        return Scratch;
+                    if (c < 0x20)
+                        malformed();
+                    if (c < 0x80 && c != '\\') {
+                        Scratch += static_cast<char>(c);
+                        continue;
+                    }
+                    if (c >= 0x80) {
+                        if ((c != 0xC2 && c != 0xC3) || At == End || (static_cast<uint8_t>(*At) & 0xC0) != 0x80)
+                            throw std::exception("Level json string is not latin-1");
+                        Scratch += static_cast<char>((c & 0x03) << 6 | (static_cast<uint8_t>(*At++) & 0x3F));
+                        continue;
+                    }
+                    if (At == End)
+                        malformed();
+                    switch (*At++) {
+                        case '"': Scratch += '"'; break;
+                        case '\\': Scratch += '\\'; break;
+                        case '/': Scratch += '/'; break;
+                        case 'b': Scratch += '\b'; break;
+                        case 'f': Scratch += '\f'; break;
+                        case 'n': Scratch += '\n'; break;
+                        case 'r': Scratch += '\r'; break;
+                        case 't': Scratch += '\t'; break;
+                        case 'u': {
+                            uint32_t code = 0;
+                            if (End - At < 4 || std::from_chars(At, At + 4, code, 16).ptr != At + 4)
+                                malformed();
+                            At += 4;
+                            if (code > 0xFF)
+                                throw std::exception("Level json string is not latin-1");
+                            Scratch += static_cast<char>(code);
+                            break;
+                        }
+                        default: malformed();
+                    }
+                }
+            }
+
+            template<typename V>
+            void number(V& v) {
+                ws();
+                if constexpr (std::is_floating_point_v<V>) {
+                    if (At < End && *At == '"') {
+                        const auto str = string();
+                        if (std::from_chars(str.data(), str.data() + str.size(), v).ptr != str.data() + str.size())
+                            malformed();
+                        return;
+                    }
+                }
+                const auto res = std::from_chars(At, End, v);
+                if (res.ec != std::errc{})
+                    malformed();
+                At = res.ptr;
+            }
+
+            // anything under a key the tables do not know
+            void skip() {
+                ws();
+                if (At == End)
+                    malformed();
+                switch (*At) {
+                    case '"': {
+                        string();
+                        return;
+                    }
+                    case '{': {
+                        enter();
+                        ++At;
+                        if (!consume('}')) {
+                            do {
+                                string();
+                                expect(':');
+                                skip();
+                            } while (consume(','));
+                            expect('}');
+                        }
+                        leave();
+                        return;
+                    }
+                    case '[': {
+                        enter();
+                        ++At;
+                        if (!consume(']')) {
+                            do skip();
+                            while (consume(','));
+                            expect(']');
+                        }
+                        leave();
+                        return;
+                    }
+                    default: {
+                        if (literal("true") || literal("false") || literal("null"))
+                            return;
+                        double ignored;
+                        number(ignored);
+                    }
+                }
+            }
+
+            void value(bool& v) {
+                if (literal("true"))
+                    v = true;
+                else if (literal("false"))
+                    v = false;
+                else
+                    malformed();
+            }
+
+            template<typename V> requires std::is_arithmetic_v<V>
+            void value(V& v) {
+                number(v);
+            }
+
+            template<Raw F>
+            void value(F& v) {
+                v = {};
+                number(v.*RawOf<F>::value);
+            }
+
+            void value(Point& v) {
+                expect('[');
+                number(v.x);
+                expect(',');
+                number(v.y);
+                expect(']');
+            }
+
+            template<typename A>
+            void value(std::vector<Point, A>& v) {
+                v.clear();
+                expect('[');
+                if (consume(']'))
+                    return;
+                do value(v.emplace_back());
+                while (consume(','));
+                expect(']');
+            }
+
+            void value(std::string_view& v) {
+                const auto str = string();
+                v = str.empty() ? std::string_view{} : Peggle::Level::StoreString(Lvl, str);
+            }
+
+            template<Record T>
+            void value(T& v) {
+                enter();
+                expect('{');
+                if (!consume('}')) {
+                    size_t next = 0;
+                    do {
+                        const auto key = string();
+                        expect(':');
+                        if (!field(v, key, next))
+                            skip();
+                    } while (consume(','));
+                    expect('}');
+                }
+                leave();
+            }
+
+            template<typename T>
+            void value(T*& v) {
+                if (literal("null")) {
+                    v = nullptr;
+                    return;
+                }
+                v = LevelSchema::arena_new<T>(Arena);
+                value(*v);
+            }
+
+            void value(Element& v) {
+                enter();
+                expect('{');
+                bool typed = false;
+                if (!consume('}')) {
+                    size_t next = 0;
+                    do {
+                        const auto key = string();
+                        expect(':');
+                        if (key == "entry") {
+                            if (!typed)
+                                throw std::exception("Level json element has its entry before its type");
+                            entry(v);
+                            continue;
+                        }
+                        const bool type = key == "type";
+                        if (field(v, key, next))
+                            typed |= type;
+                        else
+                            skip();
+                    } while (consume(','));
+                    expect('}');
+                }
+                leave();
+            }
+
+            // the record is picked by the element's type, like when decoding
+            void entry(Element& v) {
+                if (literal("null")) {
+                    v.entry = nullptr;
+                    return;
+                }
+                v.entry = Peggle::Level::CreateEntry(Lvl, static_cast<LevelEntryType>(v.eType));
+                switch (Entry::GetType(v.entry)) {
+                    case Rod: value(*Entry::GetRod(v.entry)); break;
+                    case Polygon: value(*Entry::GetPolygon(v.entry)); break;
+                    case Circle: value(*Entry::GetCircle(v.entry)); break;
+                    case Brick: value(*Entry::GetBrick(v.entry)); break;
+                    case Teleporter: value(*Entry::GetTeleporter(v.entry)); break;
+                    case Emitter: value(*Entry::GetEmitter(v.entry)); break;
+                    default: skip(); break;
+                }
+            }
+
+            // keys usually come in table order, so the search starts after the last one found
+            template<Record T>
+            bool field(T& v, const std::string_view key, size_t& next) {
+                static constexpr auto keys = std::apply([](const auto&... m) {
+                    return std::array<std::string_view, sizeof...(m)>{m.Key...};
+                }, FieldsOf<T>::value);
+                for (size_t k = 0; k < keys.size(); ++k) {
+                    const size_t i = (next + k) % keys.size();
+                    if (keys[i] != key)
+                        continue;
+                    next = i + 1;
+                    read_at(v, i, std::make_index_sequence<keys.size()>{});
+                    return true;
+                }
+                return false;
+            }
+
+            template<Record T, size_t... I>
+            void read_at(T& v, const size_t i, std::index_sequence<I...>) {
+                ((i == I ? value(v.*std::get<I>(FieldsOf<T>::value).Pointer) : void()), ...);
+            }
+
+            void level() {
+                expect('{');
+                if (!consume('}')) {
+                    do {
+                        const auto key = string();
+                        expect(':');
+                        if (key == "version")
+                            number(Lvl.version);
+                        else if (key == "sync")
+                            number(Lvl.sync_f);
+                        else if (key == "entries")
+                            number(Lvl.entries);
+                        else if (key == "elements")
+                            elements();
+                        else
+                            skip();
+                    } while (consume(','));
+                    expect('}');
+                }
+                ws();
+                if (At != End)
+                    malformed();
+            }
+
+            void elements() {
+                expect('[');
+                // size it up front, every element takes at least "{}"
+                Lvl.Elements.reserve(std::min<size_t>(Lvl.entries, static_cast<size_t>(End - At) / 2));
+                if (consume(']'))
+                    return;
+                do value(Lvl.Elements.emplace_back());
+                while (consume(','));
+                expect(']');
+            }
+        };
+    }
+
+    std::string Level::BuildLevelJson(const LevelTypes::Level& lvl) {
+        std::string out;
+        BuildLevelJson(lvl, out);
+        return out;
+    }
+
+    void Level::BuildLevelJson(const LevelTypes::Level& lvl, std::string& out) {
+        out.reserve(out.size() + lvl.Elements.size() * JsonHelpers::element_bytes);
+        JsonHelpers::Writer writer = {out};
+        writer.level(lvl);
+    }
+
+    LevelTypes::Level Level::LoadLevelJson(const std::string_view json) {
+        LevelTypes::Level lvl = {};
+        auto* arena = GetArena(lvl);
+        JsonHelpers::Reader reader = {json.data(), json.data() + json.size(), lvl, arena};
+        reader.level();
+        lvl.valid = true;
+        return lvl;
+    }
+
+    std::map<std::string, std::string> Level::BuildPakJson(Pak& pak, const unsigned threads) {
+        std::vector<std::string> paths;
+        for (const auto& path : pak.GetFileList())
+            if (PipelineHelpers::is_level_path(path))
+                paths.push_back(path);
+
+        std::vector<std::string> json(paths.size());
+        WorkPool::parallel_for(paths.size(), threads, [&](const size_t i, unsigned) {
+            const auto file = pak.GetFile(paths[i]);
+            if (file.State != FileState::OK)
+                throw std::exception("Failed to read level from pak");
+            BuildLevelJson(LoadLevel(file), json[i]);
+        });
+
+        std::map<std::string, std::string> res;
+        for (size_t i = 0; i < paths.size(); ++i)
+            res.emplace(std::move(paths[i]), std::move(json[i]));
+        return res;
+    }
+
+#pragma endregion
+}
@@ -1,1020 +1,324 @@
 #include "binstream.h"
 #include "iohelper.h"
+#include "levelschema.h"
 #include "libpeggle.h"
 #include "logma.h"
 #include "utils.h"
+#include <algorithm>
 #include <cstdlib>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
 
 namespace Peggle {
 #pragma region libpeggle_Level
 
-    struct LevelTypes::Entry {
-        union EntryData {
-            LevelTypes::RodEntry* Rod;
-            LevelTypes::PolygonEntry* Polygon;
-            LevelTypes::CircleEntry* Circle;
-            LevelTypes::BrickEntry* Brick;
-            LevelTypes::TeleportEntry* Teleport;
-            LevelTypes::EmitterEntry* Emitter;
-        };
-    private:
-        LevelTypes::LevelEntryType Type{};
-        EntryData Data{};
-
-    public:
-        explicit Entry(const LevelEntryType type) {
-            Type = type;
-            switch (type) {
-                case Rod: { Data.Rod = new RodEntry; break; }
-                case Polygon: { Data.Polygon = new PolygonEntry; break; }
-                case Circle: { Data.Circle = new CircleEntry; break; }
-                case Brick: { Data.Brick = new BrickEntry; break; }
-                case Teleporter: { Data.Teleport = new TeleportEntry; break; }
-                case Emitter: { Data.Emitter = new EmitterEntry; break; }
-                default: break;
-            }
-        }
-
-        static LevelTypes::RodEntry* GetRod(const Entry* entry) {
-            if (entry->Type == LevelEntryType::Rod)
-                return entry->Data.Rod;
-            return nullptr;
-        }
-        static LevelTypes::PolygonEntry* GetPolygon(const Entry* entry) {
-            if (entry->Type == LevelEntryType::Polygon)
-                return entry->Data.Polygon;
-            return nullptr;
-        }
-        static LevelTypes::CircleEntry* GetCircle(const Entry* entry) {
-            if (entry->Type == LevelEntryType::Circle)
-                return entry->Data.Circle;
-            return nullptr;
-        }
-        static LevelTypes::BrickEntry* GetBrick(const Entry* entry) {
-            if (entry->Type == LevelEntryType::Brick)
-                return entry->Data.Brick;
-            return nullptr;
-        }
-        static LevelTypes::TeleportEntry* GetTeleporter(const Entry* entry) {
-            if (entry->Type == LevelEntryType::Teleporter)
-                return entry->Data.Teleport;
-            return nullptr;
-        }
-        static LevelTypes::EmitterEntry* GetEmitter(const Entry* entry) {
-            if (entry->Type == LevelEntryType::Emitter)
-                return entry->Data.Emitter;
-            return nullptr;
-        }
-
-        static LevelTypes::RodEntry* GetRod(const Entry& entry) {
-            if (entry.Type == LevelEntryType::Rod)
-                return entry.Data.Rod;
-            return nullptr;
-        }
-        static LevelTypes::PolygonEntry* GetPolygon(const Entry& entry) {
-            if (entry.Type == LevelEntryType::Polygon)
-                return entry.Data.Polygon;
-            return nullptr;
-        }
-        static LevelTypes::CircleEntry* GetCircle(const Entry& entry) {
-            if (entry.Type == LevelEntryType::Circle)
-                return entry.Data.Circle;
-            return nullptr;
-        }
-        static LevelTypes::BrickEntry* GetBrick(const Entry& entry) {
-            if (entry.Type == LevelEntryType::Brick)
-                return entry.Data.Brick;
-            return nullptr;
-        }
-        static LevelTypes::TeleportEntry* GetTeleporter(const Entry& entry) {
-            if (entry.Type == LevelEntryType::Teleporter)
-                return entry.Data.Teleport;
-            return nullptr;
-        }
-        static LevelTypes::EmitterEntry* GetEmitter(const Entry& entry) {
-            if (entry.Type == LevelEntryType::Emitter)
-                return entry.Data.Emitter;
-            return nullptr;
-        }
-
-        static LevelEntryType GetType(const Entry& entry) {
-            return entry.Type;
-        }
-        static LevelEntryType GetType(const Entry* entry) {
-            return entry->Type;
-        }
+    struct LevelTypes::LevelStorage {
+        // bytes the level was loaded from, decoded strings point into this
+        binstream Source;
+        // elements, entries, points, sub records and stored strings. nothing in here is freed on its own, the whole
+        // arena goes away with the level
+        std::pmr::monotonic_buffer_resource Arena;
     };
 
+    // readers and writers are generated from the record schemas in levelschema.h.
+    // Format is either LevelSchema::LevelFormat or a LevelSchema::VersionFamily picked once per level
     namespace LevelHelpers {
-        /// fwd declarations ///
-        std::string read_string(binstream& bs);
-        void write_string(binstream& bs, const std::string& str);
-
-        LevelTypes::VariableFloat read_variable_float(binstream& bs);
-        void write_variable_float(binstream& bs, const LevelTypes::VariableFloat& vf);
-
-        LevelTypes::Point read_point(binstream& bs);
-        void write_point(binstream& bs, const LevelTypes::Point& p);
-
-        LevelTypes::RodEntry read_entry_rod(binstream& bs);
-        void write_entry_rod(binstream& bs, const LevelTypes::RodEntry& entry);
-        LevelTypes::PolygonEntry read_entry_polygon(binstream& bs);
-        void write_entry_polygon(binstream& bs, uint32_t version, const LevelTypes::PolygonEntry& entry);
-        LevelTypes::CircleEntry read_entry_circle(binstream& bs, uint32_t version);
-        void write_entry_circle(binstream& bs, uint32_t version, const LevelTypes::CircleEntry& entry);
-        LevelTypes::BrickEntry read_entry_brick(binstream& bs, uint32_t version);
-        void write_entry_brick(binstream& bs, uint32_t version, const LevelTypes::BrickEntry& entry);
-        LevelTypes::TeleportEntry read_entry_teleport(binstream& bs, uint32_t version);
-        void write_entry_teleport(binstream& bs, uint32_t version, const LevelTypes::TeleportEntry& entry);
-        LevelTypes::EmitterEntry read_entry_emitter(binstream& bs);
-        void write_entry_emitter(binstream& bs, const LevelTypes::EmitterEntry& entry);
-
-        LevelTypes::Entry read_entry(binstream& bs, int32_t eType, uint32_t version);
-        void write_entry(binstream& bs, uint32_t version, const LevelTypes::Entry& entry);
-
-        LevelTypes::MovementInfo read_movement(binstream& bs);
-        void write_movement(binstream& bs, const LevelTypes::MovementInfo& m);
-
-        LevelTypes::MovementLink read_movement_link(binstream& bs);
-        void write_movement_link(binstream& bs, const LevelTypes::MovementLink& l);
-
-        LevelTypes::PegInfo read_peginfo(binstream& bs);
-        void write_peginfo(binstream& bs, const LevelTypes::PegInfo& p);
-
-        LevelTypes::GenericData read_generic(binstream& bs, LevelTypes::GenericDataFlags flags);
-        void write_generic(binstream& bs, const LevelTypes::GenericDataFlags& flags, const LevelTypes::GenericData& generic);
-
-        LevelTypes::Element read_element(binstream& bs, uint32_t version);
-        void write_element(binstream& bs, uint32_t version, const LevelTypes::Element& element);
-
-        /// implementations ///
-        std::string read_string(binstream& bs) {
-            const auto len = bs.read<int16_t>();
-            std::string res;
-            if (len == 0) return res;
-            const char* data = static_cast<char*>(bs.bytes(len));
-            res.assign(data, len);
-            return res;
-        }
-        void write_string(binstream &bs, const std::string& str) {
-            const auto len = static_cast<int16_t>(str.length());
-            bs.write(len);
-            if (len == 0) return;
-            bs.write(str.c_str(), len);
-        }
-
-        LevelTypes::VariableFloat read_variable_float(binstream& bs) {
-            LevelTypes::VariableFloat res = {};
-            const auto var1 = bs.read<char>();
-
-            if (var1 > 0) {
-                res.mIsVariable = false;
-                res.mStaticVariable = bs.read<float>();
-            } else {
-                res.mIsVariable = true;
-                res.mVariableValue = read_string(bs);
-            }
-
-            return res;
-        }
-        void write_variable_float(binstream& bs, const LevelTypes::VariableFloat& vf) {
-            const auto var1 = static_cast<int8_t>(!vf.mIsVariable);
-            bs.write(var1);
-            if (vf.mIsVariable)
-                write_string(bs, vf.mVariableValue);
-            else
-                bs.write(vf.mStaticVariable);
-        }
-
-        LevelTypes::Point read_point(binstream& bs) {
-            return LevelTypes::Point{
-                bs.read<float>(),
-                bs.read<float>()
-            };
-        }
-        void write_point(binstream& bs, const LevelTypes::Point& p) {
-            bs.write(p.x);
-            bs.write(p.y);
-        }
-
-        // entry pain city //
-
-        LevelTypes::RodEntry read_entry_rod(binstream &bs) {
-            LevelTypes::RodEntry entry = {};
-
-            entry.mFlags = {};
-            entry.mFlags.asByte = bs.read<uint8_t>();
-
-            entry.mPointA = read_point(bs);
-            entry.mPointB = read_point(bs);
-
-            if (entry.mFlags.v0)
-                entry.mE = bs.read<float>();
-            if (entry.mFlags.v1)
-                entry.mF = bs.read<float>();
-
-            return entry;
-        }
-        void write_entry_rod(binstream &bs, const LevelTypes::RodEntry &entry) {
-            bs.write(entry.mFlags.asByte);
-
-            write_point(bs, entry.mPointA);
-            write_point(bs, entry.mPointB);
-
-            if (entry.mFlags.v0)
-                bs.write(entry.mE);
-            if (entry.mFlags.v1)
-                bs.write(entry.mF);
-        }
-
-        LevelTypes::PolygonEntry read_entry_polygon(binstream &bs, const uint32_t version) {
-            LevelTypes::PolygonEntry entry = {};
-
-            entry.mFlagsA = {};
-            entry.mFlagsA.asByte = bs.read<uint8_t>();
-            entry.mFlagsB = {};
-            if (version > 0x23)
-                entry.mFlagsB.asByte = bs.read<uint8_t>();
-
-            if (entry.mFlagsA.v2)
-                entry.mRotation = bs.read<float>();
-            if (entry.mFlagsA.v3)
-                entry.mUnk1 = bs.read<float>();
-            if (entry.mFlagsA.v5)
-                entry.mScale = bs.read<float>();
-            if (entry.mFlagsA.v1)
-                entry.mNormalDir = bs.read<uint8_t>();
-            if (entry.mFlagsA.v4)
-                entry.mPos = read_point(bs);
-
-            const auto numPoints = bs.read<int32_t>();
-            for (int i = 0; i < numPoints; ++i)
-                entry.mPoints.emplace_back(read_point(bs));
-
-            if (entry.mFlagsB.v0)
-                entry.mUnk2 = bs.read<uint8_t>();
-            if (entry.mFlagsB.v1)
-                entry.mGrowType = bs.read<int32_t>();
-
-            return entry;
-        }
-        void write_entry_polygon(binstream &bs, const uint32_t version, const LevelTypes::PolygonEntry &entry) {
-            bs.write(entry.mFlagsA.asByte);
-            if (version > 0x23)
-                bs.write(entry.mFlagsB.asByte);
-
-            if (entry.mFlagsA.v2)
-                bs.write(entry.mRotation);
-            if (entry.mFlagsA.v3)
-                bs.write(entry.mUnk1);
-            if (entry.mFlagsA.v5)
-                bs.write(entry.mScale);
-            if (entry.mFlagsA.v1)
-                bs.write(entry.mNormalDir);
-            if (entry.mFlagsA.v4)
-                write_point(bs, entry.mPos);
-
-            const auto mNumPoints = static_cast<int32_t>(entry.mPoints.size());
-            bs.write(mNumPoints);
-            for (const auto& point : entry.mPoints)
-                write_point(bs, point);
-
-            if (entry.mFlagsB.v0)
-                bs.write(entry.mUnk2);
-            if (entry.mFlagsB.v1)
-                bs.write(entry.mGrowType);
-        }
-
-        LevelTypes::CircleEntry read_entry_circle(binstream& bs, const uint32_t version) {
-            LevelTypes::CircleEntry entry = {};
-
-            entry.mFlagsA = {};
-            entry.mFlagsA.asByte = bs.read<uint8_t>();
-            entry.mFlagsB = {};
-            if (version >= 0x52)
-                entry.mFlagsB.asByte = bs.read<uint8_t>();
-
-            if (entry.mFlagsA.v1)
-                entry.mPos = read_point(bs);
-            entry.mRadius = bs.read<float>();
-
-            return entry;
-        }
-        void write_entry_circle(binstream& bs, const uint32_t version, const LevelTypes::CircleEntry& entry) {
-            bs.write(entry.mFlagsA.asByte);
-            if (version >= 0x52)
-                bs.write(entry.mFlagsB.asByte);
-
-            if (entry.mFlagsA.v1)
-                bs.write(entry.mPos);
-            bs.write(entry.mRadius);
-        }
-
-        LevelTypes::BrickEntry read_entry_brick(binstream& bs, const uint32_t version) {
-            LevelTypes::BrickEntry entry = {};
-
-            entry.mFlagsA = {};
-            entry.mFlagsA.asByte = bs.read<uint8_t>();
-
-            entry.mFlagsB = {};
-            if (version >= 0x23)
-                entry.mFlagsB.asByte = bs.read<uint8_t>();
-
-            if (entry.mFlagsA.v2)
-                entry.mUnk1 = bs.read<float>();
-            if (entry.mFlagsA.v3)
-                entry.mUnk2 = bs.read<float>();
-            if (entry.mFlagsA.v5)
-                entry.mUnk3 = bs.read<float>();
-            if (entry.mFlagsA.v1)
-                entry.mUnk4 = bs.read<uint8_t>();
-            if (entry.mFlagsA.v4)
-                entry.mPos = read_point(bs);
-
-            if (entry.mFlagsB.v0)
-                entry.mUnk5 = bs.read<uint8_t>();
-            if (entry.mFlagsB.v1)
-                entry.mUnk6 = bs.read<int32_t>();
-            if (entry.mFlagsB.v2)
-                entry.mUnk7 = bs.read<int16_t>();
-
-            entry.mFlagsC = {};
-            entry.mFlagsC.asShort = bs.read<uint16_t>();
-
-            if (entry.mFlagsC.v8)
-                entry.mUnk8 = bs.read<float>();
-            if (entry.mFlagsC.v9)
-                entry.mUnk9 = bs.read<float>();
-            if (entry.mFlagsC.v2) {
-                entry.mType = bs.read<uint8_t>();
-                if (entry.mType == 5)
-                    entry.mCurved = false;
-            }
-            if (entry.mFlagsC.v3)
-                entry.mCurvedPoints = bs.read<uint8_t>() + 2;
-            if (entry.mFlagsC.v5)
-                entry.mLeftAngle = bs.read<float>();
-            if (entry.mFlagsC.v6) {
-                entry.mRightAngle = bs.read<float>();
-                entry.mUnk10 = bs.read<float>();
-            }
-            if (entry.mFlagsC.v4)
-                entry.mSectorAngle = bs.read<float>();
-            if (entry.mFlagsC.v7)
-                entry.mWidth = bs.read<float>();
-
-            entry.mTextureFlip = entry.mFlagsC.v10;
-
-            entry.mLength = bs.read<float>();
-            entry.mAngle = bs.read<float>();
-
-            // entry.mUnk12.asInt = bs.read<uint32_t>();
-            entry.mUnk12 = bs.read<uint32_t>();
-
-            return entry;
-        }
-        void write_entry_brick(binstream& bs, const uint32_t version, const LevelTypes::BrickEntry& entry) {
-            bs.write(entry.mFlagsA.asByte);
-            if (version >= 0x23)
-                bs.write(entry.mFlagsB.asByte);
-
-            if (entry.mFlagsA.v2)
-                bs.write(entry.mUnk1);
-            if (entry.mFlagsA.v3)
-                bs.write(entry.mUnk2);
-            if (entry.mFlagsA.v5)
-                bs.write(entry.mUnk3);
-            if (entry.mFlagsA.v1)
-                bs.write(entry.mUnk4);
-            if (entry.mFlagsA.v4)
-                write_point(bs, entry.mPos);
-
-            if (entry.mFlagsB.v0)
-                bs.write(entry.mUnk5);
-            if (entry.mFlagsB.v1)
-                bs.write(entry.mUnk6);
-            if (entry.mFlagsB.v2)
-                bs.write(entry.mUnk7);
-
-            bs.write(entry.mFlagsC.asShort);
-
-            if (entry.mFlagsC.v8)
-                bs.write(entry.mUnk8);
-            if (entry.mFlagsC.v9)
-                bs.write(entry.mUnk9);
-            if (entry.mFlagsC.v2)
-                bs.write(entry.mType);
-            if (entry.mFlagsC.v3) {
-                const uint8_t points = entry.mCurvedPoints - 2;
-                bs.write(points);
-            }
-            if (entry.mFlagsC.v5)
-                bs.write(entry.mLeftAngle);
-            if (entry.mFlagsC.v6) {
-                bs.write(entry.mRightAngle);
-                bs.write(entry.mUnk10);
-            }
-            if (entry.mFlagsC.v4)
-                bs.write(entry.mSectorAngle);
-            if (entry.mFlagsC.v7)
-                bs.write(entry.mWidth);
-
-            bs.write(entry.mLength);
-            bs.write(entry.mAngle);
-
-            // bs.write(entry.mUnk12.asInt);
-            bs.write(entry.mUnk12);
+        template<typename Format>
+        LevelTypes::Element read_element(binstream& bs, const Format& fmt) {
+            LevelTypes::Element element = {};
+            const auto start = bs.tell();
+            LevelSchema::Codec<LevelTypes::Element>::read(bs, element, fmt);
+            element.source = {bs.buffer() + start, static_cast<uint32_t>(bs.tell() - start)};
+            return element;
         }
-
-        LevelTypes::TeleportEntry read_entry_teleport(binstream& bs, const uint32_t version) {
-            LevelTypes::TeleportEntry entry = {};
-
-            entry.mFlags = {};
-            entry.mFlags.asByte = bs.read<uint8_t>();
-
-            entry.mWidth = bs.read<int32_t>();
-            entry.mHeight = bs.read<int32_t>();
-
-            if (entry.mFlags.v1)
-                entry.mUnk0 = bs.read<int16_t>();
-            if (entry.mFlags.v3)
-                entry.mUnk1 = bs.read<int32_t>();
-            if (entry.mFlags.v5)
-                entry.mUnk2 = bs.read<int32_t>();
-            if (entry.mFlags.v4) {
-                // auto* sub = static_cast<LevelTypes::Element*>(malloc(sizeof LevelTypes::Element));
-                auto* sub = new LevelTypes::Element;
-                *sub = read_element(bs, version);
-                entry.mEntry = sub;
-            }
-            if (entry.mFlags.v2)
-                entry.mPos = read_point(bs);
-            if (entry.mFlags.v6) {
-                entry.mUnk3 = bs.read<float>();
-                entry.mUnk4 = bs.read<float>();
-            }
-
-            return entry;
+        template<typename Format>
+        void write_element(binstream& bs, const Format& fmt, const LevelTypes::Element& element) {
+            LevelSchema::Codec<LevelTypes::Element>::write(bs, element, fmt);
         }
-        void write_entry_teleport(binstream& bs, const uint32_t version, const LevelTypes::TeleportEntry& entry) {
-            bs.write(entry.mFlags.asByte);
 
-            bs.write(entry.mWidth);
-            bs.write(entry.mHeight);
+        // takes the place of the output stream and compares what would be written with bytes already there
+        struct SourceMatch {
+            const uint8_t* At = nullptr;
+            const uint8_t* End = nullptr;
+            bool Same = true;
 
-            if (entry.mFlags.v1)
-                bs.write(entry.mUnk0);
-            if (entry.mFlags.v3)
-                bs.write(entry.mUnk1);
-            if (entry.mFlags.v5)
-                bs.write(entry.mUnk2);
-            if (entry.mFlags.v4)
-                write_element(bs, version, *entry.mEntry);
-            if (entry.mFlags.v2)
-                write_point(bs, entry.mPos);
-            if (entry.mFlags.v6) {
-                bs.write(entry.mUnk3);
-                bs.write(entry.mUnk4);
+            template<typename T>
+            void write(const T& value) {
+                write(&value, sizeof(T));
             }
-        }
-
-        LevelTypes::EmitterEntry read_entry_emitter(binstream& bs) {
-            LevelTypes::EmitterEntry entry = {};
-
-            entry.mMainVar = bs.read<int32_t>();
-
-            entry.mFlags = {};
-            entry.mFlags.asShort = bs.read<uint16_t>();
-
-            entry.mImage = read_string(bs);
-            entry.mWidth = bs.read<int32_t>();
-            entry.mHeight = bs.read<int32_t>();
-
-            if (entry.mMainVar == 2) {
-                entry.mMainVar0 = bs.read<int32_t>();
-                entry.mMainVar1 = bs.read<float>();
-                entry.mMainVar2 = read_string(bs);
-                entry.mMainVar3 = bs.read<uint8_t>();
-
-                if (entry.mFlags.hasUnk5) {
-                    entry.mUnknown0 = read_variable_float(bs);
-                    entry.mUnknown1 = read_variable_float(bs);
+            void write(const void* ptr, const size_t size) {
+                if (!Same)
+                    return;
+                if (static_cast<size_t>(End - At) < size || memcmp(At, ptr, size) != 0) {
+                    Same = false;
+                    return;
                 }
+                At += size;
             }
-
-            if (entry.mFlags.hasPosition)
-                entry.mPos = read_point(bs);
-
-            entry.mEmitImage = read_string(bs);
-            entry.mUnknownEmitRate = bs.read<float>();
-            entry.mUnknown2 = bs.read<float>();
-            entry.mRotation = bs.read<float>();
-            entry.mMaxQuantity = bs.read<int32_t>();
-
-            entry.mTimeBeforeFadeOut = bs.read<float>();
-            entry.mFadeInTime = bs.read<float>();
-            entry.mLifeDuration = bs.read<float>();
-
-            entry.mEmitRate = read_variable_float(bs);
-            entry.mEmitAreaMultiplier = read_variable_float(bs);
-
-            if (entry.mFlags.hasChangeRotation) {
-                entry.mInitialRotation = read_variable_float(bs);
-                entry.mRotationVelocity = read_variable_float(bs);
-                entry.mRotationUnknown = bs.read<float>();
-            }
-
-            if (entry.mFlags.hasChangeScale) {
-                entry.mMinScale = read_variable_float(bs);
-                entry.mScaleVelocity = read_variable_float(bs);
-                entry.mMaxRandScale = bs.read<float>();
-            }
-
-            if (entry.mFlags.hasChangeColor) {
-                entry.mColourRed = read_variable_float(bs);
-                entry.mColourGreen = read_variable_float(bs);
-                entry.mColourBlue = read_variable_float(bs);
-            }
-
-            if (entry.mFlags.hasChangeOpacity)
-                entry.mOpacity = read_variable_float(bs);
-
-            if (entry.mFlags.hasChangeVelocity) {
-                entry.mMinVelocityX = read_variable_float(bs);
-                entry.mMinVelocityY = read_variable_float(bs);
-                entry.mMaxVelocityX = bs.read<float>();
-                entry.mMaxVelocityY = bs.read<float>();
-                entry.mAccelerationX = bs.read<float>();
-                entry.mAccelerationY = bs.read<float>();
-            }
-
-            if (entry.mFlags.hasChangeDirection) {
-                entry.mDirectionSpeed = bs.read<float>();
-                entry.mDirectionRandomSpeed = bs.read<float>();
-                entry.mDirectionAcceleration = bs.read<float>();
-                entry.mDirectionAngle = bs.read<float>();
-                entry.mDirectionRandomAngle = bs.read<float>();
-            }
-
-            if (entry.mFlags.hasChangeUnknown) {
-                entry.mUnknownA = bs.read<float>();
-                entry.mUnknownB = bs.read<float>();
-            }
-
-            return entry;
-        }
-        void write_entry_emitter(binstream& bs, const LevelTypes::EmitterEntry& entry) {
-            bs.write(entry.mMainVar);
-
-            bs.write(entry.mFlags.asShort);
-
-            write_string(bs, entry.mImage);
-            bs.write(entry.mWidth);
-            bs.write(entry.mHeight);
-
-            if (entry.mMainVar == 2) {
-                bs.write(entry.mMainVar0);
-                bs.write(entry.mMainVar1);
-                write_string(bs, entry.mMainVar2);
-                bs.write(entry.mMainVar3);
-
-                if (entry.mFlags.hasUnk5) {
-                    write_variable_float(bs, entry.mUnknown0);
-                    write_variable_float(bs, entry.mUnknown1);
-                }
-            }
-
-            if (entry.mFlags.hasPosition)
-                write_point(bs, entry.mPos);
-
-            write_string(bs, entry.mEmitImage);
-            bs.write(entry.mUnknownEmitRate);
-            bs.write(entry.mUnknown2);
-            bs.write(entry.mRotation);
-            bs.write(entry.mMaxQuantity);
-
-            bs.write(entry.mTimeBeforeFadeOut);
-            bs.write(entry.mFadeInTime);
-            bs.write(entry.mLifeDuration);
-
-            write_variable_float(bs, entry.mEmitRate);
-            write_variable_float(bs, entry.mEmitAreaMultiplier);
-
-            if (entry.mFlags.hasChangeRotation) {
-                write_variable_float(bs, entry.mInitialRotation);
-                write_variable_float(bs, entry.mRotationVelocity);
-                bs.write(entry.mRotationUnknown);
-            }
-
-            if (entry.mFlags.hasChangeScale) {
-                write_variable_float(bs, entry.mMinScale);
-                write_variable_float(bs, entry.mScaleVelocity);
-                bs.write(entry.mMaxRandScale);
-            }
-
-            if (entry.mFlags.hasChangeColor) {
-                write_variable_float(bs, entry.mColourRed);
-                write_variable_float(bs, entry.mColourGreen);
-                write_variable_float(bs, entry.mColourBlue);
-            }
-
-            if (entry.mFlags.hasChangeOpacity)
-                write_variable_float(bs, entry.mOpacity);
-
-            if (entry.mFlags.hasChangeVelocity) {
-                write_variable_float(bs, entry.mMinVelocityX);
-                write_variable_float(bs, entry.mMinVelocityY);
-                bs.write(entry.mMaxVelocityX);
-                bs.write(entry.mMaxVelocityY);
-                bs.write(entry.mAccelerationX);
-                bs.write(entry.mAccelerationY);
-            }
-
-            if (entry.mFlags.hasChangeDirection) {
-                bs.write(entry.mDirectionSpeed);
-                bs.write(entry.mDirectionRandomSpeed);
-                bs.write(entry.mDirectionAcceleration);
-                bs.write(entry.mDirectionAngle);
-                bs.write(entry.mDirectionRandomAngle);
-            }
-
-            if (entry.mFlags.hasChangeUnknown) {
-                bs.write(entry.mUnknownA);
-                bs.write(entry.mUnknownB);
-            }
-        }
-
-        LevelTypes::Entry read_entry(binstream& bs, const int32_t eType, const uint32_t version) {
-            const auto entry_type = static_cast<LevelTypes::LevelEntryType>(eType);
-            const auto entry = LevelTypes::Entry(entry_type);
-            switch (entry_type) {
-                case LevelTypes::Rod: {
-                    const auto rod = LevelTypes::Entry::GetRod(entry);
-                    *rod = read_entry_rod(bs); break;
-                }
-                case LevelTypes::Polygon: {
-                    const auto polygon = LevelTypes::Entry::GetPolygon(entry);
-                    *polygon = read_entry_polygon(bs, version); break;
-                }
-                case LevelTypes::Circle: {
-                    const auto circle = LevelTypes::Entry::GetCircle(entry);
-                    *circle = read_entry_circle(bs, version); break;
-                }
-                case LevelTypes::Brick: {
-                    const auto brick = LevelTypes::Entry::GetBrick(entry);
-                    *brick = read_entry_brick(bs, version); break;
-                }
-                case LevelTypes::Teleporter: {
-                    const auto teleporter = LevelTypes::Entry::GetTeleporter(entry);
-                    *teleporter = read_entry_teleport(bs, version); break;
-                }
-                case LevelTypes::Emitter: {
-                    const auto emitter = LevelTypes::Entry::GetEmitter(entry);
-                    *emitter = read_entry_emitter(bs); break;
+        };
+        // element still encodes to the bytes it was loaded from
+        template<typename Format>
+        bool matches_source(const Format& fmt, const LevelTypes::Element& element) {
+            SourceMatch match = {element.source.Data, element.source.Data + element.source.Size};
+            LevelSchema::Codec<LevelTypes::Element>::write(match, element, fmt);
+            return match.Same && match.At == match.End;
+        }
+        template<typename Format>
+        size_t element_size(const Format& fmt, const LevelTypes::Element& element) {
+            return LevelSchema::Codec<LevelTypes::Element>::size(element, fmt);
+        }
+        template<typename Format>
+        void skip_element(binstream& bs, const Format& fmt) {
+            LevelSchema::Codec<LevelTypes::Element>::skip(bs, fmt);
+        }
+
+        // walk one element, only decoding the fields the layout depends on, and note where its parts are.
+        // elements carried by teleporters go to carried
+        template<typename Format>
+        LevelTypes::ElementSpan skim_element(binstream& bs, const Format& fmt, std::vector<LevelTypes::ElementSpan>& carried) {
+            LevelTypes::ElementSpan span = {};
+            span.Offset = static_cast<uint32_t>(bs.tell());
+            LevelTypes::Element scratch = {};
+            span.Magic = scratch.magic = bs.read<int32_t>();
+            if (scratch.magic == 1) {
+                LevelSchema::ElementHead::skip(bs, scratch, fmt);
+                span.Type = static_cast<LevelTypes::LevelEntryType>(scratch.eType);
+                span.Flags = scratch.flags;
+                if (scratch.flags.hasMovementInfo) {
+                    span.MovementOffset = static_cast<uint32_t>(bs.tell());
+                    LevelSchema::Codec<LevelTypes::MovementLink>::skip(bs, fmt);
+                    span.MovementSize = static_cast<uint32_t>(bs.tell()) - span.MovementOffset;
                 }
-                default: {
-                    // todo: raise exception for invalid entry type
+                span.EntryOffset = static_cast<uint32_t>(bs.tell());
+                if (scratch.eType == LevelTypes::Teleporter) {
+                    LevelTypes::TeleportEntry teleporter = {};
+                    LevelSchema::TeleportHead::skip(bs, teleporter, fmt);
+                    if (teleporter.mFlags.v4) {
+                        const auto inner = skim_element(bs, fmt, carried);
+                        span.Carried = static_cast<int32_t>(carried.size());
+                        carried.push_back(inner);
+                    }
+                    LevelSchema::TeleportTail::skip(bs, teleporter, fmt);
+                } else {
+                    LevelSchema::ElementEntry::skip(bs, scratch, fmt);
                 }
             }
-            return entry;
-        }
-        void write_entry(binstream& bs, const uint32_t version, const LevelTypes::Entry& entry) {
-            switch (LevelTypes::Entry::GetType(entry)) {
-                case LevelTypes::Rod: {
-                    const auto rod = LevelTypes::Entry::GetRod(entry);
-                    write_entry_rod(bs, *rod); break;
-                }
-                case LevelTypes::Polygon: {
-                    const auto polygon = LevelTypes::Entry::GetPolygon(entry);
-                    write_entry_polygon(bs, version, *polygon); break;
-                }
-                case LevelTypes::Circle: {
-                    const auto circle = LevelTypes::Entry::GetCircle(entry);
-                    write_entry_circle(bs, version, *circle); break;
+            span.Size = static_cast<uint32_t>(bs.tell()) - span.Offset;
+            return span;
+        }
+
+        LevelTypes::LevelIndex skim_level(binstream& bs) {
+            LevelTypes::LevelIndex index = {};
+            index.version = bs.read<uint32_t>();
+            index.sync_f = bs.read<uint8_t>();
+            index.entries = bs.read<uint32_t>();
+            index.Elements.reserve(std::min<size_t>(index.entries, (bs.size() - bs.tell()) / sizeof(int32_t)));
+            LevelSchema::with_format(index.version, std::pmr::null_memory_resource(), [&](const auto fmt) {
+                for (uint32_t i = 0; i < index.entries; ++i)
+                    index.Elements.push_back(skim_element(bs, fmt, index.Carried));
+            });
+            index.valid = true;
+            return index;
+        }
+
+        // moving an element or a level is a handful of pointer copies, copies go through Cloner
+        static_assert(std::is_trivially_copyable_v<LevelTypes::ElementFields>);
+        static_assert(std::is_nothrow_move_constructible_v<LevelTypes::Element> &&
+                      std::is_nothrow_move_assignable_v<LevelTypes::Element>);
+        static_assert(std::is_nothrow_move_constructible_v<LevelTypes::Level> &&
+                      std::is_nothrow_move_assignable_v<LevelTypes::Level>);
+
+        // deep copies into an arena. records are copied whole and then only the pointers in them are redone, so
+        // new fields come along without being listed here. strings inside [From, From + FromSize) move over to the
+        // same offset from To, the rest are copied into the arena
+        struct Cloner {
+            std::pmr::memory_resource* Arena;
+            const uint8_t* From = nullptr;
+            size_t FromSize = 0;
+            const uint8_t* To = nullptr;
+            // element sources are rebased too instead of cleared, only when To holds the same bytes as From
+            bool KeepSource = false;
+
+            const uint8_t* rebase(const void* data, const size_t size) const {
+                const auto at = reinterpret_cast<uintptr_t>(data);
+                const auto begin = reinterpret_cast<uintptr_t>(From);
+                if (!To || at < begin || at - begin > FromSize || size > FromSize - (at - begin))
+                    return nullptr;
+                return To + (at - begin);
+            }
+
+            std::string_view string(const std::string_view str) const {
+                if (str.empty())
+                    return {};
+                if (const auto* at = rebase(str.data(), str.size()))
+                    return {reinterpret_cast<const char*>(at), str.size()};
+                auto* data = static_cast<char*>(Arena->allocate(str.size(), alignof(char)));
+                memcpy(data, str.data(), str.size());
+                return {data, str.size()};
+            }
+
+            LevelTypes::MovementLink* link(const LevelTypes::MovementLink* src) const {
+                if (!src)
+                    return nullptr;
+                auto* copy = LevelSchema::arena_new<LevelTypes::MovementLink>(Arena, *src);
+                copy->InternalMovement.mSubMovementLink = link(src->InternalMovement.mSubMovementLink);
+                return copy;
+            }
+
+            // element's fields are a copy of another's, give it its own entry, movement chain and strings
+            void element(LevelTypes::ElementFields& element) const {
+                const auto* source = KeepSource ? rebase(element.source.Data, element.source.Size) : nullptr;
+                element.source = source ? LevelTypes::ElementSource{source, element.source.Size} : LevelTypes::ElementSource{};
+                auto& generic = element.generic;
+                generic.mImage = string(generic.mImage);
+                generic.mID = string(generic.mID);
+                generic.mLogic = string(generic.mLogic);
+                auto& movement = generic.mMovementLink.InternalMovement;
+                movement.mSubMovementLink = link(movement.mSubMovementLink);
+                if (element.entry)
+                    element.entry = entry(*element.entry);
+            }
+
+            // about what element() takes from the arena for a copy of element, alignment included. it only sizes
+            // the first block of a copy's own arena, which grows if this falls short
+            static size_t size(const LevelTypes::ElementFields& element) {
+                constexpr size_t slack = alignof(std::max_align_t);
+                size_t total = 0;
+                const auto text = [&](const std::string_view str) { total += str.size(); };
+                const auto& generic = element.generic;
+                text(generic.mImage);
+                text(generic.mID);
+                text(generic.mLogic);
+                for (const auto* link = generic.mMovementLink.InternalMovement.mSubMovementLink; link;
+                     link = link->InternalMovement.mSubMovementLink)
+                    total += sizeof(LevelTypes::MovementLink) + slack;
+                if (!element.entry)
+                    return total;
+                const auto* entry = element.entry;
+                total += sizeof(LevelTypes::Entry) + slack;
+                switch (LevelTypes::Entry::GetType(*entry)) {
+                    case LevelTypes::Rod: { total += sizeof(LevelTypes::RodEntry) + slack; break; }
+                    case LevelTypes::Polygon: {
+                        total += sizeof(LevelTypes::PolygonEntry) + slack;
+                        total += LevelTypes::Entry::GetPolygon(entry)->mPoints.size() * sizeof(LevelTypes::Point) + slack;
+                        break;
+                    }
+                    case LevelTypes::Circle: { total += sizeof(LevelTypes::CircleEntry) + slack; break; }
+                    case LevelTypes::Brick: { total += sizeof(LevelTypes::BrickEntry) + slack; break; }
+                    case LevelTypes::Teleporter: {
+                        total += sizeof(LevelTypes::TeleportEntry) + slack;
+                        if (const auto* carried = LevelTypes::Entry::GetTeleporter(entry)->mEntry)
+                            total += sizeof(LevelTypes::Element) + slack + size(*carried);
+                        break;
+                    }
+                    case LevelTypes::Emitter: {
+                        total += sizeof(LevelTypes::EmitterEntry) + slack;
+                        LevelSchema::for_each_string(*LevelTypes::Entry::GetEmitter(entry), text);
+                        break;
+                    }
+                    default: break;
                 }
-                case LevelTypes::Brick: {
-                    const auto brick = LevelTypes::Entry::GetBrick(entry);
-                    write_entry_brick(bs, version, *brick); break;
+                return total;
+            }
+
+            LevelTypes::Entry* entry(const LevelTypes::Entry& src) const {
+                const auto type = LevelTypes::Entry::GetType(src);
+                auto* copy = LevelSchema::arena_new<LevelTypes::Entry>(Arena, type, Arena);
+                switch (type) {
+                    case LevelTypes::Rod: { *LevelTypes::Entry::GetRod(copy) = *LevelTypes::Entry::GetRod(src); break; }
+                    // points are copied into the arena the entry gave them
+                    case LevelTypes::Polygon: { *LevelTypes::Entry::GetPolygon(copy) = *LevelTypes::Entry::GetPolygon(src); break; }
+                    case LevelTypes::Circle: { *LevelTypes::Entry::GetCircle(copy) = *LevelTypes::Entry::GetCircle(src); break; }
+                    case LevelTypes::Brick: { *LevelTypes::Entry::GetBrick(copy) = *LevelTypes::Entry::GetBrick(src); break; }
+                    case LevelTypes::Teleporter: {
+                        auto* teleport = LevelTypes::Entry::GetTeleporter(copy);
+                        *teleport = *LevelTypes::Entry::GetTeleporter(src);
+                        if (const auto* carried = teleport->mEntry) {
+                            teleport->mEntry = LevelSchema::arena_new<LevelTypes::Element>(Arena);
+                            static_cast<LevelTypes::ElementFields&>(*teleport->mEntry) = *carried;
+                            element(*teleport->mEntry);
+                        }
+                        break;
+                    }
+                    case LevelTypes::Emitter: {
+                        auto* emitter = LevelTypes::Entry::GetEmitter(copy);
+                        *emitter = *LevelTypes::Entry::GetEmitter(src);
+                        LevelSchema::for_each_string(*emitter, [&](std::string_view& str) { str = string(str); });
+                        break;
+                    }
+                    default: break;
                 }
-                case LevelTypes::Teleporter: {
-                    const auto teleporter = LevelTypes::Entry::GetTeleporter(entry);
-                    write_entry_teleport(bs, version, *teleporter); break;
-                }
-                case LevelTypes::Emitter: {
-                    const auto emitter = LevelTypes::Entry::GetEmitter(entry);
-                    write_entry_emitter(bs, *emitter); break;
-                }
-                default: {
-                    // todo: raise exception for invalid entry type
-                }
-            }
-        }
-
-        LevelTypes::MovementInfo read_movement(binstream& bs) {
-            LevelTypes::MovementInfo res = {};
-
-            res.mMovementShape = bs.read<int8_t>();
-            res.mType = abs(res.mMovementShape);
-            // document mReverse as negative shape
-
-            res.mAnchorPoint = read_point(bs);
-
-            res.mTimePeriod = bs.read<int16_t>();
-
-            res.mFlags = {};
-            res.mFlags.asShort = bs.read<int16_t>();
-
-            if (res.mFlags.hasOffset)
-                res.mOffset = bs.read<int16_t>();
-            if (res.mFlags.hasRadius1)
-                res.mRadius1 = bs.read<int16_t>();
-            if (res.mFlags.hasStartPhase)
-                res.mStartPhase = bs.read<float>();
-            if (res.mFlags.hasMovementRotation)
-                res.mMoveRotation = bs.read<float>();
-            if (res.mFlags.hasRadius2)
-                res.mRadius2 = bs.read<int16_t>();
-            if (res.mFlags.hasPause1)
-                res.mPause1 = bs.read<int16_t>();
-            if (res.mFlags.hasPause2)
-                res.mPause2 = bs.read<int16_t>();
-            if (res.mFlags.hasPhase1)
-                res.mPhase1 = bs.read<uint8_t>();
-            if (res.mFlags.hasPhase2)
-                res.mPhase2 = bs.read<uint8_t>();
-            if (res.mFlags.hasPostDelayPhase)
-                res.mPostDelayPhase = bs.read<float>();
-            if (res.mFlags.hasMaxAngle)
-                res.mMaxAngle = bs.read<float>();
-            if (res.mFlags.hasUnknown8)
-                res.mUnknown8 = bs.read<float>();
-            if (res.mFlags.hasRotation)
-                res.mRotation = bs.read<float>();
-            if (res.mFlags.hasSubMovement) {
-                res.mSubMovementOffsetX = bs.read<float>();
-                res.mSubMovementOffsetY = bs.read<float>();
-                // auto* sub = static_cast<LevelTypes::MovementInfo*>(malloc(sizeof LevelTypes::MovementInfo));
-                auto* sub = new LevelTypes::MovementLink;
-                *sub = read_movement_link(bs);
-                res.mSubMovementLink = sub;
+                return copy;
             }
-            if (res.mFlags.hasObject) {
-                res.mObjectX = bs.read<float>();
-                res.mObjectY = bs.read<float>();
-            }
-
-            // log_debug("%d %f %f %f %f %d\n",
-            //     res.mMovementShape,
-            //     res.mAnchorPointX, res.mAnchorPointY,
-            //     res.mObjectX, res.mObjectY,
-            //     res.mFlags.asShort
-            //     );
-
-            return res;
-        }
-        void write_movement(binstream& bs, const LevelTypes::MovementInfo& m) {
-            bs.write(m.mMovementShape);
-
-            write_point(bs, m.mAnchorPoint);
-
-            bs.write(m.mTimePeriod);
-
-            bs.write(m.mFlags.asShort);
+        };
+    }
 
-            if (m.mFlags.hasOffset)
-                bs.write(m.mOffset);
-            if (m.mFlags.hasRadius1)
-                bs.write(m.mRadius1);
-            if (m.mFlags.hasStartPhase)
-                bs.write(m.mStartPhase);
-            if (m.mFlags.hasMovementRotation)
-                bs.write(m.mMoveRotation);
-            if (m.mFlags.hasRadius2)
-                bs.write(m.mRadius2);
-            if (m.mFlags.hasPause1)
-                bs.write(m.mPause1);
-            if (m.mFlags.hasPause2)
-                bs.write(m.mPause2);
-            if (m.mFlags.hasPhase1)
-                bs.write(m.mPhase1);
-            if (m.mFlags.hasPhase2)
-                bs.write(m.mPhase2);
-            if (m.mFlags.hasPostDelayPhase)
-                bs.write(m.mPostDelayPhase);
-            if (m.mFlags.hasMaxAngle)
-                bs.write(m.mMaxAngle);
-            if (m.mFlags.hasUnknown8)
-                bs.write(m.mUnknown8);
-            if (m.mFlags.hasRotation)
-                bs.write(m.mRotation);
-            if (m.mFlags.hasSubMovement) {
-                bs.write(m.mSubMovementOffsetX);
-                bs.write(m.mSubMovementOffsetY);
-                write_movement_link(bs, *m.mSubMovementLink);
-            }
-            if (m.mFlags.hasObject) {
-                bs.write(m.mObjectX);
-                bs.write(m.mObjectY);
-            }
-        }
+    // the arena of a copy and its first block are one allocation, sized to what the copy points at
+    LevelTypes::Element::Element(const Element& other) : ElementFields(other) {
+        const size_t bytes = LevelHelpers::Cloner::size(other);
+        if (bytes == 0)
+            return;
+        using Arena = std::pmr::monotonic_buffer_resource;
+        auto* block = static_cast<std::byte*>(::operator new(sizeof(Arena) + bytes));
+        Own.reset(new (block) Arena(block + sizeof(Arena), bytes));
+        LevelHelpers::Cloner{Own.get()}.element(*this);
+    }
 
-        LevelTypes::MovementLink read_movement_link(binstream& bs) {
-            LevelTypes::MovementLink link = {};
-            link.InternalLinkId = bs.read<int32_t>();
-            if (link.InternalLinkId == 1)
-                link.InternalMovement = read_movement(bs);
-            return link;
-        }
-        void write_movement_link(binstream& bs, const LevelTypes::MovementLink& l) {
-            bs.write(l.InternalLinkId);
-            if (l.InternalLinkId == 1)
-                write_movement(bs, l.InternalMovement);
-        }
+    void LevelTypes::Element::OwnDeleter::operator()(std::pmr::monotonic_buffer_resource* arena) const {
+        arena->~monotonic_buffer_resource();
+        ::operator delete(arena);
+    }
 
-        LevelTypes::PegInfo read_peginfo(binstream& bs) {
-            LevelTypes::PegInfo res = {};
-            res.mType = bs.read<uint8_t>();
-            res.mFlags = {};
-            res.mFlags.asByte = bs.read<uint8_t>();
+    LevelTypes::Element::Element(const Element& other, std::pmr::memory_resource* arena) : ElementFields(other) {
+        LevelHelpers::Cloner{arena}.element(*this);
+    }
 
-            if (res.mFlags.v1)
-                res.mVariable = true;
-            if (res.mFlags.v2)
-                res.mUnk0 = bs.read<int32_t>();
-            if (res.mFlags.v3)
-                res.mCrumble = true;
-            if (res.mFlags.v4)
-                res.mUnk1 = bs.read<int32_t>();
-            if (res.mFlags.v5)
-                res.mUnk2 = bs.read<uint8_t>();
-            if (res.mFlags.v7)
-                res.mUnk3 = bs.read<uint8_t>();
+    LevelTypes::Element::Element(Element&& other) noexcept
+        : ElementFields(std::exchange(static_cast<ElementFields&>(other), {})), Own(std::move(other.Own)) {}
 
-            return res;
-        }
-        void write_peginfo(binstream& bs, const LevelTypes::PegInfo& p) {
-            bs.write(p.mType);
-            auto pc = p;
-            pc.mFlags.v1 = p.mVariable;
-            pc.mFlags.v3 = p.mCrumble;
-            bs.write(pc.mFlags.asByte);
+    LevelTypes::Element& LevelTypes::Element::operator=(const Element& other) {
+        if (this != &other)
+            *this = Element(other);
+        return *this;
+    }
 
-            if (p.mFlags.v2)
-                bs.write(p.mUnk0);
-            if (p.mFlags.v4)
-                bs.write(p.mUnk1);
-            if (p.mFlags.v5)
-                bs.write(p.mUnk2);
-            if (p.mFlags.v7)
-                bs.write(p.mUnk3);
-        }
+    LevelTypes::Element& LevelTypes::Element::operator=(Element&& other) noexcept {
+        static_cast<ElementFields&>(*this) = std::exchange(static_cast<ElementFields&>(other), {});
+        Own = std::move(other.Own);
+        return *this;
+    }
 
-        LevelTypes::GenericData read_generic(binstream& bs, const LevelTypes::GenericDataFlags flags) {
-            LevelTypes::GenericData generic = {};
-            if (flags.isRolly)  // 0
-                generic.mRolly = bs.read<float>();
-            if (flags.isBouncy)  // 1
-                generic.mBouncy = bs.read<float>();
-            if (flags.unk0)  // 4
-                generic.mUnk0 = bs.read<int32_t>();
-            if (flags.hasSolidColor) {  // 8
-                generic.mSolidColor = {};
-                generic.mSolidColor.asInt = bs.read<int32_t>();
-            }
-            if (flags.hasOutlineColor) {  // 9
-                generic.mOutlineColor = {};
-                generic.mOutlineColor.asInt = bs.read<int32_t>();
-            }
-            if (flags.hasImage)  // 10
-                generic.mImage = read_string(bs);
-            if (flags.hasImageDX)  // 11
-                generic.mImageDX = bs.read<float>();
-            if (flags.hasImageDY)  // 12
-                generic.mImageDY = bs.read<float>();
-            if (flags.hasRotation)  // 13
-                generic.mRotation = bs.read<float>();
-            if (flags.unk1)  // 16
-                generic.mUnk1 = bs.read<int32_t>();
-            if (flags.hasID)  // 17
-                generic.mID = read_string(bs);
-            if (flags.unk2)  // 18
-                generic.mUnk2 = bs.read<int32_t>();
-            if (flags.hasSound)  // 19
-                generic.mSound = bs.read<uint8_t>();
-            if (flags.hasLogic)  // 21
-                generic.mLogic = read_string(bs);
-            if (flags.hasMaxBounceVelocity)  // 23
-                generic.mMaxBounceVelocity = bs.read<float>();
-            if (flags.hasSubID)  // 26
-                generic.mSubID = bs.read<float>();
-            if (flags.hasFlipperFlags)  // 27
-                generic.mFlipperFlags = bs.read<uint8_t>();
-            if (flags.hasPegInfo)
-                generic.mPegInfo = read_peginfo(bs);
-            if (flags.hasMovementInfo)
-                generic.mMovementLink = read_movement_link(bs);
+    LevelTypes::Element::~Element() = default;
 
-            return generic;
-        }
-        void write_generic(binstream& bs, const LevelTypes::GenericDataFlags& flags, const LevelTypes::GenericData& generic) {
-            if (flags.isRolly)  // 0
-                bs.write(generic.mRolly);
-            if (flags.isBouncy)  // 1
-                bs.write(generic.mBouncy);
-            if (flags.unk0)  // 4
-                bs.write(generic.mUnk0);
-            if (flags.hasSolidColor)  // 8
-                bs.write(generic.mSolidColor.asInt);
-            if (flags.hasOutlineColor)  // 9
-                bs.write(generic.mOutlineColor.asInt);
-            if (flags.hasImage)  // 10
-                write_string(bs, generic.mImage);
-            if (flags.hasImageDX)  // 11
-                bs.write(generic.mImageDX);
-            if (flags.hasImageDY)  // 12
-                bs.write(generic.mImageDY);
-            if (flags.hasRotation)  // 13
-                bs.write(generic.mRotation);
-            if (flags.unk1)  // 16
-                bs.write(generic.mUnk1);
-            if (flags.hasID)  // 17
-                write_string(bs, generic.mID);
-            if (flags.unk2)  // 18
-                bs.write(generic.mUnk2);
-            if (flags.hasSound)  // 19
-                bs.write(generic.mSound);
-            if (flags.hasLogic)  // 21
-                write_string(bs, generic.mLogic);
-            if (flags.hasMaxBounceVelocity)  // 23
-                bs.write(generic.mMaxBounceVelocity);
-            if (flags.hasSubID)  // 26
-                bs.write(generic.mSubID);
-            if (flags.hasFlipperFlags)  // 27
-                bs.write(generic.mFlipperFlags);
-            if (flags.hasPegInfo)
-                write_peginfo(bs, generic.mPegInfo);
-            if (flags.hasMovementInfo)
-                write_movement_link(bs, generic.mMovementLink);
-        }
+    LevelTypes::Level::Level(const Level& other) : Level(Peggle::Level::CloneLevel(other)) {}
 
-        LevelTypes::Element read_element(binstream& bs, const uint32_t version) {
-            LevelTypes::Element element = {};
-            // log_debug_raw(" - (start: %d, ", bs.tell());
-            element.magic = bs.read<int32_t>();
-            if (element.magic != 1) {
-                // log_debug_raw("not an element)\n");
-                return element;
-            }
-            element.eType = bs.read<int32_t>();
-            // log_debug_raw("type: %d)\n", element.eType);
-            element.flags = {};
-            if (version == 4) {  // TODO: no idea what the lower limit actually is, try and find it in ida
-                const auto low = bs.read<uint8_t>();
-                const auto mid = bs.read<uint8_t>();
-                const auto high = bs.read<uint8_t>();
-                element.flags.asInt = (high << 16) | (mid << 8) | low;
-            }
-            else
-                element.flags.asInt = bs.read<uint32_t>();
-            element.generic = read_generic(bs, element.flags);
-            const auto entry_type = static_cast<LevelTypes::LevelEntryType>(element.eType);
-            element.entry = new LevelTypes::Entry(entry_type);
-            *element.entry = read_entry(bs, element.eType, version);
-            return element;
-        }
-        void write_element(binstream& bs, const uint32_t version, const LevelTypes::Element& element) {
-            bs.write(element.magic);
-            if (element.magic != 1)
-                return;
-            bs.write(element.eType);
-            if (version == 4) {  // TODO: no idea what the lower limit actually is, try and find it in ida
-                const uint32_t flags = element.flags.asInt;
-                const uint8_t low = flags & 0xFF;
-                const uint8_t mid = flags >> 8 & 0xFF;
-                const uint8_t high = flags >> 16 & 0xFF;
-                bs.write(low);
-                bs.write(mid);
-                bs.write(high);
-            }
-            else
-                bs.write(element.flags.asInt);
-            write_generic(bs, element.flags, element.generic);
-            write_entry(bs, version, *element.entry);
-        }
+    LevelTypes::Level& LevelTypes::Level::operator=(const Level& other) {
+        if (this != &other)
+            *this = Peggle::Level::CloneLevel(other);
+        return *this;
     }
 
     LevelTypes::Level Level::LoadLevel(const void* buf, const uint32_t size) {
-        LevelTypes::Level lvl = {};
-        auto bs = binstream(buf, size);  // initialize binstream...
+        auto storage = std::make_shared<LevelTypes::LevelStorage>();
+        auto* arena = &storage->Arena;
+        LevelTypes::Level lvl;
+        lvl.Storage = std::move(storage);
+        auto& bs = lvl.Storage->Source;
+        bs.write(buf, size);  // initialize binstream...
         bs.seek(0);  // ...and go back to the start
 
         lvl.version = bs.read<uint32_t>();
         lvl.sync_f = bs.read<uint8_t>();
         lvl.entries = bs.read<uint32_t>();
-        for (int i = 0; i < lvl.entries; ++i) {
-            // log_debug("parsing element #%d\n", i);
-            lvl.Elements.emplace_back(LevelHelpers::read_element(bs, lvl.version));
-        }
+        // size it up front, every element is at least its magic
+        lvl.Elements.reserve(std::min<size_t>(lvl.entries, (bs.size() - bs.tell()) / sizeof(int32_t)));
+        LevelSchema::with_format(lvl.version, arena, [&](const auto fmt) {
+            for (int i = 0; i < lvl.entries; ++i) {
+                // log_debug("parsing element #%d\n", i);
+                lvl.Elements.emplace_back(LevelHelpers::read_element(bs, fmt));
+            }
+        });
 
         lvl.valid = true;
 
@@ -1053,11 +357,18 @@ namespace Peggle {
         if (!lvl.valid)
             return FileRef{};
         auto bs = binstream();
-        bs.write(lvl.version);
-        bs.write(lvl.sync_f);
-        bs.write(lvl.Elements.size());
-        for (const auto& e : lvl.Elements)
-            LevelHelpers::write_element(bs, lvl.version, e);
+        LevelSchema::with_format(lvl.version, std::pmr::null_memory_resource(), [&](const auto fmt) {
+            size_t size = sizeof(lvl.version) + sizeof(lvl.sync_f) + sizeof(uint32_t);
+            for (const auto& e : lvl.Elements)
+                size += LevelHelpers::element_size(fmt, e);
+
+            bs.reserve(size);
+            bs.write(lvl.version);
+            bs.write(lvl.sync_f);
+            bs.write(static_cast<uint32_t>(lvl.Elements.size()));
+            for (const auto& e : lvl.Elements)
+                LevelHelpers::write_element(bs, fmt, e);
+        });
         auto* res = malloc(bs.size());
         memcpy(res, bs.buffer(), bs.size());
         return FileRef{
@@ -1067,6 +378,115 @@ namespace Peggle {
         };
     }
 
+    void Level::MarkDirty(LevelTypes::Element& element) {
+        element.source = {};
+    }
+
+    FileRef Level::BuildLevelIncremental(const LevelTypes::Level& lvl, const bool verify) {
+        if (!lvl.valid)
+            return FileRef{};
+        // spliced bytes are in the version the level was loaded as
+        const binstream* source = lvl.Storage ? &lvl.Storage->Source : nullptr;
+        uint32_t source_version = 0;
+        if (!source || source->size() < sizeof(source_version))
+            return BuildLevel(lvl);
+        memcpy(&source_version, source->buffer(), sizeof(source_version));
+        if (source_version != lvl.version)
+            return BuildLevel(lvl);
+
+        // an element is spliced if its bytes are in this level's buffer (one moved over from another level is
+        // encoded), and with verify only if its fields still encode to them
+        const auto begin = reinterpret_cast<uintptr_t>(source->buffer());
+        const auto end = begin + source->size();
+        const auto in_source = [begin, end](const LevelTypes::Element& e) {
+            const auto data = reinterpret_cast<uintptr_t>(e.source.Data);
+            return e.source.Size && data >= begin && data <= end && e.source.Size <= end - data;
+        };
+
+        // the output is a list of pieces: runs of clean elements lying back to back in the source go over in one
+        // copy, dirty elements are encoded one after another into encoded (Data is null for those)
+        struct Piece {
+            const uint8_t* Data;
+            size_t Size;
+        };
+        std::vector<Piece> pieces;
+        binstream encoded;
+        size_t size = sizeof(lvl.version) + sizeof(lvl.sync_f) + sizeof(uint32_t);
+        LevelSchema::with_format(lvl.version, std::pmr::null_memory_resource(), [&](const auto fmt) {
+            for (const auto& e : lvl.Elements) {
+                if (in_source(e) && (!verify || LevelHelpers::matches_source(fmt, e))) {
+                    if (!pieces.empty() && pieces.back().Data && pieces.back().Data + pieces.back().Size == e.source.Data)
+                        pieces.back().Size += e.source.Size;
+                    else
+                        pieces.push_back({e.source.Data, e.source.Size});
+                    size += e.source.Size;
+                    continue;
+                }
+                const auto before = encoded.size();
+                LevelHelpers::write_element(encoded, fmt, e);
+                pieces.push_back({nullptr, encoded.size() - before});
+                size += encoded.size() - before;
+            }
+        });
+
+        auto* out = static_cast<uint8_t*>(malloc(size));
+        auto* cursor = out;
+        const auto put = [&cursor](const void* data, const size_t n) {
+            memcpy(cursor, data, n);
+            cursor += n;
+        };
+        const auto count = static_cast<uint32_t>(lvl.Elements.size());
+        put(&lvl.version, sizeof(lvl.version));
+        put(&lvl.sync_f, sizeof(lvl.sync_f));
+        put(&count, sizeof(count));
+        size_t taken = 0;
+        for (const auto& piece : pieces) {
+            if (piece.Data) {
+                put(piece.Data, piece.Size);
+                continue;
+            }
+            put(encoded.buffer() + taken, piece.Size);
+            taken += piece.Size;
+        }
+        return FileRef{
+            FileState::OK,
+            out,
+            static_cast<uint32_t>(size)
+        };
+    }
+
+    LevelTypes::LevelIndex Level::IndexLevel(const void* buf, const uint32_t size) {
+        binstream bs(buf, size);
+        return LevelHelpers::skim_level(bs);
+    }
+
+    LevelTypes::LevelIndex Level::IndexLevel(const FileRef& lvl) {
+        return IndexLevel(lvl.Data, lvl.Size);
+    }
+
+    std::string_view Level::StoreString(LevelTypes::Level& lvl, const std::string_view str) {
+        if (str.empty())
+            return {};
+        auto* data = static_cast<char*>(GetArena(lvl)->allocate(str.size(), alignof(char)));
+        memcpy(data, str.data(), str.size());
+        return {data, str.size()};
+    }
+
+    void Level::SetString(LevelTypes::Level& lvl, std::string_view& field, const std::string_view str) {
+        field = StoreString(lvl, str);
+    }
+
+    LevelTypes::Entry* Level::CreateEntry(LevelTypes::Level& lvl, const LevelTypes::LevelEntryType type) {
+        auto* arena = GetArena(lvl);
+        return LevelSchema::arena_new<LevelTypes::Entry>(arena, type, arena);
+    }
+
+    std::pmr::memory_resource* Level::GetArena(LevelTypes::Level& lvl) {
+        if (!lvl.Storage)
+            lvl.Storage = std::make_shared<LevelTypes::LevelStorage>();
+        return &lvl.Storage->Arena;
+    }
+
     LevelTypes::RodEntry* Level::AccessRod(LevelTypes::Entry& entry) {
         return LevelTypes::Entry::GetRod(entry);
     }
@@ -1086,241 +506,128 @@ namespace Peggle {
         return LevelTypes::Entry::GetEmitter(entry);
     }
 
-    void Level::CloneRod(LevelTypes::Entry& entry, LevelTypes::RodEntry* dest) {
-        const auto e = AccessRod(entry);
-
-        dest->valid = true;
-        dest->mFlags = e->mFlags;
-        dest->mPointA = e->mPointA;
-        dest->mPointB = e->mPointB;
-        dest->mE = e->mE;
-        dest->mF = e->mF;
+    LevelTypes::RodEntry* Level::AccessRod(LevelTypes::Element& element) {
+        MarkDirty(element);
+        return element.entry ? LevelTypes::Entry::GetRod(element.entry) : nullptr;
     }
-    void Level::ClonePolygon(LevelTypes::Entry& entry, LevelTypes::PolygonEntry* dest) {
-        const auto e = AccessPolygon(entry);
-
-        dest->valid = true;
-        dest->mFlagsA = e->mFlagsA;
-        dest->mFlagsB = e->mFlagsB;
-        dest->mRotation = e->mRotation;
-        dest->mUnk1 = e->mUnk1;
-        dest->mScale = e->mScale;
-        dest->mNormalDir = e->mNormalDir;
-        dest->mPos = e->mPos;
-        dest->mPoints = e->mPoints;
-        dest->mUnk2 = e->mUnk2;
-        dest->mGrowType = e->mGrowType;
+    LevelTypes::PolygonEntry* Level::AccessPolygon(LevelTypes::Element& element) {
+        MarkDirty(element);
+        return element.entry ? LevelTypes::Entry::GetPolygon(element.entry) : nullptr;
     }
-    void Level::CloneCircle(LevelTypes::Entry& entry, LevelTypes::CircleEntry* dest) {
-        const auto e = AccessCircle(entry);
-
-        dest->valid = true;
-        dest->mFlagsA = e->mFlagsA;
-        dest->mFlagsB = e->mFlagsB;
-        dest->mPos = e->mPos;
-        dest->mRadius = e->mRadius;
+    LevelTypes::CircleEntry* Level::AccessCircle(LevelTypes::Element& element) {
+        MarkDirty(element);
+        return element.entry ? LevelTypes::Entry::GetCircle(element.entry) : nullptr;
     }
-    void Level::CloneBrick(LevelTypes::Entry& entry, LevelTypes::BrickEntry* dest) {
-        const auto e = AccessBrick(entry);
-
-        dest->valid = true;
-        dest->mFlagsA = e->mFlagsA;
-        dest->mFlagsB = e->mFlagsB;
-        dest->mFlagsC = e->mFlagsC;
-        dest->mUnk1 = e->mUnk1;
-        dest->mUnk2 = e->mUnk2;
-        dest->mUnk3 = e->mUnk3;
-        dest->mUnk4 = e->mUnk4;
-        dest->mPos = e->mPos;
-        dest->mUnk5 = e->mUnk5;
-        dest->mUnk6 = e->mUnk6;
-        dest->mUnk7 = e->mUnk7;
-        dest->mUnk8 = e->mUnk8;
-        dest->mUnk9 = e->mUnk9;
-        dest->mType = e->mType;
-        dest->mCurved = e->mCurved;
-        dest->mCurvedPoints = e->mCurvedPoints;
-        dest->mLeftAngle = e->mLeftAngle;
-        dest->mRightAngle = e->mRightAngle;
-        dest->mUnk10 = e->mUnk10;
-        dest->mSectorAngle = e->mSectorAngle;
-        dest->mWidth = e->mWidth;
-        dest->mLength = e->mLength;
-        dest->mAngle = e->mAngle;
-        dest->mTextureFlip = e->mTextureFlip;
-        dest->mUnk12 = e->mUnk12;
+    LevelTypes::BrickEntry* Level::AccessBrick(LevelTypes::Element& element) {
+        MarkDirty(element);
+        return element.entry ? LevelTypes::Entry::GetBrick(element.entry) : nullptr;
     }
-    void Level::CloneTeleporter(LevelTypes::Entry& entry, LevelTypes::TeleportEntry* dest) {
-        const auto e = AccessTeleporter(entry);
-
-        dest->valid = true;
-        dest->mFlags = e->mFlags;
-        dest->mWidth = e->mWidth;
-        dest->mHeight = e->mHeight;
-        dest->mUnk0 = e->mUnk0;
-        dest->mUnk1 = e->mUnk1;
-        dest->mUnk2 = e->mUnk2;
-
-        dest->mEntry = new LevelTypes::Element;
-        *dest->mEntry = CloneElement(*e->mEntry);
-
-        dest->mPos = e->mPos;
-        dest->mUnk3 = e->mUnk3;
-        dest->mUnk4 = e->mUnk4;
+    LevelTypes::TeleportEntry* Level::AccessTeleporter(LevelTypes::Element& element) {
+        MarkDirty(element);
+        return element.entry ? LevelTypes::Entry::GetTeleporter(element.entry) : nullptr;
     }
-    void Level::CloneEmitter(LevelTypes::Entry& entry, LevelTypes::EmitterEntry* dest) {
-        const auto e = AccessEmitter(entry);
-
-        dest->valid = true;
-        dest->mMainVar = e->mMainVar;
-        dest->mFlags = e->mFlags;
-        dest->mImage = e->mImage;
-        dest->mWidth = e->mWidth;
-        dest->mHeight = e->mHeight;
-        dest->mMainVar0 = e->mMainVar0;
-        dest->mMainVar1 = e->mMainVar1;
-        dest->mMainVar2 = e->mMainVar2;
-        dest->mMainVar3 = e->mMainVar3;
-        dest->mUnknown0 = e->mUnknown0;
-        dest->mUnknown1 = e->mUnknown1;
-        dest->mPos = e->mPos;
-        dest->mEmitImage = e->mEmitImage;
-        dest->mUnknownEmitRate = e->mUnknownEmitRate;
-        dest->mUnknown2 = e->mUnknown2;
-        dest->mRotation = e->mRotation;
-        dest->mMaxQuantity = e->mMaxQuantity;
-        dest->mTimeBeforeFadeOut = e->mTimeBeforeFadeOut;
-        dest->mFadeInTime = e->mFadeInTime;
-        dest->mLifeDuration = e->mLifeDuration;
-        dest->mEmitRate = e->mEmitRate;
-        dest->mEmitAreaMultiplier = e->mEmitAreaMultiplier;
-        dest->mInitialRotation = e->mInitialRotation;
-        dest->mRotationVelocity = e->mRotationVelocity;
-        dest->mRotationUnknown = e->mRotationUnknown;
-        dest->mMinScale = e->mMinScale;
-        dest->mScaleVelocity = e->mScaleVelocity;
-        dest->mMaxRandScale = e->mMaxRandScale;
-        dest->mColourRed = e->mColourRed;
-        dest->mColourGreen = e->mColourGreen;
-        dest->mColourBlue = e->mColourBlue;
-        dest->mOpacity = e->mOpacity;
-        dest->mMinVelocityX = e->mMinVelocityX;
-        dest->mMinVelocityY = e->mMinVelocityY;
-        dest->mMaxVelocityX = e->mMaxVelocityX;
-        dest->mMaxVelocityY = e->mMaxVelocityY;
-        dest->mAccelerationX = e->mAccelerationX;
-        dest->mAccelerationY = e->mAccelerationY;
-        dest->mDirectionSpeed = e->mDirectionSpeed;
-        dest->mDirectionRandomSpeed = e->mDirectionRandomSpeed;
-        dest->mDirectionAcceleration = e->mDirectionAcceleration;
-        dest->mDirectionAngle = e->mDirectionAngle;
-        dest->mDirectionRandomAngle = e->mDirectionRandomAngle;
-        dest->mUnknownA = e->mUnknownA;
-        dest->mUnknownB = e->mUnknownB;
+    LevelTypes::EmitterEntry* Level::AccessEmitter(LevelTypes::Element& element) {
+        MarkDirty(element);
+        return element.entry ? LevelTypes::Entry::GetEmitter(element.entry) : nullptr;
     }
-    LevelTypes::GenericData Level::CloneGenericData(const LevelTypes::GenericData& generic) {
-        LevelTypes::GenericData res = {};
 
-        res.mRolly = generic.mRolly;
-        res.mBouncy = generic.mBouncy;
-        res.mPegInfo = generic.mPegInfo;
-        res.mMovementLink = CloneMovementLink(generic.mMovementLink);
-        res.mUnk0 = generic.mUnk0;
-        res.mSolidColor = generic.mSolidColor;
-        res.mOutlineColor = generic.mOutlineColor;
-        res.mImage = generic.mImage;
-        res.mImageDX = generic.mImageDX;
-        res.mImageDY = generic.mImageDY;
-        res.mRotation = generic.mRotation;
-        res.mUnk1 = generic.mUnk1;
-        res.mID = generic.mID;
-        res.mUnk2 = generic.mUnk2;
-        res.mSound = generic.mSound;
-        res.mLogic = generic.mLogic;
-        res.mMaxBounceVelocity = generic.mMaxBounceVelocity;
-        res.mSubID = generic.mSubID;
-        res.mFlipperFlags = generic.mFlipperFlags;
+    LevelTypes::Element Level::CloneElement(LevelTypes::Level& lvl, const LevelTypes::Element& element) {
+        LevelHelpers::Cloner cloner = {GetArena(lvl)};
+        // strings still pointing at the level's own source bytes can be shared
+        const auto& source = lvl.Storage->Source;
+        cloner.From = cloner.To = source.buffer();
+        cloner.FromSize = source.size();
+        LevelTypes::Element res;
+        static_cast<LevelTypes::ElementFields&>(res) = element;
+        cloner.element(res);
+        return res;
+    }
 
+    LevelTypes::Level Level::CloneLevel(const LevelTypes::Level& lvl) {
+        LevelTypes::Level res;
+        res.valid = lvl.valid;
+        res.version = lvl.version;
+        res.sync_f = lvl.sync_f;
+        res.entries = lvl.entries;
+        res.Storage = std::make_shared<LevelTypes::LevelStorage>();
+        LevelHelpers::Cloner cloner = {&res.Storage->Arena};
+        // the source bytes go over in one piece, so strings and element sources into them only move by an offset
+        // and clean elements still build from their bytes
+        if (lvl.Storage && lvl.Storage->Source.size()) {
+            const auto& from = lvl.Storage->Source;
+            auto& to = res.Storage->Source;
+            to.write(from.buffer(), from.size());
+            to.seek(0);
+            cloner.From = from.buffer();
+            cloner.FromSize = from.size();
+            cloner.To = to.buffer();
+            cloner.KeepSource = true;
+        }
+        res.Elements.resize(lvl.Elements.size());
+        for (size_t i = 0; i < res.Elements.size(); ++i) {
+            static_cast<LevelTypes::ElementFields&>(res.Elements[i]) = lvl.Elements[i];
+            cloner.element(res.Elements[i]);
+        }
         return res;
     }
-    LevelTypes::MovementLink Level::CloneMovementLink(const LevelTypes::MovementLink& movement) {
-        LevelTypes::MovementLink res = {};
 
-        res.InternalLinkId = movement.InternalLinkId;
+#pragma endregion
 
-        res.InternalMovement.mInternalLinkID = movement.InternalMovement.mInternalLinkID;
-        res.InternalMovement.mMovementShape = movement.InternalMovement.mMovementShape;
-        res.InternalMovement.mType = movement.InternalMovement.mType;
-        res.InternalMovement.mReverse = movement.InternalMovement.mReverse;
-        res.InternalMovement.mAnchorPoint = movement.InternalMovement.mAnchorPoint;
-        res.InternalMovement.mTimePeriod = movement.InternalMovement.mTimePeriod;
-        res.InternalMovement.mFlags = movement.InternalMovement.mFlags;
-        res.InternalMovement.mOffset = movement.InternalMovement.mOffset;
-        res.InternalMovement.mRadius1 = movement.InternalMovement.mRadius1;
-        res.InternalMovement.mStartPhase = movement.InternalMovement.mStartPhase;
-        res.InternalMovement.mMoveRotation = movement.InternalMovement.mMoveRotation;
-        res.InternalMovement.mRadius2 = movement.InternalMovement.mRadius2;
-        res.InternalMovement.mPause1 = movement.InternalMovement.mPause1;
-        res.InternalMovement.mPause2 = movement.InternalMovement.mPause2;
-        res.InternalMovement.mPhase1 = movement.InternalMovement.mPhase1;
-        res.InternalMovement.mPhase2 = movement.InternalMovement.mPhase2;
-        res.InternalMovement.mPostDelayPhase = movement.InternalMovement.mPostDelayPhase;
-        res.InternalMovement.mMaxAngle = movement.InternalMovement.mMaxAngle;
-        res.InternalMovement.mUnknown8 = movement.InternalMovement.mUnknown8;
-        res.InternalMovement.mRotation = movement.InternalMovement.mRotation;
-        res.InternalMovement.mSubMovementOffsetX = movement.InternalMovement.mSubMovementOffsetX;
-        res.InternalMovement.mSubMovementOffsetY = movement.InternalMovement.mSubMovementOffsetY;
-        if (movement.InternalMovement.mSubMovementLink) {
-            res.InternalMovement.mSubMovementLink = new LevelTypes::MovementLink;
-            *res.InternalMovement.mSubMovementLink = CloneMovementLink(*movement.InternalMovement.mSubMovementLink);
-        }
-        res.InternalMovement.mSubMovementLink = movement.InternalMovement.mSubMovementLink;
-        res.InternalMovement.mObjectX = movement.InternalMovement.mObjectX;
-        res.InternalMovement.mObjectY = movement.InternalMovement.mObjectY;
+#pragma region libpeggle_LazyLevel
 
-        return res;
+    LazyLevel::LazyLevel(const void* buf, const uint32_t size) : Storage(std::make_shared<LevelTypes::LevelStorage>()) {
+        auto& bs = Storage->Source;
+        bs.write(buf, size);
+        bs.seek(0);
+        Index = LevelHelpers::skim_level(bs);
+        Elements.resize(Index.Elements.size());
+        Decoded.resize(Index.Elements.size());
     }
 
-    LevelTypes::Element Level::CloneElement(const LevelTypes::Element& element) {
-        LevelTypes::Element res = {};
+    LazyLevel::LazyLevel(const FileRef& lvl) : LazyLevel(lvl.Data, lvl.Size) {}
 
-        res.magic = element.magic;
-        res.eType = element.eType;
-        res.flags = element.flags;
-        res.generic = CloneGenericData(element.generic);
+    const LevelTypes::LevelIndex& LazyLevel::GetIndex() const {
+        return Index;
+    }
 
-        const auto entry_type = static_cast<LevelTypes::LevelEntryType>(element.eType);
-        res.entry = new LevelTypes::Entry(entry_type);
+    size_t LazyLevel::GetElementCount() const {
+        return Index.Elements.size();
+    }
 
-        switch (res.eType) {
-            case LevelTypes::Rod: {
-                auto rod = LevelTypes::Entry::GetRod(res.entry);
-                CloneRod(*element.entry, rod); break;
-            }
-            case LevelTypes::Polygon: {
-                auto polygon = LevelTypes::Entry::GetPolygon(res.entry);
-                ClonePolygon(*element.entry, polygon); break;
-            }
-            case LevelTypes::Circle: {
-                auto circle = LevelTypes::Entry::GetCircle(res.entry);
-                CloneCircle(*element.entry, circle); break;
-            }
-            case LevelTypes::Brick: {
-                auto brick = LevelTypes::Entry::GetBrick(res.entry);
-                CloneBrick(*element.entry, brick); break;
-            }
-            case LevelTypes::Teleporter: {
-                auto teleporter = LevelTypes::Entry::GetTeleporter(res.entry);
-                CloneTeleporter(*element.entry, teleporter); break;
-            }
-            case LevelTypes::Emitter: {
-                auto emitter = LevelTypes::Entry::GetEmitter(res.entry);
-                CloneEmitter(*element.entry, emitter); break;
-            }
-            default: break;
-        }
+    const LevelTypes::ElementSpan& LazyLevel::GetSpan(const size_t i) const {
+        return Index.Elements.at(i);
+    }
 
-        return res;
+    LevelTypes::Element& LazyLevel::GetElement(const size_t i) {
+        if (i >= Elements.size())
+            throw std::exception("Element index out of range");
+        if (!Decoded[i]) {
+            auto& bs = Storage->Source;
+            bs.seek(Index.Elements[i].Offset);
+            LevelSchema::with_format(Index.version, &Storage->Arena, [&](const auto fmt) {
+                Elements[i] = LevelHelpers::read_element(bs, fmt);
+            });
+            Decoded[i] = true;
+        }
+        return Elements[i];
+    }
+
+    bool LazyLevel::IsDecoded(const size_t i) const {
+        return i < Decoded.size() && Decoded[i];
+    }
+
+    LevelTypes::Level LazyLevel::Materialize() {
+        LevelTypes::Level lvl;
+        lvl.valid = Index.valid;
+        lvl.version = Index.version;
+        lvl.sync_f = Index.sync_f;
+        lvl.entries = Index.entries;
+        lvl.Storage = Storage;
+        lvl.Elements.reserve(Elements.size());
+        // the fields only, the level gets the very elements this one decoded
+        for (size_t i = 0; i < Elements.size(); ++i)
+            static_cast<LevelTypes::ElementFields&>(lvl.Elements.emplace_back()) = GetElement(i);
+        return lvl;
     }
 
 #pragma endregion
@@ -0,0 +1,277 @@
+#include "levelschema.h"
+#include "libpeggle.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Peggle {
+#pragma region libpeggle_Movement
+
+    namespace MovementHelpers {
+        // the inline links of a level in the order they are read, a reference link's ID counts from 2 into these.
+        // an element's own chain comes before the element its teleporter carries
+        void number_links(const LevelTypes::Element& element, std::vector<const LevelTypes::MovementLink*>& links) {
+            if (element.flags.hasMovementInfo)
+                for (const auto* link = &element.generic.mMovementLink; link && link->InternalLinkId == 1; link = link->InternalMovement.mSubMovementLink)
+                    links.push_back(link);
+            if (element.entry && LevelTypes::Entry::GetType(element.entry) == LevelTypes::Teleporter)
+                if (const auto* carried = LevelTypes::Entry::GetTeleporter(element.entry)->mEntry)
+                    number_links(*carried, links);
+        }
+
+        // one row per link of the chain starting at link, references followed into links. a reference that
+        // cannot be followed ends the chain there, an unknown shape stays a row that does not move
+        LevelTypes::MotionStatus append_chain(LevelTypes::MotionColumns& m, const uint32_t element, const LevelTypes::MovementLink* link,
+                                              const std::vector<const LevelTypes::MovementLink*>& links) {
+            auto status = LevelTypes::MotionStatus::Ok;
+            size_t followed = 0;
+            for (; link; link = link->InternalMovement.mSubMovementLink) {
+                if (link->InternalLinkId != 1) {
+                    const auto id = static_cast<int64_t>(link->InternalLinkId) - 2;
+                    if (id < 0 || id >= static_cast<int64_t>(links.size()))
+                        return LevelTypes::MotionStatus::BrokenLink;
+                    // every reference lands on another link unless the chain loops
+                    if (++followed > links.size())
+                        return LevelTypes::MotionStatus::LinkLoop;
+                    link = links[id];
+                }
+                const auto& info = link->InternalMovement;
+                auto type = std::abs(info.mMovementShape);
+                if (type == 10 || type > static_cast<int>(LevelTypes::MovementShape::HorizontalWrap)) {
+                    type = static_cast<int>(LevelTypes::MovementShape::None);
+                    status = LevelTypes::MotionStatus::UnknownShape;
+                }
+                const auto shape = static_cast<LevelTypes::MovementShape>(type);
+                // phases are percent of the motion
+                float at1 = std::min<float>(info.mPhase1, 100.f) / 100.f * info.mTimePeriod;
+                float at2 = std::min<float>(info.mPhase2, 100.f) / 100.f * info.mTimePeriod;
+                float pause1 = std::max<float>(info.mPause1, 0.f), pause2 = std::max<float>(info.mPause2, 0.f);
+                if (at2 < at1) {
+                    std::swap(at1, at2);
+                    std::swap(pause1, pause2);
+                }
+                m.Element.push_back(element);
+                m.Shape.push_back(shape);
+                m.AnchorX.push_back(info.mAnchorPoint.x);
+                m.AnchorY.push_back(info.mAnchorPoint.y);
+                m.Period.push_back(std::max<float>(info.mTimePeriod, 0.f));
+                m.Offset.push_back(info.mOffset);
+                m.StartPhase.push_back(info.mStartPhase);
+                m.Direction.push_back(info.mReverse != (info.mMovementShape < 0) ? -1.f : 1.f);
+                m.Radius1.push_back(info.mRadius1);
+                m.Radius2.push_back(info.mFlags.hasRadius2 ? info.mRadius2 : info.mRadius1);
+                m.MaxAngle.push_back(info.mMaxAngle);
+                m.Rotation.push_back(info.mMoveRotation);
+                m.SubOffsetX.push_back(info.mFlags.hasSubMovement ? info.mSubMovementOffsetX : 0.f);
+                m.SubOffsetY.push_back(info.mFlags.hasSubMovement ? info.mSubMovementOffsetY : 0.f);
+                m.PauseAt1.push_back(at1);
+                m.Pause1.push_back(pause1);
+                m.PauseAt2.push_back(at2);
+                m.Pause2.push_back(pause2);
+            }
+            return status;
+        }
+
+        // per evaluation buffers, one float per time
+        struct Scratch {
+            std::vector<float> Phase, Arg, Tmp;
+            std::vector<float> X, Y;
+
+            void resize(const size_t n) {
+                for (auto* v : {&Phase, &Arg, &Tmp, &X, &Y})
+                    v->resize(n);
+            }
+        };
+
+        // cos(2 pi x) as sin(2 pi (x + 1/4)), tmp is clobbered
+        void cos_turns(const float* xs, float* out, float* tmp, const size_t n) {
+            for (size_t k = 0; k < n; ++k)
+                tmp[k] = xs[k] + .25f;
+            Simd::sin_turns(tmp, out, n);
+        }
+
+        // r * sin(2 pi x) and r * cos(2 pi x)
+        void scaled_sin(const float* xs, float* out, const float r, const size_t n) {
+            Simd::sin_turns(xs, out, n);
+            for (size_t k = 0; k < n; ++k)
+                out[k] *= r;
+        }
+        void scaled_cos(const float* xs, float* out, float* tmp, const float r, const size_t n) {
+            cos_turns(xs, out, tmp, n);
+            for (size_t k = 0; k < n; ++k)
+                out[k] *= r;
+        }
+
+        // add how far row r moves away from its anchor at every time to dx, dy. angle (if given) gets the degrees
+        // the row's shape turns
+        void accumulate_row(const LevelTypes::MotionColumns& m, const size_t r, const float* times, const size_t n,
+                            float* dx, float* dy, float* angle, Scratch& s) {
+            // motion tick within the cycle with the pauses held, then turns
+            const float period = m.Period[r], direction = m.Direction[r];
+            auto* phase = s.Phase.data();
+            if (period > 0.f) {
+                Simd::cycle_phase(times, phase, n, m.Offset[r], period + m.Pause1[r] + m.Pause2[r],
+                                  m.PauseAt1[r], m.Pause1[r], m.PauseAt2[r] + m.Pause1[r], m.Pause2[r],
+                                  direction / period, direction * m.StartPhase[r]);
+            } else {
+                std::fill_n(phase, n, direction * m.StartPhase[r]);
+            }
+
+            auto* x = s.X.data();
+            auto* y = s.Y.data();
+            auto* arg = s.Arg.data();
+            auto* tmp = s.Tmp.data();
+            const float r1 = m.Radius1[r], r2 = m.Radius2[r];
+            const auto turns_to_angle = [&](const float* turns) {
+                if (angle)
+                    for (size_t k = 0; k < n; ++k)
+                        angle[k] = turns[k] * 360.f;
+            };
+            // arcs swing MaxAngle either side of their rest angle, the swing goes to arg (turns)
+            const auto swing = [&] {
+                const float amplitude = m.MaxAngle[r] / 360.f;
+                Simd::sin_turns(phase, arg, n);
+                for (size_t k = 0; k < n; ++k)
+                    arg[k] *= amplitude;
+            };
+            switch (m.Shape[r]) {
+                case LevelTypes::MovementShape::VerticalCycle:
+                    std::fill_n(x, n, 0.f);
+                    scaled_sin(phase, y, r1, n);
+                    break;
+                case LevelTypes::MovementShape::HorizontalCycle:
+                    scaled_sin(phase, x, r1, n);
+                    std::fill_n(y, n, 0.f);
+                    break;
+                case LevelTypes::MovementShape::Circle:
+                    scaled_cos(phase, x, tmp, r1, n);
+                    scaled_sin(phase, y, r1, n);
+                    break;
+                case LevelTypes::MovementShape::Rotate:
+                    scaled_cos(phase, x, tmp, r1, n);
+                    scaled_sin(phase, y, r1, n);
+                    turns_to_angle(phase);
+                    break;
+                case LevelTypes::MovementShape::HorizontalInfinity:
+                case LevelTypes::MovementShape::VerticalInfinity: {
+                    // figure eight, the cross axis runs twice as fast
+                    const bool horizontal = m.Shape[r] == LevelTypes::MovementShape::HorizontalInfinity;
+                    for (size_t k = 0; k < n; ++k)
+                        arg[k] = phase[k] * 2.f;
+                    scaled_sin(phase, horizontal ? x : y, r1, n);
+                    scaled_sin(arg, horizontal ? y : x, r2, n);
+                    break;
+                }
+                case LevelTypes::MovementShape::HorizontalArc:
+                    // hangs below the anchor and swings sideways
+                    swing();
+                    scaled_sin(arg, x, r1, n);
+                    scaled_cos(arg, y, tmp, r1, n);
+                    break;
+                case LevelTypes::MovementShape::VerticalArc:
+                    swing();
+                    scaled_cos(arg, x, tmp, r1, n);
+                    scaled_sin(arg, y, r1, n);
+                    break;
+                case LevelTypes::MovementShape::RotateBackAndForth:
+                    swing();
+                    scaled_cos(arg, x, tmp, r1, n);
+                    scaled_sin(arg, y, r1, n);
+                    turns_to_angle(arg);
+                    break;
+                case LevelTypes::MovementShape::VerticalWrap:
+                case LevelTypes::MovementShape::HorizontalWrap: {
+                    // sweeps from -r1 to r1 and jumps back
+                    auto* along = m.Shape[r] == LevelTypes::MovementShape::HorizontalWrap ? x : y;
+                    Simd::fraction(phase, along, n);
+                    for (size_t k = 0; k < n; ++k)
+                        along[k] = r1 * (2.f * along[k] - 1.f);
+                    std::fill_n(along == x ? y : x, n, 0.f);
+                    break;
+                }
+                default:
+                    std::fill_n(x, n, 0.f);
+                    std::fill_n(y, n, 0.f);
+                    break;
+            }
+
+            if (m.Rotation[r] != 0.f) {
+                const double radians = m.Rotation[r] * 3.14159265358979323846 / 180.;
+                const auto c = static_cast<float>(std::cos(radians)), sn = static_cast<float>(std::sin(radians));
+                for (size_t k = 0; k < n; ++k) {
+                    const float rx = x[k] * c - y[k] * sn;
+                    const float ry = x[k] * sn + y[k] * c;
+                    x[k] = rx;
+                    y[k] = ry;
+                }
+            }
+            const float sub_x = m.SubOffsetX[r], sub_y = m.SubOffsetY[r];
+            for (size_t k = 0; k < n; ++k) {
+                dx[k] += x[k] + sub_x;
+                dy[k] += y[k] + sub_y;
+            }
+        }
+    }
+
+    LevelTypes::MotionColumns Level::ExtractMotion(const LevelTypes::Level& lvl) {
+        return ExtractMotion(lvl, std::vector<bool>(lvl.Elements.size(), true));
+    }
+
+    LevelTypes::MotionColumns Level::ExtractMotion(const LevelTypes::Level& lvl, const std::vector<bool>& elements) {
+        std::vector<const LevelTypes::MovementLink*> links;
+        for (const auto& element : lvl.Elements)
+            MovementHelpers::number_links(element, links);
+        LevelTypes::MotionColumns m = {};
+        m.Status.resize(lvl.Elements.size(), LevelTypes::MotionStatus::None);
+        for (uint32_t i = 0; i < lvl.Elements.size() && i < elements.size(); ++i) {
+            const auto& element = lvl.Elements[i];
+            if (elements[i] && element.flags.hasMovementInfo)
+                m.Status[i] = MovementHelpers::append_chain(m, i, &element.generic.mMovementLink, links);
+        }
+        return m;
+    }
+
+    LevelTypes::MotionTracks Level::EvaluateMotion(const LevelTypes::MotionColumns& motion, const std::vector<float>& times) {
+        LevelTypes::MotionTracks tracks = {};
+        tracks.Times = times;
+        for (size_t r = 0; r < motion.Element.size(); ++r)
+            if (r == 0 || motion.Element[r] != motion.Element[r - 1])
+                tracks.Element.push_back(motion.Element[r]);
+
+        const size_t n = times.size();
+        tracks.X.resize(tracks.Element.size() * n);
+        tracks.Y.resize(tracks.Element.size() * n);
+        tracks.Angle.resize(tracks.Element.size() * n);
+        MovementHelpers::Scratch scratch;
+        scratch.resize(n);
+
+        // a track starts at its anchor and every row of the element adds its offset, the first row its angle too
+        size_t track = 0;
+        for (size_t r = 0; r < motion.Element.size(); ++r) {
+            const bool first = r == 0 || motion.Element[r] != motion.Element[r - 1];
+            if (first && r != 0)
+                ++track;
+            auto* x = tracks.X.data() + track * n;
+            auto* y = tracks.Y.data() + track * n;
+            if (first) {
+                std::fill_n(x, n, motion.AnchorX[r]);
+                std::fill_n(y, n, motion.AnchorY[r]);
+            }
+            auto* angle = first ? tracks.Angle.data() + track * n : nullptr;
+            MovementHelpers::accumulate_row(motion, r, times.data(), n, x, y, angle, scratch);
+        }
+        return tracks;
+    }
+
+    LevelTypes::Point Level::EvaluateMovement(const LevelTypes::MovementLink& link, const float t) {
+        // without the level there is nothing a reference could refer to, one at the top leaves no rows
+        LevelTypes::MotionColumns motion = {};
+        MovementHelpers::append_chain(motion, 0, &link, {});
+        if (motion.Element.empty())
+            return link.InternalMovement.mAnchorPoint;
+        const auto tracks = EvaluateMotion(motion, {t});
+        return {tracks.X[0], tracks.Y[0]};
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,349 @@
+#include "helpers.h"
+#include "libpeggle.h"
+#include "simd.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace Peggle {
+#pragma region libpeggle_Particles
+
+    namespace ParticleHelpers {
+        // movement time runs in game ticks
+        constexpr float game_ticks_per_second = 100.f;
+        // ticks of movement evaluated at a time
+        constexpr uint32_t batch_ticks = 1024;
+
+        // uniform in [0, 1)
+        float draw(uint64_t& rng) {
+            return static_cast<float>(SimulationHelpers::mix(rng++) >> 40) * 0x1.0p-24f;
+        }
+
+        // every column of a particle set, in declaration order
+        template<typename F>
+        void for_each_column(ParticleTypes::Particles& p, F&& f) {
+            f(p.Emitter);
+            f(p.X); f(p.Y);
+            f(p.VX); f(p.VY);
+            f(p.AX); f(p.AY);
+            f(p.Age); f(p.Life);
+            f(p.Rotation); f(p.RotationVelocity);
+            f(p.Scale); f(p.ScaleVelocity);
+            f(p.Red); f(p.Green); f(p.Blue);
+            f(p.Opacity);
+            f(p.BaseOpacity); f(p.FadeIn); f(p.FadeOutAt);
+        }
+    }
+
+    ParticleSimulator::ParticleSimulator(const LevelTypes::Level& lvl, const ParticleTypes::Settings& settings) : Options(settings) {
+        if (!(Options.TickSeconds > 0.f) || !std::isfinite(Options.TickSeconds))
+            throw std::exception("Invalid particle settings");
+
+        // a variable value is either "Random(a, b)" or a number, anything else reads as 0
+        const auto range_of = [](const LevelTypes::VariableFloat& v) -> Range {
+            if (!v.mIsVariable)
+                return {v.mStaticVariable, v.mStaticVariable};
+            const std::string_view text = v.mVariableValue;
+            const char* p = text.data();
+            const char* end = p + text.size();
+            if (const auto open = text.find('('); open != std::string_view::npos)
+                p += open + 1;
+            float values[2] = {};
+            int found = 0;
+            while (found < 2 && p < end) {
+                while (p < end && (*p == ' ' || *p == ','))
+                    ++p;
+                const auto [next, ec] = std::from_chars(p, end, values[found]);
+                if (ec != std::errc() || !std::isfinite(values[found]))
+                    break;
+                p = next;
+                ++found;
+            }
+            if (found == 0)
+                return {};
+            return {values[0], values[found - 1]};
+        };
+
+        std::vector<bool> emitting(lvl.Elements.size());
+        for (uint32_t i = 0; i < lvl.Elements.size(); ++i) {
+            const auto& element = lvl.Elements[i];
+            const auto* e = element.entry ? Level::AccessEmitter(*element.entry) : nullptr;
+            if (!e)
+                continue;
+            emitting[i] = true;
+            const auto& f = e->mFlags;
+
+            Source s = {};
+            s.Element = i;
+            s.X = e->mPos.x;
+            s.Y = e->mPos.y;
+            if (f.hasRandomStartPosition) {
+                s.Width = static_cast<float>(e->mWidth);
+                s.Height = static_cast<float>(e->mHeight);
+            }
+            s.Life = std::isfinite(e->mLifeDuration) ? e->mLifeDuration : 0.f;
+            // an emitter whose particles never live spawns nothing
+            if (s.Life > 0.f)
+                s.Rate = range_of(e->mEmitRate);
+            s.Area = range_of(e->mEmitAreaMultiplier);
+            s.MaxQuantity = static_cast<uint32_t>(std::max(e->mMaxQuantity, 0));
+            s.FadeIn = std::max(e->mFadeInTime, 0.f);
+            s.FadeOutAt = std::clamp(e->mTimeBeforeFadeOut, 0.f, std::max(s.Life, 0.f));
+
+            s.Velocity = f.hasChangeVelocity;
+            s.MinVX = range_of(e->mMinVelocityX);
+            s.MinVY = range_of(e->mMinVelocityY);
+            s.MaxVX = e->mMaxVelocityX;
+            s.MaxVY = e->mMaxVelocityY;
+            s.AX = e->mAccelerationX;
+            s.AY = e->mAccelerationY;
+            s.Direction = f.hasChangeDirection;
+            s.Speed = e->mDirectionSpeed;
+            s.RandomSpeed = e->mDirectionRandomSpeed;
+            s.DirectionAcceleration = e->mDirectionAcceleration;
+            s.Angle = e->mDirectionAngle;
+            s.RandomAngle = e->mDirectionRandomAngle;
+            s.Rotating = f.hasChangeRotation;
+            s.Rotation = e->mRotation;
+            s.StartRotation = range_of(e->mInitialRotation);
+            s.RotationVelocity = range_of(e->mRotationVelocity);
+            s.Scaling = f.hasChangeScale;
+            s.MinScale = range_of(e->mMinScale);
+            s.ScaleVelocity = range_of(e->mScaleVelocity);
+            s.MaxRandScale = e->mMaxRandScale;
+            s.Coloured = f.hasChangeColor;
+            s.Red = range_of(e->mColourRed);
+            s.Green = range_of(e->mColourGreen);
+            s.Blue = range_of(e->mColourBlue);
+            s.Fading = f.hasChangeOpacity;
+            s.Opacity = range_of(e->mOpacity);
+            Sources.push_back(s);
+        }
+
+        // movements of other elements are left alone. an emitter whose own movement cannot be evaluated whole stays
+        // at its position, its rows are dropped by extracting again without it
+        Motion = Level::ExtractMotion(lvl, emitting);
+        bool broken = false;
+        for (uint32_t i = 0; i < lvl.Elements.size(); ++i) {
+            const auto status = Motion.Status[i];
+            if (status != LevelTypes::MotionStatus::None && status != LevelTypes::MotionStatus::Ok) {
+                emitting[i] = false;
+                broken = true;
+            }
+        }
+        if (broken)
+            Motion = Level::ExtractMotion(lvl, emitting);
+        // tracks come out one per run of rows of the same element
+        uint32_t track = 0;
+        for (size_t r = 0, s = 0; r < Motion.Element.size(); ++r) {
+            if (r > 0 && Motion.Element[r] == Motion.Element[r - 1])
+                continue;
+            while (Sources[s].Element != Motion.Element[r])
+                ++s;
+            Sources[s].Track = static_cast<int32_t>(track++);
+        }
+        Reset();
+    }
+
+    void ParticleSimulator::Reset() {
+        for (uint32_t i = 0; i < Sources.size(); ++i) {
+            Sources[i].Rng = Options.Seed ^ SimulationHelpers::mix(i);
+            Sources[i].Pending = 0.;
+        }
+        Alive.assign(Sources.size(), 0);
+        ParticleHelpers::for_each_column(State, [](auto& column) { column.clear(); });
+        Stats = {};
+        Stats.EmitterPeak.assign(Sources.size(), 0);
+    }
+
+    void ParticleSimulator::Step(const uint32_t ticks) {
+        std::vector<float> times;
+        LevelTypes::MotionTracks tracks;
+        for (uint32_t done = 0; done < ticks;) {
+            const uint32_t batch = std::min(ticks - done, ParticleHelpers::batch_ticks);
+            if (!Motion.Element.empty()) {
+                // particles spawn at the end of their tick
+                times.resize(batch);
+                for (uint32_t k = 0; k < batch; ++k)
+                    times[k] = static_cast<float>(static_cast<double>(Stats.Ticks + k + 1) * Options.TickSeconds *
+                                                  ParticleHelpers::game_ticks_per_second);
+                tracks = Level::EvaluateMotion(Motion, times);
+            }
+            for (uint32_t k = 0; k < batch; ++k)
+                Tick(tracks, k);
+            done += batch;
+        }
+    }
+
+    void ParticleSimulator::Tick(const LevelTypes::MotionTracks& tracks, const uint32_t k) {
+        const float dt = Options.TickSeconds;
+        auto& p = State;
+        size_t n = p.X.size();
+
+        Simd::integrate(p.X.data(), p.VX.data(), p.AX.data(), n, dt);
+        Simd::integrate(p.Y.data(), p.VY.data(), p.AY.data(), n, dt);
+        Simd::advance(p.Rotation.data(), p.RotationVelocity.data(), n, dt, -std::numeric_limits<float>::infinity());
+        Simd::advance(p.Scale.data(), p.ScaleVelocity.data(), n, dt, 0.f);
+        Simd::linear(p.Age.data(), n, 1., dt);
+
+        // the dead go, the rest keep their order
+        size_t first = 0;
+        while (first < n && p.Age[first] < p.Life[first])
+            ++first;
+        if (first < n) {
+            Kept.clear();
+            for (size_t i = first; i < n; ++i) {
+                if (p.Age[i] < p.Life[i])
+                    Kept.push_back(static_cast<uint32_t>(i));
+                else
+                    --Alive[p.Emitter[i]];
+            }
+            ParticleHelpers::for_each_column(p, [&](auto& column) {
+                size_t w = first;
+                for (const auto i : Kept)
+                    column[w++] = column[i];
+                column.resize(w);
+            });
+            n = p.X.size();
+        }
+
+        const size_t times = tracks.Times.size();
+        for (uint32_t i = 0; i < Sources.size(); ++i) {
+            auto& s = Sources[i];
+            if (s.Rate.High <= 0.f && s.Rate.Low <= 0.f)
+                continue;
+            const float r = s.Rate.Low + (s.Rate.High - s.Rate.Low) * ParticleHelpers::draw(s.Rng);
+            s.Pending += std::max(r, 0.f) * dt;
+            if (s.Pending < 1.)
+                continue;
+            auto count = static_cast<uint64_t>(s.Pending);
+            s.Pending -= static_cast<double>(count);
+            // an emitter at its own limit skips the spawn, only the global limit counts as dropped
+            if (s.MaxQuantity)
+                count = std::min<uint64_t>(count, s.MaxQuantity - std::min(s.MaxQuantity, Alive[i]));
+            const uint64_t room = Options.MaxParticles - std::min<uint64_t>(Options.MaxParticles, p.X.size());
+            if (count > room) {
+                Stats.Dropped += count - room;
+                count = room;
+            }
+            if (!count)
+                continue;
+            float x = s.X, y = s.Y;
+            if (s.Track >= 0) {
+                x = tracks.X[s.Track * times + k];
+                y = tracks.Y[s.Track * times + k];
+            }
+            Spawn(s, i, x, y, static_cast<uint32_t>(count));
+        }
+
+        n = p.X.size();
+        Simd::fade(p.Age.data(), p.Life.data(), p.FadeIn.data(), p.FadeOutAt.data(), p.BaseOpacity.data(), p.Opacity.data(), n);
+
+        ++Stats.Ticks;
+        Stats.Alive = static_cast<uint32_t>(n);
+        if (Stats.Alive > Stats.Peak) {
+            Stats.Peak = Stats.Alive;
+            Stats.PeakTick = Stats.Ticks;
+        }
+        for (uint32_t i = 0; i < Sources.size(); ++i)
+            Stats.EmitterPeak[i] = std::max(Stats.EmitterPeak[i], Alive[i]);
+    }
+
+    void ParticleSimulator::Spawn(Source& s, const uint32_t emitter, const float x, const float y, const uint32_t count) {
+        using ParticleHelpers::draw;
+        const auto sample = [&](const Range& range) {
+            return range.Low + (range.High - range.Low) * draw(s.Rng);
+        };
+        constexpr float radians = std::numbers::pi_v<float> / 180.f;
+        auto& p = State;
+        for (uint32_t c = 0; c < count; ++c) {
+            float px = x, py = y;
+            if (s.Width > 0.f || s.Height > 0.f) {
+                const float area = sample(s.Area);
+                const float scale = area > 0.f ? area : 1.f;
+                px += (draw(s.Rng) - .5f) * s.Width * scale;
+                py += (draw(s.Rng) - .5f) * s.Height * scale;
+            }
+            float vx = 0.f, vy = 0.f, ax = 0.f, ay = 0.f;
+            if (s.Velocity) {
+                const float lo_x = sample(s.MinVX), lo_y = sample(s.MinVY);
+                vx = lo_x + (s.MaxVX - lo_x) * draw(s.Rng);
+                vy = lo_y + (s.MaxVY - lo_y) * draw(s.Rng);
+                ax = s.AX;
+                ay = s.AY;
+            }
+            if (s.Direction) {
+                const float speed = s.Speed + s.RandomSpeed * draw(s.Rng);
+                const float angle = (s.Angle + (draw(s.Rng) - .5f) * s.RandomAngle) * radians;
+                const float cx = std::cos(angle), cy = std::sin(angle);
+                vx += cx * speed;
+                vy += cy * speed;
+                ax += cx * s.DirectionAcceleration;
+                ay += cy * s.DirectionAcceleration;
+            }
+            float rotation = s.Rotation, spin = 0.f;
+            if (s.Rotating) {
+                rotation = sample(s.StartRotation);
+                spin = sample(s.RotationVelocity);
+            }
+            float scale = 1.f, growth = 0.f;
+            if (s.Scaling) {
+                scale = sample(s.MinScale);
+                scale += s.MaxRandScale * draw(s.Rng);
+                growth = sample(s.ScaleVelocity);
+            }
+            float red = 1.f, green = 1.f, blue = 1.f;
+            if (s.Coloured) {
+                red = sample(s.Red);
+                green = sample(s.Green);
+                blue = sample(s.Blue);
+            }
+            const float opacity = s.Fading ? sample(s.Opacity) : 1.f;
+
+            p.Emitter.push_back(emitter);
+            p.X.push_back(px);
+            p.Y.push_back(py);
+            p.VX.push_back(vx);
+            p.VY.push_back(vy);
+            p.AX.push_back(ax);
+            p.AY.push_back(ay);
+            p.Age.push_back(0.f);
+            p.Life.push_back(s.Life);
+            p.Rotation.push_back(rotation);
+            p.RotationVelocity.push_back(spin);
+            p.Scale.push_back(std::max(scale, 0.f));
+            p.ScaleVelocity.push_back(growth);
+            p.Red.push_back(red);
+            p.Green.push_back(green);
+            p.Blue.push_back(blue);
+            p.Opacity.push_back(0.f);
+            p.BaseOpacity.push_back(opacity);
+            p.FadeIn.push_back(s.FadeIn);
+            p.FadeOutAt.push_back(s.FadeOutAt);
+        }
+        Alive[emitter] += count;
+        Stats.Spawned += count;
+    }
+
+    const ParticleTypes::Particles& ParticleSimulator::GetParticles() const {
+        return State;
+    }
+
+    const ParticleTypes::ParticleStats& ParticleSimulator::GetStats() const {
+        return Stats;
+    }
+
+    uint32_t ParticleSimulator::GetEmitterCount() const {
+        return static_cast<uint32_t>(Sources.size());
+    }
+
+    uint32_t ParticleSimulator::GetElement(const uint32_t emitter) const {
+        if (emitter >= Sources.size())
+            throw std::exception("Emitter out of range");
+        return Sources[emitter].Element;
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,531 @@
+#include "binstream.h"
+#include "levelschema.h"
+#include "libpeggle.h"
+#include <algorithm>
+#include <cstdlib>
+#include <memory_resource>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Peggle {
+#pragma region libpeggle_Patch
+
+    namespace PatchHelpers {
+        constexpr uint32_t patch_magic = 0x4843504C;  // "LPCH"
+        constexpr size_t level_header = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+        uint64_t hash_bytes(const uint8_t* data, const size_t size) {
+            uint64_t h = 0xCBF29CE484222325ull ^ size;
+            size_t i = 0;
+            for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+                uint64_t word;
+                memcpy(&word, data + i, sizeof(word));
+                h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+                h ^= h >> 32;
+            }
+            for (; i < size; ++i)
+                h = (h ^ data[i]) * 0x100000001B3ull;
+            return h;
+        }
+
+        void write_varint(binstream& bs, uint32_t v) {
+            while (v >= 0x80) {
+                bs.write(static_cast<uint8_t>(v | 0x80));
+                v >>= 7;
+            }
+            bs.write(static_cast<uint8_t>(v));
+        }
+        size_t varint_size(uint32_t v) {
+            size_t n = 1;
+            for (; v >= 0x80; v >>= 7)
+                ++n;
+            return n;
+        }
+        uint32_t read_varint(binstream& bs) {
+            uint32_t v = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                const auto b = bs.read<uint8_t>();
+                v |= static_cast<uint32_t>(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                    return v;
+            }
+            throw std::exception("Malformed varint in patch");
+        }
+
+        // takes the place of the output stream and notes where each write starts. the writer puts every field (a
+        // string's length and its bytes apart) down in one write
+        struct FieldMarks {
+            std::vector<uint32_t> Starts;
+            uint32_t At = 0;
+
+            template<typename T>
+            void write(const T&) {
+                write(nullptr, sizeof(T));
+            }
+            void write(const void*, const size_t size) {
+                Starts.push_back(At);
+                At += static_cast<uint32_t>(size);
+            }
+        };
+
+        // a level buffer split into its top level elements
+        struct Side {
+            const uint8_t* Data = nullptr;
+            LevelTypes::LevelIndex Index;
+            std::vector<uint64_t> Hashes;
+            std::vector<std::string_view> IDs;  // empty when the element has none
+
+            Side(const void* buf, const uint32_t size) : Data(static_cast<const uint8_t*>(buf)) {
+                Index = Level::IndexLevel(buf, size);
+                const auto& spans = Index.Elements;
+                Hashes.resize(spans.size());
+                IDs.resize(spans.size());
+                for (size_t i = 0; i < spans.size(); ++i)
+                    Hashes[i] = hash_bytes(bytes(i), spans[i].Size);
+
+                // only the head is read, for the ID. strings are views into bs, which lives as long as the side
+                Source = binstream(buf, size);
+                LevelSchema::with_format(Index.version, std::pmr::null_memory_resource(), [&](const auto fmt) {
+                    for (size_t i = 0; i < spans.size(); ++i) {
+                        if (spans[i].Magic != 1 || !spans[i].Flags.hasID)
+                            continue;
+                        Source.seek(spans[i].Offset + sizeof(int32_t));
+                        LevelTypes::Element scratch = {};
+                        LevelSchema::ElementHead::read(Source, scratch, fmt);
+                        IDs[i] = scratch.generic.mID;
+                    }
+                });
+            }
+
+            [[nodiscard]] const uint8_t* bytes(const size_t i) const { return Data + Index.Elements[i].Offset; }
+            [[nodiscard]] uint32_t size(const size_t i) const { return Index.Elements[i].Size; }
+
+            // offset of every field of element i and its end, found by decoding it and encoding it again into marks
+            [[nodiscard]] std::vector<uint32_t> fields(const size_t i) const {
+                binstream bs(bytes(i), size(i));
+                bs.seek(0);
+                std::pmr::monotonic_buffer_resource arena;
+                FieldMarks marks;
+                LevelSchema::with_format(Index.version, &arena, [&](const auto fmt) {
+                    LevelTypes::Element scratch = {};
+                    LevelSchema::Codec<LevelTypes::Element>::read(bs, scratch, fmt);
+                    LevelSchema::Codec<LevelTypes::Element>::write(marks, scratch, fmt);
+                });
+                marks.Starts.push_back(marks.At);
+                if (marks.At != size(i)) {
+                    // does not encode back to its own bytes, every byte is a field then
+                    marks.Starts.resize(size(i) + 1);
+                    for (uint32_t at = 0; at <= size(i); ++at)
+                        marks.Starts[at] = at;
+                }
+                return marks.Starts;
+            }
+
+        private:
+            binstream Source;
+        };
+
+        bool same_element(const Side& a, const size_t i, const Side& b, const size_t j) {
+            return a.Hashes[i] == b.Hashes[j] && a.size(i) == b.size(j) && !memcmp(a.bytes(i), b.bytes(j), a.size(i));
+        }
+
+        // changed fields between two encodings of an element, fields are the offsets where a's fields start plus
+        // its end. equal sized elements get one delta per run of changed fields (runs closer than a delta header
+        // are merged), others one delta between the common ends
+        std::vector<LevelTypes::ByteDelta> field_deltas(const uint8_t* a, const size_t a_size, const uint8_t* b, const size_t b_size,
+                                                        const std::vector<uint32_t>& fields) {
+            // start of the field holding offset, end of the field holding the byte before offset
+            const auto field_start = [&fields](const size_t offset) -> size_t {
+                return *std::prev(std::upper_bound(fields.begin(), fields.end(), offset));
+            };
+            const auto field_end = [&fields](const size_t offset) -> size_t {
+                return *std::lower_bound(fields.begin(), fields.end(), offset);
+            };
+
+            size_t prefix = 0;
+            const size_t shorter = std::min(a_size, b_size);
+            while (prefix < shorter && a[prefix] == b[prefix])
+                ++prefix;
+            size_t suffix = 0;
+            while (suffix < shorter - prefix && a[a_size - 1 - suffix] == b[b_size - 1 - suffix])
+                ++suffix;
+
+            std::vector<LevelTypes::ByteDelta> deltas;
+            if (a_size != b_size) {
+                // the common ends line up in both, so the fields of a mark them in b too
+                const size_t start = field_start(prefix), end = field_end(a_size - suffix);
+                deltas.push_back({
+                    static_cast<uint32_t>(start),
+                    static_cast<uint32_t>(end - start),
+                    std::vector<uint8_t>(b + start, b + end + b_size - a_size)
+                });
+                return deltas;
+            }
+
+            constexpr size_t merge_gap = 4;
+            const size_t end = a_size - suffix;
+            size_t i = prefix;
+            while (i < end) {
+                const size_t start = i;
+                size_t last = i;  // last differing byte of the run
+                while (i < end && i - last <= merge_gap) {
+                    if (a[i] != b[i])
+                        last = i;
+                    ++i;
+                }
+                const size_t from = field_start(start), to = field_end(last + 1);
+                if (!deltas.empty() && from <= deltas.back().Offset + deltas.back().Removed) {
+                    // widened into the field the last run ended in
+                    auto& back = deltas.back();
+                    back.Removed = static_cast<uint32_t>(to - back.Offset);
+                    back.Bytes.assign(b + back.Offset, b + to);
+                } else {
+                    deltas.push_back({
+                        static_cast<uint32_t>(from),
+                        static_cast<uint32_t>(to - from),
+                        std::vector<uint8_t>(b + from, b + to)
+                    });
+                }
+                i = std::max(last + 1, to);
+                while (i < end && a[i] == b[i])
+                    ++i;
+            }
+            return deltas;
+        }
+
+        // wire size of a step, to pick between a delta and a fresh encoding
+        size_t step_size(const LevelTypes::PatchStep& step) {
+            size_t n = 1;
+            switch (step.Op) {
+                case LevelTypes::PatchOp::Copy:
+                    return n + varint_size(step.Source) + varint_size(step.Count) + varint_size(step.Offset) + varint_size(step.Size);
+                case LevelTypes::PatchOp::Modify: {
+                    n += varint_size(step.Source) + varint_size(step.Offset) + varint_size(step.Size);
+                    n += varint_size(static_cast<uint32_t>(step.Deltas.size()));
+                    uint32_t cursor = 0;
+                    for (const auto& d : step.Deltas) {
+                        n += varint_size(d.Offset - cursor) + varint_size(d.Removed);
+                        n += varint_size(static_cast<uint32_t>(d.Bytes.size())) + d.Bytes.size();
+                        cursor = d.Offset + d.Removed;
+                    }
+                    return n;
+                }
+                case LevelTypes::PatchOp::Insert:
+                    return n + varint_size(static_cast<uint32_t>(step.Bytes.size())) + step.Bytes.size();
+            }
+            return n;
+        }
+    }
+
+    LevelTypes::LevelPatch Level::DiffLevel(const void* from, const uint32_t from_size, const void* to, const uint32_t to_size) {
+        const PatchHelpers::Side src(from, from_size);
+        const PatchHelpers::Side dst(to, to_size);
+        const size_t src_count = src.Index.Elements.size();
+
+        LevelTypes::LevelPatch patch = {
+            .valid = true,
+            .version = dst.Index.version,
+            .sync_f = dst.Index.sync_f,
+            .SourceSize = from_size,
+            .SourceHash = PatchHelpers::hash_bytes(static_cast<const uint8_t*>(from), from_size),
+            .SourceCount = static_cast<uint32_t>(src_count)
+        };
+
+        // source candidates by ID and by content, in file order. cursors skip the ones already taken
+        struct Queue {
+            std::vector<uint32_t> Items;
+            size_t Next = 0;
+        };
+        std::unordered_map<std::string_view, Queue> by_id;
+        std::unordered_map<uint64_t, Queue> by_hash;
+        for (uint32_t i = 0; i < src_count; ++i) {
+            if (!src.IDs[i].empty())
+                by_id[src.IDs[i]].Items.push_back(i);
+            by_hash[src.Hashes[i]].Items.push_back(i);
+        }
+        std::unordered_set<std::string_view> wanted_ids(dst.IDs.begin(), dst.IDs.end());
+        std::vector<bool> used(src_count);
+        const auto take = [&used](Queue& queue, const auto& accept) -> int64_t {
+            while (queue.Next < queue.Items.size() && used[queue.Items[queue.Next]])
+                ++queue.Next;
+            for (size_t k = queue.Next; k < queue.Items.size(); ++k)
+                if (!used[queue.Items[k]] && accept(queue.Items[k]))
+                    return queue.Items[k];
+            return -1;
+        };
+
+        int64_t prev = -1;  // last source element matched
+        for (uint32_t t = 0; t < dst.Index.Elements.size(); ++t) {
+            const auto& span = dst.Index.Elements[t];
+            int64_t match = -1;
+            if (!dst.IDs[t].empty()) {
+                if (const auto it = by_id.find(dst.IDs[t]); it != by_id.end())
+                    match = take(it->second, [&](const uint32_t s) { return src.Index.Elements[s].Type == span.Type; });
+            }
+            // same bytes, preferably right after the last match so copies form runs
+            if (match < 0 && prev + 1 < static_cast<int64_t>(src_count) && !used[prev + 1]
+                && PatchHelpers::same_element(src, prev + 1, dst, t))
+                match = prev + 1;
+            if (match < 0) {
+                if (const auto it = by_hash.find(dst.Hashes[t]); it != by_hash.end())
+                    match = take(it->second, [&](const uint32_t s) { return PatchHelpers::same_element(src, s, dst, t); });
+            }
+            // by position, unless that element's ID is still looked for elsewhere
+            if (match < 0 && prev + 1 < static_cast<int64_t>(src_count) && !used[prev + 1]) {
+                const auto next = static_cast<uint32_t>(prev + 1);
+                if (src.Index.Elements[next].Type == span.Type && src.Index.Elements[next].Magic == span.Magic
+                    && (src.IDs[next].empty() || !wanted_ids.contains(src.IDs[next])))
+                    match = next;
+            }
+
+            LevelTypes::PatchStep step = {};
+            if (match < 0) {
+                step.Op = LevelTypes::PatchOp::Insert;
+                step.Bytes.assign(dst.bytes(t), dst.bytes(t) + dst.size(t));
+                patch.Steps.push_back(std::move(step));
+                continue;
+            }
+            const auto s = static_cast<uint32_t>(match);
+            const auto& source_span = src.Index.Elements[s];
+            used[s] = true;
+            prev = s;
+            if (PatchHelpers::same_element(src, s, dst, t)) {
+                auto* last = patch.Steps.empty() ? nullptr : &patch.Steps.back();
+                if (last && last->Op == LevelTypes::PatchOp::Copy && last->Source + last->Count == s) {
+                    ++last->Count;
+                    last->Size += source_span.Size;
+                } else {
+                    patch.Steps.push_back({
+                        .Op = LevelTypes::PatchOp::Copy, .Source = s, .Count = 1,
+                        .Offset = source_span.Offset, .Size = source_span.Size
+                    });
+                }
+                continue;
+            }
+            step.Op = LevelTypes::PatchOp::Modify;
+            step.Source = s;
+            step.Offset = source_span.Offset;
+            step.Size = source_span.Size;
+            step.Deltas = PatchHelpers::field_deltas(src.bytes(s), src.size(s), dst.bytes(t), dst.size(t), src.fields(s));
+            LevelTypes::PatchStep insert = {.Op = LevelTypes::PatchOp::Insert};
+            insert.Bytes.assign(dst.bytes(t), dst.bytes(t) + dst.size(t));
+            patch.Steps.push_back(PatchHelpers::step_size(insert) < PatchHelpers::step_size(step) ? std::move(insert) : std::move(step));
+        }
+        return patch;
+    }
+
+    LevelTypes::LevelPatch Level::DiffLevel(const LevelTypes::Level& from, const LevelTypes::Level& to) {
+        if (!from.valid || !to.valid)
+            return LevelTypes::LevelPatch{};
+        const auto a = BuildLevel(from);
+        const auto b = BuildLevel(to);
+        auto patch = DiffLevel(a.Data, a.Size, b.Data, b.Size);
+        free(const_cast<void*>(a.Data));
+        free(const_cast<void*>(b.Data));
+        return patch;
+    }
+
+    FileRef Level::ApplyPatch(const void* from, const uint32_t from_size, const LevelTypes::LevelPatch& patch) {
+        if (!patch.valid)
+            throw std::exception("Invalid patch");
+        const auto* src = static_cast<const uint8_t*>(from);
+        if (from_size != patch.SourceSize || PatchHelpers::hash_bytes(src, from_size) != patch.SourceHash)
+            throw std::exception("Patch was made for a different level");
+        // the hash pins the buffer, not the steps. a step's bytes must be whole source elements, Source to
+        // Source + Count. check every step and size the output before writing anything
+        const auto spans = IndexLevel(from, from_size).Elements;
+        if (patch.SourceCount != spans.size())
+            throw std::exception("Patch was made for a different level");
+        const auto in_source = [&spans](const LevelTypes::PatchStep& step, const uint32_t count) {
+            if (count == 0 || step.Source >= spans.size() || count > spans.size() - step.Source)
+                return false;
+            const auto& first = spans[step.Source];
+            const auto& last = spans[step.Source + count - 1];
+            return step.Offset == first.Offset && step.Size == last.Offset + last.Size - first.Offset;
+        };
+        size_t size = PatchHelpers::level_header;
+        uint64_t count = 0;
+        for (const auto& step : patch.Steps) {
+            switch (step.Op) {
+                case LevelTypes::PatchOp::Copy:
+                    if (!in_source(step, step.Count))
+                        throw std::exception("Patch copies bytes the level does not have");
+                    size += step.Size;
+                    count += step.Count;
+                    break;
+                case LevelTypes::PatchOp::Modify: {
+                    if (!in_source(step, 1))
+                        throw std::exception("Patch modifies bytes the level does not have");
+                    uint64_t cursor = 0;
+                    size += step.Size;
+                    for (const auto& d : step.Deltas) {
+                        if (d.Offset < cursor || static_cast<uint64_t>(d.Offset) + d.Removed > step.Size)
+                            throw std::exception("Patch delta is outside its element");
+                        cursor = static_cast<uint64_t>(d.Offset) + d.Removed;
+                        size = size - d.Removed + d.Bytes.size();
+                    }
+                    ++count;
+                    break;
+                }
+                case LevelTypes::PatchOp::Insert:
+                    size += step.Bytes.size();
+                    ++count;
+                    break;
+                default:
+                    throw std::exception("Unknown patch step");
+            }
+        }
+        if (count > UINT32_MAX || size > UINT32_MAX)
+            throw std::exception("Patched level is too large");
+
+        auto* out = static_cast<uint8_t*>(malloc(size));
+        auto* cursor = out;
+        const auto put = [&cursor](const void* data, const size_t n) {
+            memcpy(cursor, data, n);
+            cursor += n;
+        };
+        const auto element_count = static_cast<uint32_t>(count);
+        put(&patch.version, sizeof(patch.version));
+        put(&patch.sync_f, sizeof(patch.sync_f));
+        put(&element_count, sizeof(element_count));
+        for (const auto& step : patch.Steps) {
+            switch (step.Op) {
+                case LevelTypes::PatchOp::Copy:
+                    put(src + step.Offset, step.Size);  // consecutive elements are consecutive bytes
+                    break;
+                case LevelTypes::PatchOp::Modify: {
+                    const auto* element = src + step.Offset;
+                    uint32_t at = 0;
+                    for (const auto& d : step.Deltas) {
+                        put(element + at, d.Offset - at);
+                        put(d.Bytes.data(), d.Bytes.size());
+                        at = d.Offset + d.Removed;
+                    }
+                    put(element + at, step.Size - at);
+                    break;
+                }
+                case LevelTypes::PatchOp::Insert:
+                    put(step.Bytes.data(), step.Bytes.size());
+                    break;
+            }
+        }
+        return FileRef{
+            FileState::OK,
+            out,
+            static_cast<uint32_t>(size)
+        };
+    }
+
+    FileRef Level::ApplyPatch(const FileRef& from, const LevelTypes::LevelPatch& patch) {
+        return ApplyPatch(from.Data, from.Size, patch);
+    }
+
+    FileRef Level::BuildPatch(const LevelTypes::LevelPatch& patch) {
+        if (!patch.valid)
+            return FileRef{};
+        auto bs = binstream();
+        bs.write(PatchHelpers::patch_magic);
+        bs.write(patch.version);
+        bs.write(patch.sync_f);
+        bs.write(patch.SourceSize);
+        bs.write(patch.SourceHash);
+        bs.write(patch.SourceCount);
+        PatchHelpers::write_varint(bs, static_cast<uint32_t>(patch.Steps.size()));
+        for (const auto& step : patch.Steps) {
+            bs.write(static_cast<uint8_t>(step.Op));
+            switch (step.Op) {
+                case LevelTypes::PatchOp::Copy:
+                    PatchHelpers::write_varint(bs, step.Source);
+                    PatchHelpers::write_varint(bs, step.Count);
+                    PatchHelpers::write_varint(bs, step.Offset);
+                    PatchHelpers::write_varint(bs, step.Size);
+                    break;
+                case LevelTypes::PatchOp::Modify: {
+                    PatchHelpers::write_varint(bs, step.Source);
+                    PatchHelpers::write_varint(bs, step.Offset);
+                    PatchHelpers::write_varint(bs, step.Size);
+                    PatchHelpers::write_varint(bs, static_cast<uint32_t>(step.Deltas.size()));
+                    uint32_t cursor = 0;  // offsets are stored from the end of the previous delta
+                    for (const auto& d : step.Deltas) {
+                        PatchHelpers::write_varint(bs, d.Offset - cursor);
+                        PatchHelpers::write_varint(bs, d.Removed);
+                        PatchHelpers::write_varint(bs, static_cast<uint32_t>(d.Bytes.size()));
+                        bs.write(d.Bytes.data(), d.Bytes.size());
+                        cursor = d.Offset + d.Removed;
+                    }
+                    break;
+                }
+                case LevelTypes::PatchOp::Insert:
+                    PatchHelpers::write_varint(bs, static_cast<uint32_t>(step.Bytes.size()));
+                    bs.write(step.Bytes.data(), step.Bytes.size());
+                    break;
+            }
+        }
+        auto* res = malloc(bs.size());
+        memcpy(res, bs.buffer(), bs.size());
+        return FileRef{
+            FileState::OK,
+            res,
+            static_cast<uint32_t>(bs.size())
+        };
+    }
+
+    LevelTypes::LevelPatch Level::LoadPatch(const void* buf, const uint32_t size) {
+        binstream bs(buf, size);
+        if (bs.read<uint32_t>() != PatchHelpers::patch_magic)
+            throw std::exception("Not a level patch");
+        LevelTypes::LevelPatch patch = {};
+        patch.version = bs.read<uint32_t>();
+        patch.sync_f = bs.read<uint8_t>();
+        patch.SourceSize = bs.read<uint32_t>();
+        patch.SourceHash = bs.read<uint64_t>();
+        patch.SourceCount = bs.read<uint32_t>();
+        const auto steps = PatchHelpers::read_varint(bs);
+        patch.Steps.reserve(std::min<size_t>(steps, bs.size() - bs.tell()));  // every step is at least its op
+        for (uint32_t i = 0; i < steps; ++i) {
+            LevelTypes::PatchStep step = {};
+            step.Op = static_cast<LevelTypes::PatchOp>(bs.read<uint8_t>());
+            switch (step.Op) {
+                case LevelTypes::PatchOp::Copy:
+                    step.Source = PatchHelpers::read_varint(bs);
+                    step.Count = PatchHelpers::read_varint(bs);
+                    step.Offset = PatchHelpers::read_varint(bs);
+                    step.Size = PatchHelpers::read_varint(bs);
+                    break;
+                case LevelTypes::PatchOp::Modify: {
+                    step.Source = PatchHelpers::read_varint(bs);
+                    step.Offset = PatchHelpers::read_varint(bs);
+                    step.Size = PatchHelpers::read_varint(bs);
+                    const auto deltas = PatchHelpers::read_varint(bs);
+                    uint32_t cursor = 0;
+                    for (uint32_t j = 0; j < deltas; ++j) {
+                        LevelTypes::ByteDelta d = {};
+                        d.Offset = cursor + PatchHelpers::read_varint(bs);
+                        d.Removed = PatchHelpers::read_varint(bs);
+                        const auto n = PatchHelpers::read_varint(bs);
+                        const auto* bytes = bs.view(n);
+                        d.Bytes.assign(bytes, bytes + n);
+                        cursor = d.Offset + d.Removed;
+                        step.Deltas.push_back(std::move(d));
+                    }
+                    break;
+                }
+                case LevelTypes::PatchOp::Insert: {
+                    const auto n = PatchHelpers::read_varint(bs);
+                    const auto* bytes = bs.view(n);
+                    step.Bytes.assign(bytes, bytes + n);
+                    break;
+                }
+                default:
+                    throw std::exception("Unknown patch step");
+            }
+            patch.Steps.push_back(std::move(step));
+        }
+        if (bs.tell() != bs.size())
+            throw std::exception("Trailing bytes after level patch");
+        patch.valid = true;
+        return patch;
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,51 @@
+#include "helpers.h"
+#include "libpeggle.h"
+#include "workpool.h"
+#include <cstdlib>
+
+namespace Peggle {
+#pragma region libpeggle_Pipeline
+
+    std::vector<std::string> Level::TransformPak(Pak& pak, const std::function<bool(const std::string& path, LevelTypes::Level& lvl)>& f, const unsigned threads) {
+        std::vector<std::string> paths;
+        for (const auto& path : pak.GetFileList())
+            if (PipelineHelpers::is_level_path(path))
+                paths.push_back(path);
+
+        // one slot per level, filled by whichever worker ran it
+        struct Built {
+            const void* Data = nullptr;
+            uint32_t Size = 0;
+        };
+        std::vector<Built> built(paths.size());
+        const auto release = [&] {
+            for (auto& b : built)
+                free(const_cast<void*>(b.Data));
+        };
+
+        try {
+            WorkPool::parallel_for(paths.size(), threads, [&](const size_t i, unsigned) {
+                auto lvl = LoadLevel(pak.GetFile(paths[i]));
+                if (!f(paths[i], lvl))
+                    return;
+                const auto res = BuildLevel(lvl);
+                built[i] = {res.Data, res.Size};
+            });
+        } catch (...) {
+            release();
+            throw;
+        }
+
+        std::vector<std::string> written;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (!built[i].Data)
+                continue;
+            pak.UpdateFile(paths[i], built[i].Data, built[i].Size);
+            written.push_back(paths[i]);
+        }
+        release();
+        return written;
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,185 @@
+#include "binstream.h"
+#include "helpers.h"
+#include "levelschema.h"
+#include "libpeggle.h"
+#include "simd.h"
+#include "workpool.h"
+#include <algorithm>
+
+namespace Peggle {
+#pragma region libpeggle_Query
+
+    namespace QueryHelpers {
+        // rows scanned at a time, the lanes of a block stay in l1
+        constexpr uint32_t block_rows = 512;
+        constexpr uint32_t has_peg_info = 1u << 16;
+
+        uint32_t pack_peg(const LevelTypes::Element& element) {
+            if (!element.flags.hasPegInfo)
+                return 0;
+            const auto& peg = element.generic.mPegInfo;
+            return has_peg_info | static_cast<uint32_t>(peg.mFlags.asByte) << 8 | peg.mType;
+        }
+
+        const std::vector<uint32_t>& column(const QueryTypes::ElementColumns& columns, const QueryTypes::Column c) {
+            switch (c) {
+                case QueryTypes::Column::Type: return columns.Type;
+                case QueryTypes::Column::Peg: return columns.Peg;
+                default: return columns.Flags;
+            }
+        }
+    }
+
+    ElementQuery::ElementQuery(const QueryTypes::Predicate& predicate) {
+        for (const auto& terms : predicate.AnyOf) {
+            Clause clause = {};
+            bool never = false;
+            for (const auto& term : terms) {
+                // a value with bits outside the mask is never equal
+                const bool satisfiable = (term.Value & ~term.Mask) == 0;
+                if (term.Negate) {
+                    if (!satisfiable)
+                        continue;  // always true
+                    if (term.Mask == 0) {
+                        never = true;  // 0 != 0
+                        break;
+                    }
+                    clause.Negated.push_back(term);
+                    continue;
+                }
+                const auto c = static_cast<size_t>(term.Field);
+                if (!satisfiable || ((clause.Value[c] ^ term.Value) & clause.Mask[c] & term.Mask)) {
+                    never = true;
+                    break;
+                }
+                clause.Mask[c] |= term.Mask;
+                clause.Value[c] |= term.Value;
+            }
+            if (!never)
+                Clauses.push_back(std::move(clause));
+        }
+    }
+
+    QueryTypes::Term ElementQuery::HasFlags(const LevelTypes::GenericDataFlags flags) {
+        return {QueryTypes::Column::Flags, flags.asInt, flags.asInt};
+    }
+
+    QueryTypes::Term ElementQuery::LacksFlags(const LevelTypes::GenericDataFlags flags) {
+        return {QueryTypes::Column::Flags, flags.asInt, 0};
+    }
+
+    QueryTypes::Term ElementQuery::TypeIs(const LevelTypes::LevelEntryType type) {
+        return {QueryTypes::Column::Type, 0xFFFFFFFF, static_cast<uint32_t>(type)};
+    }
+
+    QueryTypes::Term ElementQuery::PegTypeIs(const uint8_t type) {
+        return {QueryTypes::Column::Peg, QueryHelpers::has_peg_info | 0xFF, QueryHelpers::has_peg_info | type};
+    }
+
+    QueryTypes::Term ElementQuery::HasPegFlags(const uint8_t flags) {
+        const uint32_t bits = QueryHelpers::has_peg_info | static_cast<uint32_t>(flags) << 8;
+        return {QueryTypes::Column::Peg, bits, bits};
+    }
+
+    QueryTypes::ElementColumns ElementQuery::ExtractColumns(const LevelTypes::Level& lvl) {
+        QueryTypes::ElementColumns columns = {};
+        const size_t n = lvl.Elements.size();
+        columns.Flags.resize(n);
+        columns.Type.resize(n);
+        columns.Peg.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const auto& element = lvl.Elements[i];
+            columns.Flags[i] = element.flags.asInt;
+            columns.Type[i] = static_cast<uint32_t>(element.eType);
+            columns.Peg[i] = QueryHelpers::pack_peg(element);
+        }
+        return columns;
+    }
+
+    QueryTypes::ElementColumns ElementQuery::ExtractColumns(const void* buf, const uint32_t size) {
+        const auto index = Level::IndexLevel(buf, size);
+        QueryTypes::ElementColumns columns = {};
+        const size_t n = index.Elements.size();
+        columns.Flags.resize(n);
+        columns.Type.resize(n);
+        columns.Peg.resize(n);
+        binstream bs(buf, size);
+        LevelSchema::with_format(index.version, std::pmr::null_memory_resource(), [&](const auto fmt) {
+            for (size_t i = 0; i < n; ++i) {
+                const auto& span = index.Elements[i];
+                if (span.Magic != 1)
+                    continue;
+                columns.Flags[i] = span.Flags.asInt;
+                columns.Type[i] = static_cast<uint32_t>(span.Type);
+                // peg info is the last field of the head
+                if (!span.Flags.hasPegInfo)
+                    continue;
+                bs.seek(span.Offset + sizeof(int32_t));
+                LevelTypes::Element scratch = {};
+                LevelSchema::ElementHead::read(bs, scratch, fmt);
+                columns.Peg[i] = QueryHelpers::pack_peg(scratch);
+            }
+        });
+        return columns;
+    }
+
+    std::vector<uint32_t> ElementQuery::Run(const QueryTypes::ElementColumns& columns) const {
+        const auto n = static_cast<uint32_t>(columns.Flags.size());
+        if (columns.Type.size() != n || columns.Peg.size() != n)
+            throw std::exception("Element columns differ in length");
+
+        std::vector<uint32_t> res;
+        if (Clauses.empty())
+            return res;
+        uint32_t any[QueryHelpers::block_rows], lanes[QueryHelpers::block_rows];
+        for (uint32_t base = 0; base < n; base += QueryHelpers::block_rows) {
+            const uint32_t rows = std::min(QueryHelpers::block_rows, n - base);
+            // a lone clause scans straight into the result lanes
+            auto* out = Clauses.size() == 1 ? any : lanes;
+            std::fill_n(any, rows, Clauses.size() == 1 ? ~0u : 0u);
+            for (const auto& clause : Clauses) {
+                if (out == lanes)
+                    std::fill_n(lanes, rows, ~0u);
+                for (size_t c = 0; c < 3; ++c)
+                    if (clause.Mask[c])
+                        Simd::and_match(QueryHelpers::column(columns, static_cast<QueryTypes::Column>(c)).data() + base,
+                                        out, rows, clause.Mask[c], clause.Value[c], false);
+                for (const auto& term : clause.Negated)
+                    Simd::and_match(QueryHelpers::column(columns, term.Field).data() + base,
+                                    out, rows, term.Mask, term.Value, true);
+                if (out == lanes)
+                    for (uint32_t k = 0; k < rows; ++k)
+                        any[k] |= lanes[k];
+            }
+            Simd::append_set(any, rows, base, res);
+        }
+        return res;
+    }
+
+    std::vector<uint32_t> ElementQuery::Run(const LevelTypes::Level& lvl) const {
+        return Run(ExtractColumns(lvl));
+    }
+
+    std::vector<QueryTypes::PakMatch> ElementQuery::Run(Pak& pak, const unsigned threads) const {
+        std::vector<std::string> paths;
+        for (const auto& path : pak.GetFileList())
+            if (PipelineHelpers::is_level_path(path))
+                paths.push_back(path);
+
+        std::vector<std::vector<uint32_t>> found(paths.size());
+        WorkPool::parallel_for(paths.size(), threads, [&](const size_t i, unsigned) {
+            const auto file = pak.GetFile(paths[i]);
+            if (file.State != FileState::OK)
+                throw std::exception("Failed to read level from pak");
+            found[i] = Run(ExtractColumns(file.Data, file.Size));
+        });
+
+        std::vector<QueryTypes::PakMatch> res;
+        for (size_t i = 0; i < paths.size(); ++i)
+            if (!found[i].empty())
+                res.push_back({std::move(paths[i]), std::move(found[i])});
+        return res;
+    }
+
+#pragma endregion
+}
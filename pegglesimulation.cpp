@@ -0,0 +1,255 @@
+#include "helpers.h"
+#include "libpeggle.h"
+#include "workpool.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace Peggle {
+#pragma region libpeggle_Simulation
+
+    namespace SimulationHelpers {
+        // shots handed to a worker at a time
+        constexpr uint32_t chunk_shots = 256;
+
+        // uniform in [0, 1)
+        double unit(const uint64_t bits) {
+            return static_cast<double>(bits >> 11) * 0x1.0p-53;
+        }
+
+        // what one worker counted, merged once every shot ran
+        struct Tally {
+            std::vector<uint32_t> Shots, Hits;
+            std::vector<uint32_t> Seen;  // shot + 1 that last touched each peg
+            uint32_t Stuck = 0;
+            uint64_t Ticks = 0;
+        };
+    }
+
+    ShotSimulator::ShotSimulator(const LevelTypes::Level& lvl, const SimulationTypes::Physics& physics) : World(physics) {
+        if (!(World.BallRadius > 0.f) || !(World.Right > World.Left) || !(World.Bottom > World.Top))
+            throw std::exception("Invalid physics");
+
+        CollisionCache cache;
+        cache.Refresh(lvl);
+        const auto& baked = cache.GetBaked();
+        for (const auto& shape : baked.Shapes) {
+            const auto& element = lvl.Elements[shape.Element];
+            const auto& generic = element.generic;
+            Surface surface = {World.Restitution, World.Friction, World.MaxSpeed, -1};
+            if (element.flags.isBouncy)
+                surface.Restitution = std::max(generic.mBouncy, 0.f);
+            if (element.flags.isRolly)
+                surface.Friction = std::clamp(generic.mRolly, 0.f, 1.f);
+            if (element.flags.hasMaxBounceVelocity && generic.mMaxBounceVelocity > 0.f)
+                surface.MaxSpeed = std::min(surface.MaxSpeed, generic.mMaxBounceVelocity);
+            if (element.flags.hasPegInfo) {
+                surface.Peg = static_cast<int32_t>(Pegs.size());
+                Pegs.push_back(shape.Element);
+            }
+            const auto s = static_cast<uint32_t>(Surfaces.size());
+            Surfaces.push_back(surface);
+
+            if (shape.Type == LevelTypes::Circle) {
+                Primitives.push_back({shape.X, shape.Y, 0.f, 0.f, shape.Radius, 0.f, s, true});
+                continue;
+            }
+            for (uint32_t k = 0; k < shape.SegmentCount; ++k) {
+                const auto& segment = baked.Segments[shape.FirstSegment + k];
+                const float dx = segment.B.x - segment.A.x, dy = segment.B.y - segment.A.y;
+                const float length2 = dx * dx + dy * dy;
+                // a point is a segment that always clamps to its start
+                Primitives.push_back({segment.A.x, segment.A.y, dx, dy, 0.f, length2 > 0.f ? 1.f / length2 : 0.f, s, false});
+            }
+        }
+
+        // cells a few balls across keep the lists short without putting long segments in too many cells
+        CellSize = World.BallRadius * 4.f;
+        Columns = std::max(1u, static_cast<uint32_t>(std::ceil((World.Right - World.Left) / CellSize)));
+        Rows = std::max(1u, static_cast<uint32_t>(std::ceil((World.Bottom - World.Top) / CellSize)));
+
+        // every primitive goes in the cells its box, grown by a ball radius, overlaps. a ball touching it then has
+        // its center in one of those
+        const auto cells_of = [&](const Primitive& p, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1) {
+            const float grow = p.Radius + World.BallRadius;
+            const float min_x = std::min(p.AX, p.AX + p.DX) - grow, max_x = std::max(p.AX, p.AX + p.DX) + grow;
+            const float min_y = std::min(p.AY, p.AY + p.DY) - grow, max_y = std::max(p.AY, p.AY + p.DY) + grow;
+            if (max_x < World.Left || min_x > World.Right || max_y < World.Top || min_y > World.Bottom)
+                return false;
+            const auto cell = [&](const float v, const float origin, const uint32_t count) {
+                return static_cast<uint32_t>(std::clamp((v - origin) / CellSize, 0.f, static_cast<float>(count - 1)));
+            };
+            x0 = cell(min_x, World.Left, Columns);
+            x1 = cell(max_x, World.Left, Columns);
+            y0 = cell(min_y, World.Top, Rows);
+            y1 = cell(max_y, World.Top, Rows);
+            return true;
+        };
+        CellStart.assign(static_cast<size_t>(Columns) * Rows + 1, 0);
+        for (const auto& p : Primitives) {
+            uint32_t x0, y0, x1, y1;
+            if (cells_of(p, x0, y0, x1, y1))
+                for (uint32_t y = y0; y <= y1; ++y)
+                    for (uint32_t x = x0; x <= x1; ++x)
+                        ++CellStart[y * Columns + x + 1];
+        }
+        for (size_t c = 1; c < CellStart.size(); ++c)
+            CellStart[c] += CellStart[c - 1];
+        CellItems.resize(CellStart.back());
+        std::vector<uint32_t> fill(CellStart.begin(), CellStart.end() - 1);
+        for (uint32_t i = 0; i < Primitives.size(); ++i) {
+            uint32_t x0, y0, x1, y1;
+            if (cells_of(Primitives[i], x0, y0, x1, y1))
+                for (uint32_t y = y0; y <= y1; ++y)
+                    for (uint32_t x = x0; x <= x1; ++x)
+                        CellItems[fill[y * Columns + x]++] = i;
+        }
+    }
+
+    SimulationTypes::ShotHistogram ShotSimulator::Run(const SimulationTypes::Shots& shots, const unsigned threads) const {
+        if (shots.Bins == 0)
+            throw std::exception("Shots need at least one bin");
+
+        const uint32_t chunks = (shots.Count + SimulationHelpers::chunk_shots - 1) / SimulationHelpers::chunk_shots;
+        std::vector<SimulationHelpers::Tally> tallies(WorkPool::worker_count(chunks, threads));
+        for (auto& t : tallies) {
+            t.Shots.resize(shots.Bins);
+            t.Hits.resize(Pegs.size() * shots.Bins);
+            t.Seen.resize(Pegs.size());
+        }
+
+        const float radius = World.BallRadius;
+        const float min_x = World.Left + radius, max_x = World.Right - radius, min_y = World.Top + radius;
+        const float lost_y = World.Bottom + radius;
+        // substeps move the ball at most half its radius at the speed it starts the tick with, so it does not pass
+        // through segments
+        const float max_step = radius * .5f;
+
+        const auto shoot = [&](const uint32_t shot, SimulationHelpers::Tally& tally) {
+            const double u = SimulationHelpers::unit(SimulationHelpers::mix(shots.Seed ^ SimulationHelpers::mix(shot)));
+            const uint32_t bin = std::min(static_cast<uint32_t>(u * shots.Bins), shots.Bins - 1);
+            const double radians = (shots.MinAngle + (shots.MaxAngle - shots.MinAngle) * u) * std::numbers::pi / 180.;
+            ++tally.Shots[bin];
+
+            float x = shots.LaunchX, y = shots.LaunchY;
+            auto vx = static_cast<float>(std::cos(radians) * shots.Speed);
+            auto vy = static_cast<float>(std::sin(radians) * shots.Speed);
+            float still_x = x, still_y = y;
+            for (uint32_t tick = 0; tick < World.MaxTicks; ++tick) {
+                if (World.StuckTicks && tick && tick % World.StuckTicks == 0) {
+                    const float moved_x = x - still_x, moved_y = y - still_y;
+                    if (moved_x * moved_x + moved_y * moved_y < radius * radius) {
+                        tally.Ticks += tick;
+                        ++tally.Stuck;
+                        return;
+                    }
+                    still_x = x;
+                    still_y = y;
+                }
+                const float speed = std::sqrt(vx * vx + vy * vy) + World.Gravity;
+                const uint32_t steps = std::max(1u, static_cast<uint32_t>(std::ceil(speed / max_step)));
+                const float dt = 1.f / static_cast<float>(steps);
+                for (uint32_t step = 0; step < steps; ++step) {
+                    vy += World.Gravity * dt;
+                    x += vx * dt;
+                    y += vy * dt;
+                    if (y > lost_y) {
+                        tally.Ticks += tick + 1;
+                        return;
+                    }
+                    // walls bounce like any surface without friction
+                    if (x < min_x) {
+                        x = min_x;
+                        vx = std::abs(vx) * World.Restitution;
+                    } else if (x > max_x) {
+                        x = max_x;
+                        vx = -std::abs(vx) * World.Restitution;
+                    }
+                    if (y < min_y) {
+                        y = min_y;
+                        vy = std::abs(vy) * World.Restitution;
+                    }
+
+                    const uint32_t cx = std::min(static_cast<uint32_t>(std::max(x - World.Left, 0.f) / CellSize), Columns - 1);
+                    const uint32_t cy = std::min(static_cast<uint32_t>(std::max(y - World.Top, 0.f) / CellSize), Rows - 1);
+                    const uint32_t cell = cy * Columns + cx;
+                    for (uint32_t k = CellStart[cell]; k < CellStart[cell + 1]; ++k) {
+                        const auto& p = Primitives[CellItems[k]];
+                        float nx = x - p.AX, ny = y - p.AY;
+                        float reach = radius + p.Radius;
+                        if (!p.Circle) {
+                            const float t = std::clamp((nx * p.DX + ny * p.DY) * p.InvLength2, 0.f, 1.f);
+                            nx -= t * p.DX;
+                            ny -= t * p.DY;
+                            reach = radius;
+                        }
+                        const float distance2 = nx * nx + ny * ny;
+                        if (distance2 >= reach * reach)
+                            continue;
+
+                        // push the ball out along the normal, then reflect what moves into the surface
+                        const float distance = std::sqrt(distance2);
+                        if (distance > 1e-6f) {
+                            nx /= distance;
+                            ny /= distance;
+                        } else {
+                            nx = 0.f;
+                            ny = -1.f;
+                        }
+                        x += nx * (reach - distance);
+                        y += ny * (reach - distance);
+                        const auto& surface = Surfaces[p.Surface];
+                        const float normal = vx * nx + vy * ny;
+                        if (normal < 0.f) {
+                            const float tx = vx - normal * nx, ty = vy - normal * ny;
+                            vx = tx * surface.Friction - normal * surface.Restitution * nx;
+                            vy = ty * surface.Friction - normal * surface.Restitution * ny;
+                            const float after2 = vx * vx + vy * vy;
+                            if (after2 > surface.MaxSpeed * surface.MaxSpeed) {
+                                const float scale = surface.MaxSpeed / std::sqrt(after2);
+                                vx *= scale;
+                                vy *= scale;
+                            }
+                        }
+                        if (surface.Peg >= 0 && tally.Seen[surface.Peg] != shot + 1) {
+                            tally.Seen[surface.Peg] = shot + 1;
+                            ++tally.Hits[static_cast<size_t>(surface.Peg) * shots.Bins + bin];
+                        }
+                    }
+                }
+                const float speed2 = vx * vx + vy * vy;
+                if (speed2 > World.MaxSpeed * World.MaxSpeed) {
+                    const float scale = World.MaxSpeed / std::sqrt(speed2);
+                    vx *= scale;
+                    vy *= scale;
+                }
+            }
+            tally.Ticks += World.MaxTicks;
+            ++tally.Stuck;
+        };
+
+        WorkPool::parallel_for(chunks, threads, [&](const size_t chunk, const unsigned worker) {
+            const auto first = static_cast<uint32_t>(chunk * SimulationHelpers::chunk_shots);
+            const uint32_t last = first + std::min(shots.Count - first, SimulationHelpers::chunk_shots);
+            for (uint32_t shot = first; shot < last; ++shot)
+                shoot(shot, tallies[worker]);
+        });
+
+        SimulationTypes::ShotHistogram res = {};
+        res.Pegs = Pegs;
+        res.Bins = shots.Bins;
+        res.Shots.resize(shots.Bins);
+        res.Hits.resize(Pegs.size() * shots.Bins);
+        for (const auto& t : tallies) {
+            for (size_t b = 0; b < res.Shots.size(); ++b)
+                res.Shots[b] += t.Shots[b];
+            for (size_t h = 0; h < res.Hits.size(); ++h)
+                res.Hits[h] += t.Hits[h];
+            res.Stuck += t.Stuck;
+            res.Ticks += t.Ticks;
+        }
+        return res;
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,738 @@
+#include "levelschema.h"
+#include "libpeggle.h"
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <optional>
+#include <fstream>
+#include <string_view>
+#include <type_traits>
+
+namespace Peggle {
+#pragma region libpeggle_Snapshot
+
+    namespace SnapshotHelpers {
+        constexpr uint32_t snapshot_magic = 0x504E534C;  // "LSNP"
+        // bump when what an image holds changes, the layout of the structs in it is keyed by layout below
+        constexpr uint32_t snapshot_format = 2;
+        // every image is copied into an allocation this aligned, offsets inside it keep their alignment
+        constexpr size_t image_align = 16;
+
+        // polygons own a pmr vector, so their image is this and a real entry is made on load
+        struct PolygonImage {
+            bool valid;
+            LevelTypes::Bits8 mFlagsA;
+            LevelTypes::Bits8 mFlagsB;
+            float mRotation;
+            float mUnk1;
+            float mScale;
+            uint8_t mNormalDir;
+            LevelTypes::Point mPos;
+            LevelTypes::Point* mPoints;
+            uint32_t mPointCount;
+            uint8_t mUnk2;
+            int32_t mGrowType;
+        };
+
+        template<typename... T>
+        constexpr bool copyable = (std::is_trivially_copyable_v<T> && ...);
+        template<typename... T>
+        constexpr bool aligned = ((alignof(T) <= image_align) && ...);
+        static_assert(copyable<LevelTypes::ElementFields, LevelTypes::Entry, LevelTypes::MovementLink, LevelTypes::RodEntry,
+                               LevelTypes::CircleEntry, LevelTypes::BrickEntry, LevelTypes::TeleportEntry,
+                               LevelTypes::EmitterEntry, LevelTypes::Point, PolygonImage>,
+                      "level snapshots copy these as raw bytes");
+        static_assert(aligned<LevelTypes::ElementFields, LevelTypes::Entry, LevelTypes::MovementLink, LevelTypes::RodEntry,
+                              LevelTypes::CircleEntry, LevelTypes::BrickEntry, LevelTypes::TeleportEntry,
+                              LevelTypes::EmitterEntry, LevelTypes::Point, PolygonImage>);
+
+        // a stored field, its offset and size go into the layout key
+        struct FieldSpan {
+            size_t Offset, Size, Align;
+        };
+#define SNAPSHOT_FIELD(T, f) SnapshotHelpers::FieldSpan{offsetof(T, f), sizeof(T::f), alignof(decltype(T::f))}
+
+        // the fields are every member of T in declaration order, each where the one before it ends (padded up to its
+        // alignment). a member added, removed or moved fails this until its table is updated
+        template<typename T, size_t N>
+        constexpr bool covers(const FieldSpan (&fields)[N]) {
+            size_t end = 0;
+            for (const auto& f : fields) {
+                if (f.Offset != (end + f.Align - 1) / f.Align * f.Align)
+                    return false;
+                end = f.Offset + f.Size;
+            }
+            return (end + alignof(T) - 1) / alignof(T) * alignof(T) == sizeof(T);
+        }
+
+        using namespace LevelTypes;
+        constexpr FieldSpan point_fields[] = {SNAPSHOT_FIELD(Point, x), SNAPSHOT_FIELD(Point, y)};
+        constexpr FieldSpan peg_info_fields[] = {
+            SNAPSHOT_FIELD(PegInfo, mType), SNAPSHOT_FIELD(PegInfo, mFlags), SNAPSHOT_FIELD(PegInfo, mUnk0),
+            SNAPSHOT_FIELD(PegInfo, mUnk1), SNAPSHOT_FIELD(PegInfo, mUnk2), SNAPSHOT_FIELD(PegInfo, mUnk3),
+            SNAPSHOT_FIELD(PegInfo, mVariable), SNAPSHOT_FIELD(PegInfo, mCrumble)
+        };
+        constexpr FieldSpan movement_info_fields[] = {
+            SNAPSHOT_FIELD(MovementInfo, mInternalLinkID), SNAPSHOT_FIELD(MovementInfo, mMovementShape),
+            SNAPSHOT_FIELD(MovementInfo, mType), SNAPSHOT_FIELD(MovementInfo, mReverse),
+            SNAPSHOT_FIELD(MovementInfo, mAnchorPoint), SNAPSHOT_FIELD(MovementInfo, mTimePeriod),
+            SNAPSHOT_FIELD(MovementInfo, mFlags), SNAPSHOT_FIELD(MovementInfo, mOffset),
+            SNAPSHOT_FIELD(MovementInfo, mRadius1), SNAPSHOT_FIELD(MovementInfo, mStartPhase),
+            SNAPSHOT_FIELD(MovementInfo, mMoveRotation), SNAPSHOT_FIELD(MovementInfo, mRadius2),
+            SNAPSHOT_FIELD(MovementInfo, mPause1), SNAPSHOT_FIELD(MovementInfo, mPause2),
+            SNAPSHOT_FIELD(MovementInfo, mPhase1), SNAPSHOT_FIELD(MovementInfo, mPhase2),
+            SNAPSHOT_FIELD(MovementInfo, mPostDelayPhase), SNAPSHOT_FIELD(MovementInfo, mMaxAngle),
+            SNAPSHOT_FIELD(MovementInfo, mUnknown8), SNAPSHOT_FIELD(MovementInfo, mRotation),
+            SNAPSHOT_FIELD(MovementInfo, mSubMovementOffsetX), SNAPSHOT_FIELD(MovementInfo, mSubMovementOffsetY),
+            SNAPSHOT_FIELD(MovementInfo, mSubMovementLink), SNAPSHOT_FIELD(MovementInfo, mObjectX),
+            SNAPSHOT_FIELD(MovementInfo, mObjectY)
+        };
+        constexpr FieldSpan movement_link_fields[] = {
+            SNAPSHOT_FIELD(MovementLink, InternalLinkId), SNAPSHOT_FIELD(MovementLink, InternalMovement)
+        };
+        constexpr FieldSpan generic_fields[] = {
+            SNAPSHOT_FIELD(GenericData, mRolly), SNAPSHOT_FIELD(GenericData, mBouncy),
+            SNAPSHOT_FIELD(GenericData, mPegInfo), SNAPSHOT_FIELD(GenericData, mMovementLink),
+            SNAPSHOT_FIELD(GenericData, mUnk0), SNAPSHOT_FIELD(GenericData, mSolidColor),
+            SNAPSHOT_FIELD(GenericData, mOutlineColor), SNAPSHOT_FIELD(GenericData, mImage),
+            SNAPSHOT_FIELD(GenericData, mImageDX), SNAPSHOT_FIELD(GenericData, mImageDY),
+            SNAPSHOT_FIELD(GenericData, mRotation), SNAPSHOT_FIELD(GenericData, mUnk1),
+            SNAPSHOT_FIELD(GenericData, mID), SNAPSHOT_FIELD(GenericData, mUnk2), SNAPSHOT_FIELD(GenericData, mSound),
+            SNAPSHOT_FIELD(GenericData, mLogic), SNAPSHOT_FIELD(GenericData, mMaxBounceVelocity),
+            SNAPSHOT_FIELD(GenericData, mSubID), SNAPSHOT_FIELD(GenericData, mFlipperFlags)
+        };
+        constexpr FieldSpan source_fields[] = {SNAPSHOT_FIELD(ElementSource, Data), SNAPSHOT_FIELD(ElementSource, Size)};
+        constexpr FieldSpan element_fields[] = {
+            SNAPSHOT_FIELD(ElementFields, magic), SNAPSHOT_FIELD(ElementFields, eType),
+            SNAPSHOT_FIELD(ElementFields, flags), SNAPSHOT_FIELD(ElementFields, generic),
+            SNAPSHOT_FIELD(ElementFields, entry), SNAPSHOT_FIELD(ElementFields, source)
+        };
+        constexpr FieldSpan variable_fields[] = {
+            SNAPSHOT_FIELD(VariableFloat, mIsVariable), SNAPSHOT_FIELD(VariableFloat, mStaticVariable),
+            SNAPSHOT_FIELD(VariableFloat, mVariableValue)
+        };
+        constexpr FieldSpan rod_fields[] = {
+            SNAPSHOT_FIELD(RodEntry, valid), SNAPSHOT_FIELD(RodEntry, mFlags), SNAPSHOT_FIELD(RodEntry, mPointA),
+            SNAPSHOT_FIELD(RodEntry, mPointB), SNAPSHOT_FIELD(RodEntry, mE), SNAPSHOT_FIELD(RodEntry, mF)
+        };
+        constexpr FieldSpan polygon_fields[] = {
+            SNAPSHOT_FIELD(PolygonImage, valid), SNAPSHOT_FIELD(PolygonImage, mFlagsA),
+            SNAPSHOT_FIELD(PolygonImage, mFlagsB), SNAPSHOT_FIELD(PolygonImage, mRotation),
+            SNAPSHOT_FIELD(PolygonImage, mUnk1), SNAPSHOT_FIELD(PolygonImage, mScale),
+            SNAPSHOT_FIELD(PolygonImage, mNormalDir), SNAPSHOT_FIELD(PolygonImage, mPos),
+            SNAPSHOT_FIELD(PolygonImage, mPoints), SNAPSHOT_FIELD(PolygonImage, mPointCount),
+            SNAPSHOT_FIELD(PolygonImage, mUnk2), SNAPSHOT_FIELD(PolygonImage, mGrowType)
+        };
+        constexpr FieldSpan circle_fields[] = {
+            SNAPSHOT_FIELD(CircleEntry, valid), SNAPSHOT_FIELD(CircleEntry, mFlagsA),
+            SNAPSHOT_FIELD(CircleEntry, mFlagsB), SNAPSHOT_FIELD(CircleEntry, mPos), SNAPSHOT_FIELD(CircleEntry, mRadius)
+        };
+        constexpr FieldSpan brick_fields[] = {
+            SNAPSHOT_FIELD(BrickEntry, valid), SNAPSHOT_FIELD(BrickEntry, mFlagsA), SNAPSHOT_FIELD(BrickEntry, mFlagsB),
+            SNAPSHOT_FIELD(BrickEntry, mFlagsC), SNAPSHOT_FIELD(BrickEntry, mUnk1), SNAPSHOT_FIELD(BrickEntry, mUnk2),
+            SNAPSHOT_FIELD(BrickEntry, mUnk3), SNAPSHOT_FIELD(BrickEntry, mUnk4), SNAPSHOT_FIELD(BrickEntry, mPos),
+            SNAPSHOT_FIELD(BrickEntry, mUnk5), SNAPSHOT_FIELD(BrickEntry, mUnk6), SNAPSHOT_FIELD(BrickEntry, mUnk7),
+            SNAPSHOT_FIELD(BrickEntry, mUnk8), SNAPSHOT_FIELD(BrickEntry, mUnk9), SNAPSHOT_FIELD(BrickEntry, mType),
+            SNAPSHOT_FIELD(BrickEntry, mCurved), SNAPSHOT_FIELD(BrickEntry, mCurvedPoints),
+            SNAPSHOT_FIELD(BrickEntry, mLeftAngle), SNAPSHOT_FIELD(BrickEntry, mRightAngle),
+            SNAPSHOT_FIELD(BrickEntry, mUnk10), SNAPSHOT_FIELD(BrickEntry, mSectorAngle),
+            SNAPSHOT_FIELD(BrickEntry, mWidth), SNAPSHOT_FIELD(BrickEntry, mLength), SNAPSHOT_FIELD(BrickEntry, mAngle),
+            SNAPSHOT_FIELD(BrickEntry, mTextureFlip), SNAPSHOT_FIELD(BrickEntry, mUnk12)
+        };
+        constexpr FieldSpan teleport_fields[] = {
+            SNAPSHOT_FIELD(TeleportEntry, valid), SNAPSHOT_FIELD(TeleportEntry, mFlags),
+            SNAPSHOT_FIELD(TeleportEntry, mWidth), SNAPSHOT_FIELD(TeleportEntry, mHeight),
+            SNAPSHOT_FIELD(TeleportEntry, mUnk0), SNAPSHOT_FIELD(TeleportEntry, mUnk1),
+            SNAPSHOT_FIELD(TeleportEntry, mUnk2), SNAPSHOT_FIELD(TeleportEntry, mEntry),
+            SNAPSHOT_FIELD(TeleportEntry, mPos), SNAPSHOT_FIELD(TeleportEntry, mUnk3), SNAPSHOT_FIELD(TeleportEntry, mUnk4)
+        };
+        constexpr FieldSpan emitter_fields[] = {
+            SNAPSHOT_FIELD(EmitterEntry, valid), SNAPSHOT_FIELD(EmitterEntry, mMainVar),
+            SNAPSHOT_FIELD(EmitterEntry, mFlags), SNAPSHOT_FIELD(EmitterEntry, mImage),
+            SNAPSHOT_FIELD(EmitterEntry, mWidth), SNAPSHOT_FIELD(EmitterEntry, mHeight),
+            SNAPSHOT_FIELD(EmitterEntry, mMainVar0), SNAPSHOT_FIELD(EmitterEntry, mMainVar1),
+            SNAPSHOT_FIELD(EmitterEntry, mMainVar2), SNAPSHOT_FIELD(EmitterEntry, mMainVar3),
+            SNAPSHOT_FIELD(EmitterEntry, mUnknown0), SNAPSHOT_FIELD(EmitterEntry, mUnknown1),
+            SNAPSHOT_FIELD(EmitterEntry, mPos), SNAPSHOT_FIELD(EmitterEntry, mEmitImage),
+            SNAPSHOT_FIELD(EmitterEntry, mUnknownEmitRate), SNAPSHOT_FIELD(EmitterEntry, mUnknown2),
+            SNAPSHOT_FIELD(EmitterEntry, mRotation), SNAPSHOT_FIELD(EmitterEntry, mMaxQuantity),
+            SNAPSHOT_FIELD(EmitterEntry, mTimeBeforeFadeOut), SNAPSHOT_FIELD(EmitterEntry, mFadeInTime),
+            SNAPSHOT_FIELD(EmitterEntry, mLifeDuration), SNAPSHOT_FIELD(EmitterEntry, mEmitRate),
+            SNAPSHOT_FIELD(EmitterEntry, mEmitAreaMultiplier), SNAPSHOT_FIELD(EmitterEntry, mInitialRotation),
+            SNAPSHOT_FIELD(EmitterEntry, mRotationVelocity), SNAPSHOT_FIELD(EmitterEntry, mRotationUnknown),
+            SNAPSHOT_FIELD(EmitterEntry, mMinScale), SNAPSHOT_FIELD(EmitterEntry, mScaleVelocity),
+            SNAPSHOT_FIELD(EmitterEntry, mMaxRandScale), SNAPSHOT_FIELD(EmitterEntry, mColourRed),
+            SNAPSHOT_FIELD(EmitterEntry, mColourGreen), SNAPSHOT_FIELD(EmitterEntry, mColourBlue),
+            SNAPSHOT_FIELD(EmitterEntry, mOpacity), SNAPSHOT_FIELD(EmitterEntry, mMinVelocityX),
+            SNAPSHOT_FIELD(EmitterEntry, mMinVelocityY), SNAPSHOT_FIELD(EmitterEntry, mMaxVelocityX),
+            SNAPSHOT_FIELD(EmitterEntry, mMaxVelocityY), SNAPSHOT_FIELD(EmitterEntry, mAccelerationX),
+            SNAPSHOT_FIELD(EmitterEntry, mAccelerationY), SNAPSHOT_FIELD(EmitterEntry, mDirectionSpeed),
+            SNAPSHOT_FIELD(EmitterEntry, mDirectionRandomSpeed), SNAPSHOT_FIELD(EmitterEntry, mDirectionAcceleration),
+            SNAPSHOT_FIELD(EmitterEntry, mDirectionAngle), SNAPSHOT_FIELD(EmitterEntry, mDirectionRandomAngle),
+            SNAPSHOT_FIELD(EmitterEntry, mUnknownA), SNAPSHOT_FIELD(EmitterEntry, mUnknownB)
+        };
+#undef SNAPSHOT_FIELD
+        static_assert(covers<Point>(point_fields) && covers<PegInfo>(peg_info_fields)
+                      && covers<MovementInfo>(movement_info_fields) && covers<MovementLink>(movement_link_fields)
+                      && covers<GenericData>(generic_fields) && covers<ElementSource>(source_fields)
+                      && covers<ElementFields>(element_fields) && covers<VariableFloat>(variable_fields)
+                      && covers<RodEntry>(rod_fields) && covers<PolygonImage>(polygon_fields)
+                      && covers<CircleEntry>(circle_fields) && covers<BrickEntry>(brick_fields)
+                      && covers<TeleportEntry>(teleport_fields) && covers<EmitterEntry>(emitter_fields),
+                      "a struct stored in snapshots changed, update its field table");
+
+        constexpr uint64_t mix(const uint64_t h, const size_t v) {
+            return (h ^ v) * 0x100000001B3ull;
+        }
+        template<size_t N>
+        constexpr uint64_t mix(uint64_t h, const FieldSpan (&fields)[N]) {
+            for (const auto& f : fields)
+                h = mix(mix(h, f.Offset), f.Size);
+            return h;
+        }
+
+        // images are only read back by a library with the same layout: the offset and size of every stored field,
+        // and the size of what is stored whole (flag words, colours, entries)
+        constexpr uint64_t layout = [] {
+            uint64_t h = mix(0xCBF29CE484222325ull ^ snapshot_format, sizeof(void*));
+            for (const size_t v : {sizeof(GenericDataFlags), sizeof(MovementInfoFlags), sizeof(EmitterFlags),
+                                   sizeof(Bits8), sizeof(Bits16), sizeof(ColorARGB), sizeof(Entry), alignof(Entry),
+                                   sizeof(std::string_view)})
+                h = mix(h, v);
+            for (const auto table : {mix(0, point_fields), mix(0, peg_info_fields), mix(0, movement_info_fields),
+                                     mix(0, movement_link_fields), mix(0, generic_fields), mix(0, source_fields),
+                                     mix(0, element_fields), mix(0, variable_fields), mix(0, rod_fields),
+                                     mix(0, polygon_fields), mix(0, circle_fields), mix(0, brick_fields),
+                                     mix(0, teleport_fields), mix(0, emitter_fields)})
+                h = mix(h, table);
+            return h;
+        }();
+
+        // checked on every verified load, so unlike the patch hash it runs four independent lanes over 32 byte blocks
+        uint64_t hash_source(const void* buf, const size_t size) {
+            const auto* data = static_cast<const uint8_t*>(buf);
+            uint64_t lanes[4] = {0xCBF29CE484222325ull ^ size, 0x84222325CBF29CE4ull, 0x9E3779B97F4A7C15ull, 0x100000001B3ull};
+            size_t i = 0;
+            for (; i + sizeof(lanes) <= size; i += sizeof(lanes))
+                for (size_t k = 0; k < 4; ++k) {
+                    uint64_t word;
+                    memcpy(&word, data + i + k * sizeof(word), sizeof(word));
+                    lanes[k] = (lanes[k] ^ word) * 0x9E3779B97F4A7C15ull;
+                    lanes[k] ^= lanes[k] >> 32;
+                }
+            uint64_t h = lanes[0];
+            for (size_t k = 1; k < 4; ++k)
+                h = (h ^ lanes[k]) * 0x9E3779B97F4A7C15ull;
+            for (; i < size; ++i)
+                h = (h ^ data[i]) * 0x100000001B3ull;
+            return h ^ h >> 29;
+        }
+
+        // flattens what a level's elements point at into one blob. pointers in the copies become offset + 1 into
+        // it, so null stays null
+        struct Writer {
+            std::vector<uint8_t> Blob;
+
+            size_t put(const void* data, const size_t size, const size_t align) {
+                const size_t offset = (Blob.size() + align - 1) / align * align;
+                Blob.resize(offset + size);
+                if (size)
+                    memcpy(Blob.data() + offset, data, size);
+                return offset;
+            }
+
+            template<typename T>
+            T* put(const T& value) {
+                return reinterpret_cast<T*>(put(&value, sizeof(T), alignof(T)) + 1);
+            }
+
+            std::string_view string(const std::string_view str) {
+                if (str.empty())
+                    return {};
+                return {reinterpret_cast<const char*>(put(str.data(), str.size(), alignof(char)) + 1), str.size()};
+            }
+
+            LevelTypes::MovementLink* link(const LevelTypes::MovementLink* src) {
+                if (!src)
+                    return nullptr;
+                auto copy = *src;
+                copy.InternalMovement.mSubMovementLink = link(src->InternalMovement.mSubMovementLink);
+                return put(copy);
+            }
+
+            void element(LevelTypes::ElementFields& element) {
+                element.source = {};
+                auto& generic = element.generic;
+                generic.mImage = string(generic.mImage);
+                generic.mID = string(generic.mID);
+                generic.mLogic = string(generic.mLogic);
+                auto& movement = generic.mMovementLink.InternalMovement;
+                movement.mSubMovementLink = link(movement.mSubMovementLink);
+                if (element.entry)
+                    element.entry = entry(*element.entry);
+            }
+
+            LevelTypes::Entry* entry(const LevelTypes::Entry& src) {
+                auto copy = src;
+                void* payload = nullptr;
+                switch (LevelTypes::Entry::GetType(src)) {
+                    case LevelTypes::Rod: { payload = put(*LevelTypes::Entry::GetRod(src)); break; }
+                    case LevelTypes::Circle: { payload = put(*LevelTypes::Entry::GetCircle(src)); break; }
+                    case LevelTypes::Brick: { payload = put(*LevelTypes::Entry::GetBrick(src)); break; }
+                    case LevelTypes::Polygon: {
+                        const auto& polygon = *LevelTypes::Entry::GetPolygon(src);
+                        PolygonImage image = {
+                            polygon.valid, polygon.mFlagsA, polygon.mFlagsB, polygon.mRotation, polygon.mUnk1,
+                            polygon.mScale, polygon.mNormalDir, polygon.mPos, nullptr,
+                            static_cast<uint32_t>(polygon.mPoints.size()), polygon.mUnk2, polygon.mGrowType
+                        };
+                        if (!polygon.mPoints.empty())
+                            image.mPoints = reinterpret_cast<LevelTypes::Point*>(
+                                put(polygon.mPoints.data(), polygon.mPoints.size() * sizeof(LevelTypes::Point),
+                                    alignof(LevelTypes::Point)) + 1);
+                        payload = put(image);
+                        break;
+                    }
+                    case LevelTypes::Teleporter: {
+                        auto teleport = *LevelTypes::Entry::GetTeleporter(src);
+                        if (teleport.mEntry) {
+                            // carried elements are stored as their fields too, a real element is made on load
+                            LevelTypes::ElementFields carried = *teleport.mEntry;
+                            element(carried);
+                            teleport.mEntry = reinterpret_cast<LevelTypes::Element*>(put(carried));
+                        }
+                        payload = put(teleport);
+                        break;
+                    }
+                    case LevelTypes::Emitter: {
+                        auto emitter = *LevelTypes::Entry::GetEmitter(src);
+                        LevelSchema::for_each_string(emitter, [&](std::string_view& str) { str = string(str); });
+                        payload = put(emitter);
+                        break;
+                    }
+                    default: break;
+                }
+                copy.SetPayload(payload);
+                return put(copy);
+            }
+        };
+
+        // finds every pointer in an image and checks where it points, once per record, so a load only copies and
+        // adds. anything pointing outside the blob, misaligned, or at a slot another pointer also uses means the
+        // image is broken
+        struct Indexer {
+            const uint8_t* Base = nullptr;
+            uint64_t Size = 0;
+            // blob offsets of raw pointers, of string views and of entries, all stored as offset + 1
+            std::vector<uint32_t> Pointers, Strings, Entries;
+            std::vector<std::pair<uint64_t, uint64_t>> Slots;  // offset and size of everything a load writes
+
+            [[noreturn]] static void corrupt() {
+                throw std::exception("Corrupt level snapshot");
+            }
+
+            template<typename T>
+            const T* at(const T* encoded, const uint64_t count = 1) const {
+                if (!encoded)
+                    return nullptr;
+                const uint64_t offset = reinterpret_cast<uintptr_t>(encoded) - 1;
+                if (offset > Size || count > (Size - offset) / sizeof(T) || offset % alignof(T))
+                    corrupt();
+                return reinterpret_cast<const T*>(Base + offset);
+            }
+
+            uint32_t slot(const void* in_blob, const size_t size) {
+                const auto offset = static_cast<uint32_t>(static_cast<const uint8_t*>(in_blob) - Base);
+                Slots.emplace_back(offset, size);
+                return offset;
+            }
+
+            // top level elements are not in the blob, Load redoes their few pointers itself
+            void string(const std::string_view& str, const bool in_blob) {
+                if (at(str.data(), str.size()) && in_blob)
+                    Strings.push_back(slot(&str, sizeof(str)));
+            }
+
+            template<typename T>
+            const T* pointer(T* const& ptr, const bool in_blob, const uint64_t count = 1) {
+                const auto* target = at(ptr, count);
+                if (target && in_blob)
+                    Pointers.push_back(slot(&ptr, sizeof(ptr)));
+                return target;
+            }
+
+            void link(LevelTypes::MovementLink* const& head, const bool in_blob) {
+                // links are written innermost first, so each one sits below the one pointing at it and a broken
+                // image cannot loop them
+                uint64_t below = Size + 1;
+                bool blob = in_blob;
+                for (auto* const* next = &head; *next; next = &pointer(*next, blob)->InternalMovement.mSubMovementLink, blob = true) {
+                    const uint64_t offset = reinterpret_cast<uintptr_t>(*next) - 1;
+                    if (offset >= below)
+                        corrupt();
+                    below = offset;
+                }
+            }
+
+            void element(const LevelTypes::ElementFields& element, const bool in_blob, const uint32_t depth = 0) {
+                const auto& generic = element.generic;
+                string(generic.mImage, in_blob);
+                string(generic.mID, in_blob);
+                string(generic.mLogic, in_blob);
+                link(generic.mMovementLink.InternalMovement.mSubMovementLink, in_blob);
+                if (const auto* entry = pointer(element.entry, in_blob))
+                    this->entry(*entry, depth);
+            }
+
+            void entry(const LevelTypes::Entry& entry, const uint32_t depth) {
+                Entries.push_back(slot(&entry, sizeof(entry)));
+                const auto* payload = entry.GetPayload();
+                switch (LevelTypes::Entry::GetType(entry)) {
+                    case LevelTypes::Rod: { at(static_cast<const LevelTypes::RodEntry*>(payload)); break; }
+                    case LevelTypes::Circle: { at(static_cast<const LevelTypes::CircleEntry*>(payload)); break; }
+                    case LevelTypes::Brick: { at(static_cast<const LevelTypes::BrickEntry*>(payload)); break; }
+                    case LevelTypes::Polygon: {
+                        if (const auto* image = at(static_cast<const PolygonImage*>(payload)))
+                            pointer(image->mPoints, true, image->mPointCount);
+                        break;
+                    }
+                    case LevelTypes::Teleporter: {
+                        const auto* teleport = at(static_cast<const LevelTypes::TeleportEntry*>(payload));
+                        if (!teleport || !teleport->mEntry)
+                            break;
+                        // carried elements are written before their teleporter, the same way, but a broken image
+                        // could still nest them without end
+                        if (depth > 8)
+                            corrupt();
+                        // stored as fields, Load makes the element
+                        const auto* fields = pointer(reinterpret_cast<LevelTypes::ElementFields* const&>(teleport->mEntry), true);
+                        element(*fields, true, depth + 1);
+                        break;
+                    }
+                    case LevelTypes::Emitter: {
+                        const auto* emitter = at(static_cast<const LevelTypes::EmitterEntry*>(payload));
+                        if (!emitter)
+                            break;
+                        // for_each_string wants a mutable emitter, the copy gives each string's place in it
+                        auto copy = *emitter;
+                        const auto* base = reinterpret_cast<const uint8_t*>(&copy);
+                        LevelSchema::for_each_string(copy, [&](const std::string_view& str) {
+                            const auto* in_blob = reinterpret_cast<const uint8_t*>(emitter) + (reinterpret_cast<const uint8_t*>(&str) - base);
+                            string(*reinterpret_cast<const std::string_view*>(in_blob), true);
+                        });
+                        break;
+                    }
+                    default: break;
+                }
+            }
+
+            // no slot written twice or overlapping another, so redoing one never disturbs the next
+            void finish() {
+                std::sort(Slots.begin(), Slots.end());
+                for (size_t i = 1; i < Slots.size(); ++i)
+                    if (Slots[i].first < Slots[i - 1].first + Slots[i - 1].second)
+                        corrupt();
+                Slots = {};
+            }
+        };
+
+        // offset + 1 into blob back to a pointer, null stays null
+        template<typename T>
+        T* rebase(uint8_t* blob, T* encoded) {
+            return encoded ? reinterpret_cast<T*>(blob + (reinterpret_cast<uintptr_t>(encoded) - 1)) : nullptr;
+        }
+        inline std::string_view rebase(uint8_t* blob, const std::string_view str) {
+            return str.data() ? std::string_view{rebase(blob, str.data()), str.size()} : std::string_view{};
+        }
+
+        // bounds checked reads over a loaded file
+        struct Cursor {
+            const uint8_t* Data;
+            size_t Size;
+            size_t At = 0;
+
+            const uint8_t* take(const size_t count) {
+                if (count > Size - At)
+                    throw std::exception("Truncated level snapshot");
+                const auto* at = Data + At;
+                At += count;
+                return at;
+            }
+
+            template<typename T>
+            T read() {
+                T value;
+                memcpy(&value, take(sizeof(T)), sizeof(T));
+                return value;
+            }
+
+            void align(const size_t to) {
+                take((to - At % to) % to);
+            }
+        };
+
+        template<typename T>
+        void write(std::ofstream& out, const T& value) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+    }
+
+    LevelSnapshot::LevelSnapshot(const std::filesystem::path& path) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(path, ec);
+        if (ec)
+            return;
+        // from here on a file that does not open needs writing again
+        Dirty = true;
+        auto file = std::make_shared<std::vector<uint8_t>>(size);
+        std::ifstream fs(path, std::ifstream::in | std::ifstream::binary);
+        if (!fs.read(reinterpret_cast<char*>(file->data()), static_cast<std::streamsize>(size)))
+            return;
+
+        SnapshotHelpers::Cursor cur = {file->data(), file->size()};
+        try {
+            if (cur.read<uint32_t>() != SnapshotHelpers::snapshot_magic
+                || cur.read<uint32_t>() != SnapshotHelpers::snapshot_format
+                || cur.read<uint64_t>() != SnapshotHelpers::layout)
+                return;
+            const auto count = cur.read<uint32_t>();
+            std::map<std::string, Record> records;
+            for (uint32_t i = 0; i < count; ++i) {
+                const auto name_size = cur.read<uint32_t>();
+                const auto* name = cur.take(name_size);
+                Record record = {};
+                record.SourceHash = cur.read<uint64_t>();
+                record.SourceSize = cur.read<uint32_t>();
+                record.Version = cur.read<uint32_t>();
+                record.Sync = cur.read<uint8_t>();
+                record.Entries = cur.read<uint32_t>();
+                record.ElementCount = cur.read<uint32_t>();
+                record.BlobSize = cur.read<uint64_t>();
+                cur.align(SnapshotHelpers::image_align);
+                const uint64_t elements = static_cast<uint64_t>(record.ElementCount) * sizeof(LevelTypes::ElementFields);
+                if (elements > cur.Size - cur.At || record.BlobSize > cur.Size - cur.At - elements)
+                    throw std::exception("Truncated level snapshot");
+                record.Image = cur.take(elements + record.BlobSize);
+                record.Owner = file;
+                records.insert_or_assign(std::string(reinterpret_cast<const char*>(name), name_size), std::move(record));
+            }
+            Records = std::move(records);
+            Dirty = false;
+        } catch (const std::exception&) {
+            // a cut off file is as good as none, it gets written again
+            Records.clear();
+        }
+    }
+
+    void LevelSnapshot::Save(const std::filesystem::path& path) const {
+        std::ofstream out(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        if (!out)
+            throw std::exception("Failed to open level snapshot for writing");
+        SnapshotHelpers::write(out, SnapshotHelpers::snapshot_magic);
+        SnapshotHelpers::write(out, SnapshotHelpers::snapshot_format);
+        SnapshotHelpers::write(out, SnapshotHelpers::layout);
+        SnapshotHelpers::write(out, static_cast<uint32_t>(Records.size()));
+        for (const auto& [name, record] : Records) {
+            SnapshotHelpers::write(out, static_cast<uint32_t>(name.size()));
+            out.write(name.data(), static_cast<std::streamsize>(name.size()));
+            SnapshotHelpers::write(out, record.SourceHash);
+            SnapshotHelpers::write(out, record.SourceSize);
+            SnapshotHelpers::write(out, record.Version);
+            SnapshotHelpers::write(out, record.Sync);
+            SnapshotHelpers::write(out, record.Entries);
+            SnapshotHelpers::write(out, record.ElementCount);
+            SnapshotHelpers::write(out, record.BlobSize);
+            constexpr char zeros[SnapshotHelpers::image_align] = {};
+            const auto at = static_cast<size_t>(out.tellp());
+            out.write(zeros, static_cast<std::streamsize>((SnapshotHelpers::image_align - at % SnapshotHelpers::image_align) % SnapshotHelpers::image_align));
+            out.write(reinterpret_cast<const char*>(record.Image),
+                      static_cast<std::streamsize>(record.ElementCount * sizeof(LevelTypes::ElementFields) + record.BlobSize));
+        }
+        if (!out)
+            throw std::exception("Failed to write level snapshot");
+        Dirty = false;
+    }
+
+    bool LevelSnapshot::IsFresh(const std::string& name, const void* buf, const uint32_t size) const {
+        const auto it = Records.find(name);
+        // the size first, the bytes are only hashed when it matches
+        return it != Records.end() && it->second.SourceSize == size
+            && it->second.SourceHash == SnapshotHelpers::hash_source(buf, size);
+    }
+
+    LevelTypes::Level LevelSnapshot::Load(const std::string& name, const void* buf, const uint32_t size, const bool verify) {
+        // the size rules most stale records out before anything is hashed
+        std::optional<uint64_t> hash;
+        const auto source_hash = [&] {
+            if (!hash)
+                hash = SnapshotHelpers::hash_source(buf, size);
+            return *hash;
+        };
+        if (const auto it = Records.find(name);
+            it != Records.end() && it->second.SourceSize == size && (!verify || it->second.SourceHash == source_hash())) {
+            auto& record = it->second;
+            try {
+                const size_t elements = record.ElementCount * sizeof(LevelTypes::ElementFields);
+                if (!record.Indexed) {
+                    SnapshotHelpers::Indexer index;
+                    index.Base = record.Image + elements;
+                    index.Size = record.BlobSize;
+                    if (record.BlobSize > UINT32_MAX)
+                        index.corrupt();
+                    const auto* first = reinterpret_cast<const LevelTypes::ElementFields*>(record.Image);
+                    for (uint32_t i = 0; i < record.ElementCount; ++i)
+                        index.element(first[i], false);
+                    index.finish();
+                    record.PointerSlots = std::move(index.Pointers);
+                    record.StringSlots = std::move(index.Strings);
+                    record.EntrySlots = std::move(index.Entries);
+                    record.Indexed = true;
+                }
+                return load(record);
+            } catch (const std::exception&) {
+                // parsed again below, and the broken image replaced
+            }
+        }
+
+        auto lvl = Level::LoadLevel(buf, size);
+        if (lvl.valid)
+            Store(name, source_hash(), size, lvl);
+        return lvl;
+    }
+
+    LevelTypes::Level LevelSnapshot::load(const Record& record) const {
+        LevelTypes::Level lvl = {};
+        auto* arena = Level::GetArena(lvl);
+        lvl.valid = true;
+        lvl.version = record.Version;
+        lvl.sync_f = record.Sync;
+        lvl.entries = record.Entries;
+
+        // the blob goes over in one copy and every pointer the index found is moved onto it
+        const size_t elements = record.ElementCount * sizeof(LevelTypes::ElementFields);
+        auto* blob = static_cast<uint8_t*>(arena->allocate(std::max<uint64_t>(record.BlobSize, 1), SnapshotHelpers::image_align));
+        if (record.BlobSize)
+            memcpy(blob, record.Image + elements, record.BlobSize);
+        for (const auto offset : record.PointerSlots) {
+            void* ptr;
+            memcpy(&ptr, blob + offset, sizeof(ptr));
+            ptr = SnapshotHelpers::rebase(blob, static_cast<uint8_t*>(ptr));
+            memcpy(blob + offset, &ptr, sizeof(ptr));
+        }
+        for (const auto offset : record.StringSlots) {
+            auto& str = *reinterpret_cast<std::string_view*>(blob + offset);
+            str = SnapshotHelpers::rebase(blob, str);
+        }
+        // then the entries, polygons and carried elements become real ones out of what the pointers now reach
+        for (const auto offset : record.EntrySlots) {
+            auto& entry = *reinterpret_cast<LevelTypes::Entry*>(blob + offset);
+            void* payload = SnapshotHelpers::rebase(blob, static_cast<uint8_t*>(entry.GetPayload()));
+            switch (LevelTypes::Entry::GetType(entry)) {
+                case LevelTypes::Polygon: {
+                    const auto* image = static_cast<const SnapshotHelpers::PolygonImage*>(payload);
+                    if (!image)
+                        break;
+                    auto* polygon = LevelSchema::arena_new<LevelTypes::PolygonEntry>(arena);
+                    std::destroy_at(&polygon->mPoints);
+                    std::construct_at(&polygon->mPoints, arena);
+                    polygon->valid = image->valid;
+                    polygon->mFlagsA = image->mFlagsA;
+                    polygon->mFlagsB = image->mFlagsB;
+                    polygon->mRotation = image->mRotation;
+                    polygon->mUnk1 = image->mUnk1;
+                    polygon->mScale = image->mScale;
+                    polygon->mNormalDir = image->mNormalDir;
+                    polygon->mPos = image->mPos;
+                    if (image->mPoints)
+                        polygon->mPoints.assign(image->mPoints, image->mPoints + image->mPointCount);
+                    polygon->mUnk2 = image->mUnk2;
+                    polygon->mGrowType = image->mGrowType;
+                    payload = polygon;
+                    break;
+                }
+                case LevelTypes::Teleporter: {
+                    auto* teleport = static_cast<LevelTypes::TeleportEntry*>(payload);
+                    if (!teleport || !teleport->mEntry)
+                        break;
+                    auto* carried = LevelSchema::arena_new<LevelTypes::Element>(arena);
+                    static_cast<LevelTypes::ElementFields&>(*carried) = *reinterpret_cast<const LevelTypes::ElementFields*>(teleport->mEntry);
+                    teleport->mEntry = carried;
+                    break;
+                }
+                default: break;
+            }
+            entry.SetPayload(payload);
+        }
+
+        // images start image_align into the file, so the elements can be copied straight out of it
+        const auto* first = reinterpret_cast<const LevelTypes::ElementFields*>(record.Image);
+        lvl.Elements.resize(record.ElementCount);
+        for (uint32_t i = 0; i < record.ElementCount; ++i) {
+            auto& element = lvl.Elements[i];
+            static_cast<LevelTypes::ElementFields&>(element) = first[i];
+            auto& generic = element.generic;
+            generic.mImage = SnapshotHelpers::rebase(blob, generic.mImage);
+            generic.mID = SnapshotHelpers::rebase(blob, generic.mID);
+            generic.mLogic = SnapshotHelpers::rebase(blob, generic.mLogic);
+            auto& sub = generic.mMovementLink.InternalMovement.mSubMovementLink;
+            sub = SnapshotHelpers::rebase(blob, sub);
+            element.entry = SnapshotHelpers::rebase(blob, element.entry);
+        }
+        return lvl;
+    }
+
+    LevelTypes::Level LevelSnapshot::Load(const std::string& name, const FileRef& lvl, const bool verify) {
+        if (lvl.State != FileState::OK)
+            return LevelTypes::Level{};  // valid = false
+        return Load(name, lvl.Data, lvl.Size, verify);
+    }
+
+    void LevelSnapshot::Store(const std::string& name, const void* buf, const uint32_t size, const LevelTypes::Level& lvl) {
+        Store(name, SnapshotHelpers::hash_source(buf, size), size, lvl);
+    }
+
+    void LevelSnapshot::Store(const std::string& name, const uint64_t hash, const uint32_t size, const LevelTypes::Level& lvl) {
+        if (!lvl.valid)
+            throw std::exception("Cannot snapshot an invalid level");
+        const size_t count = lvl.Elements.size();
+        std::vector<LevelTypes::ElementFields> elements(lvl.Elements.begin(), lvl.Elements.end());
+        SnapshotHelpers::Writer writer;
+        for (auto& element : elements)
+            writer.element(element);
+
+        const size_t element_bytes = count * sizeof(LevelTypes::ElementFields);
+        auto image = std::make_shared<std::vector<uint8_t>>(element_bytes + writer.Blob.size());
+        if (element_bytes)
+            memcpy(image->data(), elements.data(), element_bytes);
+        if (!writer.Blob.empty())
+            memcpy(image->data() + element_bytes, writer.Blob.data(), writer.Blob.size());
+
+        Record record = {};
+        record.SourceHash = hash;
+        record.SourceSize = size;
+        record.Version = lvl.version;
+        record.Sync = lvl.sync_f;
+        record.Entries = lvl.entries;
+        record.ElementCount = static_cast<uint32_t>(count);
+        record.BlobSize = writer.Blob.size();
+        record.Image = image->data();
+        record.Owner = std::move(image);
+        Records.insert_or_assign(name, std::move(record));
+        Dirty = true;
+    }
+
+    void LevelSnapshot::Remove(const std::string& name) {
+        if (Records.erase(name))
+            Dirty = true;
+    }
+
+    bool LevelSnapshot::IsDirty() const {
+        return Dirty;
+    }
+
+    size_t LevelSnapshot::GetLevelCount() const {
+        return Records.size();
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,326 @@
+#include "levelschema.h"
+#include "levelshapes.h"
+#include "libpeggle.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Peggle {
+#pragma region libpeggle_Spatial
+
+    namespace SpatialHelpers {
+        uint64_t cell_key(const int32_t x, const int32_t y) {
+            return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y);
+        }
+
+        bool overlaps(const SpatialTypes::Box& a, const SpatialTypes::Box& b) {
+            return a.MinX <= b.MaxX && b.MinX <= a.MaxX && a.MinY <= b.MaxY && b.MinY <= a.MaxY;
+        }
+
+        // squared distance from a point to a box, 0 inside
+        float box_distance2(const SpatialTypes::Box& box, const float x, const float y) {
+            const float dx = std::max({box.MinX - x, 0.f, x - box.MaxX});
+            const float dy = std::max({box.MinY - y, 0.f, y - box.MaxY});
+            return dx * dx + dy * dy;
+        }
+
+        bool finite(const SpatialTypes::Box& box) {
+            return std::isfinite(box.MinX) && std::isfinite(box.MinY) && std::isfinite(box.MaxX) && std::isfinite(box.MaxY);
+        }
+
+        // cell coordinates saturate here (NaN goes to the low end), far enough in that differences of two still
+        // fit an int32_t
+        constexpr int32_t cell_limit = 1 << 29;
+        // an element covering more cells than this is kept out of the grid and checked by every query instead
+        constexpr int64_t max_cells = 1024;
+
+        int32_t cell_of(const float v, const float cell_size) {
+            const double cell = std::floor(static_cast<double>(v) / cell_size);
+            if (!(cell > -cell_limit))
+                return -cell_limit;
+            return cell < cell_limit ? static_cast<int32_t>(cell) : cell_limit;
+        }
+
+        int64_t cell_count(const int32_t x0, const int32_t y0, const int32_t x1, const int32_t y1) {
+            if (x1 < x0 || y1 < y0)
+                return 0;
+            return (static_cast<int64_t>(x1) - x0 + 1) * (static_cast<int64_t>(y1) - y0 + 1);
+        }
+    }
+
+    SpatialIndex::SpatialIndex(const LevelTypes::Level& lvl, const float cell_size) : CellSize(cell_size) {
+        Items.resize(lvl.Elements.size());
+        double extent = 0.;
+        size_t count = 0;
+        for (uint32_t i = 0; i < lvl.Elements.size(); ++i) {
+            auto& item = Items[i];
+            if (!Shapes::bounds(lvl.Elements[i], item.Bounds) || !SpatialHelpers::finite(item.Bounds)) {
+                item = {};
+                continue;
+            }
+            item.Indexed = true;
+            item.Type = LevelTypes::Entry::GetType(lvl.Elements[i].entry);
+            if (item.Type == LevelTypes::Circle) {
+                const auto* circle = LevelTypes::Entry::GetCircle(lvl.Elements[i].entry);
+                item.X = circle->mPos.x;
+                item.Y = circle->mPos.y;
+                item.Radius = std::abs(circle->mRadius);
+            }
+            extent += std::max(item.Bounds.MaxX - item.Bounds.MinX, item.Bounds.MaxY - item.Bounds.MinY);
+            ++count;
+        }
+        // a couple of average elements per cell keeps both the cell lists and the cells per element short
+        if (!(CellSize > 0.f))
+            CellSize = count ? std::max(static_cast<float>(2. * extent / count), 1.f) : 64.f;
+
+        for (uint32_t i = 0; i < Items.size(); ++i)
+            if (Items[i].Indexed)
+                Insert(i);
+    }
+
+    void SpatialIndex::Insert(const uint32_t element) {
+        auto& item = Items[element];
+        const auto& b = item.Bounds;
+        const auto x0 = SpatialHelpers::cell_of(b.MinX, CellSize);
+        const auto y0 = SpatialHelpers::cell_of(b.MinY, CellSize);
+        const auto x1 = SpatialHelpers::cell_of(b.MaxX, CellSize);
+        const auto y1 = SpatialHelpers::cell_of(b.MaxY, CellSize);
+        if (SpatialHelpers::cell_count(x0, y0, x1, y1) > SpatialHelpers::max_cells) {
+            item.Large = true;
+            Large.push_back(element);
+            return;
+        }
+        for (int32_t y = y0; y <= y1; ++y)
+            for (int32_t x = x0; x <= x1; ++x)
+                Cells[SpatialHelpers::cell_key(x, y)].push_back(element);
+        if (MaxCellX < MinCellX) {
+            MinCellX = x0; MinCellY = y0;
+            MaxCellX = x1; MaxCellY = y1;
+        } else {
+            MinCellX = std::min(MinCellX, x0); MinCellY = std::min(MinCellY, y0);
+            MaxCellX = std::max(MaxCellX, x1); MaxCellY = std::max(MaxCellY, y1);
+        }
+    }
+
+    void SpatialIndex::Erase(const uint32_t element) {
+        const auto& item = Items[element];
+        if (item.Large) {
+            std::erase(Large, element);
+            return;
+        }
+        const auto& b = item.Bounds;
+        const auto x0 = SpatialHelpers::cell_of(b.MinX, CellSize);
+        const auto y0 = SpatialHelpers::cell_of(b.MinY, CellSize);
+        const auto x1 = SpatialHelpers::cell_of(b.MaxX, CellSize);
+        const auto y1 = SpatialHelpers::cell_of(b.MaxY, CellSize);
+        for (int32_t y = y0; y <= y1; ++y) {
+            for (int32_t x = x0; x <= x1; ++x) {
+                const auto cell = Cells.find(SpatialHelpers::cell_key(x, y));
+                if (cell == Cells.end())
+                    continue;
+                auto& list = cell->second;
+                list.erase(std::remove(list.begin(), list.end(), element), list.end());
+                if (list.empty())
+                    Cells.erase(cell);
+            }
+        }
+    }
+
+    void SpatialIndex::Update(const LevelTypes::Level& lvl, const uint32_t element) {
+        if (element >= lvl.Elements.size())
+            return;
+        if (element >= Items.size())
+            Items.resize(element + 1);
+        Remove(element);
+
+        auto& item = Items[element];
+        if (!Shapes::bounds(lvl.Elements[element], item.Bounds) || !SpatialHelpers::finite(item.Bounds)) {
+            item = {};
+            return;
+        }
+        item.Indexed = true;
+        item.Type = LevelTypes::Entry::GetType(lvl.Elements[element].entry);
+        if (item.Type == LevelTypes::Circle) {
+            const auto* circle = LevelTypes::Entry::GetCircle(lvl.Elements[element].entry);
+            item.X = circle->mPos.x;
+            item.Y = circle->mPos.y;
+            item.Radius = std::abs(circle->mRadius);
+        }
+        Insert(element);
+    }
+
+    void SpatialIndex::Remove(const uint32_t element) {
+        if (element >= Items.size() || !Items[element].Indexed)
+            return;
+        Erase(element);
+        Items[element] = {};
+    }
+
+    std::vector<uint32_t> SpatialIndex::QueryBox(const SpatialTypes::Box& box) const {
+        std::vector<uint32_t> res;
+        const auto test = [&](const uint32_t i) {
+            const auto& item = Items[i];
+            if (!SpatialHelpers::overlaps(item.Bounds, box))
+                return;
+            if (item.Type == LevelTypes::Circle && SpatialHelpers::box_distance2(box, item.X, item.Y) > item.Radius * item.Radius)
+                return;
+            res.push_back(i);
+        };
+
+        const auto x0 = std::max(SpatialHelpers::cell_of(box.MinX, CellSize), MinCellX);
+        const auto y0 = std::max(SpatialHelpers::cell_of(box.MinY, CellSize), MinCellY);
+        const auto x1 = std::min(SpatialHelpers::cell_of(box.MaxX, CellSize), MaxCellX);
+        const auto y1 = std::min(SpatialHelpers::cell_of(box.MaxY, CellSize), MaxCellY);
+        // a box over more cells than there are elements is cheaper to answer from the elements
+        if (SpatialHelpers::cell_count(x0, y0, x1, y1) > static_cast<int64_t>(Items.size())) {
+            for (uint32_t i = 0; i < Items.size(); ++i)
+                if (Items[i].Indexed)
+                    test(i);
+            return res;
+        }
+        for (int32_t y = y0; y <= y1; ++y) {
+            for (int32_t x = x0; x <= x1; ++x) {
+                const auto cell = Cells.find(SpatialHelpers::cell_key(x, y));
+                if (cell == Cells.end())
+                    continue;
+                for (const auto i : cell->second)
+                    test(i);
+            }
+        }
+        for (const auto i : Large)
+            test(i);
+        std::sort(res.begin(), res.end());
+        res.erase(std::unique(res.begin(), res.end()), res.end());
+        return res;
+    }
+
+    std::vector<uint32_t> SpatialIndex::QueryCircle(const float x, const float y, const float radius) const {
+        auto res = QueryBox({x - radius, y - radius, x + radius, y + radius});
+        std::erase_if(res, [&](const uint32_t i) {
+            const auto& item = Items[i];
+            if (item.Type == LevelTypes::Circle) {
+                const float dx = item.X - x, dy = item.Y - y, r = item.Radius + radius;
+                return dx * dx + dy * dy > r * r;
+            }
+            return SpatialHelpers::box_distance2(item.Bounds, x, y) > radius * radius;
+        });
+        return res;
+    }
+
+    std::optional<SpatialTypes::Nearest> SpatialIndex::QueryNearest(const float x, const float y, const LevelTypes::LevelEntryType type) const {
+        std::optional<SpatialTypes::Nearest> best;
+        if (!std::isfinite(x) || !std::isfinite(y))
+            return best;
+
+        const auto test = [&](const uint32_t i) {
+            const auto& item = Items[i];
+            if (type != LevelTypes::Unknown && item.Type != type)
+                return;
+            const float d = item.Type == LevelTypes::Circle
+                ? std::max(std::hypot(item.X - x, item.Y - y) - item.Radius, 0.f)
+                : std::sqrt(SpatialHelpers::box_distance2(item.Bounds, x, y));
+            if (!best || d < best->Distance || (d == best->Distance && i < best->Element))
+                best = SpatialTypes::Nearest{i, d};
+        };
+        for (const auto i : Large)
+            test(i);
+        if (MaxCellX < MinCellX)
+            return best;
+
+        // walk rings of cells outwards from the first one reaching the occupied cells, until the ring is further
+        // away than the best hit. a point far outside starts next to the cells instead of crossing the empty space
+        // between, and once the rings would have covered more cells than there are elements the rest is a scan
+        const int64_t cx = SpatialHelpers::cell_of(x, CellSize);
+        const int64_t cy = SpatialHelpers::cell_of(y, CellSize);
+        const int64_t first_ring = std::max({MinCellX - cx, cx - MaxCellX, MinCellY - cy, cy - MaxCellY, int64_t{0}});
+        const int64_t last_ring = std::max({cx - MinCellX, MaxCellX - cx, cy - MinCellY, MaxCellY - cy});
+        const auto visit = [&](const int64_t gx, const int64_t gy) {
+            const auto cell = Cells.find(SpatialHelpers::cell_key(static_cast<int32_t>(gx), static_cast<int32_t>(gy)));
+            if (cell == Cells.end())
+                return;
+            for (const auto i : cell->second)
+                test(i);
+        };
+        int64_t visited = 0;
+        for (int64_t ring = first_ring; ring <= last_ring; ++ring) {
+            if (best && static_cast<double>(ring - 1) * CellSize > best->Distance)
+                break;
+            // the ring's square, clipped to the occupied cells
+            const int64_t x0 = std::max<int64_t>(cx - ring, MinCellX), x1 = std::min<int64_t>(cx + ring, MaxCellX);
+            const int64_t y0 = std::max<int64_t>(cy - ring, MinCellY), y1 = std::min<int64_t>(cy + ring, MaxCellY);
+            const bool top = cy - ring >= MinCellY, bottom = ring && cy + ring <= MaxCellY;
+            const bool left = cx - ring >= MinCellX, right = ring && cx + ring <= MaxCellX;
+            const int64_t rows = (top + bottom) * (x1 - x0 + 1);
+            const int64_t columns = (left + right) * std::max<int64_t>(std::min(y1, cy + ring - 1) - std::max(y0, cy - ring + 1) + 1, 0);
+            visited += rows + columns;
+            if (visited > static_cast<int64_t>(Items.size())) {
+                for (uint32_t i = 0; i < Items.size(); ++i)
+                    if (Items[i].Indexed && !Items[i].Large)
+                        test(i);
+                return best;
+            }
+            for (int64_t gx = x0; gx <= x1; ++gx) {
+                if (top)
+                    visit(gx, cy - ring);
+                if (bottom)
+                    visit(gx, cy + ring);
+            }
+            for (int64_t gy = std::max(y0, cy - ring + 1); gy <= std::min(y1, cy + ring - 1); ++gy) {
+                if (left)
+                    visit(cx - ring, gy);
+                if (right)
+                    visit(cx + ring, gy);
+            }
+        }
+        return best;
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> SpatialIndex::QueryOverlaps() const {
+        std::vector<std::pair<uint32_t, uint32_t>> res;
+        const auto touch = [&](const uint32_t a, const uint32_t b) {
+            const auto& ia = Items[a];
+            const auto& ib = Items[b];
+            if (!SpatialHelpers::overlaps(ia.Bounds, ib.Bounds))
+                return;
+            if (ia.Type == LevelTypes::Circle && ib.Type == LevelTypes::Circle) {
+                const float dx = ia.X - ib.X, dy = ia.Y - ib.Y, r = ia.Radius + ib.Radius;
+                if (dx * dx + dy * dy > r * r)
+                    return;
+            } else if (ia.Type == LevelTypes::Circle || ib.Type == LevelTypes::Circle) {
+                const auto& circle = ia.Type == LevelTypes::Circle ? ia : ib;
+                const auto& other = ia.Type == LevelTypes::Circle ? ib : ia;
+                if (SpatialHelpers::box_distance2(other.Bounds, circle.X, circle.Y) > circle.Radius * circle.Radius)
+                    return;
+            }
+            res.emplace_back(std::min(a, b), std::max(a, b));
+        };
+
+        for (const auto& [key, list] : Cells) {
+            const auto cx = static_cast<int32_t>(key >> 32);
+            const auto cy = static_cast<int32_t>(key & 0xFFFFFFFF);
+            for (size_t a = 0; a < list.size(); ++a) {
+                for (size_t b = a + 1; b < list.size(); ++b) {
+                    const auto& ia = Items[list[a]];
+                    const auto& ib = Items[list[b]];
+                    // a pair shares several cells, report it from the one holding the corner of the overlap
+                    const float ox = std::max(ia.Bounds.MinX, ib.Bounds.MinX);
+                    const float oy = std::max(ia.Bounds.MinY, ib.Bounds.MinY);
+                    if (SpatialHelpers::cell_of(ox, CellSize) != cx || SpatialHelpers::cell_of(oy, CellSize) != cy)
+                        continue;
+                    touch(list[a], list[b]);
+                }
+            }
+        }
+        // elements kept out of the grid are checked against everything
+        for (size_t a = 0; a < Large.size(); ++a) {
+            for (uint32_t b = 0; b < Items.size(); ++b) {
+                if (!Items[b].Indexed || b == Large[a] || (Items[b].Large && b < Large[a]))
+                    continue;
+                touch(Large[a], b);
+            }
+        }
+        std::sort(res.begin(), res.end());
+        return res;
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,199 @@
+#include "binstream.h"
+#include "helpers.h"
+#include "levelschema.h"
+#include "levelshapes.h"
+#include "libpeggle.h"
+#include "workpool.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace Peggle {
+#pragma region libpeggle_Statistics
+
+    namespace StatisticsHelpers {
+        struct Count {
+            const char* Name;
+            uint32_t StatsTypes::LevelStats::* Member;
+        };
+        // every count of a row, in declaration order, for summing and printing
+        constexpr Count counts[] = {
+            {"elements", &StatsTypes::LevelStats::Elements},
+            {"rods", &StatsTypes::LevelStats::Rods},
+            {"polygons", &StatsTypes::LevelStats::Polygons},
+            {"circles", &StatsTypes::LevelStats::Circles},
+            {"bricks", &StatsTypes::LevelStats::Bricks},
+            {"teleporters", &StatsTypes::LevelStats::Teleporters},
+            {"emitters", &StatsTypes::LevelStats::Emitters},
+            {"other", &StatsTypes::LevelStats::Other},
+            {"pegs", &StatsTypes::LevelStats::Pegs},
+            {"blue", &StatsTypes::LevelStats::Blue},
+            {"orange", &StatsTypes::LevelStats::Orange},
+            {"green", &StatsTypes::LevelStats::Green},
+            {"purple", &StatsTypes::LevelStats::Purple},
+            {"other_pegs", &StatsTypes::LevelStats::OtherPegs},
+            {"crumbling", &StatsTypes::LevelStats::Crumbling},
+            {"variable", &StatsTypes::LevelStats::Variable},
+            {"moving", &StatsTypes::LevelStats::Moving},
+            {"static", &StatsTypes::LevelStats::Static},
+            {"shapes", &StatsTypes::LevelStats::Shapes},
+        };
+
+        // box is the first one when shapes is 0
+        void grow(SpatialTypes::Box& bounds, const SpatialTypes::Box& box, const uint32_t shapes) {
+            if (shapes == 0) {
+                bounds = box;
+                return;
+            }
+            bounds.MinX = std::min(bounds.MinX, box.MinX);
+            bounds.MinY = std::min(bounds.MinY, box.MinY);
+            bounds.MaxX = std::max(bounds.MaxX, box.MaxX);
+            bounds.MaxY = std::max(bounds.MaxY, box.MaxY);
+        }
+
+        void count_type(StatsTypes::LevelStats& s, const int32_t type) {
+            switch (type) {
+                case LevelTypes::Rod: ++s.Rods; break;
+                case LevelTypes::Polygon: ++s.Polygons; break;
+                case LevelTypes::Circle: ++s.Circles; break;
+                case LevelTypes::Brick: ++s.Bricks; break;
+                case LevelTypes::Teleporter: ++s.Teleporters; break;
+                case LevelTypes::Emitter: ++s.Emitters; break;
+                default: ++s.Other; break;
+            }
+        }
+
+        void count_peg(StatsTypes::LevelStats& s, const LevelTypes::PegInfo& peg) {
+            ++s.Pegs;
+            switch (peg.mType) {
+                case 1: ++s.Blue; break;
+                case 2: ++s.Orange; break;
+                case 3: ++s.Green; break;
+                case 4: ++s.Purple; break;
+                default: ++s.OtherPegs; break;
+            }
+            s.Crumbling += peg.mCrumble;
+            s.Variable += peg.mVariable;
+        }
+
+        bool has_shape(const int32_t type) {
+            return type == LevelTypes::Rod || type == LevelTypes::Polygon || type == LevelTypes::Circle || type == LevelTypes::Brick;
+        }
+    }
+
+    StatsTypes::LevelStats LevelStatistics::Collect(const LevelTypes::Level& lvl) {
+        StatsTypes::LevelStats s = {};
+        for (const auto& element : lvl.Elements) {
+            if (element.magic != 1)
+                continue;
+            ++s.Elements;
+            StatisticsHelpers::count_type(s, element.eType);
+            if (element.flags.hasPegInfo)
+                StatisticsHelpers::count_peg(s, element.generic.mPegInfo);
+            ++(element.flags.hasMovementInfo ? s.Moving : s.Static);
+            SpatialTypes::Box box;
+            if (Shapes::bounds(element, box))
+                StatisticsHelpers::grow(s.Bounds, box, s.Shapes++);
+        }
+        return s;
+    }
+
+    StatsTypes::LevelStats LevelStatistics::Collect(const void* buf, const uint32_t size) {
+        StatsTypes::LevelStats s = {};
+        binstream bs(buf, size);
+        const auto version = bs.read<uint32_t>();
+        bs.read<uint8_t>();  // sync
+        const auto entries = bs.read<uint32_t>();
+        // shape entries are read into this, dropped with the collection
+        std::byte initial[16384];
+        std::pmr::monotonic_buffer_resource arena(initial, sizeof(initial));
+        LevelSchema::with_format(version, &arena, [&](const auto fmt) {
+            for (uint32_t i = 0; i < entries; ++i) {
+                LevelTypes::Element scratch = {};
+                scratch.magic = bs.read<int32_t>();
+                if (scratch.magic != 1)
+                    continue;
+                LevelSchema::ElementHead::read(bs, scratch, fmt);
+                ++s.Elements;
+                StatisticsHelpers::count_type(s, scratch.eType);
+                if (scratch.flags.hasPegInfo)
+                    StatisticsHelpers::count_peg(s, scratch.generic.mPegInfo);
+                ++(scratch.flags.hasMovementInfo ? s.Moving : s.Static);
+                if (scratch.flags.hasMovementInfo)
+                    LevelSchema::Codec<LevelTypes::MovementLink>::skip(bs, fmt);
+                if (!StatisticsHelpers::has_shape(scratch.eType)) {
+                    LevelSchema::ElementEntry::skip(bs, scratch, fmt);
+                    continue;
+                }
+                LevelSchema::ElementEntry::read(bs, scratch, fmt);
+                SpatialTypes::Box box;
+                if (Shapes::bounds(scratch, box))
+                    StatisticsHelpers::grow(s.Bounds, box, s.Shapes++);
+            }
+        });
+        return s;
+    }
+
+    StatsTypes::StatsTable LevelStatistics::Collect(Pak& pak, const unsigned threads) {
+        StatsTypes::StatsTable table = {};
+        for (const auto& path : pak.GetFileList())
+            if (PipelineHelpers::is_level_path(path))
+                table.Paths.push_back(path);
+
+        table.Levels.resize(table.Paths.size());
+        WorkPool::parallel_for(table.Paths.size(), threads, [&](const size_t i, unsigned) {
+            const auto file = pak.GetFile(table.Paths[i]);
+            if (file.State != FileState::OK)
+                throw std::exception("Failed to read level from pak");
+            table.Levels[i] = Collect(file.Data, file.Size);
+        });
+
+        auto& total = table.Total;
+        for (const auto& s : table.Levels) {
+            if (s.Shapes)
+                StatisticsHelpers::grow(total.Bounds, s.Bounds, total.Shapes);
+            for (const auto& count : StatisticsHelpers::counts)
+                total.*count.Member += s.*count.Member;
+        }
+        return table;
+    }
+
+    std::string LevelStatistics::ToCsv(const StatsTypes::StatsTable& table) {
+        std::string res = "path";
+        for (const auto& count : StatisticsHelpers::counts) {
+            res += ',';
+            res += count.Name;
+        }
+        res += ",min_x,min_y,max_x,max_y\n";
+
+        const auto row = [&](const std::string& path, const StatsTypes::LevelStats& s) {
+            // paths are quoted when they hold a separator or a quote, quotes doubled
+            if (path.find_first_of(",\"\n") == std::string::npos) {
+                res += path;
+            } else {
+                res += '"';
+                for (const char c : path) {
+                    if (c == '"')
+                        res += '"';
+                    res += c;
+                }
+                res += '"';
+            }
+            for (const auto& count : StatisticsHelpers::counts) {
+                res += ',';
+                res += std::to_string(s.*count.Member);
+            }
+            for (const float v : {s.Bounds.MinX, s.Bounds.MinY, s.Bounds.MaxX, s.Bounds.MaxY}) {
+                char buf[32];
+                std::snprintf(buf, sizeof(buf), ",%g", v);
+                res += buf;
+            }
+            res += '\n';
+        };
+        for (size_t i = 0; i < table.Levels.size() && i < table.Paths.size(); ++i)
+            row(table.Paths[i], table.Levels[i]);
+        row("total", table.Total);
+        return res;
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,149 @@
+#include "helpers.h"
+#include "levelschema.h"
+#include "libpeggle.h"
+#include "workpool.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Peggle {
+#pragma region libpeggle_Strings
+
+    namespace StringHelpers {
+        // levels loaded at once by AddPak, bounds how many are held before their strings are in the table
+        constexpr size_t pak_batch = 64;
+    }
+
+    StringTable::StringTable() : Arena(std::make_unique<std::pmr::monotonic_buffer_resource>()) {
+        Lookup.emplace(std::string_view{}, 0);
+        Strings.emplace_back();
+        Uses.emplace_back();
+    }
+
+    StringTypes::Handle StringTable::Intern(const std::string_view str) {
+        if (const auto it = Lookup.find(str); it != Lookup.end())
+            return it->second;
+        // the table keys on the arena copy, so callers' strings can go away
+        auto* chars = static_cast<char*>(Arena->allocate(str.size(), alignof(char)));
+        memcpy(chars, str.data(), str.size());
+        const std::string_view kept(chars, str.size());
+        const auto handle = static_cast<StringTypes::Handle>(Strings.size());
+        Lookup.emplace(kept, handle);
+        Strings.push_back(kept);
+        Uses.emplace_back();
+        Bytes += str.size();
+        return handle;
+    }
+
+    std::optional<StringTypes::Handle> StringTable::Find(const std::string_view str) const {
+        if (const auto it = Lookup.find(str); it != Lookup.end())
+            return it->second;
+        return std::nullopt;
+    }
+
+    std::string_view StringTable::GetString(const StringTypes::Handle handle) const {
+        if (handle >= Strings.size())
+            throw std::exception("String handle out of range");
+        return Strings[handle];
+    }
+
+    size_t StringTable::GetCount() const {
+        return Strings.size();
+    }
+
+    size_t StringTable::GetBytes() const {
+        return Bytes;
+    }
+
+    uint32_t StringTable::AddLevel(const std::string& name, const LevelTypes::Level& lvl) {
+        const auto level = static_cast<uint32_t>(Levels.size());
+        StringTypes::LevelStrings strings = {};
+        strings.Name = name;
+        const size_t n = lvl.Elements.size();
+        for (auto* column : {&strings.Image, &strings.ID, &strings.Logic,
+                             &strings.EmitterImage, &strings.EmitImage, &strings.EmitterMainVar2})
+            column->resize(n);
+
+        // carried elements are interned and used under their teleporter's row, they have no columns of their own
+        uint8_t depth = 0;
+        const auto add = [&](std::vector<StringTypes::Handle>& column, const uint32_t element,
+                             const StringTypes::StringField field, const std::string_view str) {
+            const auto handle = Intern(str);
+            if (depth == 0)
+                column[element] = handle;
+            if (handle != 0)
+                Uses[handle].push_back({level, element, field, depth});
+        };
+        const auto add_element = [&](const auto& self, const LevelTypes::Element& element, const uint32_t i) -> void {
+            const auto& generic = element.generic;
+            if (element.flags.hasImage)
+                add(strings.Image, i, StringTypes::StringField::Image, generic.mImage);
+            if (element.flags.hasID)
+                add(strings.ID, i, StringTypes::StringField::ID, generic.mID);
+            if (element.flags.hasLogic)
+                add(strings.Logic, i, StringTypes::StringField::Logic, generic.mLogic);
+            if (!element.entry)
+                return;
+            if (const auto* emitter = LevelTypes::Entry::GetEmitter(element.entry)) {
+                add(strings.EmitterImage, i, StringTypes::StringField::EmitterImage, emitter->mImage);
+                add(strings.EmitImage, i, StringTypes::StringField::EmitImage, emitter->mEmitImage);
+                add(strings.EmitterMainVar2, i, StringTypes::StringField::EmitterMainVar2, emitter->mMainVar2);
+            }
+            if (const auto* teleport = LevelTypes::Entry::GetTeleporter(element.entry); teleport && teleport->mEntry) {
+                ++depth;
+                self(self, *teleport->mEntry, i);
+                --depth;
+            }
+        };
+        for (uint32_t i = 0; i < n; ++i)
+            add_element(add_element, lvl.Elements[i], i);
+        Levels.push_back(std::move(strings));
+        return level;
+    }
+
+    void StringTable::AddPak(Pak& pak, const unsigned threads) {
+        std::vector<std::string> paths;
+        for (const auto& path : pak.GetFileList())
+            if (PipelineHelpers::is_level_path(path))
+                paths.push_back(path);
+
+        // loading runs on the pool, interning stays on this thread so handles come out in path order
+        for (size_t first = 0; first < paths.size(); first += StringHelpers::pak_batch) {
+            const size_t count = std::min(StringHelpers::pak_batch, paths.size() - first);
+            std::vector<LevelTypes::Level> batch(count);
+            WorkPool::parallel_for(count, threads, [&](const size_t i, unsigned) {
+                batch[i] = Level::LoadLevel(pak.GetFile(paths[first + i]));
+            });
+            for (size_t i = 0; i < count; ++i) {
+                AddLevel(paths[first + i], batch[i]);
+                batch[i] = {};
+            }
+        }
+    }
+
+    size_t StringTable::GetLevelCount() const {
+        return Levels.size();
+    }
+
+    const StringTypes::LevelStrings& StringTable::GetLevel(const uint32_t level) const {
+        if (level >= Levels.size())
+            throw std::exception("Level number out of range");
+        return Levels[level];
+    }
+
+    const std::vector<StringTypes::Use>& StringTable::GetUses(const StringTypes::Handle handle) const {
+        if (handle >= Uses.size())
+            throw std::exception("String handle out of range");
+        return Uses[handle];
+    }
+
+    std::vector<uint32_t> StringTable::GetLevelsUsing(const StringTypes::Handle handle) const {
+        std::vector<uint32_t> levels;
+        // uses are appended level by level, so equal levels are adjacent
+        for (const auto& use : GetUses(handle))
+            if (levels.empty() || levels.back() != use.Level)
+                levels.push_back(use.Level);
+        return levels;
+    }
+
+#pragma endregion
+}
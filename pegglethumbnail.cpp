@@ -0,0 +1,499 @@
+#include "helpers.h"
+#include "libpeggle.h"
+#include "workpool.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace Peggle {
+#pragma region libpeggle_Thumbnails
+
+    namespace ThumbnailHelpers {
+        // pixels along a side of a tile
+        constexpr uint32_t tile_size = 32;
+
+        // one piece of a level in pixels, with its color as floats in [0, 1]
+        struct Primitive {
+            enum Kind : uint8_t { Triangle, Ring, Capsule } Shape;
+            // triangle: three edges a * x + b * y + c, inside where all are >= 0
+            // ring: center x, y, squared inner and outer radius, then both radii (inner < 0 fills it)
+            // capsule: start x, y, direction x, y, 1 / squared length, squared radius and radius
+            float D[9]{};
+            float R = 0.f, G = 0.f, B = 0.f, A = 0.f;
+            int32_t X0 = 0, Y0 = 0, X1 = 0, Y1 = 0;  // pixels it may touch, ends excluded
+        };
+
+        std::array<float, 4> color_of(const uint32_t argb) {
+            return {(argb >> 16 & 0xFF) / 255.f, (argb >> 8 & 0xFF) / 255.f, (argb & 0xFF) / 255.f, (argb >> 24) / 255.f};
+        }
+
+        uint32_t darken(const uint32_t argb) {
+            uint32_t res = argb & 0xFF000000;
+            for (const uint32_t shift : {0u, 8u, 16u})
+                res |= (argb >> shift & 0xFF) * 3 / 5 << shift;
+            return res;
+        }
+
+        enum Cover { Outside, Partly, Inside };
+
+        // how much of the box centered on (cx, cy), hw by hh either side, p covers. Partly when unsure
+        Cover classify(const Primitive& p, const float cx, const float cy, const float hw, const float hh) {
+            const float* d = p.D;
+            switch (p.Shape) {
+                case Primitive::Triangle: {
+                    bool inside = true;
+                    for (int k = 0; k < 9; k += 3) {
+                        const float e = d[k] * cx + d[k + 1] * cy + d[k + 2];
+                        const float extent = std::abs(d[k]) * hw + std::abs(d[k + 1]) * hh;
+                        if (e + extent < 0.f)
+                            return Outside;
+                        inside &= e - extent >= 0.f;
+                    }
+                    return inside ? Inside : Partly;
+                }
+                case Primitive::Ring: {
+                    const float distance = std::hypot(cx - d[0], cy - d[1]), h = std::hypot(hw, hh);
+                    if (distance - h > d[5] || distance + h < d[4])
+                        return Outside;
+                    return distance + h <= d[5] && distance - h >= d[4] ? Inside : Partly;
+                }
+                case Primitive::Capsule: {
+                    const float rx = cx - d[0], ry = cy - d[1];
+                    const float t = std::clamp((rx * d[2] + ry * d[3]) * d[4], 0.f, 1.f);
+                    const float distance = std::hypot(rx - d[2] * t, ry - d[3] * t), h = std::hypot(hw, hh);
+                    if (distance - h > d[6])
+                        return Outside;
+                    return distance + h <= d[6] ? Inside : Partly;
+                }
+            }
+            return Partly;
+        }
+
+        // share of the samples of pixel (x, y) that are inside p
+        float coverage(const Primitive& p, const int32_t x, const int32_t y, const float* offsets, const uint32_t samples) {
+            const auto cover = classify(p, static_cast<float>(x) + .5f, static_cast<float>(y) + .5f, .5f, .5f);
+            if (cover != Partly)
+                return cover == Inside ? 1.f : 0.f;
+            uint32_t inside = 0;
+            for (uint32_t sy = 0; sy < samples; ++sy) {
+                const float py = static_cast<float>(y) + offsets[sy];
+                for (uint32_t sx = 0; sx < samples; ++sx) {
+                    const float px = static_cast<float>(x) + offsets[sx];
+                    const float* d = p.D;
+                    switch (p.Shape) {
+                        case Primitive::Triangle:
+                            inside += d[0] * px + d[1] * py + d[2] >= 0.f && d[3] * px + d[4] * py + d[5] >= 0.f &&
+                                      d[6] * px + d[7] * py + d[8] >= 0.f;
+                            break;
+                        case Primitive::Ring: {
+                            const float dx = px - d[0], dy = py - d[1];
+                            const float r2 = dx * dx + dy * dy;
+                            inside += r2 >= d[2] && r2 <= d[3];
+                            break;
+                        }
+                        case Primitive::Capsule: {
+                            const float rx = px - d[0], ry = py - d[1];
+                            const float t = std::clamp((rx * d[2] + ry * d[3]) * d[4], 0.f, 1.f);
+                            const float dx = rx - d[2] * t, dy = ry - d[3] * t;
+                            inside += dx * dx + dy * dy <= d[5];
+                            break;
+                        }
+                    }
+                }
+            }
+            return static_cast<float>(inside) / static_cast<float>(samples * samples);
+        }
+
+        // png chunks and zlib streams check themselves with these
+        uint32_t crc32(const uint8_t* data, const size_t size, uint32_t crc = 0) {
+            static const auto table = [] {
+                std::array<uint32_t, 256> t{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k)
+                        c = c & 1 ? 0xEDB88320u ^ c >> 1 : c >> 1;
+                    t[i] = c;
+                }
+                return t;
+            }();
+            crc = ~crc;
+            for (size_t i = 0; i < size; ++i)
+                crc = table[(crc ^ data[i]) & 0xFF] ^ crc >> 8;
+            return ~crc;
+        }
+
+        uint32_t adler32(const uint8_t* data, const size_t size) {
+            uint32_t a = 1, b = 0;
+            for (size_t i = 0; i < size;) {
+                // 5552 bytes is as far as the sums go before they can overflow
+                const size_t end = std::min(size, i + 5552);
+                for (; i < end; ++i) {
+                    a += data[i];
+                    b += a;
+                }
+                a %= 65521;
+                b %= 65521;
+            }
+            return b << 16 | a;
+        }
+
+        void put_be32(std::vector<uint8_t>& out, const uint32_t v) {
+            out.insert(out.end(), {static_cast<uint8_t>(v >> 24), static_cast<uint8_t>(v >> 16),
+                                   static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v)});
+        }
+
+        // deflate bits go out lowest first, huffman codes highest bit first
+        struct BitWriter {
+            std::vector<uint8_t>& Out;
+            uint64_t Bits = 0;
+            uint32_t Count = 0;
+
+            void put(const uint32_t value, const uint32_t n) {
+                Bits |= static_cast<uint64_t>(value) << Count;
+                Count += n;
+                while (Count >= 8) {
+                    Out.push_back(static_cast<uint8_t>(Bits));
+                    Bits >>= 8;
+                    Count -= 8;
+                }
+            }
+            void code(const uint32_t value, const uint32_t n) {
+                uint32_t reversed = 0;
+                for (uint32_t i = 0; i < n; ++i)
+                    reversed |= (value >> i & 1) << (n - 1 - i);
+                put(reversed, n);
+            }
+            void flush() {
+                if (Count)
+                    put(0, 8 - Count);
+            }
+        };
+
+        constexpr uint16_t length_base[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67,
+                                            83, 99, 115, 131, 163, 195, 227, 258};
+        constexpr uint8_t length_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5,
+                                            5, 5, 5, 0};
+        constexpr uint16_t distance_base[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+                                              769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        constexpr uint8_t distance_extra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+                                              11, 11, 12, 12, 13, 13};
+        constexpr uint32_t window = 32768;
+        constexpr uint32_t min_match = 3, max_match = 258;
+        // candidates looked at per position, plenty for flat colors
+        constexpr uint32_t chain_limit = 16;
+        constexpr uint32_t hash_bits = 15;
+
+        void fixed_symbol(BitWriter& w, const uint32_t symbol) {
+            if (symbol < 144)
+                w.code(0x30 + symbol, 8);
+            else if (symbol < 256)
+                w.code(0x190 + symbol - 144, 9);
+            else if (symbol < 280)
+                w.code(symbol - 256, 7);
+            else
+                w.code(0xC0 + symbol - 280, 8);
+        }
+
+        // a zlib stream of one fixed code block, greedy matches over hash chains
+        void deflate(const uint8_t* data, const size_t size, std::vector<uint8_t>& out) {
+            out.push_back(0x78);
+            out.push_back(0x01);
+            BitWriter w{out};
+            w.put(1, 1);  // last block
+            w.put(1, 2);  // fixed codes
+
+            const auto hash = [&](const size_t i) {
+                const uint32_t v = data[i] | data[i + 1] << 8 | data[i + 2] << 16;
+                return v * 2654435761u >> (32 - hash_bits);
+            };
+            std::vector<int64_t> head(size_t{1} << hash_bits, -1);
+            std::vector<int64_t> prev(window, -1);
+            const auto insert = [&](const size_t i) {
+                if (i + min_match > size)
+                    return;
+                auto& h = head[hash(i)];
+                prev[i % window] = h;
+                h = static_cast<int64_t>(i);
+            };
+
+            for (size_t i = 0; i < size;) {
+                uint32_t best = 0, best_distance = 0;
+                if (i + min_match <= size) {
+                    const uint32_t limit = static_cast<uint32_t>(std::min<size_t>(max_match, size - i));
+                    int64_t candidate = head[hash(i)];
+                    for (uint32_t chain = 0; candidate >= 0 && chain < chain_limit; ++chain) {
+                        const size_t distance = i - static_cast<size_t>(candidate);
+                        if (distance > window)
+                            break;
+                        uint32_t length = 0;
+                        while (length < limit && data[candidate + length] == data[i + length])
+                            ++length;
+                        if (length > best) {
+                            best = length;
+                            best_distance = static_cast<uint32_t>(distance);
+                            if (length == limit)
+                                break;
+                        }
+                        candidate = prev[candidate % window];
+                    }
+                }
+                if (best < min_match) {
+                    fixed_symbol(w, data[i]);
+                    insert(i);
+                    ++i;
+                    continue;
+                }
+                const auto l = static_cast<uint32_t>(std::upper_bound(std::begin(length_base), std::end(length_base), best) - std::begin(length_base) - 1);
+                fixed_symbol(w, 257 + l);
+                w.put(best - length_base[l], length_extra[l]);
+                const auto d = static_cast<uint32_t>(std::upper_bound(std::begin(distance_base), std::end(distance_base), best_distance) - std::begin(distance_base) - 1);
+                w.code(d, 5);
+                w.put(best_distance - distance_base[d], distance_extra[d]);
+                for (uint32_t k = 0; k < best; ++k)
+                    insert(i + k);
+                i += best;
+            }
+            fixed_symbol(w, 256);
+            w.flush();
+            put_be32(out, adler32(data, size));
+        }
+
+        void put_chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+            put_be32(out, static_cast<uint32_t>(data.size()));
+            const size_t start = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data.begin(), data.end());
+            put_be32(out, crc32(out.data() + start, out.size() - start));
+        }
+    }
+
+    Thumbnailer::Thumbnailer(const ThumbnailTypes::Style& style) : Look(style) {
+        const auto& view = Look.View;
+        if (!Look.Width || !Look.Height || Look.Width > 16384 || Look.Height > 16384 || !(view.MaxX > view.MinX) ||
+            !(view.MaxY > view.MinY) || !Look.Samples || Look.Samples > 16)
+            throw std::exception("Invalid thumbnail style");
+    }
+
+    ThumbnailTypes::Image Thumbnailer::Render(const LevelTypes::Level& lvl, const unsigned threads) const {
+        using ThumbnailHelpers::Primitive;
+        using ThumbnailHelpers::tile_size;
+
+        CollisionCache cache;
+        cache.Refresh(lvl);
+        const auto& baked = cache.GetBaked();
+
+        const auto width = static_cast<int32_t>(Look.Width), height = static_cast<int32_t>(Look.Height);
+        const auto& view = Look.View;
+        const float scale = std::min(width / (view.MaxX - view.MinX), height / (view.MaxY - view.MinY));
+        const float ox = (width - (view.MaxX - view.MinX) * scale) * .5f - view.MinX * scale;
+        const float oy = (height - (view.MaxY - view.MinY) * scale) * .5f - view.MinY * scale;
+        const auto to_pixels = [&](const LevelTypes::Point p) { return LevelTypes::Point{p.x * scale + ox, p.y * scale + oy}; };
+
+        std::vector<Primitive> primitives;
+        const auto add = [&](Primitive p, const uint32_t argb, const float x0, const float y0, const float x1, const float y1) {
+            const auto [r, g, b, a] = ThumbnailHelpers::color_of(argb);
+            if (a <= 0.f || !(x0 <= x1) || !(y0 <= y1))
+                return;
+            p.R = r;
+            p.G = g;
+            p.B = b;
+            p.A = a;
+            p.X0 = static_cast<int32_t>(std::clamp(std::floor(x0), 0.f, static_cast<float>(width)));
+            p.Y0 = static_cast<int32_t>(std::clamp(std::floor(y0), 0.f, static_cast<float>(height)));
+            p.X1 = static_cast<int32_t>(std::clamp(std::floor(x1) + 1.f, 0.f, static_cast<float>(width)));
+            p.Y1 = static_cast<int32_t>(std::clamp(std::floor(y1) + 1.f, 0.f, static_cast<float>(height)));
+            if (p.X0 < p.X1 && p.Y0 < p.Y1)
+                primitives.push_back(p);
+        };
+        const auto add_capsule = [&](LevelTypes::Point a, LevelTypes::Point b, const float radius, const uint32_t argb) {
+            a = to_pixels(a);
+            b = to_pixels(b);
+            const float dx = b.x - a.x, dy = b.y - a.y, length2 = dx * dx + dy * dy;
+            Primitive p = {Primitive::Capsule, {a.x, a.y, dx, dy, length2 > 0.f ? 1.f / length2 : 0.f, radius * radius, radius}};
+            add(p, argb, std::min(a.x, b.x) - radius, std::min(a.y, b.y) - radius, std::max(a.x, b.x) + radius,
+                std::max(a.y, b.y) + radius);
+        };
+
+        const float outline = Look.OutlineWidth * .5f;
+        for (const auto& shape : baked.Shapes) {
+            const auto& element = lvl.Elements[shape.Element];
+            uint32_t fill = Look.Fill;
+            if (element.flags.hasPegInfo) {
+                const auto type = element.generic.mPegInfo.mType;
+                fill = Look.PegColors[type < std::size(Look.PegColors) ? type : 0];
+            } else if (element.flags.hasSolidColor) {
+                fill = element.generic.mSolidColor.asInt;
+            }
+            const uint32_t edge = element.flags.hasOutlineColor ? element.generic.mOutlineColor.asInt : ThumbnailHelpers::darken(fill);
+
+            if (shape.Type == LevelTypes::Rod) {
+                for (uint32_t k = 0; k < shape.SegmentCount; ++k) {
+                    const auto& segment = baked.Segments[shape.FirstSegment + k];
+                    add_capsule(segment.A, segment.B, Look.RodWidth * .5f, fill);
+                }
+                continue;
+            }
+            if (shape.Type == LevelTypes::Circle) {
+                const auto c = to_pixels({shape.X, shape.Y});
+                const float r = shape.Radius * scale;
+                add({Primitive::Ring, {c.x, c.y, -1.f, r * r, -1.f, r}}, fill, c.x - r, c.y - r, c.x + r, c.y + r);
+                if (outline > 0.f) {
+                    const float inner = std::max(r - outline, 0.f), outer = r + outline;
+                    add({Primitive::Ring, {c.x, c.y, inner * inner, outer * outer, inner, outer}}, edge, c.x - outer, c.y - outer,
+                        c.x + outer, c.y + outer);
+                }
+                continue;
+            }
+            for (uint32_t k = 0; k < shape.TriangleCount; ++k) {
+                const auto& t = baked.Triangles[shape.FirstTriangle + k];
+                auto a = to_pixels(t.A), b = to_pixels(t.B), c = to_pixels(t.C);
+                if ((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x) < 0.f)
+                    std::swap(b, c);
+                // edge p -> q keeps the triangle on its left, which is where the function is positive
+                const auto edge_of = [](const LevelTypes::Point p, const LevelTypes::Point q, float* d) {
+                    d[0] = -(q.y - p.y);
+                    d[1] = q.x - p.x;
+                    d[2] = -(d[0] * p.x + d[1] * p.y);
+                };
+                Primitive p = {Primitive::Triangle};
+                edge_of(a, b, p.D);
+                edge_of(b, c, p.D + 3);
+                edge_of(c, a, p.D + 6);
+                add(p, fill, std::min({a.x, b.x, c.x}), std::min({a.y, b.y, c.y}), std::max({a.x, b.x, c.x}),
+                    std::max({a.y, b.y, c.y}));
+            }
+            if (outline > 0.f)
+                for (uint32_t k = 0; k < shape.SegmentCount; ++k) {
+                    const auto& segment = baked.Segments[shape.FirstSegment + k];
+                    add_capsule(segment.A, segment.B, outline, edge);
+                }
+        }
+
+        // primitives by tile, in drawing order. a tile starts at the last opaque primitive covering all of it
+        const uint32_t columns = (Look.Width + tile_size - 1) / tile_size, rows = (Look.Height + tile_size - 1) / tile_size;
+        constexpr float half_tile = tile_size * .5f;
+        const auto for_each_tile = [&](const Primitive& p, auto&& f) {
+            for (uint32_t ty = p.Y0 / tile_size; ty <= (p.Y1 - 1) / tile_size; ++ty)
+                for (uint32_t tx = p.X0 / tile_size; tx <= (p.X1 - 1) / tile_size; ++tx) {
+                    const auto cover = ThumbnailHelpers::classify(p, tx * tile_size + half_tile, ty * tile_size + half_tile,
+                                                                  half_tile, half_tile);
+                    if (cover != ThumbnailHelpers::Outside)
+                        f(ty * columns + tx, cover == ThumbnailHelpers::Inside && p.A >= 1.f);
+                }
+        };
+        std::vector<uint32_t> first(columns * rows + 1, 0);
+        for (const auto& p : primitives)
+            for_each_tile(p, [&](const uint32_t tile, bool) { ++first[tile + 1]; });
+        for (size_t t = 1; t < first.size(); ++t)
+            first[t] += first[t - 1];
+        std::vector<uint32_t> binned(first.back());
+        auto start = first;
+        {
+            auto next = first;
+            for (uint32_t i = 0; i < primitives.size(); ++i)
+                for_each_tile(primitives[i], [&](const uint32_t tile, const bool hides) {
+                    if (hides)
+                        start[tile] = next[tile];
+                    binned[next[tile]++] = i;
+                });
+        }
+
+        float offsets[16];
+        for (uint32_t s = 0; s < Look.Samples; ++s)
+            offsets[s] = (static_cast<float>(s) + .5f) / static_cast<float>(Look.Samples);
+        const auto background = ThumbnailHelpers::color_of(Look.Background);
+
+        ThumbnailTypes::Image image = {Look.Width, Look.Height};
+        image.Pixels.resize(static_cast<size_t>(Look.Width) * Look.Height * 4);
+        WorkPool::parallel_for(columns * rows, threads, [&](const size_t tile, unsigned) {
+            const int32_t tx0 = static_cast<int32_t>(tile % columns * tile_size), ty0 = static_cast<int32_t>(tile / columns * tile_size);
+            const int32_t tx1 = std::min<int32_t>(tx0 + tile_size, width), ty1 = std::min<int32_t>(ty0 + tile_size, height);
+            // the tile is blended in floats and written out once
+            float rgba[tile_size * tile_size * 4];
+            for (uint32_t i = 0; i < tile_size * tile_size; ++i)
+                std::copy(background.begin(), background.end(), rgba + i * 4);
+            for (uint32_t b = start[tile]; b < first[tile + 1]; ++b) {
+                const auto& p = primitives[binned[b]];
+                const auto cover = ThumbnailHelpers::classify(p, static_cast<float>(tx0) + half_tile,
+                                                              static_cast<float>(ty0) + half_tile, half_tile, half_tile);
+                if (cover == ThumbnailHelpers::Inside) {
+                    for (uint32_t i = 0; i < tile_size * tile_size * 4; i += 4) {
+                        rgba[i] += (p.R - rgba[i]) * p.A;
+                        rgba[i + 1] += (p.G - rgba[i + 1]) * p.A;
+                        rgba[i + 2] += (p.B - rgba[i + 2]) * p.A;
+                        rgba[i + 3] += (1.f - rgba[i + 3]) * p.A;
+                    }
+                    continue;
+                }
+                for (int32_t y = std::max(p.Y0, ty0); y < std::min(p.Y1, ty1); ++y) {
+                    for (int32_t x = std::max(p.X0, tx0); x < std::min(p.X1, tx1); ++x) {
+                        const float c = ThumbnailHelpers::coverage(p, x, y, offsets, Look.Samples);
+                        if (c <= 0.f)
+                            continue;
+                        const float a = c * p.A;
+                        float* px = rgba + ((y - ty0) * tile_size + (x - tx0)) * 4;
+                        px[0] += (p.R - px[0]) * a;
+                        px[1] += (p.G - px[1]) * a;
+                        px[2] += (p.B - px[2]) * a;
+                        px[3] += (1.f - px[3]) * a;
+                    }
+                }
+            }
+            for (int32_t y = ty0; y < ty1; ++y) {
+                uint8_t* out = image.Pixels.data() + (static_cast<size_t>(y) * width + tx0) * 4;
+                const float* in = rgba + (y - ty0) * tile_size * 4;
+                for (int32_t i = 0; i < (tx1 - tx0) * 4; ++i)
+                    out[i] = static_cast<uint8_t>(std::clamp(in[i], 0.f, 1.f) * 255.f + .5f);
+            }
+        });
+        return image;
+    }
+
+    std::map<std::string, ThumbnailTypes::Image> Thumbnailer::RenderPak(Pak& pak, const unsigned threads) const {
+        std::vector<std::string> paths;
+        for (const auto& path : pak.GetFileList())
+            if (PipelineHelpers::is_level_path(path))
+                paths.push_back(path);
+
+        std::vector<ThumbnailTypes::Image> images(paths.size());
+        WorkPool::parallel_for(paths.size(), threads, [&](const size_t i, unsigned) {
+            const auto file = pak.GetFile(paths[i]);
+            if (file.State != FileState::OK)
+                throw std::exception("Failed to read level from pak");
+            images[i] = Render(Level::LoadLevel(file));
+        });
+
+        std::map<std::string, ThumbnailTypes::Image> res;
+        for (size_t i = 0; i < paths.size(); ++i)
+            res.emplace(std::move(paths[i]), std::move(images[i]));
+        return res;
+    }
+
+    std::vector<uint8_t> Thumbnailer::EncodePng(const ThumbnailTypes::Image& image) {
+        const size_t stride = static_cast<size_t>(image.Width) * 4;
+        if (!image.Width || !image.Height || image.Pixels.size() != stride * image.Height)
+            throw std::exception("Invalid image");
+
+        // every row goes out unfiltered
+        std::vector<uint8_t> raw;
+        raw.reserve((stride + 1) * image.Height);
+        for (uint32_t y = 0; y < image.Height; ++y) {
+            raw.push_back(0);
+            raw.insert(raw.end(), image.Pixels.begin() + y * stride, image.Pixels.begin() + (y + 1) * stride);
+        }
+
+        std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        std::vector<uint8_t> header;
+        ThumbnailHelpers::put_be32(header, image.Width);
+        ThumbnailHelpers::put_be32(header, image.Height);
+        header.insert(header.end(), {8, 6, 0, 0, 0});  // 8 bit RGBA, no interlace
+        ThumbnailHelpers::put_chunk(png, "IHDR", header);
+        std::vector<uint8_t> data;
+        ThumbnailHelpers::deflate(raw.data(), raw.size(), data);
+        ThumbnailHelpers::put_chunk(png, "IDAT", data);
+        ThumbnailHelpers::put_chunk(png, "IEND", {});
+        return png;
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,265 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// batch kernels over float and integer columns. every kernel has an sse2 body and a scalar tail doing the exact same
+// math in the same order, so results do not depend on where a value falls in the batch
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define PEGGLE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Peggle::Simd {
+
+    // x' = a * x + b * y + tx, y' = c * x + d * y + ty, in double and rounded once
+    inline void affine(float* xs, float* ys, const size_t n,
+                       const double a, const double b, const double c, const double d,
+                       const double tx, const double ty) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto va = _mm_set1_pd(a), vb = _mm_set1_pd(b);
+        const auto vc = _mm_set1_pd(c), vd = _mm_set1_pd(d);
+        const auto vtx = _mm_set1_pd(tx), vty = _mm_set1_pd(ty);
+        for (; i + 4 <= n; i += 4) {
+            const auto x4 = _mm_loadu_ps(xs + i);
+            const auto y4 = _mm_loadu_ps(ys + i);
+            const auto x_lo = _mm_cvtps_pd(x4), x_hi = _mm_cvtps_pd(_mm_movehl_ps(x4, x4));
+            const auto y_lo = _mm_cvtps_pd(y4), y_hi = _mm_cvtps_pd(_mm_movehl_ps(y4, y4));
+            const auto rx_lo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(va, x_lo), _mm_mul_pd(vb, y_lo)), vtx);
+            const auto rx_hi = _mm_add_pd(_mm_add_pd(_mm_mul_pd(va, x_hi), _mm_mul_pd(vb, y_hi)), vtx);
+            const auto ry_lo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vc, x_lo), _mm_mul_pd(vd, y_lo)), vty);
+            const auto ry_hi = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vc, x_hi), _mm_mul_pd(vd, y_hi)), vty);
+            _mm_storeu_ps(xs + i, _mm_movelh_ps(_mm_cvtpd_ps(rx_lo), _mm_cvtpd_ps(rx_hi)));
+            _mm_storeu_ps(ys + i, _mm_movelh_ps(_mm_cvtpd_ps(ry_lo), _mm_cvtpd_ps(ry_hi)));
+        }
+#endif
+        for (; i < n; ++i) {
+            const double x = xs[i], y = ys[i];
+            xs[i] = static_cast<float>(a * x + b * y + tx);
+            ys[i] = static_cast<float>(c * x + d * y + ty);
+        }
+    }
+
+    // v' = m * v + k, in double and rounded once
+    inline void linear(float* vs, const size_t n, const double m, const double k) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto vm = _mm_set1_pd(m), vk = _mm_set1_pd(k);
+        for (; i + 4 <= n; i += 4) {
+            const auto v4 = _mm_loadu_ps(vs + i);
+            const auto lo = _mm_add_pd(_mm_mul_pd(vm, _mm_cvtps_pd(v4)), vk);
+            const auto hi = _mm_add_pd(_mm_mul_pd(vm, _mm_cvtps_pd(_mm_movehl_ps(v4, v4))), vk);
+            _mm_storeu_ps(vs + i, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+        }
+#endif
+        for (; i < n; ++i)
+            vs[i] = static_cast<float>(m * static_cast<double>(vs[i]) + k);
+    }
+
+    // floor in the sse2 body is a truncation fixed up for negatives, same in the scalar tail. both need |x| < 2^31
+
+    // out = scale * (u - held) + bias, u = (t + offset) wrapped into [0, cycle) and held the ticks spent in the
+    // pauses (at1, for p1 ticks, then at2, for p2) before u. at1 <= at2, and at2 counts the first pause
+    inline void cycle_phase(const float* ts, float* out, const size_t n, const float offset, const float cycle,
+                            const float at1, const float p1, const float at2, const float p2,
+                            const float scale, const float bias) {
+        const float inv_cycle = 1.f / cycle;
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto voffset = _mm_set1_ps(offset), vcycle = _mm_set1_ps(cycle), vinv = _mm_set1_ps(inv_cycle);
+        const auto vat1 = _mm_set1_ps(at1), vp1 = _mm_set1_ps(p1), vat2 = _mm_set1_ps(at2), vp2 = _mm_set1_ps(p2);
+        const auto vscale = _mm_set1_ps(scale), vbias = _mm_set1_ps(bias);
+        const auto zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+        for (; i + 4 <= n; i += 4) {
+            auto u = _mm_add_ps(_mm_loadu_ps(ts + i), voffset);
+            const auto q = _mm_mul_ps(u, vinv);
+            auto fl = _mm_cvtepi32_ps(_mm_cvttps_epi32(q));
+            fl = _mm_sub_ps(fl, _mm_and_ps(_mm_cmpgt_ps(fl, q), one));
+            u = _mm_sub_ps(u, _mm_mul_ps(fl, vcycle));
+            const auto h1 = _mm_min_ps(_mm_max_ps(_mm_sub_ps(u, vat1), zero), vp1);
+            const auto h2 = _mm_min_ps(_mm_max_ps(_mm_sub_ps(u, vat2), zero), vp2);
+            u = _mm_sub_ps(u, _mm_add_ps(h1, h2));
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(u, vscale), vbias));
+        }
+#endif
+        for (; i < n; ++i) {
+            float u = ts[i] + offset;
+            const float q = u * inv_cycle;
+            float fl = static_cast<float>(static_cast<int32_t>(q));
+            fl -= fl > q ? 1.f : 0.f;
+            u -= fl * cycle;
+            const float h1 = std::min(std::max(u - at1, 0.f), p1);
+            const float h2 = std::min(std::max(u - at2, 0.f), p2);
+            u -= h1 + h2;
+            out[i] = u * scale + bias;
+        }
+    }
+
+    // out = x - floor(x)
+    inline void fraction(const float* xs, float* out, const size_t n) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto one = _mm_set1_ps(1.f);
+        for (; i + 4 <= n; i += 4) {
+            const auto x4 = _mm_loadu_ps(xs + i);
+            auto fl = _mm_cvtepi32_ps(_mm_cvttps_epi32(x4));
+            fl = _mm_sub_ps(fl, _mm_and_ps(_mm_cmpgt_ps(fl, x4), one));
+            _mm_storeu_ps(out + i, _mm_sub_ps(x4, fl));
+        }
+#endif
+        for (; i < n; ++i) {
+            float fl = static_cast<float>(static_cast<int32_t>(xs[i]));
+            fl -= fl > xs[i] ? 1.f : 0.f;
+            out[i] = xs[i] - fl;
+        }
+    }
+
+    // out = sin(2 pi x), x in turns. x is reduced to a quarter turn either side of 0 and put through an odd taylor
+    // polynomial, error is below 1e-6. the reduction rounds x to an int32, keep |x| under 2^31
+    inline void sin_turns(const float* xs, float* out, const size_t n) {
+        constexpr float two_pi = 6.28318531f;
+        constexpr float k3 = -1.f / 6.f, k5 = 1.f / 120.f, k7 = -1.f / 5040.f, k9 = 1.f / 362880.f, k11 = -1.f / 39916800.f;
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto half = _mm_set1_ps(.5f), neg_half = _mm_set1_ps(-.5f), tau = _mm_set1_ps(two_pi);
+        const auto v3 = _mm_set1_ps(k3), v5 = _mm_set1_ps(k5), v7 = _mm_set1_ps(k7);
+        const auto v9 = _mm_set1_ps(k9), v11 = _mm_set1_ps(k11), one = _mm_set1_ps(1.f);
+        for (; i + 4 <= n; i += 4) {
+            const auto x4 = _mm_loadu_ps(xs + i);
+            const auto r = _mm_sub_ps(x4, _mm_cvtepi32_ps(_mm_cvtps_epi32(x4)));
+            const auto upper = _mm_min_ps(r, _mm_sub_ps(half, r));
+            const auto q = _mm_max_ps(upper, _mm_sub_ps(neg_half, upper));
+            const auto t = _mm_mul_ps(q, tau);
+            const auto z = _mm_mul_ps(t, t);
+            auto p = _mm_add_ps(_mm_mul_ps(z, v11), v9);
+            p = _mm_add_ps(_mm_mul_ps(z, p), v7);
+            p = _mm_add_ps(_mm_mul_ps(z, p), v5);
+            p = _mm_add_ps(_mm_mul_ps(z, p), v3);
+            p = _mm_add_ps(_mm_mul_ps(z, p), one);
+            _mm_storeu_ps(out + i, _mm_mul_ps(t, p));
+        }
+#endif
+        for (; i < n; ++i) {
+            const float r = xs[i] - std::nearbyint(xs[i]);
+            const float upper = std::min(r, .5f - r);
+            const float q = std::max(upper, -.5f - upper);
+            const float t = q * two_pi;
+            const float z = t * t;
+            float p = z * k11 + k9;
+            p = z * p + k7;
+            p = z * p + k5;
+            p = z * p + k3;
+            p = z * p + 1.f;
+            out[i] = t * p;
+        }
+    }
+
+    // v' = v + a * dt, then x' = x + v' * dt
+    inline void integrate(float* xs, float* vs, const float* as, const size_t n, const float dt) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto vdt = _mm_set1_ps(dt);
+        for (; i + 4 <= n; i += 4) {
+            const auto v4 = _mm_add_ps(_mm_loadu_ps(vs + i), _mm_mul_ps(_mm_loadu_ps(as + i), vdt));
+            _mm_storeu_ps(vs + i, v4);
+            _mm_storeu_ps(xs + i, _mm_add_ps(_mm_loadu_ps(xs + i), _mm_mul_ps(v4, vdt)));
+        }
+#endif
+        for (; i < n; ++i) {
+            vs[i] = vs[i] + as[i] * dt;
+            xs[i] = xs[i] + vs[i] * dt;
+        }
+    }
+
+    // x' = x + v * dt, held at lo or above
+    inline void advance(float* xs, const float* vs, const size_t n, const float dt, const float lo) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto vdt = _mm_set1_ps(dt), vlo = _mm_set1_ps(lo);
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(xs + i, _mm_max_ps(_mm_add_ps(_mm_loadu_ps(xs + i), _mm_mul_ps(_mm_loadu_ps(vs + i), vdt)), vlo));
+#endif
+        for (; i < n; ++i) {
+            const float x = xs[i] + vs[i] * dt;
+            xs[i] = x > lo ? x : lo;
+        }
+    }
+
+    // out = base * in * away, in = min(age / fade_in, 1) (1 when fade_in <= 0) and away = max((life - age) /
+    // (life - fade_out_at), 0) once age is past fade_out_at (1 before)
+    inline void fade(const float* age, const float* life, const float* fade_in, const float* fade_out_at,
+                     const float* base, float* out, const size_t n) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+        for (; i + 4 <= n; i += 4) {
+            const auto a4 = _mm_loadu_ps(age + i), l4 = _mm_loadu_ps(life + i);
+            const auto fi4 = _mm_loadu_ps(fade_in + i), fo4 = _mm_loadu_ps(fade_out_at + i);
+            // both quotients are worked out everywhere and only kept where their condition holds
+            const auto fading_in = _mm_cmpgt_ps(fi4, zero);
+            const auto in = _mm_or_ps(_mm_and_ps(fading_in, _mm_min_ps(_mm_div_ps(a4, fi4), one)), _mm_andnot_ps(fading_in, one));
+            const auto fading_out = _mm_cmpgt_ps(a4, fo4);
+            const auto left = _mm_max_ps(_mm_div_ps(_mm_sub_ps(l4, a4), _mm_sub_ps(l4, fo4)), zero);
+            const auto away = _mm_or_ps(_mm_and_ps(fading_out, left), _mm_andnot_ps(fading_out, one));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(base + i), in), away));
+        }
+#endif
+        for (; i < n; ++i) {
+            float in = 1.f, away = 1.f;
+            if (fade_in[i] > 0.f) {
+                const float q = age[i] / fade_in[i];
+                in = q < 1.f ? q : 1.f;
+            }
+            if (age[i] > fade_out_at[i]) {
+                const float q = (life[i] - age[i]) / (life[i] - fade_out_at[i]);
+                away = q > 0.f ? q : 0.f;
+            }
+            out[i] = base[i] * in * away;
+        }
+    }
+
+    // lanes[i] is kept where (xs[i] & mask) == value (!= when invert) and zeroed elsewhere
+    inline void and_match(const uint32_t* xs, uint32_t* lanes, const size_t n, const uint32_t mask, const uint32_t value,
+                          const bool invert) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto vmask = _mm_set1_epi32(static_cast<int32_t>(mask)), vvalue = _mm_set1_epi32(static_cast<int32_t>(value));
+        const auto vinvert = _mm_set1_epi32(invert ? -1 : 0);
+        for (; i + 4 <= n; i += 4) {
+            const auto x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + i));
+            const auto hit = _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(x4, vmask), vvalue), vinvert);
+            const auto l4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + i), _mm_and_si128(l4, hit));
+        }
+#endif
+        for (; i < n; ++i)
+            if (((xs[i] & mask) == value) == invert)
+                lanes[i] = 0;
+    }
+
+    // append base + i for every nonzero lanes[i], in order
+    inline void append_set(const uint32_t* lanes, const size_t n, const uint32_t base, std::vector<uint32_t>& out) {
+        size_t i = 0;
+#ifdef PEGGLE_SSE2
+        const auto zero = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            const auto l4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + i));
+            int set = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(l4, zero))) & 0xF;
+            for (uint32_t b = 0; set; ++b, set >>= 1)
+                if (set & 1)
+                    out.push_back(base + static_cast<uint32_t>(i) + b);
+        }
+#endif
+        for (; i < n; ++i)
+            if (lanes[i])
+                out.push_back(base + static_cast<uint32_t>(i));
+    }
+}
+
+#endif //SIMD_H
@@ -0,0 +1,450 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory_resource>
+#include <new>
+#include <string>
+
+#include "../libpeggle.h"
+#include "../levelschema.h"
+#include "testutil.h"
+
+// throughput of the pak, level and config paths on synthetic data, run in release mode. correctness is checked by
+// the test_*.cpp sources next to this one, this only times
+
+// every operator new in the process, for allocs/op. malloc (pak records, BuildLevel output) is not counted
+static std::atomic<uint64_t> g_allocs = 0;
+
+void* operator new(const size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+using namespace TestUtil;
+
+namespace {
+    struct Measurement {
+        double Ns;      // per op
+        double MBps;    // 0 when the op has no byte size
+        double Allocs;  // per op
+    };
+
+    // best of reps for the time, allocations from one more run
+    template<typename F>
+    Measurement measure(const int reps, const size_t ops, const size_t bytes, F&& f) {
+        double best = 1e300;
+        for (int i = 0; i < reps; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            f();
+            const auto finish = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(finish - start).count());
+        }
+        const auto allocs_before = g_allocs.load();
+        f();
+        const auto allocs = g_allocs.load() - allocs_before;
+        return {
+            best * 1e9 / static_cast<double>(ops),
+            bytes ? static_cast<double>(bytes) / 1e6 / best : 0.,
+            static_cast<double>(allocs) / static_cast<double>(ops)
+        };
+    }
+
+    void report(const char* name, const Measurement& m) {
+        if (m.MBps > 0.)
+            std::printf("  %-24s %12.1f ns/op %10.1f MB/s %10.2f allocs/op\n", name, m.Ns, m.MBps, m.Allocs);
+        else
+            std::printf("  %-24s %12.1f ns/op %10s      %10.2f allocs/op\n", name, m.Ns, "-", m.Allocs);
+    }
+}
+
+int main()
+{
+    change_logging(LogDisable);
+
+    constexpr int element_count = 5000;
+    constexpr int reps = 20;
+
+    std::printf("[levels] %d elements each\n", element_count);
+    for (const uint32_t version : Versions) {
+        const auto built = Level::BuildLevel(make_level(version, element_count, version * 7919));
+        const size_t bytes = built.Size;
+        const auto loaded = Level::LoadLevel(built.Data, built.Size);
+
+        std::printf(" version 0x%02X, %.2f MB\n", version, bytes / 1e6);
+        report("LoadLevel", measure(reps, 1, bytes, [&] {
+            const auto res = Level::LoadLevel(built.Data, built.Size);
+        }));
+        report("IndexLevel", measure(reps, 1, bytes, [&] {
+            const auto res = Level::IndexLevel(built);
+        }));
+        report("LazyLevel, one element", measure(reps, 1, bytes, [&] {
+            auto lazy = LazyLevel(built);
+            if (lazy.GetElement(lazy.GetElementCount() / 2).magic != 1)
+                std::printf("?");
+        }));
+        report("BuildLevel", measure(reps, 1, bytes, [&] {
+            const auto res = Level::BuildLevel(loaded);
+            free(const_cast<void*>(res.Data));
+        }));
+        // one element marked dirty (the 1), the rest spliced from the loaded buffer
+        auto edited = Level::LoadLevel(built);
+        Level::MarkDirty(edited.Elements[element_count / 2]);
+        report("BuildLevelIncremental 1", measure(reps, 1, bytes, [&] {
+            const auto res = Level::BuildLevelIncremental(edited, false);
+            free(const_cast<void*>(res.Data));
+        }));
+        report("BuildLevelIncremental 1v", measure(reps, 1, bytes, [&] {
+            const auto res = Level::BuildLevelIncremental(edited);
+            free(const_cast<void*>(res.Data));
+        }));
+        edited.Elements[element_count / 2].generic.mRolly += 1.f;
+        const auto target = Level::BuildLevelIncremental(edited);
+        const auto patch = Level::DiffLevel(built.Data, built.Size, target.Data, target.Size);
+        free(const_cast<void*>(target.Data));
+        report("ApplyPatch 1", measure(reps, 1, bytes, [&] {
+            const auto res = Level::ApplyPatch(built, patch);
+            free(const_cast<void*>(res.Data));
+        }));
+        // element decode with the version checked per element vs once per level
+        report("decode (runtime version)", measure(reps, 1, bytes, [&] {
+            binstream bs(built.Data, built.Size);
+            bs.seek(9);  // version, sync, count
+            std::pmr::monotonic_buffer_resource arena;
+            const LevelSchema::LevelFormat fmt{version, &arena};
+            std::pmr::vector<LevelTypes::Element> elements(element_count, &arena);
+            for (auto& e : elements)
+                LevelSchema::Codec<LevelTypes::Element>::read(bs, e, fmt);
+        }));
+        report("decode (version family)", measure(reps, 1, bytes, [&] {
+            binstream bs(built.Data, built.Size);
+            bs.seek(9);
+            std::pmr::monotonic_buffer_resource arena;
+            std::pmr::vector<LevelTypes::Element> elements(element_count, &arena);
+            LevelSchema::with_format(version, &arena, [&](const auto fmt) {
+                for (auto& e : elements)
+                    LevelSchema::Codec<LevelTypes::Element>::read(bs, e, fmt);
+            });
+        }));
+        report("skip", measure(reps, 1, bytes, [&] {
+            binstream bs(built.Data, built.Size);
+            bs.seek(9);
+            LevelSchema::with_format(version, std::pmr::null_memory_resource(), [&](const auto fmt) {
+                for (int i = 0; i < element_count; ++i)
+                    LevelSchema::Codec<LevelTypes::Element>::skip(bs, fmt);
+            });
+        }));
+        report("size", measure(reps, 1, bytes, [&] {
+            size_t total = 0;
+            LevelSchema::with_format(version, std::pmr::null_memory_resource(), [&](const auto fmt) {
+                for (const auto& e : loaded.Elements)
+                    total += LevelSchema::Codec<LevelTypes::Element>::size(e, fmt);
+            });
+            if (total != bytes - 9)
+                std::printf("?");
+        }));
+        report("CloneElement", measure(reps, loaded.Elements.size(), 0, [&] {
+            LevelTypes::Level scratch = {};
+            for (const auto& e : loaded.Elements)
+                const auto copy = Level::CloneElement(scratch, e);
+        }));
+        report("Element copy", measure(reps, loaded.Elements.size(), 0, [&] {
+            const std::vector<LevelTypes::Element> copies = loaded.Elements;
+        }));
+        report("CloneLevel", measure(reps, 1, bytes, [&] {
+            const auto res = Level::CloneLevel(loaded);
+        }));
+        // a plain copy goes through CloneLevel too
+        report("Level copy", measure(reps, 1, bytes, [&] {
+            const LevelTypes::Level res = loaded;
+        }));
+        const auto geometry = Level::ExtractGeometry(loaded);
+        report("ExtractGeometry", measure(reps, 1, 0, [&] {
+            const auto res = Level::ExtractGeometry(loaded);
+        }));
+        report("ApplyGeometry", measure(reps, 1, 0, [&] {
+            Level::ApplyGeometry(edited, geometry);
+        }));
+        // a second of frames for every movement, ns/op is per movement and frame
+        const auto motion = Level::ExtractMotion(loaded);
+        std::vector<float> frames(60);
+        for (size_t k = 0; k < frames.size(); ++k)
+            frames[k] = static_cast<float>(k) * (100.f / 60.f);
+        report("EvaluateMotion", measure(reps, motion.Element.size() * frames.size(), 0, [&] {
+            const auto tracks = Level::EvaluateMotion(motion, frames);
+        }));
+        report("CollisionCache, bake", measure(reps, 1, 0, [&] {
+            CollisionCache cache;
+            cache.Refresh(loaded);
+        }));
+        CollisionCache collision;
+        collision.Refresh(loaded);
+        report("CollisionCache, refresh", measure(reps, 1, 0, [&] {
+            if (collision.Refresh(loaded) != 0)
+                std::printf("?");
+        }));
+        report("SpatialIndex", measure(reps, 1, 0, [&] {
+            const SpatialIndex res(loaded);
+        }));
+        {
+            const SpatialIndex index(loaded);
+            report("QueryNearest, far away", measure(reps, 1, 0, [&] {
+                if (!index.QueryNearest(40000.f, 300.f))
+                    std::printf("?");
+            }));
+        }
+        // moving pegs of one type that run logic, ns/op is per element
+        LevelTypes::GenericDataFlags moving_logic = {};
+        moving_logic.hasMovementInfo = true;
+        moving_logic.hasLogic = true;
+        const ElementQuery query({{{ElementQuery::HasFlags(moving_logic), ElementQuery::PegTypeIs(2)}}});
+        const auto columns = ElementQuery::ExtractColumns(loaded);
+        report("ElementQuery", measure(reps, loaded.Elements.size(), 0, [&] {
+            const auto res = query.Run(columns);
+        }));
+        report("ExtractColumns (bytes)", measure(reps, 1, bytes, [&] {
+            const auto res = ElementQuery::ExtractColumns(built.Data, built.Size);
+        }));
+        free(const_cast<void*>(built.Data));
+    }
+
+    // one edit at every size: BuildLevelIncremental should stay close to copying the bytes, BuildLevel grows with
+    // the encoding work
+    std::printf("[incremental] one element marked dirty\n");
+    for (const int count : {1000, 5000, 20000, 80000}) {
+        const auto built = Level::BuildLevel(make_level(0x52, count, count));
+        auto edited = Level::LoadLevel(built);
+        Level::MarkDirty(edited.Elements[count / 2]);
+        std::printf(" %d elements, %.2f MB\n", count, built.Size / 1e6);
+        std::vector<uint8_t> copy(built.Size);
+        report("copy of the bytes", measure(reps, 1, built.Size, [&] {
+            std::memcpy(copy.data(), built.Data, built.Size);
+        }));
+        report("BuildLevelIncremental 1", measure(reps, 1, built.Size, [&] {
+            const auto res = Level::BuildLevelIncremental(edited, false);
+            free(const_cast<void*>(res.Data));
+        }));
+        report("BuildLevel", measure(reps, 1, built.Size, [&] {
+            const auto res = Level::BuildLevel(edited);
+            free(const_cast<void*>(res.Data));
+        }));
+        free(const_cast<void*>(built.Data));
+    }
+
+    // ns/op is per shot
+    {
+        const ShotSimulator simulator(make_board(0x52));
+        SimulationTypes::Shots shots = {};
+        shots.Count = 20000;
+        std::printf("[simulation] %u shots\n", shots.Count);
+        report("ShotSimulator, 1 thread", measure(reps / 4, shots.Count, 0, [&] {
+            const auto res = simulator.Run(shots, 1);
+        }));
+        report("ShotSimulator", measure(reps / 4, shots.Count, 0, [&] {
+            const auto res = simulator.Run(shots);
+        }));
+    }
+
+    // ns/op is per particle and tick
+    {
+        const auto lvl = make_level(0x52, 2400, 0x46);
+        ParticleTypes::Settings settings = {};
+        settings.MaxParticles = 1u << 18;
+        constexpr uint32_t ticks = 1000;
+        ParticleSimulator particles(lvl, settings);
+        particles.Step(ticks);
+        const auto stats = particles.GetStats();
+        std::printf("[particles] %u emitters, peak %u, %llu spawned over %u ticks\n", particles.GetEmitterCount(),
+                    stats.Peak, static_cast<unsigned long long>(stats.Spawned), ticks);
+        report("ParticleSimulator", measure(reps / 8, std::max<size_t>(stats.Alive, 1), 0, [&] {
+            particles.Step();
+        }));
+    }
+
+    // ns/op is per level
+    {
+        const auto lvl = make_level(0x52, 2400, 0x47);
+        const Thumbnailer thumbnailer;
+        const auto image = thumbnailer.Render(lvl);
+        std::printf("[thumbnails] %ux%u, %zu byte png\n", image.Width, image.Height, Thumbnailer::EncodePng(image).size());
+        report("Thumbnailer, 1 thread", measure(reps, 1, 0, [&] {
+            const auto res = thumbnailer.Render(lvl);
+        }));
+        report("Thumbnailer", measure(reps, 1, 0, [&] {
+            const auto res = thumbnailer.Render(lvl, 0);
+        }));
+        report("EncodePng", measure(reps, 1, image.Pixels.size(), [&] {
+            const auto res = Thumbnailer::EncodePng(image);
+        }));
+    }
+
+    // an editing session of transactions that each nudge a few circles, ns/op is per transaction
+    {
+        constexpr int transactions = 1000;
+        auto lvl = make_level(0x52, element_count, 0x50);
+        std::vector<uint32_t> circles;
+        for (uint32_t i = 0; i < lvl.Elements.size(); ++i)
+            if (lvl.Elements[i].eType == LevelTypes::Circle)
+                circles.push_back(i);
+        LevelJournal journal(lvl);
+        const auto session = [&] {
+            for (int t = 0; t < transactions; ++t) {
+                journal.Begin();
+                for (int k = 0; k < 8; ++k) {
+                    auto& element = journal.Modify(circles[(t * 8 + k) % circles.size()]);
+                    Level::AccessCircle(*element.entry)->mPos.x += 1.f;
+                }
+                journal.Commit();
+            }
+        };
+        session();
+        const auto built = Level::BuildLevel(lvl);
+        std::printf("[journal] %d transactions, %.1f KB of history vs %.1f KB per level copy\n",
+                    transactions, journal.GetMemoryUsage() / 1024., built.Size / 1024.);
+        free(const_cast<void*>(built.Data));
+        report("LevelJournal, edit", measure(reps / 4, transactions, 0, [&] {
+            journal.Clear();
+            session();
+        }));
+        report("LevelJournal, undo + redo", measure(reps / 4, transactions * 2, 0, [&] {
+            while (journal.Undo()) {}
+            while (journal.Redo()) {}
+        }));
+    }
+
+    // a pak of mixed version levels plus one of each config, saved and opened again like a game pak
+    size_t pak_bytes = 0;
+    const auto pak_path = make_pak("libpeggle_bench", &pak_bytes);
+    const auto work_dir = pak_path.parent_path();
+    auto pak = Pak(pak_path);
+    const auto files = pak.GetFileList();
+    std::printf("[pak] %zu files, %.2f MB\n", files.size(), pak_bytes / 1e6);
+    report("Pak open", measure(reps, 1, pak_bytes, [&] {
+        const auto res = Pak(pak_path);
+    }));
+    report("GetFile", measure(reps, files.size(), 0, [&] {
+        for (const auto& f : files)
+            if (pak.GetFile(f).State != FileState::OK)
+                std::printf("?");
+    }));
+
+    size_t level_bytes = 0;
+    for (const auto& f : files)
+        if (f.ends_with(".dat"))
+            level_bytes += pak.GetFile(f).Size;
+    report("LoadLevel + BuildLevel", measure(reps, PakLevels, level_bytes, [&] {
+        for (const auto& f : files) {
+            if (!f.ends_with(".dat"))
+                continue;
+            const auto rebuilt = Level::BuildLevel(Level::LoadLevel(pak.GetFile(f)));
+            free(const_cast<void*>(rebuilt.Data));
+        }
+    }));
+    {
+        const auto transform = Level::ComposeTransform(Level::MirrorTransform(true, false), Level::TranslateTransform(800., 0.));
+        auto parallel = Pak(pak_path);
+        report("TransformPak", measure(reps, PakLevels, level_bytes, [&] {
+            const auto res = Level::TransformPak(parallel, [&](const std::string&, LevelTypes::Level& lvl) {
+                Level::TransformLevel(lvl, transform);
+                return true;
+            });
+        }));
+    }
+    {
+        StringTable strings;
+        strings.AddPak(pak);
+        std::printf(" %zu distinct strings, %zu bytes\n", strings.GetCount(), strings.GetBytes());
+    }
+    report("StringTable, AddPak", measure(reps, PakLevels, level_bytes, [&] {
+        StringTable strings;
+        strings.AddPak(pak);
+    }));
+
+    const auto snapshot_path = work_dir / "bench.snap";
+    {
+        LevelSnapshot snapshot;
+        for (const auto& f : files)
+            if (f.ends_with(".dat"))
+                snapshot.Load(f, pak.GetFile(f));
+        snapshot.Save(snapshot_path);
+    }
+    LevelSnapshot snapshot(snapshot_path);
+    report("LoadLevel", measure(reps, PakLevels, level_bytes, [&] {
+        for (const auto& f : files) {
+            if (!f.ends_with(".dat"))
+                continue;
+            const auto lvl = Level::LoadLevel(pak.GetFile(f));
+        }
+    }));
+    report("LevelSnapshot, Load", measure(reps, PakLevels, level_bytes, [&] {
+        for (const auto& f : files) {
+            if (!f.ends_with(".dat"))
+                continue;
+            const auto lvl = snapshot.Load(f, pak.GetFile(f));
+        }
+    }));
+    report("LevelSnapshot, Load unverified", measure(reps, PakLevels, level_bytes, [&] {
+        for (const auto& f : files) {
+            if (!f.ends_with(".dat"))
+                continue;
+            const auto lvl = snapshot.Load(f, pak.GetFile(f), false);
+        }
+    }));
+
+    const auto json = Level::BuildPakJson(pak);
+    size_t json_bytes = 0;
+    for (const auto& [path, text] : json)
+        json_bytes += text.size();
+    std::printf(" level json, %.2f MB\n", json_bytes / 1e6);
+    report("BuildPakJson, 1 thread", measure(reps, PakLevels, json_bytes, [&] {
+        const auto res = Level::BuildPakJson(pak, 1);
+    }));
+    report("BuildPakJson", measure(reps, PakLevels, json_bytes, [&] {
+        const auto res = Level::BuildPakJson(pak);
+    }));
+    report("LoadLevelJson", measure(reps, PakLevels, json_bytes, [&] {
+        for (const auto& [path, text] : json) {
+            const auto lvl = Level::LoadLevelJson(text);
+        }
+    }));
+
+    report("LevelStatistics, 1 thread", measure(reps, PakLevels, level_bytes, [&] {
+        const auto res = LevelStatistics::Collect(pak, 1);
+    }));
+    report("LevelStatistics", measure(reps, PakLevels, level_bytes, [&] {
+        const auto res = LevelStatistics::Collect(pak);
+    }));
+
+    std::printf("[configs]\n");
+    const auto stages = Config::LoadStageConfig(pak, "levels\\stages.cfg");
+    const auto trophies = Config::LoadTrophyConfig(pak, "levels\\trophy.cfg");
+    const auto characters = Config::LoadCharacterConfig(pak, "characters\\characters.cfg");
+    const auto stages_str = Config::BuildConfig(stages);
+    const auto trophies_str = Config::BuildConfig(trophies);
+    const auto characters_str = Config::BuildConfig(characters);
+    report("LoadStageConfig", measure(reps, 1, stages_str.size(), [&] {
+        const auto res = Config::LoadStageConfig(stages_str);
+    }));
+    report("BuildConfig (stages)", measure(reps, 1, stages_str.size(), [&] {
+        const auto res = Config::BuildConfig(stages);
+    }));
+    report("LoadTrophyConfig", measure(reps, 1, trophies_str.size(), [&] {
+        const auto res = Config::LoadTrophyConfig(trophies_str);
+    }));
+    report("BuildConfig (trophies)", measure(reps, 1, trophies_str.size(), [&] {
+        const auto res = Config::BuildConfig(trophies);
+    }));
+    report("LoadCharacterConfig", measure(reps, 1, characters_str.size(), [&] {
+        const auto res = Config::LoadCharacterConfig(characters_str);
+    }));
+    report("BuildConfig (characters)", measure(reps, 1, characters_str.size(), [&] {
+        const auto res = Config::BuildConfig(characters);
+    }));
+
+    std::filesystem::remove_all(work_dir);
+    return 0;
+}
@@ -0,0 +1,369 @@
+#ifndef LEVELGEN_H
+#define LEVELGEN_H
+
+// synthetic levels for benchmarks and fuzzers, no game data needed. the same options always give the same level.
+//
+// each flag field walks through every bit on its own, then all bits, then none, then every combination in order
+// (random combinations for the 31 bit element flags), counted per entry type, so a few hundred elements of a type
+// cover every optional field of it. element flag bits that have no known payload (unk3, and hasShadow before 0x50)
+// and flags that the version does not store are kept clear, so every generated level round trips byte for byte
+
+#include <algorithm>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../libpeggle.h"
+
+namespace LevelGen {
+    using namespace Peggle;
+
+    struct Options {
+        uint32_t Version = 0x52;
+        uint32_t Seed = 1;
+        // elements of each entry type, shuffled together
+        uint32_t Rods = 0;
+        uint32_t Polygons = 0;
+        uint32_t Circles = 0;
+        uint32_t Bricks = 0;
+        uint32_t Teleporters = 0;
+        uint32_t Emitters = 0;
+        // deepest chain of sub movements, and of teleporters carrying teleporters
+        uint32_t MaxDepth = 3;
+    };
+
+    // the same number of elements of every type
+    inline Options uniform(const uint32_t version, const uint32_t per_type, const uint32_t seed) {
+        return {version, seed, per_type, per_type, per_type, per_type, per_type, per_type};
+    }
+
+    struct Rng {
+        std::mt19937 gen;
+        explicit Rng(const uint32_t seed) : gen(seed) {}
+        uint32_t bits() { return gen(); }
+        uint32_t below(const uint32_t n) { return gen() % n; }
+        float real() { return static_cast<float>(below(80000)) / 100.f - 100.f; }
+        LevelTypes::Point point() { return {real(), real()}; }
+    };
+
+    // flag pattern number i of a field with the given valid bits
+    inline uint32_t cover(const uint32_t i, const uint32_t mask, Rng& rng) {
+        std::vector<uint32_t> bits;
+        for (uint32_t b = 0; b < 32; ++b)
+            if (mask >> b & 1)
+                bits.push_back(1u << b);
+        const auto n = static_cast<uint32_t>(bits.size());
+        if (i < n)
+            return bits[i];
+        if (i == n)
+            return mask;
+        if (i == n + 1)
+            return 0;
+        if (n > 16)
+            return rng.bits() & mask;
+        // spread the combination counter over the valid bits
+        uint32_t combination = (i - n - 2) % (1u << n), res = 0;
+        for (uint32_t b = 0; b < n; ++b)
+            if (combination >> b & 1)
+                res |= bits[b];
+        return res;
+    }
+
+    class Generator {
+    public:
+        Generator(const Options& options, LevelTypes::Level& lvl) : Opt(options), Lvl(lvl), R(options.Seed), NestedCounter(options.MaxDepth) {}
+
+        LevelTypes::Element element(const LevelTypes::LevelEntryType type, const uint32_t depth) {
+            const uint32_t i = Counter[slot(type)]++;
+
+            LevelTypes::Element e = {};
+            e.magic = 1;
+            e.eType = type;
+            e.flags.asInt = cover(i, element_mask(), R);
+            auto& g = e.generic;
+            g.mRolly = R.real();
+            g.mBouncy = R.real();
+            g.mPegInfo = peg_info(i);
+            if (e.flags.hasMovementInfo)
+                g.mMovementLink = movement(0);
+            g.mUnk0 = static_cast<int32_t>(R.bits());
+            g.mSolidColor.asInt = R.bits();
+            g.mOutlineColor.asInt = R.bits();
+            g.mImage = string("images/levels/pegs/peg_", i % 7);
+            g.mImageDX = R.real();
+            g.mImageDY = R.real();
+            g.mRotation = R.real();
+            g.mUnk1 = static_cast<int32_t>(R.bits());
+            g.mID = string("peg", i);
+            g.mUnk2 = static_cast<int32_t>(R.bits());
+            g.mSound = static_cast<uint8_t>(R.bits());
+            g.mLogic = string("logic", i % 5);
+            g.mMaxBounceVelocity = R.real();
+            g.mSubID = static_cast<float>(R.below(100));
+            g.mFlipperFlags = static_cast<uint8_t>(R.bits());
+
+            e.entry = Level::CreateEntry(Lvl, type);
+            switch (type) {
+                case LevelTypes::Rod: rod(*Level::AccessRod(*e.entry), i); break;
+                case LevelTypes::Polygon: polygon(*Level::AccessPolygon(*e.entry), i); break;
+                case LevelTypes::Circle: circle(*Level::AccessCircle(*e.entry), i); break;
+                case LevelTypes::Brick: brick(*Level::AccessBrick(*e.entry), i); break;
+                case LevelTypes::Teleporter: teleporter(*Level::AccessTeleporter(*e.entry), i, depth); break;
+                case LevelTypes::Emitter: emitter(*Level::AccessEmitter(*e.entry), i); break;
+                default: break;
+            }
+            return e;
+        }
+
+    private:
+        static constexpr LevelTypes::LevelEntryType Types[] = {
+            LevelTypes::Rod, LevelTypes::Polygon, LevelTypes::Circle,
+            LevelTypes::Brick, LevelTypes::Teleporter, LevelTypes::Emitter
+        };
+
+        const Options& Opt;
+        LevelTypes::Level& Lvl;
+        Rng R;
+        uint32_t Counter[6] = {};
+        uint32_t LinkCounter = 0;
+        uint32_t MovementCounter = 0;
+        std::vector<uint32_t> NestedCounter;  // per depth
+
+        static size_t slot(const LevelTypes::LevelEntryType type) {
+            return std::find(std::begin(Types), std::end(Types), type) - std::begin(Types);
+        }
+
+        uint32_t element_mask() const {
+            LevelTypes::GenericDataFlags mask{};
+            mask.asInt = Opt.Version == 4 ? 0xFFFFFF : 0x7FFFFFFF;
+            mask.unk3 = false;  // payload unknown
+            if (Opt.Version < 0x50)
+                mask.hasShadow = false;
+            return mask.asInt;
+        }
+
+        std::string_view string(const char* prefix, const uint32_t n) {
+            return Level::StoreString(Lvl, prefix + std::to_string(n));
+        }
+
+        LevelTypes::PegInfo peg_info(const uint32_t i) {
+            LevelTypes::PegInfo p = {};
+            p.mType = static_cast<uint8_t>(R.below(5));
+            p.mFlags.asByte = static_cast<uint8_t>(cover(i, 0xFF, R));
+            p.mVariable = p.mFlags.v1;
+            p.mCrumble = p.mFlags.v3;
+            p.mUnk0 = static_cast<int32_t>(R.bits());
+            p.mUnk1 = static_cast<int32_t>(R.bits());
+            p.mUnk2 = static_cast<uint8_t>(R.bits());
+            p.mUnk3 = static_cast<uint8_t>(R.bits());
+            return p;
+        }
+
+        LevelTypes::MovementLink movement(const uint32_t depth) {
+            LevelTypes::MovementLink link = {};
+            // every eighth link points at another element's movement instead of carrying one, some go nowhere
+            link.InternalLinkId = LinkCounter++ % 8 == 7 ? static_cast<int32_t>(2 + R.below(100)) : 1;
+            if (link.InternalLinkId != 1)
+                return link;
+
+            const uint32_t i = MovementCounter++;
+
+            auto& m = link.InternalMovement;
+            m.mMovementShape = static_cast<int8_t>(R.below(29)) - 14;  // negative shapes run in reverse
+            m.mType = std::abs(m.mMovementShape);
+            m.mAnchorPoint = R.point();
+            m.mTimePeriod = static_cast<int16_t>(R.below(1000));
+            m.mFlags.asShort = static_cast<uint16_t>(cover(i, 0x7FFF, R));
+            if (depth + 1 >= Opt.MaxDepth)
+                m.mFlags.hasSubMovement = false;
+            m.mOffset = static_cast<int16_t>(R.below(200));
+            m.mRadius1 = static_cast<int16_t>(R.below(200));
+            m.mStartPhase = R.real();
+            m.mMoveRotation = R.real();
+            m.mRadius2 = static_cast<int16_t>(R.below(200));
+            m.mPause1 = static_cast<int16_t>(R.below(100));
+            m.mPause2 = static_cast<int16_t>(R.below(100));
+            m.mPhase1 = static_cast<uint8_t>(R.below(100));
+            m.mPhase2 = static_cast<uint8_t>(R.below(100));
+            m.mPostDelayPhase = R.real();
+            m.mMaxAngle = R.real();
+            m.mUnknown8 = R.real();
+            m.mRotation = R.real();
+            m.mSubMovementOffsetX = R.real();
+            m.mSubMovementOffsetY = R.real();
+            if (m.mFlags.hasSubMovement) {
+                std::pmr::polymorphic_allocator<> alloc(Level::GetArena(Lvl));
+                m.mSubMovementLink = alloc.new_object<LevelTypes::MovementLink>(movement(depth + 1));
+            }
+            m.mObjectX = R.real();
+            m.mObjectY = R.real();
+            return link;
+        }
+
+        LevelTypes::VariableFloat variable(const uint32_t i) {
+            LevelTypes::VariableFloat v = {};
+            v.mIsVariable = i % 2;
+            if (v.mIsVariable)
+                v.mVariableValue = string("Random(0, ", 1 + i % 9);
+            else
+                v.mStaticVariable = R.real();
+            return v;
+        }
+
+        void rod(LevelTypes::RodEntry& rod, const uint32_t i) {
+            rod.mFlags.asByte = static_cast<uint8_t>(cover(i, 0xFF, R));
+            rod.mPointA = R.point();
+            rod.mPointB = R.point();
+            rod.mE = R.real();
+            rod.mF = R.real();
+        }
+
+        void polygon(LevelTypes::PolygonEntry& poly, const uint32_t i) {
+            poly.mFlagsA.asByte = static_cast<uint8_t>(cover(i, 0xFF, R));
+            poly.mFlagsB.asByte = Opt.Version > 0x23 ? static_cast<uint8_t>(cover(i, 0xFF, R)) : 0;
+            poly.mRotation = R.real();
+            poly.mUnk1 = R.real();
+            poly.mScale = R.real();
+            poly.mNormalDir = static_cast<uint8_t>(R.bits());
+            poly.mPos = R.point();
+            for (uint32_t p = 0, n = i % 5 == 4 ? 0 : 3 + R.below(12); p < n; ++p)
+                poly.mPoints.push_back(R.point());
+            poly.mUnk2 = static_cast<uint8_t>(R.bits());
+            poly.mGrowType = static_cast<int32_t>(R.below(4));
+        }
+
+        void circle(LevelTypes::CircleEntry& circle, const uint32_t i) {
+            circle.mFlagsA.asByte = static_cast<uint8_t>(cover(i, 0xFF, R));
+            circle.mFlagsB.asByte = Opt.Version >= 0x52 ? static_cast<uint8_t>(cover(i, 0xFF, R)) : 0;
+            circle.mPos = R.point();
+            circle.mRadius = 5.f + static_cast<float>(R.below(20));
+        }
+
+        void brick(LevelTypes::BrickEntry& brick, const uint32_t i) {
+            brick.mFlagsA.asByte = static_cast<uint8_t>(cover(i, 0xFF, R));
+            brick.mFlagsB.asByte = Opt.Version >= 0x23 ? static_cast<uint8_t>(cover(i, 0xFF, R)) : 0;
+            brick.mFlagsC.asShort = static_cast<uint16_t>(cover(i, 0x7FF, R));
+            brick.mUnk1 = R.real();
+            brick.mUnk2 = R.real();
+            brick.mUnk3 = R.real();
+            brick.mUnk4 = static_cast<uint8_t>(R.bits());
+            brick.mPos = R.point();
+            brick.mUnk5 = static_cast<uint8_t>(R.bits());
+            brick.mUnk6 = static_cast<int32_t>(R.bits());
+            brick.mUnk7 = static_cast<int16_t>(R.bits());
+            brick.mUnk8 = R.real();
+            brick.mUnk9 = R.real();
+            brick.mType = i % 3 ? 5 : static_cast<uint8_t>(R.below(8));
+            brick.mCurved = !(brick.mFlagsC.v2 && brick.mType == 5);
+            brick.mCurvedPoints = 2 + R.below(10);
+            brick.mLeftAngle = R.real();
+            brick.mRightAngle = R.real();
+            brick.mUnk10 = R.real();
+            brick.mSectorAngle = R.real();
+            brick.mWidth = 10.f + static_cast<float>(R.below(20));
+            brick.mLength = 20.f + static_cast<float>(R.below(40));
+            brick.mAngle = R.real();
+            brick.mTextureFlip = brick.mFlagsC.v10;
+            brick.mUnk12 = R.bits();
+        }
+
+        void teleporter(LevelTypes::TeleportEntry& tele, const uint32_t i, const uint32_t depth) {
+            tele.mFlags.asByte = static_cast<uint8_t>(cover(i, 0xFF, R));
+            if (depth + 1 >= Opt.MaxDepth)
+                tele.mFlags.v4 = false;
+            tele.mWidth = 20 + static_cast<int32_t>(R.below(40));
+            tele.mHeight = 20 + static_cast<int32_t>(R.below(40));
+            tele.mUnk0 = static_cast<int16_t>(R.bits());
+            tele.mUnk1 = static_cast<int32_t>(R.bits());
+            tele.mUnk2 = static_cast<int32_t>(R.bits());
+            if (tele.mFlags.v4) {
+                // carried elements cycle through every type, teleporters included
+                const auto type = Types[NestedCounter[depth]++ % std::size(Types)];
+                std::pmr::polymorphic_allocator<> alloc(Level::GetArena(Lvl));
+                tele.mEntry = alloc.new_object<LevelTypes::Element>(element(type, depth + 1));
+            }
+            tele.mPos = R.point();
+            tele.mUnk3 = R.real();
+            tele.mUnk4 = R.real();
+        }
+
+        void emitter(LevelTypes::EmitterEntry& emitter, const uint32_t i) {
+            emitter.mMainVar = i % 2 ? 2 : 1;
+            emitter.mFlags.asShort = static_cast<uint16_t>(cover(i / 2, 0x7FFF, R));
+            emitter.mImage = string("images/levels/particles/sparkle", i % 3);
+            emitter.mWidth = static_cast<int32_t>(R.below(64));
+            emitter.mHeight = static_cast<int32_t>(R.below(64));
+            emitter.mMainVar0 = static_cast<int32_t>(R.bits());
+            emitter.mMainVar1 = R.real();
+            emitter.mMainVar2 = string("var", i % 4);
+            emitter.mMainVar3 = static_cast<uint8_t>(R.bits());
+            emitter.mUnknown0 = variable(i);
+            emitter.mUnknown1 = variable(i + 1);
+            emitter.mPos = R.point();
+            emitter.mEmitImage = emitter.mImage;
+            emitter.mUnknownEmitRate = R.real();
+            emitter.mUnknown2 = R.real();
+            emitter.mRotation = R.real();
+            emitter.mMaxQuantity = static_cast<int32_t>(R.below(500));
+            emitter.mTimeBeforeFadeOut = R.real();
+            emitter.mFadeInTime = R.real();
+            emitter.mLifeDuration = R.real();
+            emitter.mEmitRate = variable(i);
+            emitter.mEmitAreaMultiplier = variable(i + 1);
+            emitter.mInitialRotation = variable(i);
+            emitter.mRotationVelocity = variable(i + 1);
+            emitter.mRotationUnknown = R.real();
+            emitter.mMinScale = variable(i);
+            emitter.mScaleVelocity = variable(i + 1);
+            emitter.mMaxRandScale = R.real();
+            emitter.mColourRed = variable(i);
+            emitter.mColourGreen = variable(i + 1);
+            emitter.mColourBlue = variable(i);
+            emitter.mOpacity = variable(i + 1);
+            emitter.mMinVelocityX = variable(i);
+            emitter.mMinVelocityY = variable(i + 1);
+            emitter.mMaxVelocityX = R.real();
+            emitter.mMaxVelocityY = R.real();
+            emitter.mAccelerationX = R.real();
+            emitter.mAccelerationY = R.real();
+            emitter.mDirectionSpeed = R.real();
+            emitter.mDirectionRandomSpeed = R.real();
+            emitter.mDirectionAcceleration = R.real();
+            emitter.mDirectionAngle = R.real();
+            emitter.mDirectionRandomAngle = R.real();
+            emitter.mUnknownA = R.real();
+            emitter.mUnknownB = R.real();
+        }
+    };
+
+    inline LevelTypes::Level make_level(const Options& options) {
+        LevelTypes::Level lvl = {};
+        lvl.valid = true;
+        lvl.version = options.Version;
+        lvl.sync_f = 1;
+
+        std::vector<LevelTypes::LevelEntryType> order;
+        order.insert(order.end(), options.Rods, LevelTypes::Rod);
+        order.insert(order.end(), options.Polygons, LevelTypes::Polygon);
+        order.insert(order.end(), options.Circles, LevelTypes::Circle);
+        order.insert(order.end(), options.Bricks, LevelTypes::Brick);
+        order.insert(order.end(), options.Teleporters, LevelTypes::Teleporter);
+        order.insert(order.end(), options.Emitters, LevelTypes::Emitter);
+        std::shuffle(order.begin(), order.end(), std::mt19937(options.Seed ^ 0x9E3779B9));
+
+        Generator gen(options, lvl);
+        lvl.Elements.reserve(order.size());
+        for (const auto type : order)
+            lvl.Elements.emplace_back(gen.element(type, 0));
+        lvl.entries = static_cast<uint32_t>(lvl.Elements.size());
+        return lvl;
+    }
+
+    // level file bytes, free() the data when done
+    inline FileRef make_level_file(const Options& options) {
+        return Level::BuildLevel(make_level(options));
+    }
+}
+
+#endif //LEVELGEN_H
@@ -37,7 +37,7 @@ int main()
             circle->mPos.x += 10.;
             circle->mPos.y -= 10.;
 
-            auto new_element = Peggle::Level::CloneElement(element);
+            auto new_element = Peggle::Level::CloneElement(lvl_level1, element);
             auto new_circle = Peggle::Level::AccessCircle(*new_element.entry);
             new_circle->mPos.x += 20.;
             new_circle->mPos.y -= 20.;
@@ -0,0 +1,38 @@
+#include <cmath>
+
+#include "testutil.h"
+
+// baked outlines follow the level through a mirror
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    for (const uint32_t version : Versions) {
+        const auto lvl = make_level(version, 5000, version * 7919);
+        auto flipped = Level::CloneLevel(lvl);
+        Level::TransformLevel(flipped, Level::MirrorTransform(true, false));
+        CollisionCache collision, flipped_collision;
+        collision.Refresh(lvl);
+        flipped_collision.Refresh(flipped);
+        expect(collision.Refresh(lvl) == 0, "CollisionCache rebaked a level that did not change");
+
+        // the outlines of a mirrored level are the mirrored outlines
+        const auto& a = collision.GetBaked().Shapes;
+        const auto& b = flipped_collision.GetBaked().Shapes;
+        bool same = a.size() == b.size();
+        for (size_t i = 0; same && i < a.size(); ++i) {
+            const auto& p = a[i].Bounds;
+            const auto& q = b[i].Bounds;
+            const float tolerance = 1e-4f * (1.f + std::max({-p.MinX, p.MaxX, -p.MinY, p.MaxY}));
+            const auto near = [tolerance](const float x, const float y) { return std::abs(x - y) <= tolerance; };
+            same = a[i].Element == b[i].Element && near(q.MinX, -p.MaxX) && near(q.MaxX, -p.MinX) &&
+                   near(q.MinY, p.MinY) && near(q.MaxY, p.MaxY);
+        }
+        expect(same, "mirrored outlines differ from the outlines mirrored");
+    }
+
+    return result("collision");
+}
@@ -0,0 +1,26 @@
+#include "testutil.h"
+
+// configs are text, so building a loaded config is a fixed point
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto pak_path = make_pak("libpeggle_test_config");
+    auto pak = Pak(pak_path);
+
+    const auto check = [](const char* name, const std::string& built, const std::string& rebuilt) {
+        expect(!built.empty() && built == rebuilt, (std::string(name) + " round trip").c_str());
+    };
+    const auto stages = Config::BuildConfig(Config::LoadStageConfig(pak, "levels\\stages.cfg"));
+    const auto trophies = Config::BuildConfig(Config::LoadTrophyConfig(pak, "levels\\trophy.cfg"));
+    const auto characters = Config::BuildConfig(Config::LoadCharacterConfig(pak, "characters\\characters.cfg"));
+    check("stages.cfg", stages, Config::BuildConfig(Config::LoadStageConfig(stages)));
+    check("trophy.cfg", trophies, Config::BuildConfig(Config::LoadTrophyConfig(trophies)));
+    check("characters.cfg", characters, Config::BuildConfig(Config::LoadCharacterConfig(characters)));
+
+    std::filesystem::remove_all(pak_path.parent_path());
+    return result("config");
+}
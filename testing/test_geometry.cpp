@@ -0,0 +1,41 @@
+#include "testutil.h"
+
+// geometry columns and transforms that undo each other leave the level as it was
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    for (const uint32_t version : Versions) {
+        const auto built = Level::BuildLevel(make_level(version, 5000, version * 7919));
+        const auto geometry = Level::ExtractGeometry(Level::LoadLevel(built));
+
+        // geometry columns written straight back change nothing
+        {
+            auto scratch = Level::LoadLevel(built);
+            Level::ApplyGeometry(scratch, Level::ExtractGeometry(scratch));
+            expect(same_level(built, scratch), "ApplyGeometry of ExtractGeometry changed the level");
+        }
+        // scaling and scaling back gives back the bytes, a mirror and back the geometry (a figure eight can keep a
+        // Radius2 of its own, see TransformGeometry)
+        {
+            const auto scale = Level::ScaleTransform(4.);
+            auto scaled = Level::LoadLevel(built);
+            Level::TransformLevel(scaled, scale);
+            Level::TransformLevel(scaled, Level::InvertTransform(scale));
+            expect(same_level(built, scaled), "TransformLevel and its inverse changed the level");
+        }
+        {
+            const auto mirror = Level::ComposeTransform(Level::MirrorTransform(false, true), Level::ScaleTransform(2.));
+            auto mirrored = Level::LoadLevel(built);
+            Level::TransformLevel(mirrored, mirror);
+            Level::TransformLevel(mirrored, Level::InvertTransform(mirror));
+            expect(same_geometry(geometry, Level::ExtractGeometry(mirrored)), "mirroring and back changed the geometry");
+        }
+        free(const_cast<void*>(built.Data));
+    }
+
+    return result("geometry");
+}
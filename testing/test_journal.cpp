@@ -0,0 +1,82 @@
+#include "testutil.h"
+
+// undoing an editing session gives back the level it started from, redoing it the level it ended on
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    auto lvl = make_level(0x52, 5000, 0x50);
+    std::vector<uint32_t> circles;
+    for (uint32_t i = 0; i < lvl.Elements.size(); ++i)
+        if (lvl.Elements[i].eType == LevelTypes::Circle)
+            circles.push_back(i);
+    LevelJournal journal(lvl);
+    const auto before = Level::BuildLevel(lvl);
+    for (int t = 0; t < 1000; ++t) {
+        journal.Begin();
+        for (int k = 0; k < 8; ++k) {
+            auto& element = journal.Modify(circles[(t * 8 + k) % circles.size()]);
+            Level::AccessCircle(*element.entry)->mPos.x += 1.f;
+        }
+        journal.Commit();
+    }
+    const auto after = Level::BuildLevel(lvl);
+    expect(!same_bytes(before, after.Data, after.Size), "the session changed nothing");
+    while (journal.Undo()) {}
+    expect(same_level(before, lvl), "undo differs from the level before the session");
+    while (journal.Redo()) {}
+    expect(same_level(after, lvl), "redo differs from the level after the session");
+    free(const_cast<void*>(before.Data));
+    free(const_cast<void*>(after.Data));
+
+    // values changed in place next to edits that change the layout (a flag, a string, a removed element), and a
+    // brick type, which the brick's curve is derived from
+    {
+        const auto start = Level::BuildLevel(make_level(0x52, 2400, 0x51));
+        auto mixed = Level::LoadLevel(start);
+        const auto curved = [](const LevelTypes::Level& l) {
+            std::vector<bool> res;
+            for (const auto& e : l.Elements)
+                if (const auto* brick = e.entry ? Level::AccessBrick(*e.entry) : nullptr)
+                    res.push_back(brick->mCurved);
+            return res;
+        };
+        const auto start_curved = curved(mixed);
+        LevelJournal edits(mixed);
+        edits.Begin();
+        bool typed = false;
+        for (uint32_t i = 0; i < mixed.Elements.size(); i += 7) {
+            auto& e = edits.Modify(i);
+            e.flags.isRolly = true;
+            e.generic.mRolly += 1.f;
+            if (auto* brick = Level::AccessBrick(*e.entry); brick && brick->mFlagsC.v2 && !typed) {
+                brick->mType = brick->mType == 5 ? 4 : 5;
+                typed = true;
+            }
+            if (i % 3 == 0)
+                e.flags.isBouncy = !e.flags.isBouncy;
+            if (i % 5 == 0) {
+                e.flags.hasID = true;
+                Level::SetString(mixed, e.generic.mID, "journal " + std::to_string(i));
+            }
+        }
+        edits.Remove(10);
+        edits.Commit();
+        const auto end = Level::BuildLevel(mixed);
+        const auto end_curved = curved(Level::LoadLevel(end));
+        for (int round = 0; round < 3; ++round) {
+            edits.Undo();
+            expect(same_level(start, mixed) && curved(mixed) == start_curved, "undo of mixed edits differs from the level before");
+            edits.Redo();
+            expect(same_level(end, mixed) && curved(mixed) == end_curved, "redo of mixed edits differs from the level after");
+        }
+        expect(typed && start_curved != end_curved, "no brick changed its curve");
+        free(const_cast<void*>(start.Data));
+        free(const_cast<void*>(end.Data));
+    }
+
+    return result("journal");
+}
@@ -0,0 +1,22 @@
+#include "testutil.h"
+
+// every level of a pak comes back from its json through BuildLevel byte for byte
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto pak_path = make_pak("libpeggle_test_json");
+    auto pak = Pak(pak_path);
+
+    const auto json = Level::BuildPakJson(pak);
+    expect(json.size() == PakLevels, "BuildPakJson is missing levels");
+    expect(Level::BuildPakJson(pak, 1) == json, "BuildPakJson threads disagree");
+    for (const auto& [path, text] : json)
+        expect(same_level(pak.GetFile(path), Level::LoadLevelJson(text)), ("json round trip of " + path).c_str());
+
+    std::filesystem::remove_all(pak_path.parent_path());
+    return result("json");
+}
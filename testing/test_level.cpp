@@ -0,0 +1,105 @@
+#include "testutil.h"
+
+// LoadLevel and BuildLevel round trips, BuildLevelIncremental against BuildLevel, and copies of levels and elements
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    constexpr int element_count = 5000;
+    for (const uint32_t version : Versions) {
+        const auto built = Level::BuildLevel(make_level(version, element_count, version * 7919));
+        expect(same_level(built, Level::LoadLevel(built.Data, built.Size)), "LoadLevel and BuildLevel round trip");
+
+        // one element marked dirty, the rest spliced from the loaded buffer
+        {
+            auto edited = Level::LoadLevel(built);
+            Level::MarkDirty(edited.Elements[element_count / 2]);
+            const auto spliced = Level::BuildLevelIncremental(edited, false);
+            expect(same_bytes(built, spliced.Data, spliced.Size), "BuildLevelIncremental differs from BuildLevel");
+            free(const_cast<void*>(spliced.Data));
+        }
+        // edits in an entry and in an element carried by a teleporter, marked by taking the entry through its
+        // element and trusted, and the same edits made on the entry directly, which the default verify finds
+        for (const bool marked : {true, false}) {
+            auto lvl_edited = Level::LoadLevel(built);
+            bool circle = false, carried = false;
+            for (auto& e : lvl_edited.Elements) {
+                if (e.eType == LevelTypes::Circle && !circle) {
+                    auto* c = marked ? Level::AccessCircle(e) : Level::AccessCircle(*e.entry);
+                    c->mRadius += 1.f;
+                    circle = true;
+                }
+                if (e.eType == LevelTypes::Teleporter && !carried) {
+                    auto* t = marked ? Level::AccessTeleporter(e) : Level::AccessTeleporter(*e.entry);
+                    if (!t->mEntry)
+                        continue;
+                    t->mEntry->flags.isRolly = true;
+                    t->mEntry->generic.mRolly += 1.f;
+                    carried = true;
+                }
+            }
+            const auto expected = Level::BuildLevel(lvl_edited);
+            const auto res = marked ? Level::BuildLevelIncremental(lvl_edited, false) : Level::BuildLevelIncremental(lvl_edited);
+            expect(same_bytes(expected, res.Data, res.Size) && !same_bytes(built, res.Data, res.Size),
+                   marked ? "BuildLevelIncremental missed a marked edit" : "BuildLevelIncremental missed an edit that was not marked");
+            free(const_cast<void*>(expected.Data));
+            free(const_cast<void*>(res.Data));
+        }
+
+        // the clone outlives the level it was made from and still splices its clean elements
+        {
+            const auto clone = Level::CloneLevel(Level::LoadLevel(built));
+            const auto cloned = Level::BuildLevelIncremental(clone);
+            expect(same_bytes(built, cloned.Data, cloned.Size), "CloneLevel differs from the level it was cloned from");
+            free(const_cast<void*>(cloned.Data));
+        }
+        // a plain copy goes through CloneLevel too
+        {
+            const auto loaded = Level::LoadLevel(built);
+            const LevelTypes::Level copy = loaded;
+            const auto res = Level::BuildLevelIncremental(copy);
+            expect(copy.Storage != loaded.Storage && same_bytes(built, res.Data, res.Size),
+                   "a level copy differs from the level or shares its storage");
+            free(const_cast<void*>(res.Data));
+        }
+        // element copies own what they point at, they outlive their level and edits to them stay their own
+        {
+            std::vector<LevelTypes::Element> copies;
+            {
+                const auto source = Level::LoadLevel(built);
+                copies = source.Elements;
+            }
+            auto holder = Level::LoadLevel(built);
+            holder.Elements = copies;
+            for (auto& e : copies) {
+                if (auto* c = e.entry ? Level::AccessCircle(*e.entry) : nullptr) {
+                    c->mRadius += 1.f;
+                    break;
+                }
+            }
+            expect(same_level(built, holder), "copied elements differ from the ones they were copied from");
+        }
+        free(const_cast<void*>(built.Data));
+    }
+
+    // a string set from a temporary outlives it
+    {
+        auto lvl = make_level(0x52, 200, 0x26);
+        auto& element = lvl.Elements[100];
+        {
+            const std::string id = "set from a temporary " + std::to_string(element.magic);
+            element.flags.hasID = true;
+            Level::SetString(lvl, element.generic.mID, id);
+        }
+        Level::MarkDirty(element);
+        const auto built = Level::BuildLevel(lvl);
+        const auto loaded = Level::LoadLevel(built);
+        expect(loaded.Elements[100].generic.mID == "set from a temporary 1", "SetString did not copy the string");
+        free(const_cast<void*>(built.Data));
+    }
+
+    return result("level");
+}
@@ -0,0 +1,100 @@
+#include <cmath>
+
+#include "testutil.h"
+
+// EvaluateMotion against positions worked out by hand, movements it cannot evaluate, and mirrored paths
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    // a circle carrying a sideways cycle, worked out by hand, and a second element referring to the same movement
+    {
+        LevelTypes::Level lvl = {};
+        LevelTypes::Element e = {};
+        e.magic = 1;
+        e.flags.hasMovementInfo = true;
+        auto& outer = e.generic.mMovementLink;
+        outer.InternalLinkId = 1;
+        outer.InternalMovement.mMovementShape = static_cast<int8_t>(LevelTypes::MovementShape::Circle);
+        outer.InternalMovement.mAnchorPoint = {100.f, 200.f};
+        outer.InternalMovement.mTimePeriod = 100;
+        outer.InternalMovement.mRadius1 = 50;
+        outer.InternalMovement.mFlags.hasRadius1 = true;
+        outer.InternalMovement.mFlags.hasSubMovement = true;
+        outer.InternalMovement.mSubMovementOffsetX = 5.f;
+        outer.InternalMovement.mSubMovementOffsetY = -3.f;
+        std::pmr::polymorphic_allocator<> alloc(Level::GetArena(lvl));
+        auto* inner = alloc.new_object<LevelTypes::MovementLink>();
+        inner->InternalLinkId = 1;
+        inner->InternalMovement.mMovementShape = static_cast<int8_t>(LevelTypes::MovementShape::HorizontalCycle);
+        inner->InternalMovement.mTimePeriod = 50;
+        inner->InternalMovement.mRadius1 = 20;
+        inner->InternalMovement.mFlags.hasRadius1 = true;
+        outer.InternalMovement.mSubMovementLink = inner;
+        lvl.Elements.push_back(std::move(e));
+        auto& reference = lvl.Elements.emplace_back();
+        reference.magic = 1;
+        reference.flags.hasMovementInfo = true;
+        reference.generic.mMovementLink.InternalLinkId = 2;
+
+        // t = 12.5: the circle is an eighth round, the cycle a quarter
+        const float d = 50.f * std::sqrt(.5f);
+        const float xs[] = {105.f, 100.f + d + 20.f + 5.f}, ys[] = {247.f, 200.f + d - 3.f};
+        const auto tracks = Level::EvaluateMotion(Level::ExtractMotion(lvl), {25.f, 12.5f});
+        bool right = tracks.Element == std::vector<uint32_t>{0, 1};
+        for (size_t k = 0; right && k < tracks.X.size(); ++k)
+            right = std::abs(tracks.X[k] - xs[k % 2]) < 1e-3f && std::abs(tracks.Y[k] - ys[k % 2]) < 1e-3f;
+        expect(right, "EvaluateMotion puts a movement in the wrong place");
+        const auto single = Level::EvaluateMovement(lvl.Elements[0].generic.mMovementLink, 25.f);
+        expect(std::abs(single.x - xs[0]) < 1e-3f && std::abs(single.y - ys[0]) < 1e-3f,
+               "EvaluateMovement puts a movement in the wrong place");
+
+        // shapes nobody knows hold still without stopping the rest, references that go nowhere leave no rows
+        inner->InternalMovement.mMovementShape = 13;
+        auto& known = lvl.Elements.emplace_back();
+        known.magic = 1;
+        known.flags.hasMovementInfo = true;
+        known.generic.mMovementLink.InternalLinkId = 1;
+        known.generic.mMovementLink.InternalMovement = inner->InternalMovement;
+        known.generic.mMovementLink.InternalMovement.mMovementShape = static_cast<int8_t>(LevelTypes::MovementShape::HorizontalCycle);
+        auto& broken = lvl.Elements.emplace_back();
+        broken.magic = 1;
+        broken.flags.hasMovementInfo = true;
+        broken.generic.mMovementLink.InternalLinkId = 50;
+        const auto mixed = Level::ExtractMotion(lvl);
+        using Status = LevelTypes::MotionStatus;
+        expect(mixed.Status == std::vector{Status::UnknownShape, Status::UnknownShape, Status::Ok, Status::BrokenLink},
+               "ExtractMotion reports the wrong status");
+        const auto mixed_tracks = Level::EvaluateMotion(mixed, {12.5f});
+        const float mixed_xs[] = {100.f + d + 5.f, 100.f + d + 5.f, 20.f}, mixed_ys[] = {200.f + d - 3.f, 200.f + d - 3.f, 0.f};
+        right = mixed_tracks.Element == std::vector<uint32_t>{0, 1, 2};
+        for (size_t k = 0; right && k < mixed_tracks.X.size(); ++k)
+            right = std::abs(mixed_tracks.X[k] - mixed_xs[k]) < 1e-3f && std::abs(mixed_tracks.Y[k] - mixed_ys[k]) < 1e-3f;
+        expect(right, "EvaluateMotion moves a movement it cannot evaluate");
+    }
+
+    // a mirrored level runs the mirrored paths
+    std::vector<float> frames(60);
+    for (size_t k = 0; k < frames.size(); ++k)
+        frames[k] = static_cast<float>(k) * (100.f / 60.f);
+    for (const uint32_t version : Versions) {
+        const auto built = Level::BuildLevel(make_level(version, 5000, version * 7919));
+        auto flipped = Level::LoadLevel(built);
+        Level::TransformLevel(flipped, Level::MirrorTransform(true, false));
+        const auto tracks = Level::EvaluateMotion(Level::ExtractMotion(Level::LoadLevel(built)), frames);
+        const auto flipped_tracks = Level::EvaluateMotion(Level::ExtractMotion(flipped), frames);
+        bool same = tracks.Element == flipped_tracks.Element;
+        for (size_t k = 0; same && k < tracks.X.size(); ++k) {
+            const auto near = [](const float x, const float y) { return std::abs(x - y) <= 1e-3f * (1.f + std::abs(x)); };
+            same = near(-tracks.X[k], flipped_tracks.X[k]) && near(tracks.Y[k], flipped_tracks.Y[k]) &&
+                   near(-tracks.Angle[k], flipped_tracks.Angle[k]);
+        }
+        expect(same, "mirrored movements differ from the movements mirrored");
+        free(const_cast<void*>(built.Data));
+    }
+
+    return result("motion");
+}
@@ -0,0 +1,51 @@
+#include "testutil.h"
+
+// a saved pak opens again with every file, its levels round trip, and TransformPak matches transforming one level
+// after another
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto pak_path = make_pak("libpeggle_test_pak");
+    auto pak = Pak(pak_path);
+    const auto files = pak.GetFileList();
+    expect(pak.IsPak() && files.size() == PakLevels + 3, "reopened pak is missing files");
+
+    for (const auto& f : files) {
+        if (!f.ends_with(".dat"))
+            continue;
+        const auto data = pak.GetFile(f);
+        expect(same_level(data, Level::LoadLevel(data)), ("round trip of " + f).c_str());
+    }
+
+    // levels transformed across the pool come out as they do one after another
+    {
+        const auto transform = Level::ComposeTransform(Level::MirrorTransform(true, false), Level::TranslateTransform(800., 0.));
+        const auto edit = [&](const std::string& path, LevelTypes::Level& lvl) {
+            if (path.ends_with("0.dat"))
+                return false;
+            Level::TransformLevel(lvl, transform);
+            return true;
+        };
+        auto parallel = Pak(pak_path);
+        const auto written = Level::TransformPak(parallel, edit);
+        std::vector<std::string> expected;
+        bool same = true;
+        for (const auto& f : files) {
+            if (!f.ends_with(".dat"))
+                continue;
+            auto lvl = Level::LoadLevel(pak.GetFile(f));
+            const bool changed = edit(f, lvl);
+            if (changed)
+                expected.push_back(f);
+            same = same && same_level(parallel.GetFile(f), lvl);
+        }
+        expect(same && written == expected, "TransformPak differs from transforming one level after another");
+    }
+
+    std::filesystem::remove_all(pak_path.parent_path());
+    return result("pak");
+}
@@ -0,0 +1,82 @@
+#include "testutil.h"
+
+// ParticleSimulator is deterministic, and movements it cannot evaluate stay with the elements they are on
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto lvl = make_level(0x52, 2400, 0x46);
+    ParticleTypes::Settings settings = {};
+    settings.MaxParticles = 1u << 18;
+    constexpr uint32_t ticks = 1000;
+    ParticleSimulator particles(lvl, settings);
+    particles.Step(ticks);
+    {
+        ParticleSimulator again(lvl, settings);
+        again.Step(ticks);
+        expect(particles.GetStats().Spawned > 0, "ParticleSimulator spawned nothing");
+        expect(again.GetParticles().X == particles.GetParticles().X &&
+               again.GetParticles().Opacity == particles.GetParticles().Opacity, "ParticleSimulator is not deterministic");
+    }
+
+    // a movement the evaluator does not know on an element that is not an emitter changes nothing
+    {
+        auto broken = lvl;
+        bool isolated = false;
+        for (auto& e : broken.Elements) {
+            if (e.eType != LevelTypes::Emitter && e.flags.hasMovementInfo && e.generic.mMovementLink.InternalLinkId == 1) {
+                e.generic.mMovementLink.InternalMovement.mMovementShape = 10;
+                isolated = true;
+                break;
+            }
+        }
+        try {
+            ParticleSimulator unaffected(broken, settings);
+            unaffected.Step(ticks);
+            isolated = isolated && unaffected.GetParticles().X == particles.GetParticles().X;
+        } catch (const std::exception&) {
+            isolated = false;
+        }
+        expect(isolated, "a broken movement on another element stopped the emitters");
+    }
+
+    // and an emitter on such a movement spawns where it would without one. only its own particles are compared,
+    // dropping its movement renumbers the references of the others
+    {
+        auto broken = lvl, still = lvl;
+        bool held = false;
+        uint32_t element = 0;
+        for (uint32_t i = 0; i < broken.Elements.size(); ++i) {
+            auto& e = broken.Elements[i];
+            if (e.eType == LevelTypes::Emitter && e.flags.hasMovementInfo && e.generic.mMovementLink.InternalLinkId == 1) {
+                e.generic.mMovementLink.InternalMovement.mMovementShape = 13;
+                e.generic.mMovementLink.InternalMovement.mSubMovementLink = nullptr;
+                still.Elements[i].flags.hasMovementInfo = false;
+                element = i;
+                held = true;
+                break;
+            }
+        }
+        ParticleSimulator moving(broken, settings), standing(still, settings);
+        moving.Step(ticks);
+        standing.Step(ticks);
+        const auto own = [element](const ParticleSimulator& sim) {
+            std::vector<float> xy;
+            const auto& p = sim.GetParticles();
+            for (size_t k = 0; k < p.X.size(); ++k) {
+                if (sim.GetElement(p.Emitter[k]) == element) {
+                    xy.push_back(p.X[k]);
+                    xy.push_back(p.Y[k]);
+                }
+            }
+            return xy;
+        };
+        const auto xy = own(moving);
+        expect(held && !xy.empty() && xy == own(standing), "an emitter on a movement that cannot be evaluated left its position");
+    }
+
+    return result("particles");
+}
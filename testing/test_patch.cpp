@@ -0,0 +1,81 @@
+#include "testutil.h"
+
+// DiffLevel and ApplyPatch give back the target level, and a changed field is a delta over that field alone
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    constexpr int element_count = 5000;
+    for (const uint32_t version : Versions) {
+        const auto built = Level::BuildLevel(make_level(version, element_count, version * 7919));
+
+        // one element edited through BuildLevelIncremental, patched back in
+        {
+            auto edited = Level::LoadLevel(built);
+            Level::MarkDirty(edited.Elements[element_count / 2]);
+            edited.Elements[element_count / 2].generic.mRolly += 1.f;
+            const auto target = Level::BuildLevelIncremental(edited);
+            const auto patch = Level::DiffLevel(built.Data, built.Size, target.Data, target.Size);
+            const auto patched = Level::ApplyPatch(built, patch);
+            expect(same_bytes(target, patched.Data, patched.Size), "ApplyPatch differs from the patched level");
+            free(const_cast<void*>(patched.Data));
+
+            // steps that stay inside the source but cut through its elements
+            const auto rejects = [&](const auto& tamper) {
+                auto bad = patch;
+                for (auto& step : bad.Steps) {
+                    if (step.Op == LevelTypes::PatchOp::Copy && step.Count > 1) {
+                        tamper(step);
+                        break;
+                    }
+                }
+                try {
+                    free(const_cast<void*>(Level::ApplyPatch(built, bad).Data));
+                } catch (const std::exception&) {
+                    return true;
+                }
+                return false;
+            };
+            expect(rejects([](auto& step) { step.Size -= 1; }), "ApplyPatch took a copy that ends inside an element");
+            expect(rejects([](auto& step) { --step.Count; }), "ApplyPatch took a copy whose count and size disagree");
+            expect(rejects([](auto& step) { ++step.Offset; --step.Size; }), "ApplyPatch took a copy that starts inside an element");
+            free(const_cast<void*>(target.Data));
+        }
+        // a changed radius is one delta over its four bytes
+        {
+            const auto from = Level::LoadLevel(built);
+            auto to = Level::LoadLevel(built);
+            size_t circles = 0;
+            for (auto& e : to.Elements) {
+                if (auto* c = e.entry ? Level::AccessCircle(*e.entry) : nullptr) {
+                    c->mRadius += 1.f;
+                    circles = 1;
+                    break;
+                }
+            }
+            const auto source = Level::BuildLevel(from);
+            const auto expected = Level::BuildLevel(to);
+            const auto radius = Level::DiffLevel(from, to);
+            size_t modified = 0;
+            bool whole = true;
+            for (const auto& step : radius.Steps) {
+                if (step.Op != LevelTypes::PatchOp::Modify)
+                    continue;
+                ++modified;
+                whole &= step.Deltas.size() == 1 && step.Deltas[0].Removed == 4 && step.Deltas[0].Bytes.size() == 4;
+            }
+            const auto res = Level::ApplyPatch(source, radius);
+            expect(modified == circles && whole && same_bytes(expected, res.Data, res.Size),
+                   "DiffLevel did not patch the radius field alone");
+            free(const_cast<void*>(source.Data));
+            free(const_cast<void*>(expected.Data));
+            free(const_cast<void*>(res.Data));
+        }
+        free(const_cast<void*>(built.Data));
+    }
+
+    return result("patch");
+}
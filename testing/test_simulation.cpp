@@ -0,0 +1,19 @@
+#include "testutil.h"
+
+// ShotSimulator gives the same hits on one thread as on all of them
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const ShotSimulator simulator(make_board(0x52));
+    SimulationTypes::Shots shots = {};
+    shots.Count = 20000;
+    const auto one = simulator.Run(shots, 1);
+    expect(!one.Pegs.empty(), "ShotSimulator found no pegs on the board");
+    expect(simulator.Run(shots).Hits == one.Hits, "ShotSimulator threads disagree");
+
+    return result("simulation");
+}
@@ -0,0 +1,55 @@
+#include <fstream>
+
+#include "testutil.h"
+
+// a snapshot written on the first pass serves every level after it is reopened, one from another build opens empty
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto pak_path = make_pak("libpeggle_test_snapshot");
+    const auto work_dir = pak_path.parent_path();
+    auto pak = Pak(pak_path);
+    const auto files = pak.GetFileList();
+
+    const auto snapshot_path = work_dir / "test.snap";
+    {
+        LevelSnapshot snapshot;
+        for (const auto& f : files)
+            if (f.ends_with(".dat"))
+                snapshot.Load(f, pak.GetFile(f));
+        snapshot.Save(snapshot_path);
+    }
+    {
+        LevelSnapshot snapshot(snapshot_path);
+        expect(snapshot.GetLevelCount() == PakLevels, "reopened snapshot is missing levels");
+        for (const auto& f : files) {
+            if (!f.ends_with(".dat"))
+                continue;
+            const auto data = pak.GetFile(f);
+            expect(snapshot.IsFresh(f, data.Data, data.Size), ("snapshot of " + f + " is stale").c_str());
+            expect(same_level(data, snapshot.Load(f, data)), ("snapshot round trip of " + f).c_str());
+            expect(same_level(data, snapshot.Load(f, data, false)), ("unverified snapshot round trip of " + f).c_str());
+        }
+        expect(!snapshot.IsDirty(), "loading fresh levels dirtied the snapshot");
+    }
+
+    // a file from another build opens empty and asks to be saved again
+    {
+        const auto foreign_path = work_dir / "foreign.snap";
+        std::filesystem::copy_file(snapshot_path, foreign_path, std::filesystem::copy_options::overwrite_existing);
+        {
+            std::fstream fs(foreign_path, std::fstream::in | std::fstream::out | std::fstream::binary);
+            fs.seekp(8);  // magic, format, then the layout key
+            fs.put('\xFF');
+        }
+        const LevelSnapshot foreign(foreign_path);
+        expect(foreign.GetLevelCount() == 0 && foreign.IsDirty(), "snapshot from another build did not open empty");
+    }
+
+    std::filesystem::remove_all(work_dir);
+    return result("snapshot");
+}
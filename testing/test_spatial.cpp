@@ -0,0 +1,92 @@
+#include <cmath>
+#include <optional>
+#include <random>
+
+#include "testutil.h"
+
+// SpatialIndex queries against a scan over the baked shapes
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto box_distance2 = [](const SpatialTypes::Box& b, const float x, const float y) {
+        const float dx = std::max({b.MinX - x, 0.f, x - b.MaxX});
+        const float dy = std::max({b.MinY - y, 0.f, y - b.MaxY});
+        return dx * dx + dy * dy;
+    };
+    const auto overlaps = [](const SpatialTypes::Box& a, const SpatialTypes::Box& b) {
+        return a.MinX <= b.MaxX && b.MinX <= a.MaxX && a.MinY <= b.MaxY && b.MinY <= a.MaxY;
+    };
+    const auto in_box = [&](const CollisionTypes::Shape& shape, const SpatialTypes::Box& box) {
+        if (shape.Type == LevelTypes::Circle)
+            return box_distance2(box, shape.X, shape.Y) <= shape.Radius * shape.Radius;
+        return overlaps(shape.Bounds, box);
+    };
+    const auto distance = [&](const CollisionTypes::Shape& shape, const float x, const float y) {
+        if (shape.Type == LevelTypes::Circle)
+            return std::max(std::hypot(shape.X - x, shape.Y - y) - shape.Radius, 0.f);
+        return std::sqrt(box_distance2(shape.Bounds, x, y));
+    };
+
+    for (const uint32_t version : Versions) {
+        const auto lvl = make_level(version, 5000, version * 7919);
+        const SpatialIndex index(lvl);
+        CollisionCache collision;
+        collision.Refresh(lvl);
+        const auto& shapes = collision.GetBaked().Shapes;
+
+        bool same = true;
+        std::mt19937 rng(version);
+        std::uniform_real_distribution<float> coord(-200.f, 800.f), extent(0.f, 60.f);
+        for (int q = 0; q < 200 && same; ++q) {
+            // every fourth point is far outside the level
+            const float far = q % 4 ? 1.f : 1000.f;
+            const float x = coord(rng) * far, y = coord(rng) * far, w = extent(rng), h = extent(rng);
+            const SpatialTypes::Box box = {x - w, y - h, x + w, y + h};
+            std::vector<uint32_t> boxed, circled;
+            std::optional<SpatialTypes::Nearest> nearest;
+            for (const auto& shape : shapes) {
+                if (in_box(shape, box))
+                    boxed.push_back(shape.Element);
+                const bool touches = shape.Type == LevelTypes::Circle
+                    ? (shape.X - x) * (shape.X - x) + (shape.Y - y) * (shape.Y - y) <= (shape.Radius + w) * (shape.Radius + w)
+                    : box_distance2(shape.Bounds, x, y) <= w * w;
+                if (touches)
+                    circled.push_back(shape.Element);
+                if (const float d = distance(shape, x, y); !nearest || d < nearest->Distance)
+                    nearest = SpatialTypes::Nearest{shape.Element, d};
+            }
+            const auto found = index.QueryNearest(x, y);
+            same = index.QueryBox(box) == boxed && index.QueryCircle(x, y, w) == circled &&
+                   found.has_value() == nearest.has_value() &&
+                   (!found || (found->Element == nearest->Element && found->Distance == nearest->Distance));
+        }
+        expect(same, "SpatialIndex queries differ from a scan over the baked shapes");
+
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;
+        for (size_t a = 0; a < shapes.size(); ++a) {
+            for (size_t b = a + 1; b < shapes.size(); ++b) {
+                const auto& sa = shapes[a];
+                const auto& sb = shapes[b];
+                bool hit;
+                if (sa.Type == LevelTypes::Circle && sb.Type == LevelTypes::Circle) {
+                    const float dx = sa.X - sb.X, dy = sa.Y - sb.Y, r = sa.Radius + sb.Radius;
+                    hit = dx * dx + dy * dy <= r * r;
+                } else if (sa.Type == LevelTypes::Circle || sb.Type == LevelTypes::Circle) {
+                    const auto& circle = sa.Type == LevelTypes::Circle ? sa : sb;
+                    hit = box_distance2((&circle == &sa ? sb : sa).Bounds, circle.X, circle.Y) <= circle.Radius * circle.Radius;
+                } else {
+                    hit = overlaps(sa.Bounds, sb.Bounds);
+                }
+                if (hit)
+                    pairs.emplace_back(sa.Element, sb.Element);
+            }
+        }
+        expect(index.QueryOverlaps() == pairs, "SpatialIndex overlaps differ from a scan over the baked shapes");
+    }
+
+    return result("spatial");
+}
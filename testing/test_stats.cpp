@@ -0,0 +1,25 @@
+#include "testutil.h"
+
+// statistics straight from the buffers agree with those of the decoded levels
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto pak_path = make_pak("libpeggle_test_stats");
+    auto pak = Pak(pak_path);
+
+    const auto stats = LevelStatistics::Collect(pak);
+    expect(stats.Levels.size() == PakLevels, "LevelStatistics is missing levels");
+    for (size_t i = 0; i < stats.Paths.size(); ++i) {
+        const auto decoded = LevelStatistics::Collect(Level::LoadLevel(pak.GetFile(stats.Paths[i])));
+        expect(std::memcmp(&decoded, &stats.Levels[i], sizeof(decoded)) == 0, ("statistics of " + stats.Paths[i]).c_str());
+    }
+    const auto serial = LevelStatistics::Collect(pak, 1);
+    expect(std::memcmp(&serial.Total, &stats.Total, sizeof(stats.Total)) == 0, "LevelStatistics threads disagree");
+
+    std::filesystem::remove_all(pak_path.parent_path());
+    return result("stats");
+}
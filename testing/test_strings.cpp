@@ -0,0 +1,34 @@
+#include "../levelschema.h"
+#include "testutil.h"
+
+// StringTable interns the strings of elements carried by teleporters, used under their teleporter's row
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto lvl = make_level(0x52, 2400, 0x57);
+    StringTable strings;
+    const auto level = strings.AddLevel("carried", lvl);
+    size_t expected = 0, found = 0;
+    for (uint32_t i = 0; i < lvl.Elements.size(); ++i) {
+        const auto* t = lvl.Elements[i].entry ? LevelTypes::Entry::GetTeleporter(lvl.Elements[i].entry) : nullptr;
+        if (!t || !t->mEntry || !t->mEntry->flags.hasID || t->mEntry->generic.mID.empty())
+            continue;
+        ++expected;
+        const auto handle = strings.Find(t->mEntry->generic.mID);
+        if (!handle)
+            continue;
+        for (const auto& use : strings.GetUses(*handle))
+            if (use.Level == level && use.Element == i && use.Field == StringTypes::StringField::ID && use.Depth == 1) {
+                ++found;
+                break;
+            }
+    }
+    expect(expected != 0, "the level carries no strings");
+    expect(found == expected, "StringTable missed the strings of carried elements");
+
+    return result("strings");
+}
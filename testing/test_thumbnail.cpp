@@ -0,0 +1,20 @@
+#include "testutil.h"
+
+// Thumbnailer renders the same pixels on one thread as on all of them
+
+using namespace TestUtil;
+
+int main()
+{
+    change_logging(LogDisable);
+
+    const auto lvl = make_level(0x52, 2400, 0x47);
+    const Thumbnailer thumbnailer;
+    const auto image = thumbnailer.Render(lvl);
+    expect(!image.Pixels.empty(), "Thumbnailer rendered nothing");
+    expect(thumbnailer.Render(lvl, 0).Pixels == image.Pixels, "Thumbnailer threads disagree");
+    const auto png = Thumbnailer::EncodePng(image);
+    expect(png.size() > 8 && std::memcmp(png.data(), "\x89PNG", 4) == 0, "EncodePng wrote no png");
+
+    return result("thumbnail");
+}
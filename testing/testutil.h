@@ -0,0 +1,210 @@
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+// what the tests and the benchmark share: the levels, configs and pak they run on, and the checks. every test source
+// is its own program, a failed check is printed and counted and the rest of the checks still run
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+
+#include "../libpeggle.h"
+#include "levelgen.h"
+
+namespace TestUtil {
+    using namespace Peggle;
+
+    inline constexpr uint32_t Versions[] = {0x04, 0x23, 0x50, 0x52};
+    inline constexpr int PakLevels = 64;
+
+    inline int Failures = 0;
+
+    inline void expect(const bool ok, const char* what) {
+        if (ok)
+            return;
+        std::printf(" FAILED: %s\n", what);
+        ++Failures;
+    }
+
+    // the exit code of a test source
+    inline int result(const char* name) {
+        std::printf("[%s] %s\n", name, Failures ? "FAILED" : "ok");
+        return Failures ? 1 : 0;
+    }
+
+    // pegs dominate real levels
+    inline LevelTypes::Level make_level(const uint32_t version, const uint32_t count, const uint32_t seed) {
+        const uint32_t other = count / 24;
+        return LevelGen::make_level({
+            .Version = version,
+            .Seed = seed,
+            .Rods = other,
+            .Polygons = other,
+            .Circles = count - 5 * other,
+            .Bricks = other,
+            .Teleporters = other,
+            .Emitters = other
+        });
+    }
+
+    // staggered rows of round pegs over a line of angled bricks, something a ball can actually fall through
+    inline LevelTypes::Level make_board(const uint32_t version) {
+        LevelTypes::Level lvl = {};
+        lvl.valid = true;
+        lvl.version = version;
+        const auto add = [&](const LevelTypes::LevelEntryType type) -> LevelTypes::Entry& {
+            LevelTypes::Element e = {};
+            e.magic = 1;
+            e.eType = type;
+            e.flags.hasPegInfo = true;
+            e.entry = Level::CreateEntry(lvl, type);
+            return *lvl.Elements.emplace_back(std::move(e)).entry;
+        };
+        for (int row = 0; row < 10; ++row) {
+            for (int column = 0; column < 14; ++column) {
+                auto& circle = *Level::AccessCircle(add(LevelTypes::Circle));
+                circle.mPos = {60.f + column * 50.f + row % 2 * 25.f, 150.f + row * 38.f};
+                circle.mRadius = 10.f;
+            }
+        }
+        for (int k = 0; k < 6; ++k) {
+            auto& brick = *Level::AccessBrick(add(LevelTypes::Brick));
+            brick.mPos = {100.f + k * 120.f, 560.f};
+            brick.mLength = 60.f;
+            brick.mWidth = 15.f;
+            brick.mAngle = k * 20.f;
+            brick.mCurved = false;
+        }
+        return lvl;
+    }
+
+    inline std::string make_stage_config(const int stages) {
+        std::string cfg;
+        for (int s = 0; s < stages; ++s) {
+            cfg += "Stage\n{\n";
+            for (int l = 0; l < 5; ++l)
+                cfg += "\tLevel: level" + std::to_string(s * 5 + l) + ", \"Level " + std::to_string(s * 5 + l) + "\"\n";
+            cfg += "\tDialog: " + std::to_string(s) + ", \"Hello there, stage " + std::to_string(s) + "\", \"Bjorn\"\n";
+            cfg += "\tStageDialog: " + std::to_string(s) + ", \"On to the next one\"\n";
+            cfg += "}\n\n";
+        }
+        cfg += "ExcludeRandStages: 1,2\nIncludeRandLevels: level1, level2\n\nTip: \"Aim for the orange pegs\"\n";
+        return cfg;
+    }
+
+    inline std::string make_trophy_config(const int pages) {
+        std::string cfg;
+        for (int p = 0; p < pages; ++p) {
+            cfg += "Page \"Page " + std::to_string(p) + "\"\n{\n\tDesc: \"Trophies\"\n";
+            for (int t = 0; t < 8; ++t) {
+                cfg += "\tTrophy \"Trophy " + std::to_string(t) + "\"\n\t{\n";
+                cfg += "\t\tId: " + std::to_string(p * 8 + t) + "\n";
+                cfg += "\t\tDesc: \"Clear " + std::to_string(t) + " levels\"\n";
+                cfg += "\t\tLevels: " + std::to_string(t) + ", " + std::to_string(t + 1) + "\n";
+                cfg += "\t}\n";
+            }
+            cfg += "}\n\n";
+        }
+        return cfg;
+    }
+
+    inline std::string make_character_config(const int characters) {
+        std::string cfg;
+        for (int c = 0; c < characters; ++c) {
+            cfg += "Character \"Master " + std::to_string(c) + "\"\n{\n";
+            cfg += "\tPowerup: SuperGuide\n\tDesc: \"Guides the ball\"\n\tTip: \"Bank shots are easy\"\n";
+            cfg += "\tVoiceScale: 1.5\n\tVoiceDelay: " + std::to_string(c) + "\n}\n\n";
+        }
+        return cfg;
+    }
+
+    // a pak of mixed version levels plus one of each config, saved like a game pak. returns the pak path under a
+    // fresh directory of the given name in the temp directory
+    inline std::filesystem::path make_pak(const char* name, size_t* bytes = nullptr) {
+        const auto work_dir = std::filesystem::temp_directory_path() / name;
+        std::filesystem::remove_all(work_dir);
+        std::filesystem::create_directories(work_dir / "folder");
+        const auto pak_path = work_dir / "test.pak";
+        size_t pak_bytes = 0;
+        auto pak = Pak(work_dir / "folder", 0xF7);
+        for (int i = 0; i < PakLevels; ++i) {
+            auto lvl = make_level(Versions[i % 4], 200 + i * 37, i + 1);
+            const auto built = Level::BuildLevel(lvl);
+            pak.AddFile("levels\\level" + std::to_string(i) + ".dat", built.Data, built.Size);
+            pak_bytes += built.Size;
+            free(const_cast<void*>(built.Data));
+        }
+        for (const auto& [path, cfg] : {
+            std::pair{"levels\\stages.cfg", make_stage_config(11)},
+            std::pair{"levels\\trophy.cfg", make_trophy_config(6)},
+            std::pair{"characters\\characters.cfg", make_character_config(10)}
+        }) {
+            pak.AddFile(path, cfg.data(), static_cast<uint32_t>(cfg.size()));
+            pak_bytes += cfg.size();
+        }
+        pak.SetXor(0xF7);
+        pak.Save(pak_path);
+        if (bytes)
+            *bytes = pak_bytes;
+        return pak_path;
+    }
+
+    inline bool same_bytes(const FileRef& a, const void* data, const size_t size) {
+        return a.Size == size && std::memcmp(a.Data, data, size) == 0;
+    }
+
+    // builds both and compares, the buffers are freed
+    inline bool same_level(const FileRef& expected, const LevelTypes::Level& lvl) {
+        const auto res = Level::BuildLevel(lvl);
+        const bool same = same_bytes(expected, res.Data, res.Size);
+        free(const_cast<void*>(res.Data));
+        return same;
+    }
+
+    // every column, bit for bit
+    inline bool same_geometry(const LevelTypes::Geometry& a, const LevelTypes::Geometry& b) {
+        bool same = true;
+        const auto column = [&same](const auto& x, const auto& y) {
+            same = same && x.size() == y.size() && std::memcmp(x.data(), y.data(), x.size() * sizeof(x[0])) == 0;
+        };
+        const auto positions = [&](const auto& x, const auto& y) {
+            column(x.Element, y.Element);
+            column(x.X, y.X);
+            column(x.Y, y.Y);
+        };
+        positions(a.Circles, b.Circles);
+        column(a.Circles.Radius, b.Circles.Radius);
+        positions(a.Bricks, b.Bricks);
+        for (const auto c : {&LevelTypes::BrickColumns::Angle, &LevelTypes::BrickColumns::Length,
+                             &LevelTypes::BrickColumns::Width, &LevelTypes::BrickColumns::SectorAngle,
+                             &LevelTypes::BrickColumns::LeftAngle, &LevelTypes::BrickColumns::RightAngle})
+            column(a.Bricks.*c, b.Bricks.*c);
+        column(a.Rods.Element, b.Rods.Element);
+        for (const auto c : {&LevelTypes::RodColumns::AX, &LevelTypes::RodColumns::AY,
+                             &LevelTypes::RodColumns::BX, &LevelTypes::RodColumns::BY})
+            column(a.Rods.*c, b.Rods.*c);
+        positions(a.Polygons, b.Polygons);
+        column(a.Polygons.Rotation, b.Polygons.Rotation);
+        column(a.Polygons.Scale, b.Polygons.Scale);
+        column(a.Polygons.PointStart, b.Polygons.PointStart);
+        column(a.Polygons.PointX, b.Polygons.PointX);
+        column(a.Polygons.PointY, b.Polygons.PointY);
+        positions(a.Teleporters, b.Teleporters);
+        positions(a.Emitters, b.Emitters);
+        column(a.Emitters.Rotation, b.Emitters.Rotation);
+        column(a.Images.Element, b.Images.Element);
+        column(a.Images.Rotation, b.Images.Rotation);
+        positions(a.Movements, b.Movements);
+        column(a.Movements.Depth, b.Movements.Depth);
+        column(a.Movements.Shape, b.Movements.Shape);
+        for (const auto c : {&LevelTypes::MovementColumns::MoveRotation, &LevelTypes::MovementColumns::Rotation,
+                             &LevelTypes::MovementColumns::Radius1, &LevelTypes::MovementColumns::Radius2,
+                             &LevelTypes::MovementColumns::SubOffsetX, &LevelTypes::MovementColumns::SubOffsetY})
+            column(a.Movements.*c, b.Movements.*c);
+        return same;
+    }
+}
+
+#endif //TESTUTIL_H
@@ -0,0 +1,118 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+// fork join over an index range. every worker starts on its own slice of the range and, once that runs dry, steals
+// the back half of whichever slice has the most left, so uneven tasks still keep every thread busy
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Peggle::WorkPool {
+
+    // workers to use for count tasks, threads = 0 means one per core
+    inline unsigned worker_count(const size_t count, const unsigned threads = 0) {
+        const unsigned wanted = threads ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+        return static_cast<unsigned>(std::min<size_t>(wanted, std::max<size_t>(count, 1)));
+    }
+
+    // call f(task, worker) for every task in [0, count) and wait for all of them. worker is in [0, worker_count) and
+    // never runs two tasks at once, so it can index per thread scratch. the first exception thrown by a task is
+    // rethrown here once every worker stopped; tasks not started by then are dropped
+    template<typename F>
+    void parallel_for(const size_t count, const unsigned threads, F&& f) {
+        if (count == 0)
+            return;
+        const unsigned workers = worker_count(count, threads);
+        if (workers == 1) {
+            for (size_t i = 0; i < count; ++i)
+                f(i, 0u);
+            return;
+        }
+
+        struct alignas(64) Slice {
+            std::mutex Lock;
+            size_t Begin = 0, End = 0;
+        };
+        std::vector<Slice> slices(workers);
+        for (unsigned w = 0; w < workers; ++w) {
+            slices[w].Begin = count * w / workers;
+            slices[w].End = count * (w + 1) / workers;
+        }
+
+        std::mutex error_lock;
+        std::exception_ptr error;
+        std::atomic<bool> failed = false;
+
+        const auto take = [&](const unsigned self, size_t& task) {
+            {
+                std::scoped_lock lock(slices[self].Lock);
+                if (slices[self].Begin < slices[self].End) {
+                    task = slices[self].Begin++;
+                    return true;
+                }
+            }
+            // own slice is empty, steal half of the largest one left
+            while (true) {
+                unsigned victim = self;
+                size_t most = 0;
+                for (unsigned w = 0; w < workers; ++w) {
+                    std::scoped_lock lock(slices[w].Lock);
+                    if (slices[w].End - slices[w].Begin > most) {
+                        most = slices[w].End - slices[w].Begin;
+                        victim = w;
+                    }
+                }
+                if (most == 0)
+                    return false;
+                size_t begin, end;
+                {
+                    std::scoped_lock lock(slices[victim].Lock);
+                    const size_t left = slices[victim].End - slices[victim].Begin;
+                    if (left == 0)
+                        continue;  // drained while we looked, pick again
+                    end = slices[victim].End;
+                    begin = end - (left + 1) / 2;
+                    slices[victim].End = begin;
+                }
+                std::scoped_lock lock(slices[self].Lock);
+                slices[self].Begin = begin + 1;
+                slices[self].End = end;
+                task = begin;
+                return true;
+            }
+        };
+
+        const auto run = [&](const unsigned self) {
+            size_t task;
+            while (take(self, task)) {
+                if (failed)
+                    return;
+                try {
+                    f(task, self);
+                } catch (...) {
+                    std::scoped_lock lock(error_lock);
+                    if (!failed.exchange(true))
+                        error = std::current_exception();
+                    return;
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (unsigned w = 1; w < workers; ++w)
+            pool.emplace_back(run, w);
+        run(0);
+        for (auto& t : pool)
+            t.join();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+#endif //WORKPOOL_H